@@ -94,7 +94,8 @@ inline VkPhysicalDevice pickPhysicalDevice(
 inline RendererContext glfwCreateRendererContext(
     GLFWwindow* window, const std::vector<const char*>& validationLayers,
     bool enableValidationLayers,
-    const std::vector<const char*>& deviceExtensions) {
+    const std::vector<const char*>& deviceExtensions,
+    const std::vector<const char*>& optionalExtensions = {}) {
     RendererContext context{};
     context.instance = createInstance(validationLayers, enableValidationLayers);
 
@@ -111,7 +112,15 @@ inline RendererContext glfwCreateRendererContext(
     // physical device
     VkPhysicalDevice physicalDevice =
         pickPhysicalDevice(context.instance, surface, deviceExtensions);
-    vkDevice device = createDevice(physicalDevice, deviceExtensions, surface);
+
+    // optional extensions are enabled only if the device has them
+    std::vector<const char*> enabledExtensions = deviceExtensions;
+    for (const char* extension : optionalExtensions) {
+        if (checkDeviceExtensionSupport(physicalDevice, {extension}))
+            enabledExtensions.push_back(extension);
+    }
+
+    vkDevice device = createDevice(physicalDevice, enabledExtensions, surface);
     context.device = device;
     glfwGetFramebufferSize(window, &context.width, &context.height);
     return context;
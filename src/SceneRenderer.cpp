@@ -6,14 +6,18 @@
 #include <algorithm>
 #include <array>
 #include <chrono>
+#include <cmath>
 #include <cstdint>
 #include <cstring>
+#include <filesystem>
 #include <limits>
 #include <memory>
 #include <optional>
 #include <queue>
 #include <ranges>
 #include <stdexcept>
+#include <thread>
+#include <tuple>
 #include <vector>
 
 #include "Light.hpp"
@@ -32,8 +36,10 @@
 #include "shaderReflexion.hpp"
 #include "srMaterial.hpp"
 #include "srMesh.hh"
+#include "srResidency.hpp"
 #include "srShader.hpp"
 #include "srTexture.hpp"
+#include "srTextureLoader.hpp"
 #include "tracy/Tracy.hpp"
 #include "tracy/TracyVulkan.hpp"
 #include "traits/traits.hpp"
@@ -78,6 +84,11 @@ void SceneRenderer::initImgui() {
 
 void SceneRenderer::setScene(Scene* scene) {
     active_scene_data.scene = scene;
+    lightSlotsStale = true;
+    shadowCacheStale = true;
+    dynamicCasterNodes.clear();
+    lightRanges.clear();
+    directionalLight = LightHandle();
     vkDeviceWaitIdle(device.ldevice);
     initResources();
 }
@@ -90,6 +101,7 @@ void SceneRenderer::initVulkan() {
     createColorResources();
     createDepthResources();
     createFrameBuffers();
+    createTextureUploader();
 }
 
 void SceneRenderer::initResources() {
@@ -100,11 +112,13 @@ void SceneRenderer::initResources() {
     createGlobalShaderResources();
     createGlobalDescriptorPool();
     createTextureSampler();
+    createShadowImages();
     std::cout << "Globals created" << std::endl;
     createGlobalDescriptorSets();
 
     // Per Material pool and sets
     createMaterialDescriptorPool();
+    createFrameDescriptorPools();
 
     createShadowResources();
 
@@ -123,52 +137,315 @@ void SceneRenderer::updateMesh(MeshHandle mesh_h,
     Scene* scene = scene_data.scene;
     auto& mesh = scene->ms_mg.get(mesh_h);
     srMeshHandle vkmh = scene_data.srmsh_mg.create("srMesh::" + mesh.getName());
-    srMesh& vkmesh = scene_data.srmsh_mg.get(vkmh);
+    uploadMesh(mesh_h, scene_data.srmsh_mg.get(vkmh), scene_data);
+    applyMeshRetention(mesh_h, scene_data);
+}
 
-    for (auto& attr : mesh.getAttributes()) {
-        srAttribute attrib = std::visit<srAttribute>(
-            [&](auto&& arg) -> srAttribute {
-                return srAttribute(device, attr.first, arg.size(),
-                                   (AttributeTypes)attr.second.index(),
-                                   (void*)arg.data());
-            },
-            attr.second);
+void SceneRenderer::uploadMesh(MeshHandle mesh_h, srMesh& vkmesh,
+                               InternalSceneData& scene_data) {
+    if (vkmesh.cpuCopy) {
+        // the Mesh resource's data is gone
+        uploadMeshCopy(device, vkmesh, *vkmesh.cpuCopy,
+                       meshOptimization.splitIndices, &meshStaging);
+        vkmesh.resident = true;
+        trackMemory(residency, MEMORY_MESH, meshMemorySize(vkmesh));
+        return;
+    }
 
-        vkmesh.vertexAttributes.push_back(attrib);
+    auto start = std::chrono::steady_clock::now();
+    auto elapsedMs = [&]() {
+        return std::chrono::duration<double, std::milli>(
+                   std::chrono::steady_clock::now() - start)
+            .count();
+    };
+    auto& mesh = scene_data.scene->ms_mg.get(mesh_h);
+
+    // only the scene's meshes come from the source file
+    std::string cachePath = vkmesh.cachePath;
+    if (cachePath.empty() and meshSourceKey != 0 and not vkmesh.edited and
+        &scene_data == &active_scene_data) {
+        // the source's earlier meshes of the same name
+        uint32_t occurrence = 0;
+        for (MeshHandle other : scene_data.scene->ms_mg) {
+            if (other == mesh_h) break;
+            if (scene_data.scene->ms_mg.get(other).getName() == mesh.getName())
+                occurrence++;
+        }
+        cachePath = meshCachePath(meshCache.dir, meshSourceKey,
+                                  hashMeshSettings(meshOptimization, vertexLayout),
+                                  mesh.getName(), occurrence);
+    }
+    if (not cachePath.empty()) {
+        if (auto cached = mapMeshCache(cachePath)) {
+            uploadMeshData(device, vkmesh, cached->data, &meshStaging);
+            vkmesh.bounds = cached->bounds;
+            vkmesh.uvDensity = cached->uvDensity;
+            unmapMeshCache(*cached);
+            vkmesh.cachePath = cachePath;
+            // the file doesn't say where its vertices came from
+            vkmesh.patchable = false;
+            vkmesh.resident = true;
+            trackMemory(residency, MEMORY_MESH, meshMemorySize(vkmesh));
+            meshCacheStats.hits++;
+            meshCacheStats.warmMs += elapsedMs();
+            return;
+        }
     }
 
-    std::vector<uint32_t> indices = createIndexBuffer(device, mesh.getFaces());
+    // without a cache file to write nor a compact copy to keep, nothing
+    // needs the streams once uploaded
+    bool uploadOnly =
+        cachePath.empty() and
+        resolveRetention(vkmesh.retention, retentionDefaults.meshes) !=
+            RETAIN_COMPRESS;
+    srMeshCopy streams =
+        copyMesh(device, mesh, meshOptimization, vertexLayout,
+                 &meshOptimizationStats, uploadOnly);
+    srIndexData indices{};
+    srMeshData data{};
+    if (uploadOnly) {
+        uploadMeshCopy(device, vkmesh, streams, meshOptimization.splitIndices,
+                       &meshStaging);
+    } else {
+        indices = buildIndexData(streams, meshOptimization.splitIndices);
+        data = viewMeshCopy(streams, indices);
+        uploadMeshData(device, vkmesh, data, &meshStaging);
+    }
+
+    // it doesn't depend on the order
+    const auto& positions = mesh.getAttribute<AttributeTypes::VEC3_ATTR>(0);
+    vkmesh.bounds = computeBoundingSphere(positions);
+    vkmesh.uvDensity = streams.uvDensity;
+
+    // edits are written in place only while the Mesh keeps its data
+    vkmesh.patchable =
+        resolveRetention(vkmesh.retention, retentionDefaults.meshes) ==
+        RETAIN_KEEP;
+    vkmesh.sourceVertexCount = positions.size();
+    vkmesh.sourceFaceCount = mesh.getFaces().size();
+    vkmesh.sourceVertices.clear();
+    vkmesh.weldedInto.clear();
+    if (vkmesh.patchable) {
+        vkmesh.sourceVertices = streams.sourceVertices;
+        vkmesh.weldedInto = streams.weldedInto;
+        vkmesh.sourceFaceHash = hashMeshFaces(mesh);
+    }
+    streams.sourceVertices.clear();
+    streams.weldedInto.clear();
+
+    if (not cachePath.empty()) {
+        std::error_code ec;
+        std::filesystem::create_directories(meshCache.dir, ec);
+        if (writeMeshCache(cachePath, data, vkmesh.bounds, vkmesh.uvDensity)) {
+            vkmesh.cachePath = cachePath;
+        } else {
+            std::cerr << "failed to write mesh cache " << cachePath
+                      << std::endl;
+        }
+        meshCacheStats.misses++;
+        meshCacheStats.coldMs += elapsedMs();
+    }
 
-    VkDeviceSize size = indices.size() * sizeof(indices[0]);
+    // already what a compressed copy keeps
+    if (resolveRetention(vkmesh.retention, retentionDefaults.meshes) ==
+            RETAIN_COMPRESS and
+        vkmesh.cachePath.empty()) {
+        vkmesh.cpuCopy = std::move(streams);
+    }
 
-    gbg::vkBuffer stagingBuffer =
-        gbg::createBuffer(device, size, VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
-                          VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
-                              VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+    vkmesh.resident = true;
+    trackMemory(residency, MEMORY_MESH, meshMemorySize(vkmesh));
+}
 
-    void* data;
-    vkMapMemory(device.ldevice, stagingBuffer.memory, 0, size, 0, &data);
-    memcpy(data, indices.data(), size);
-    vkUnmapMemory(device.ldevice, stagingBuffer.memory);
+void SceneRenderer::updateMeshVertices(MeshHandle h, uint32_t first,
+                                       uint32_t count) {
+    srMesh& vkmesh = active_scene_data.srmsh_mg.getRelated(h);
+    uint32_t end = count > UINT32_MAX - first ? UINT32_MAX : first + count;
+    if (vkmesh.dirtyFirst >= vkmesh.dirtyEnd) {
+        vkmesh.dirtyFirst = first;
+        vkmesh.dirtyEnd = end;
+    } else {
+        vkmesh.dirtyFirst = std::min(vkmesh.dirtyFirst, first);
+        vkmesh.dirtyEnd = std::max(vkmesh.dirtyEnd, end);
+    }
+}
 
-    vkBuffer indexBuffer = gbg::createBuffer(
-        device, size,
-        VK_BUFFER_USAGE_INDEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
-        VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
-    copyBuffer(device, stagingBuffer, indexBuffer);
-    vkDestroyBuffer(device.ldevice, stagingBuffer.buffer, nullptr);
-    vkFreeMemory(device.ldevice, stagingBuffer.memory, nullptr);
+void SceneRenderer::updateMeshEdits() {
+    ZoneScoped;
+    Scene* scene = active_scene_data.scene;
+    for (MeshHandle mh : scene->ms_mg) {
+        Mesh& mesh = scene->ms_mg.get(mh);
+        srMesh& vkmesh = active_scene_data.srmsh_mg.getRelated(mh);
+        if (vkmesh.dynamic) {
+            // written every frame, carried over when it wasn't
+            copyDynamicMeshRegion(vkmesh, currentFrame);
+            mesh.unsetFlag(ResourceFlags::DIRTY);
+            continue;
+        }
+        if (mesh.getFlags() & ResourceFlags::DIRTY) {
+            vkmesh.dirtyFirst = 0;
+            vkmesh.dirtyEnd = UINT32_MAX;
+            mesh.unsetFlag(ResourceFlags::DIRTY);
+        }
+        if (vkmesh.dirtyFirst >= vkmesh.dirtyEnd) continue;
+        uint32_t first = vkmesh.dirtyFirst;
+        uint32_t count = vkmesh.dirtyEnd - vkmesh.dirtyFirst;
+
+        // nothing to read the edit from
+        if (vkmesh.released) {
+            vkmesh.dirtyFirst = vkmesh.dirtyEnd = 0;
+            continue;
+        }
+        // the cache file and the compact copy hold the old geometry
+        vkmesh.edited = true;
+        vkmesh.cachePath.clear();
+        vkmesh.cpuCopy.reset();
+        if (vkmesh.resident) {
+            auto patches = patchMeshVertices(vkmesh, mesh, first, count);
+            VkDeviceSize size = 0;
+            if (patches) {
+                for (const srVertexPatch& patch : *patches)
+                    size += patch.data.size();
+            }
+            if (not patches or not stagingFits(meshStaging, size)) {
+                rebuildMesh(mh, vkmesh);
+            } else if (stageMeshPatches(vkmesh, *patches)) {
+                vkmesh.bounds = computeBoundingSphere(
+                    mesh.getAttribute<AttributeTypes::VEC3_ATTR>(0));
+            } else {
+                meshUpdateStats.deferred++;
+                continue;
+            }
+        }
+        // otherwise it's built from the Mesh when drawn again
+        vkmesh.dirtyFirst = vkmesh.dirtyEnd = 0;
+        shadowCacheStale = true;
+    }
+}
+
+bool SceneRenderer::stageMeshPatches(
+    srMesh& vkmesh, const std::vector<srVertexPatch>& patches) {
+    VkDeviceSize size = 0;
+    for (const srVertexPatch& patch : patches) size += patch.data.size();
+    if (size == 0) return true;
+
+    auto span = acquireStaging(meshStaging, size, false);
+    if (not span) return false;
+    meshStagingSpans[currentFrame].push_back(*span);
+
+    VkDeviceSize offset = 0;
+    for (const srVertexPatch& patch : patches) {
+        memcpy(span->data + offset, patch.data.data(), patch.data.size());
+        VkBufferCopy region{};
+        region.srcOffset = span->offset + offset;
+        region.dstOffset = patch.offset;
+        region.size = patch.data.size();
+        meshPatchCopies.push_back(
+            {span->buffer,
+             vkmesh.vertexAttributes[patch.attribute].buffer.buffer, region});
+        offset += patch.data.size();
+    }
 
-    vkmesh.indexBuffer = indexBuffer;
+    // the meshlet bounds were taken from the old positions, it's drawn
+    // with the whole index buffer from now on
+    if (vkmesh.meshletCount > 0) {
+        retiredBuffers[currentFrame].push_back(vkmesh.meshletBuffer);
+        untrackMemory(residency, MEMORY_MESH, vkmesh.meshletBuffer.size);
+        vkmesh.meshletBuffer = vkBuffer{};
+        vkmesh.meshletCount = 0;
+    }
+    meshUpdateStats.patches++;
+    meshUpdateStats.patchedBytes += size;
+    return true;
+}
+
+void SceneRenderer::retireMeshBuffers(srMesh& vkmesh) {
+    // the frames in flight still draw the old buffers
+    if (vkmesh.dynamic) {
+        retiredBuffers[currentFrame].push_back(vkmesh.dynamic->buffer);
+        vkmesh.dynamic.reset();
+    } else if (vkmesh.resident) {
+        untrackMemory(residency, MEMORY_MESH, meshMemorySize(vkmesh));
+        for (const srAttribute& attr : vkmesh.vertexAttributes) {
+            retiredBuffers[currentFrame].push_back(attr.buffer);
+        }
+        retiredBuffers[currentFrame].push_back(vkmesh.indexBuffer);
+        retiredBuffers[currentFrame].push_back(vkmesh.meshletBuffer);
+    }
+    vkmesh.vertexAttributes.clear();
+    vkmesh.indexBuffer = vkBuffer{};
+    vkmesh.meshletBuffer = vkBuffer{};
+    vkmesh.meshletCount = 0;
+}
 
-    auto tangents = createTangentBuffer(
-        device, mesh.getAttribute<AttributeTypes::VEC3_ATTR>(0),
-        mesh.getAttribute<AttributeTypes::VEC2_ATTR>(2), indices);
+void SceneRenderer::rebuildMesh(MeshHandle mesh_h, srMesh& vkmesh) {
+    retireMeshBuffers(vkmesh);
+    uploadMesh(mesh_h, vkmesh, active_scene_data);
+    meshUpdateStats.rebuilds++;
+}
+
+void SceneRenderer::setMeshDynamic(MeshHandle h, uint32_t maxVertices,
+                                   uint32_t maxIndices,
+                                   const glm::vec4& bounds) {
+    srMesh& vkmesh = active_scene_data.srmsh_mg.getRelated(h);
+    retireMeshBuffers(vkmesh);
+    vkmesh.cpuCopy.reset();
+    vkmesh.cachePath.clear();
+    vkmesh.dirtyFirst = vkmesh.dirtyEnd = 0;
+    createDynamicMesh(device, vkmesh, active_scene_data.scene->ms_mg.get(h),
+                      vertexLayout, maxVertices, maxIndices,
+                      MAX_FRAMES_IN_FLIGHT, bounds);
+}
+
+srDynamicMeshFrame SceneRenderer::beginDynamicMesh(MeshHandle h) {
+    srMesh& vkmesh = active_scene_data.srmsh_mg.getRelated(h);
+    if (not vkmesh.dynamic)
+        throw std::runtime_error("failed to write a mesh that isn't dynamic!");
+    // the frame that drew this region last, drawFrame waits for it anyway
+    vkWaitForFences(device.ldevice, 1, &inFlightFences[currentFrame], VK_TRUE,
+                    UINT64_MAX);
+    return mapDynamicMesh(vkmesh, currentFrame);
+}
 
-    auto tangentAttr =
-        srAttribute(device, mesh.getAttributes().size(), tangents.size(),
-                    AttributeTypes::VEC3_ATTR, (void*)tangents.data());
-    vkmesh.vertexAttributes.push_back(tangentAttr);
+void SceneRenderer::endDynamicMesh(MeshHandle h, uint32_t vertexCount,
+                                   uint32_t indexCount) {
+    srMesh& vkmesh = active_scene_data.srmsh_mg.getRelated(h);
+    setDynamicMeshCounts(vkmesh, currentFrame, vertexCount, indexCount);
+}
+
+void SceneRenderer::recordMeshUpdates(VkCommandBuffer commandBuffer) {
+    if (meshPatchCopies.empty()) return;
+
+    // the frames before may still be reading what gets overwritten
+    VkMemoryBarrier barrier{};
+    barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+    barrier.srcAccessMask = 0;
+    barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_VERTEX_INPUT_BIT,
+                         VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 1, &barrier, 0,
+                         nullptr, 0, nullptr);
+
+    for (const srMeshPatchCopy& copy : meshPatchCopies) {
+        vkCmdCopyBuffer(commandBuffer, copy.src, copy.dst, 1, &copy.region);
+    }
+    meshPatchCopies.clear();
+
+    barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    barrier.dstAccessMask = VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT;
+    vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT,
+                         VK_PIPELINE_STAGE_VERTEX_INPUT_BIT, 0, 1, &barrier,
+                         0, nullptr, 0, nullptr);
+}
+
+void SceneRenderer::releaseMeshStaging(uint32_t frame) {
+    for (const vkStagingSpan& span : meshStagingSpans[frame]) {
+        releaseStaging(meshStaging, span);
+    }
+    meshStagingSpans[frame].clear();
+    for (const vkBuffer& buffer : retiredBuffers[frame]) {
+        destroyBuffer(device, buffer);
+    }
+    retiredBuffers[frame].clear();
 }
 
 void SceneRenderer::updateTexture(TextureHandle h,
@@ -178,50 +455,749 @@ void SceneRenderer::updateTexture(TextureHandle h,
     if (flags & NEW) {
         CREATE_AND_GET(tex, scene_data.srtx_mg,
                        "srTexture" + texture.getName());
+        tex.sampler = textureSampler;
+        tex.mipLevels = 0;
+
+        // still decoding, see loadTextureAsync
+        if (texture.data.empty()) return;
+
+        uint32_t width = static_cast<uint32_t>(texture.width);
+        uint32_t height = static_cast<uint32_t>(texture.height);
+        if (compressesTextures(*textureLoader) or textureStreaming.enabled) {
+            // the workers compress it or find it in the cache, and cut the
+            // chain down to its tail when streaming
+            requestTexturePixels(
+                *textureLoader, h,
+                std::vector<unsigned char>(texture.data.begin(),
+                                           texture.data.end()),
+                width, height, texture.raw, 0,
+                textureStreaming.enabled ? textureStreaming.tailSize : 0);
+            return;
+        }
 
-        VkFormat format = VK_FORMAT_R8G8B8A8_SRGB;
-        if (texture.raw) format = VK_FORMAT_R8G8B8A8_UNORM;
+        // the image is created when the batch is recorded
+        tex.fullMips = fullMipLevels(width, height);
+        tex.raw = texture.raw;
+        stagedTextures.push_back(stageTexture(
+            *textureLoader, h, width, height, texture.data.data(),
+            texture.data.size(), texture.raw));
+    }
+}
 
-        tex.textureImage = createImage(
-            device.pdevice, device.ldevice,
-            static_cast<uint32_t>(texture.width),
-            static_cast<uint32_t>(texture.height),
-            static_cast<uint32_t>(texture.mip_levels), VK_SAMPLE_COUNT_1_BIT,
-            format, VK_IMAGE_TILING_OPTIMAL,
-            VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT,
-            VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+void SceneRenderer::loadTextureAsync(TextureHandle h, const std::string& path,
+                                     bool raw) {
+    requestTexture(*textureLoader, h, path, raw, 0,
+                   textureStreaming.enabled ? textureStreaming.tailSize : 0);
+}
 
-        tex.mipLevels = texture.mip_levels;
-        tex.sampler = textureSampler;
+void SceneRenderer::setTextureStreaming(const srTextureStreaming& streaming) {
+    textureStreaming = streaming;
+}
+
+void SceneRenderer::setMemoryBudget(const srMemoryBudget& budget) {
+    residency.settings = budget;
+}
+
+void SceneRenderer::setMeshOptimization(
+    const srMeshOptimization& optimization) {
+    meshOptimization = optimization;
+}
+
+void SceneRenderer::setVertexFormat(srVertexFormat format) {
+    vertexLayout = chooseVertexLayout(device, format);
+}
+
+void SceneRenderer::setMeshCache(const srMeshCacheSettings& settings) {
+    meshCache = settings;
+    meshSourceKey = settings.enabled ? hashMeshSource(settings.source) : 0;
+}
+
+void SceneRenderer::setDebugDrawSettings(const srDebugDrawSettings& settings) {
+    debugDrawSettings = settings;
+}
+
+srDebugDraw& SceneRenderer::getDebugDraw() { return debugDraw; }
+
+void SceneRenderer::setLightClusterSettings(
+    const srLightClusterSettings& settings) {
+    lightClusters.settings = settings;
+    // the range is in every entry
+    lightSlotsStale = true;
+}
+
+void SceneRenderer::setShadowAtlas(const srShadowAtlasSettings& settings) {
+    shadowAtlas.settings = settings;
+}
+
+void SceneRenderer::setDirectionalLight(LightHandle h) {
+    directionalLight = h;
+    // it leaves or joins the clusters and the atlas
+    lightSlotsStale = true;
+}
+
+void SceneRenderer::setShadowCascades(
+    const srShadowCascadeSettings& settings) {
+    srShadowCascadeSettings& current = shadowCascades.settings;
+    // the images keep their layers and size once created
+    uint32_t count = current.count;
+    uint32_t size = current.size;
+    current = settings;
+    if (not shadowCascades.frames.empty()) {
+        current.count = count;
+        current.size = size;
+    }
+}
+
+void SceneRenderer::updateLight(LightHandle h) {
+    active_scene_data.scene->lh_mg.get(h).setFlags(ResourceFlags::DIRTY);
+}
+
+void SceneRenderer::updateLights() { lightSlotsStale = true; }
+
+void SceneRenderer::setLightRange(LightHandle h, float range) {
+    auto it = std::find_if(lightRanges.begin(), lightRanges.end(),
+                           [&](const auto& entry) { return entry.first == h; });
+    if (it != lightRanges.end()) lightRanges.erase(it);
+    if (range > 0.0f) lightRanges.push_back({h, range});
+    updateLight(h);
+}
+
+void SceneRenderer::setShadowCasterDynamic(SceneTreeHandle node,
+                                           bool dynamic) {
+    uint32_t rid =
+        active_scene_data.scene->getSceneTreeManager().get(node).getRID();
+    if (dynamic == dynamicCasterNodes.contains(rid)) return;
+    if (dynamic) {
+        dynamicCasterNodes.insert(rid);
+    } else {
+        dynamicCasterNodes.erase(rid);
+    }
+    // the cache has it or misses it
+    shadowCacheStale = true;
+}
+
+void SceneRenderer::updateShadowCasters() { shadowCacheStale = true; }
+
+void SceneRenderer::setLodSelection(const srLodSelection& selection) {
+    lodSelection = selection;
+}
+
+void SceneRenderer::setRetention(const srRetention& retention) {
+    retentionDefaults = retention;
+}
+
+void SceneRenderer::setRetentionPolicy(MeshHandle h,
+                                       srRetentionPolicy policy) {
+    active_scene_data.srmsh_mg.getRelated(h).retention = policy;
+    applyMeshRetention(h, active_scene_data);
+}
+
+void SceneRenderer::setRetentionPolicy(TextureHandle h,
+                                       srRetentionPolicy policy) {
+    active_scene_data.srtx_mg.getRelated(h).retention = policy;
+    applyTextureRetention(h);
+}
+
+void SceneRenderer::applyMeshRetention(MeshHandle mesh_h,
+                                       InternalSceneData& scene_data) {
+    srMesh& vkmesh = scene_data.srmsh_mg.getRelated(mesh_h);
+    srRetentionPolicy policy =
+        resolveRetention(vkmesh.retention, retentionDefaults.meshes);
+    if (policy == RETAIN_KEEP or vkmesh.released) return;
+
+    Mesh& mesh = scene_data.scene->ms_mg.get(mesh_h);
+    // a mesh cache file does as the compact copy
+    if (policy == RETAIN_COMPRESS and vkmesh.cachePath.empty()) {
+        if (not vkmesh.cpuCopy)
+            vkmesh.cpuCopy =
+                copyMesh(device, mesh, meshOptimization, vertexLayout);
+        retentionStats.compactBytes += meshCopySize(*vkmesh.cpuCopy);
+    }
+    retentionStats.meshBytesFreed += releaseMeshData(mesh);
+    retentionStats.releasedMeshes++;
+    vkmesh.released = true;
+}
+
+void SceneRenderer::applyTextureRetention(TextureHandle h) {
+    srTexture& tex = active_scene_data.srtx_mg.getRelated(h);
+    Texture& texture = active_scene_data.scene->tx_mg.get(h);
+    if (not tex.resident or texture.data.empty()) return;
+    srRetentionPolicy policy =
+        resolveRetention(tex.retention, retentionDefaults.textures);
+    if (policy == RETAIN_KEEP) return;
+
+    if (tex.sourcePath.empty() and policy == RETAIN_COMPRESS) {
+        // nothing compact to fall back to without block compression
+        if (tex.cachePath.empty()) return;
+        // streaming reads the cached chain from now on
+        tex.sourcePath = tex.cachePath;
+    }
+    // the finer levels are cut from these pixels, they go once the whole
+    // chain is on the gpu. Without a source file it stays at those levels
+    if (tex.sourcePath.empty() and tex.baseMip > 0) return;
+    retentionStats.textureBytesFreed += texture.data.size();
+    retentionStats.releasedTextures++;
+    texture.data.clear();
+    texture.data.shrink_to_fit();
+}
+
+void SceneRenderer::setTextureCompression(
+    const srTextureCompression& compression) {
+    gbg::setTextureCompression(*textureLoader, compression);
+}
+
+void SceneRenderer::processTextureUploads() {
+    ZoneScoped;
+    bool finished = false;
+    std::erase_if(uploadBatches, [&](srUploadBatch& batch) {
+        if (vkGetFenceStatus(device.ldevice, batch.fence) != VK_SUCCESS)
+            return false;
+
+        for (size_t i = 0; i < batch.uploads.size(); i++) {
+            srTextureUpload& upload = batch.uploads[i];
+            srTexture& tex = active_scene_data.srtx_mg.getRelated(upload.handle);
+            // the frames in flight still sample the old one
+            if (tex.textureImage.image != VK_NULL_HANDLE) {
+                retiredImages[currentFrame].push_back(tex.textureImage);
+                untrackMemory(residency, MEMORY_TEXTURE, tex.textureImage.size);
+            }
+
+            tex.textureImage = batch.images[i].image;
+            trackMemory(residency, MEMORY_TEXTURE, tex.textureImage.size);
+            tex.mipLevels = batch.images[i].mipLevels;
+            tex.baseMip = upload.baseMip;
+            tex.pendingMip = noStreamRequest;
+            tex.resident = true;
+            tex.generation++;
+            active_scene_data.scene->tx_mg.get(upload.handle).mip_levels =
+                tex.baseMip + tex.mipLevels;
+            finishTextureUpload(*textureLoader, upload);
+            applyTextureRetention(upload.handle);
+        }
+        for (srDownsampleJob& job : batch.downsampleJobs) {
+            releaseDownsampleJob(device, downsampler, job);
+        }
+        vkFreeCommandBuffers(device.ldevice, uploadCmdPool, 1,
+                             &batch.commandBuffer);
+        vkDestroyFence(device.ldevice, batch.fence, nullptr);
+        finished = true;
+        return true;
+    });
+
+    if (finished) {
+        for (MaterialHandle math : active_scene_data.scene->mat_mg) {
+            refreshMaterialDescriptorSet(math, active_scene_data);
+        }
+    }
+
+    for (srTextureUpload& upload : takeDecodedTextures(*textureLoader)) {
+        srTexture& tex = active_scene_data.srtx_mg.getRelated(upload.handle);
+        if (not upload.error.empty()) {
+            std::cerr << upload.error << std::endl;
+            tex.pendingMip = noStreamRequest;
+            continue;
+        }
+
+        Texture& texture = active_scene_data.scene->tx_mg.get(upload.handle);
+        texture.width = upload.width;
+        texture.height = upload.height;
+        srRetentionPolicy policy =
+            resolveRetention(tex.retention, retentionDefaults.textures);
+        if (upload.pixels and texture.data.empty() and
+            policy == RETAIN_KEEP) {
+            // keep the cpu copy like loadTexture does
+            size_t size =
+                static_cast<size_t>(upload.width) * upload.height * 4;
+            texture.data.assign(upload.pixels.get(),
+                                upload.pixels.get() + size);
+        }
+        upload.pixels.reset();
+
+        tex.fullMips = fullMipLevels(upload.width, upload.height);
+        tex.sourcePath = upload.path;
+        tex.raw = upload.raw;
+        if (not upload.cachePath.empty()) tex.cachePath = upload.cachePath;
+
+        stagedTextures.push_back(std::move(upload));
+    }
+
+    submitTextureUploads();
+}
+
+void SceneRenderer::submitTextureUploads() {
+    if (stagedTextures.empty()) return;
+    ZoneScoped;
+
+    srUploadBatch batch{};
+
+    VkCommandBufferAllocateInfo allocInfo{};
+    allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+    allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+    allocInfo.commandPool = uploadCmdPool;
+    allocInfo.commandBufferCount = 1;
+    if (vkAllocateCommandBuffers(device.ldevice, &allocInfo,
+                                 &batch.commandBuffer) != VK_SUCCESS) {
+        throw std::runtime_error("failed to allocate command buffer!");
+    }
+
+    VkCommandBufferBeginInfo beginInfo{};
+    beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+    beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+    vkBeginCommandBuffer(batch.commandBuffer, &beginInfo);
+
+    // index in batch.downsampleJobs, or -1 to blit the mips
+    std::vector<int32_t> downsampleJob(stagedTextures.size(), -1);
+    std::vector<VkImageMemoryBarrier> barriers;
+    for (size_t i = 0; i < stagedTextures.size(); i++) {
+        srTextureUpload& upload = stagedTextures[i];
+        VkFormat format = upload.format;
+        // the image starts at the first staged level
+        uint32_t width = std::max(upload.width >> upload.baseMip, 1u);
+        uint32_t height = std::max(upload.height >> upload.baseMip, 1u);
+
+        uint32_t mipLevels = upload.mipLevels;
+        bool compute = false;
+        if (upload.generateMips) {
+            uint32_t fullChain = fullMipLevels(width, height);
+            compute =
+                canDownsample(downsampler, format, width, height, fullChain);
+            if (compute or supportsLinearBlit(device, format))
+                mipLevels = fullChain;
+        }
+
+        VkImageUsageFlags usage =
+            VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT;
+        VkImageCreateFlags flags = 0;
+        VkFormat imageFormat = format;
+        if (compute) {
+            // written through unorm storage views, sampled as sRGB
+            usage |= VK_IMAGE_USAGE_STORAGE_BIT;
+            flags |= VK_IMAGE_CREATE_MUTABLE_FORMAT_BIT;
+            imageFormat = VK_FORMAT_R8G8B8A8_UNORM;
+        } else if (upload.generateMips) {
+            usage |= VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
+        }
+
+        srUploadedImage uploaded{};
+        uploaded.image = createImage(
+            device.pdevice, device.ldevice, width, height, mipLevels,
+            VK_SAMPLE_COUNT_1_BIT, imageFormat, VK_IMAGE_TILING_OPTIMAL, usage,
+            VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, flags);
+        uploaded.mipLevels = mipLevels;
+        uploaded.image.view = createImageView(
+            uploaded.image.image, device.ldevice, format,
+            VK_IMAGE_ASPECT_COLOR_BIT, 0, mipLevels, VK_IMAGE_USAGE_SAMPLED_BIT);
+        VkImage image = uploaded.image.image;
+        batch.images.push_back(uploaded);
+
+        if (compute) {
+            downsampleJob[i] = static_cast<int32_t>(batch.downsampleJobs.size());
+            batch.downsampleJobs.push_back(prepareDownsample(
+                device, downsampler, image, format, width, height, mipLevels));
+
+            // the levels below are only written by the shader
+            VkImageMemoryBarrier levelsBarrier{};
+            levelsBarrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+            levelsBarrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+            levelsBarrier.newLayout = VK_IMAGE_LAYOUT_GENERAL;
+            levelsBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+            levelsBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+            levelsBarrier.image = image;
+            levelsBarrier.subresourceRange.aspectMask =
+                VK_IMAGE_ASPECT_COLOR_BIT;
+            levelsBarrier.subresourceRange.baseMipLevel = 1;
+            levelsBarrier.subresourceRange.levelCount = mipLevels - 1;
+            levelsBarrier.subresourceRange.baseArrayLayer = 0;
+            levelsBarrier.subresourceRange.layerCount = 1;
+            levelsBarrier.srcAccessMask = 0;
+            levelsBarrier.dstAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+            barriers.push_back(levelsBarrier);
+        }
+
+        VkImageMemoryBarrier barrier{};
+        barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+        barrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+        barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+        barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        barrier.image = image;
+        barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+        barrier.subresourceRange.baseMipLevel = 0;
+        barrier.subresourceRange.levelCount = compute ? 1 : mipLevels;
+        barrier.subresourceRange.baseArrayLayer = 0;
+        barrier.subresourceRange.layerCount = 1;
+        barrier.srcAccessMask = 0;
+        barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+        barriers.push_back(barrier);
+    }
+
+    vkCmdPipelineBarrier(
+        batch.commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
+        VK_PIPELINE_STAGE_TRANSFER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+        0, 0, nullptr, 0, nullptr, static_cast<uint32_t>(barriers.size()),
+        barriers.data());
+
+    std::vector<VkImageMemoryBarrier> readyBarriers;
+    for (size_t i = 0; i < stagedTextures.size(); i++) {
+        srTextureUpload& upload = stagedTextures[i];
+        const srUploadedImage& uploaded = batch.images[i];
+
+        VkDeviceSize base = upload.staging ? upload.staging->offset : 0;
+        std::vector<VkBufferImageCopy> regions;
+        for (uint32_t level = 0; level < upload.mipLevels; level++) {
+            uint32_t fullLevel = upload.baseMip + level;
+            VkBufferImageCopy region{};
+            region.bufferOffset = base + upload.levelOffsets[level];
+            region.bufferRowLength = 0;
+            region.bufferImageHeight = 0;
+            region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+            region.imageSubresource.mipLevel = level;
+            region.imageSubresource.baseArrayLayer = 0;
+            region.imageSubresource.layerCount = 1;
+            region.imageOffset = {0, 0, 0};
+            region.imageExtent = {std::max(upload.width >> fullLevel, 1u),
+                                  std::max(upload.height >> fullLevel, 1u), 1};
+            regions.push_back(region);
+        }
+
+        VkBuffer staging = upload.staging ? upload.staging->buffer
+                                          : upload.ownStaging->buffer;
+        vkCmdCopyBufferToImage(batch.commandBuffer, staging,
+                               uploaded.image.image,
+                               VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+                               static_cast<uint32_t>(regions.size()),
+                               regions.data());
+
+        if (not upload.generateMips or downsampleJob[i] >= 0) {
+            // the whole chain came from staging, or the downsampler reads
+            // level 0
+            VkImageMemoryBarrier barrier{};
+            barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+            barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+            barrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+            barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+            barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+            barrier.image = uploaded.image.image;
+            barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+            barrier.subresourceRange.baseMipLevel = 0;
+            barrier.subresourceRange.levelCount =
+                downsampleJob[i] >= 0 ? 1 : uploaded.mipLevels;
+            barrier.subresourceRange.baseArrayLayer = 0;
+            barrier.subresourceRange.layerCount = 1;
+            barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+            barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+            readyBarriers.push_back(barrier);
+        }
+    }
+
+    if (not readyBarriers.empty()) {
+        vkCmdPipelineBarrier(batch.commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT,
+                             VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT |
+                                 VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
+                             0, 0, nullptr, 0, nullptr,
+                             static_cast<uint32_t>(readyBarriers.size()),
+                             readyBarriers.data());
+    }
+
+    // mips once every copy is recorded
+    std::vector<VkImageMemoryBarrier> mipBarriers;
+    for (size_t i = 0; i < stagedTextures.size(); i++) {
+        srTextureUpload& upload = stagedTextures[i];
+        if (not upload.generateMips) continue;
+        const srUploadedImage& uploaded = batch.images[i];
+
+        if (downsampleJob[i] < 0) {
+            uint32_t width = std::max(upload.width >> upload.baseMip, 1u);
+            uint32_t height = std::max(upload.height >> upload.baseMip, 1u);
+            recordMipmaps(batch.commandBuffer, uploaded.image.image,
+                          static_cast<int32_t>(width),
+                          static_cast<int32_t>(height), uploaded.mipLevels);
+            continue;
+        }
+
+        recordDownsample(downsampler, batch.commandBuffer,
+                         batch.downsampleJobs[downsampleJob[i]]);
+
+        VkImageMemoryBarrier barrier{};
+        barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+        barrier.oldLayout = VK_IMAGE_LAYOUT_GENERAL;
+        barrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+        barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        barrier.image = uploaded.image.image;
+        barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+        barrier.subresourceRange.baseMipLevel = 1;
+        barrier.subresourceRange.levelCount = uploaded.mipLevels - 1;
+        barrier.subresourceRange.baseArrayLayer = 0;
+        barrier.subresourceRange.layerCount = 1;
+        barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+        barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+        mipBarriers.push_back(barrier);
+    }
+
+    if (not mipBarriers.empty()) {
+        vkCmdPipelineBarrier(batch.commandBuffer,
+                             VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                             VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0, 0,
+                             nullptr, 0, nullptr,
+                             static_cast<uint32_t>(mipBarriers.size()),
+                             mipBarriers.data());
+    }
+
+    vkEndCommandBuffer(batch.commandBuffer);
+
+    VkFenceCreateInfo fenceInfo{};
+    fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+    if (vkCreateFence(device.ldevice, &fenceInfo, nullptr, &batch.fence) !=
+        VK_SUCCESS) {
+        throw std::runtime_error("failed to create upload fence!");
+    }
+
+    VkSubmitInfo submitInfo{};
+    submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+    submitInfo.commandBufferCount = 1;
+    submitInfo.pCommandBuffers = &batch.commandBuffer;
+    if (vkQueueSubmit(device.gqueue, 1, &submitInfo, batch.fence) !=
+        VK_SUCCESS) {
+        throw std::runtime_error("failed to submit texture uploads!");
+    }
+
+    batch.uploads = std::move(stagedTextures);
+    stagedTextures.clear();
+    uploadBatches.push_back(std::move(batch));
+}
+
+void SceneRenderer::updateTextureStreaming() {
+    if (not textureStreaming.enabled) return;
+    ZoneScoped;
+    Scene* scene = active_scene_data.scene;
+    auto& st_mg = scene->getSceneTreeManager();
+
+    for (TextureHandle th : scene->tx_mg) {
+        active_scene_data.srtx_mg.getRelated(th).wantedMip = noStreamRequest;
+    }
+
+    glm::vec3 eye = st_mg.getGlobalTransform(scene->active_camera) *
+                    glm::vec4(0.0f, 0.0f, 0.0f, 1.0f);
+
+    std::queue<std::pair<SceneTreeHandle, glm::mat4>> Q;
+    Q.push({scene->root, glm::mat4(1.f)});
+    while (not Q.empty()) {
+        SceneTreeHandle visited = Q.front().first;
+        glm::mat4 transform = Q.front().second;
+        Q.pop();
+
+        SceneTreeNode& stn = st_mg.get(visited);
+        transform = transform * stn.getLocalTransform();
+
+        auto handle = stn.getResourceH();
+        if (auto mh = std::get_if<ModelHandle>(&handle)) {
+            Model& md = scene->md_mg.get(*mh);
+            const srMesh& mesh =
+                active_scene_data.srmsh_mg.getRelated(md.getMesh());
+
+            float scale = std::max({glm::length(glm::vec3(transform[0])),
+                                    glm::length(glm::vec3(transform[1])),
+                                    glm::length(glm::vec3(transform[2]))});
+            glm::vec3 center =
+                transform * glm::vec4(glm::vec3(mesh.bounds), 1.0f);
+            float distance = std::max(
+                glm::length(center - eye) - mesh.bounds.w * scale, 0.1f);
+            float pixelsPerUnit = pixelsAtUnitDistance / distance;
+            float uvPerUnit = scale > 0.0f ? mesh.uvDensity / scale : 0.0f;
+
+            Material& mat = scene->mat_mg.get(md.getMaterial());
+            for (const parm_vt& val : mat.getValues()) {
+                auto th = std::get_if<TextureHandle>(&val);
+                if (not th) continue;
+                srTexture& tex = active_scene_data.srtx_mg.getRelated(*th);
+                if (tex.fullMips == 0) continue;
+
+                Texture& texture = scene->tx_mg.get(*th);
+                uint32_t size = static_cast<uint32_t>(
+                    std::max(texture.width, texture.height));
+                float level = estimateMipLevel(size, uvPerUnit, pixelsPerUnit) +
+                              textureStreaming.bias;
+                uint32_t mip = static_cast<uint32_t>(std::clamp(
+                    std::floor(level), 0.0f,
+                    static_cast<float>(tex.fullMips - 1)));
+                tex.wantedMip = std::min(tex.wantedMip, mip);
+            }
+        }
 
-        addImageView(tex.textureImage, device.ldevice, format,
-                     VK_IMAGE_ASPECT_COLOR_BIT, tex.mipLevels);
+        SceneTreeHandle child = stn.childH;
+        while (child) {
+            Q.push({child, transform});
+            child = st_mg.get(child).nextH;
+        }
+    }
 
-        VkDeviceSize dsize = texture.data.size();
+    uint32_t tailLevels =
+        fullMipLevels(textureStreaming.tailSize, textureStreaming.tailSize);
+    uint32_t inFlight = 0;
+    std::vector<std::pair<int32_t, TextureHandle>> candidates;
+    for (TextureHandle th : scene->tx_mg) {
+        srTexture& tex = active_scene_data.srtx_mg.getRelated(th);
+        bool idle = false;
+        if (tex.wantedMip != noStreamRequest) {
+            tex.lastWanted = residency.frame;
+        } else if (textureStreaming.idleFrames > 0 and tex.fullMips > 0 and
+                   tex.lastWanted + textureStreaming.idleFrames <
+                       residency.frame) {
+            // nothing showed it for a while, back down to the tail
+            tex.wantedMip = tex.fullMips > tailLevels
+                                ? tex.fullMips - tailLevels
+                                : 0;
+            idle = true;
+        }
+        if (tex.pendingMip != noStreamRequest) {
+            inFlight++;
+            continue;
+        }
+        if (not tex.resident or tex.wantedMip == noStreamRequest) continue;
+        if (tex.sourcePath.empty() and scene->tx_mg.get(th).data.empty())
+            continue;
+
+        // finer levels right away, coarser ones with a level of slack so a
+        // texture on the edge doesn't bounce between two images
+        int32_t gap = static_cast<int32_t>(tex.baseMip) -
+                      static_cast<int32_t>(tex.wantedMip);
+        // over budget the eviction decides what gets finer
+        if (gap > 0 and residency.overBudget) continue;
+        if (gap > 0 or gap < -1 or (idle and gap < 0))
+            candidates.push_back({gap, th});
+    }
 
-        gbg::vkBuffer stagingBuffer =
-            gbg::createBuffer(device, dsize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
-                              VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
-                                  VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
-        void* sdata;
-        vkMapMemory(device.ldevice, stagingBuffer.memory, 0, dsize, 0, &sdata);
-        memcpy(sdata, texture.data.data(), texture.data.size());
-        vkUnmapMemory(device.ldevice, stagingBuffer.memory);
+    // biggest upgrades first, releases last
+    std::sort(candidates.begin(), candidates.end(),
+              [](const auto& a, const auto& b) { return a.first > b.first; });
+    for (const auto& [gap, th] : candidates) {
+        if (inFlight >= textureStreaming.maxRequests) break;
+        requestTextureLevels(
+            th, active_scene_data.srtx_mg.getRelated(th).wantedMip);
+        inFlight++;
+    }
+}
 
-        transitionImageLayout(tex.textureImage.image, format,
-                              VK_IMAGE_LAYOUT_UNDEFINED,
-                              VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
-                              static_cast<uint32_t>(tex.mipLevels));
+void SceneRenderer::requestTextureLevels(TextureHandle h, uint32_t baseMip) {
+    srTexture& tex = active_scene_data.srtx_mg.getRelated(h);
+    Texture& texture = active_scene_data.scene->tx_mg.get(h);
+    tex.pendingMip = baseMip;
 
-        copyBufferToImage(stagingBuffer.buffer, tex.textureImage.image,
-                          texture.width, texture.height);
-        vkDestroyBuffer(device.ldevice, stagingBuffer.buffer, nullptr);
-        vkFreeMemory(device.ldevice, stagingBuffer.memory, nullptr);
+    if (not tex.sourcePath.empty()) {
+        requestTexture(*textureLoader, h, tex.sourcePath, tex.raw, baseMip);
+        return;
+    }
+    requestTexturePixels(
+        *textureLoader, h,
+        std::vector<unsigned char>(texture.data.begin(), texture.data.end()),
+        static_cast<uint32_t>(texture.width),
+        static_cast<uint32_t>(texture.height), tex.raw, baseMip);
+}
 
-        transitionImageLayout(tex.textureImage.image, format,
-                              VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
-                              VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
-                              static_cast<uint32_t>(tex.mipLevels));
+void SceneRenderer::releaseRetiredImages(uint32_t frame) {
+    for (gbg::vkImage& image : retiredImages[frame]) {
+        destoryImage(image, device.ldevice);
+    }
+    retiredImages[frame].clear();
+}
+
+void SceneRenderer::updateResidency() {
+    if (not residency.settings.enabled) return;
+    ZoneScoped;
+    Scene* scene = active_scene_data.scene;
+
+    // drawn again after being dropped, they were skipped for a frame
+    for (MeshHandle mh : scene->ms_mg) {
+        srMesh& mesh = active_scene_data.srmsh_mg.getRelated(mh);
+        if (not mesh.resident and mesh.lastUsed + 1 >= residency.frame) {
+            uploadMesh(mh, mesh, active_scene_data);
+            // the cached shadows were drawn without it
+            shadowCacheStale = true;
+        }
+    }
+
+    VkDeviceSize excess = updateMemoryBudget(device, residency);
+    if (excess == 0) return;
+
+    // meshes nobody draws go first, nothing on screen changes
+    uint64_t idleFrames = std::max<uint64_t>(
+        residency.settings.meshIdleFrames, MAX_FRAMES_IN_FLIGHT);
+    for (MeshHandle mh : scene->ms_mg) {
+        if (excess == 0) break;
+        srMesh& mesh = active_scene_data.srmsh_mg.getRelated(mh);
+        if (not mesh.resident or mesh.dynamic or
+            mesh.lastUsed + idleFrames >= residency.frame)
+            continue;
+        // it couldn't be uploaded again
+        if (mesh.released and not mesh.cpuCopy and mesh.cachePath.empty())
+            continue;
+
+        // no frame in flight reads it anymore
+        VkDeviceSize size = meshMemorySize(mesh);
+        destroyMesh(device, mesh);
+        untrackMemory(residency, MEMORY_MESH, size);
+        mesh.vertexAttributes.clear();
+        mesh.indexBuffer = vkBuffer{};
+        mesh.meshletBuffer = vkBuffer{};
+        mesh.submeshes.clear();
+        mesh.resident = false;
+        excess -= std::min(excess, size);
+        residency.stats.droppedMeshes++;
+    }
+
+    // a texture was last used when a material sampling it was
+    for (MaterialHandle math : scene->mat_mg) {
+        const srMaterial& srmt = active_scene_data.srmat_mg.getRelated(math);
+        for (const parm_vt& val : scene->mat_mg.get(math).getValues()) {
+            auto th = std::get_if<TextureHandle>(&val);
+            if (not th) continue;
+            srTexture& tex = active_scene_data.srtx_mg.getRelated(*th);
+            tex.lastUsed = std::max(tex.lastUsed, srmt.lastUsed);
+        }
+    }
+
+    struct EvictCandidate {
+        uint64_t lastUsed;
+        VkDeviceSize size;
+        TextureHandle handle;
+    };
+    // streaming never goes coarser than the tail either
+    uint32_t tailLevels =
+        fullMipLevels(textureStreaming.tailSize, textureStreaming.tailSize);
+    std::vector<EvictCandidate> candidates;
+    for (TextureHandle th : scene->tx_mg) {
+        srTexture& tex = active_scene_data.srtx_mg.getRelated(th);
+        if (not tex.resident or tex.fullMips == 0) continue;
+        if (tex.pendingMip != noStreamRequest) {
+            // a coarser image on its way frees most of this one, don't
+            // evict twice for the same bytes
+            if (tex.pendingMip > tex.baseMip) {
+                VkDeviceSize size = tex.textureImage.size;
+                excess -= std::min(excess, size - size / 4);
+            }
+            continue;
+        }
+        if (tex.sourcePath.empty() and scene->tx_mg.get(th).data.empty())
+            continue;
+        if (tex.baseMip + tailLevels >= tex.fullMips) continue;
+        candidates.push_back({tex.lastUsed, tex.textureImage.size, th});
+    }
+
+    // least recently drawn first, the biggest of those first
+    std::sort(candidates.begin(), candidates.end(),
+              [](const EvictCandidate& a, const EvictCandidate& b) {
+                  if (a.lastUsed != b.lastUsed) return a.lastUsed < b.lastUsed;
+                  return a.size > b.size;
+              });
+    for (const EvictCandidate& candidate : candidates) {
+        if (excess == 0) break;
+        // one level down is a quarter of the texels
+        requestTextureLevels(
+            candidate.handle,
+            active_scene_data.srtx_mg.getRelated(candidate.handle).baseMip + 1);
+        excess -= std::min(excess, candidate.size - candidate.size / 4);
+        residency.stats.evictedTextures++;
     }
 }
 
@@ -237,14 +1213,31 @@ void SceneRenderer::updateShader(ShaderHandle sh_h,
     if (flags & (ResourceFlags::NEW | ResourceFlags::DIRTY)) {
         if (flags & ResourceFlags::DIRTY) {
             vkDeviceWaitIdle(device.ldevice);
+            for (uint32_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
+                releaseRetiredMaterialSets(i);
+            }
+            forgetDescriptorLayout(device, materialDescAllocator,
+                                   sr_sh.layout);
+            destroyDescriptorTemplate(device, sr_sh.descTemplate);
             vkDestroyDescriptorSetLayout(device.ldevice, sr_sh.layout, nullptr);
+            sr_sh.layout = VK_NULL_HANDLE;
             vkDestroyPipeline(device.ldevice, sr_sh.pipeline.pipeline, nullptr);
             vkDestroyPipelineLayout(device.ldevice, sr_sh.pipeline.layout,
                                     nullptr);
         }
 
+        auto texFilter = [](ParameterTypes p) {
+            return p == ParameterTypes::TEXTURE_PARM;
+        };
+        auto nonTexFilter = [](ParameterTypes p) {
+            return p != ParameterTypes::TEXTURE_PARM;
+        };
+
         std::vector<VkDescriptorSetLayoutBinding> materialBindings;
-        if (not shader.getParameters().empty()) {
+        // textures don't live in the parameter buffer
+        if (not (shader.getParameters() |
+                 std::ranges::views::filter(nonTexFilter))
+                    .empty()) {
             VkDescriptorSetLayoutBinding matParmsLayoutBinding{};
             matParmsLayoutBinding.binding = 0;
             matParmsLayoutBinding.descriptorCount = 1;
@@ -256,10 +1249,6 @@ void SceneRenderer::updateShader(ShaderHandle sh_h,
             materialBindings.push_back(matParmsLayoutBinding);
         }
 
-        auto texFilter = [](ParameterTypes p) {
-            return p == ParameterTypes::TEXTURE_PARM;
-        };
-
         // creates a binding for each texture
         int textureCount = 0;
         for (ParameterTypes p :
@@ -296,24 +1285,18 @@ void SceneRenderer::updateShader(ShaderHandle sh_h,
                     "failed to create descriptor set layout!");
             }
             desc_sets_layouts.push_back(sr_sh.layout);
+
+            sr_sh.descTemplate = createDescriptorTemplate(
+                device, materialBindings, sr_sh.layout);
         }
 
         std::vector<VkVertexInputBindingDescription> bindingDescriptions;
         std::vector<VkVertexInputAttributeDescription> attributeDescriptions;
-        // TODO: make them a parameter.
         for (const auto& type : shader.getAttributes()) {
-            vkVertexInputDescription desc;
-            switch (type.second) {
-                case FLOAT_ATTR:
-                    desc = getVertexFloatInputDescription(type.first);
-                    break;
-                case VEC2_ATTR:
-                    desc = getVertexVector2InputDescription(type.first);
-                    break;
-                case VEC3_ATTR:
-                    desc = getVertexVector3InputDescription(type.first);
-                    break;
-            }
+            VkFormat format =
+                vertexAttributeFormat(vertexLayout, type.first, type.second);
+            vkVertexInputDescription desc = getVertexInputDescription(
+                type.first, format, vertexFormatSize(format));
             bindingDescriptions.push_back(desc.binding_desc);
             attributeDescriptions.push_back(desc.attrib_desc);
         }
@@ -354,6 +1337,7 @@ void SceneRenderer::updateMaterial(MaterialHandle math,
                     device, values.size, VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT,
                     VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
                         VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+                trackMemory(residency, MEMORY_MATERIAL, srmt.paramBuffer.size);
             }
             void* data;
             vkMapMemory(device.ldevice, srmt.paramBuffer.memory, 0,
@@ -365,13 +1349,24 @@ void SceneRenderer::updateMaterial(MaterialHandle math,
         }
 
         auto& sh = scene_data.scene->sh_mg.get(mat.getShaderHandle());
+        srShader& srsh = scene_data.srsh_mg.getRelated(mat.getShaderHandle());
         // create descriptor sets if new
         if (mat.getFlags() & ResourceFlags::NEW)
             createMaterialDescriptorSet(math, scene_data);
         else if (sh.getFlags() & ResourceFlags::DIRTY) {
+            // the old layout is gone, its set can't be reused
             vkDeviceWaitIdle(device.ldevice);
-            vkFreeDescriptorSets(device.ldevice, materialDescPool, 1,
-                                 &srmt.descriptor_set);
+            if (srmt.descriptor_set != VK_NULL_HANDLE)
+                dropDescriptorSet(device, materialDescAllocator,
+                                  srmt.descriptor_set);
+            createMaterialDescriptorSet(math, scene_data);
+        } else if (not mat.getValues().empty() and
+                   srmt.layout != srsh.layout) {
+            // the material switched shader, recycle the old set
+            vkDeviceWaitIdle(device.ldevice);
+            if (srmt.descriptor_set != VK_NULL_HANDLE)
+                releaseDescriptorSet(materialDescAllocator, srmt.layout,
+                                     srmt.descriptor_set);
             createMaterialDescriptorSet(math, scene_data);
         }
 
@@ -379,61 +1374,190 @@ void SceneRenderer::updateMaterial(MaterialHandle math,
     }
 }
 
-void SceneRenderer::fillLightBuffer(uint32_t currentImage) {
-    auto& st_mg = active_scene_data.scene->getSceneTreeManager();
+vkLight SceneRenderer::packLight(LightHandle h,
+                                 const glm::mat4& transform) const {
+    // the shadow pass looks down the node's -z
+    static const glm::mat4 projection = [] {
+        glm::mat4 proj =
+            glm::perspective(glm::radians(45.0f), 1.0f, 0.1f, 100.0f);
+        proj[1][1] *= -1;
+        return proj;
+    }();
+
+    const Light& light = active_scene_data.scene->lh_mg.get(h);
+    vkLight vklight{};
+    vklight.position = transform * glm::vec4(0., 0., 0., 1.);
+    vklight.range = lightClusters.settings.lightRange;
+    for (const auto& [lh, range] : lightRanges) {
+        if (lh == h) vklight.range = range;
+    }
+    vklight.color = light.color;
+    vklight.direction = light.direction;
+    vklight.proj = projection * glm::inverse(transform);
+    // out of the clusters and the atlas, the cascades shadow it
+    if (directionalLight and h == directionalLight) {
+        vklight.range = 0.0f;
+        vklight.direction = glm::normalize(
+            glm::vec3(transform * glm::vec4(0.0f, 0.0f, -1.0f, 0.0f)));
+    }
+    return vklight;
+}
 
-    std::vector<vkLight> lightTemporalBuffer;
+static void markLightsDirty(std::pair<uint32_t, uint32_t>& range,
+                            uint32_t first, uint32_t end) {
+    if (range.first >= range.second) {
+        range = {first, end};
+    } else {
+        range = {std::min(range.first, first), std::max(range.second, end)};
+    }
+}
 
-    glm::mat4 accumulated_transform = glm::mat4(1.0f);
+void SceneRenderer::rebuildLightTable() {
+    ZoneScoped;
+    auto& st_mg = active_scene_data.scene->getSceneTreeManager();
+    lightSlots.clear();
+    lightTable.clear();
 
     std::queue<std::pair<SceneTreeHandle, glm::mat4>> Q;
     Q.push({active_scene_data.scene->root, glm::mat4(1.f)});
     while (not Q.empty()) {
         SceneTreeHandle visited = Q.front().first;
-        accumulated_transform = Q.front().second;
+        glm::mat4 transform = Q.front().second;
         Q.pop();
 
         SceneTreeNode& stn = st_mg.get(visited);
+        transform = transform * stn.getLocalTransform();
 
         auto handle = stn.getResourceH();
-
-        accumulated_transform = accumulated_transform * stn.getLocalTransform();
-
-        std::visit(overloads{[&](const ModelHandle& mh) {},
-                             [&](const CameraHandle& empty) {
-
-                             },
-                             [&](const std::monostate& empty) {
-
-                             },
-                             [&](const LightHandle& lh) {
-                                 auto& light =
-                                     active_scene_data.scene->lh_mg.get(lh);
-                                 vkLight vklight{};
-                                 vklight.color = light.color;
-                                 vklight.direction = light.direction;
-                                 vklight.position = accumulated_transform *
-                                                    glm::vec4(0., 0., 0., 1.);
-                                 vklight.proj =
-                                     glm::perspective(glm::radians(45.0f),
-                                                      1.0f,
-                                                      0.1f, 100.0f);
-                                 vklight.proj[1][1] *= -1;
-                                 vklight.proj = vklight.proj * glm::inverse(accumulated_transform);
-                                 lightTemporalBuffer.push_back(vklight);
-                             }},
-
-                   handle);
+        if (const LightHandle* lh = std::get_if<LightHandle>(&handle)) {
+            lightSlots.push_back({*lh, visited, transform});
+            lightTable.push_back(
+                packLight(*lh, transform));
+        }
 
         SceneTreeHandle child = stn.childH;
         while (child) {
-            Q.push({child, accumulated_transform});
+            Q.push({child, transform});
             child = st_mg.get(child).nextH;
         }
     }
 
-    memcpy(lightsBuffersMapped[currentImage], lightTemporalBuffer.data(),
-           lightTemporalBuffer.size() * sizeof(vkLight));
+    for (auto& range : lightDirtyRanges) {
+        range = {0, static_cast<uint32_t>(lightTable.size())};
+    }
+}
+
+void SceneRenderer::assignShadowTiles() {
+    ZoneScoped;
+    float height = static_cast<float>(swapChain.swapChainImageExtent.height);
+    std::vector<srShadowRequest> requests;
+    requests.reserve(lightTable.size());
+    for (uint32_t i = 0; i < lightTable.size(); i++) {
+        const vkLight& vklight = lightTable[i];
+        float distance = glm::length(vklight.position - cameraPosition);
+        float coverage =
+            distance <= vklight.range
+                ? 1.0f
+                : vklight.range / distance * pixelsAtUnitDistance / height;
+        // the directional light has no range, nor a tile
+        float importance =
+            vklight.range > 0.0f
+                ? std::max({vklight.color.r, vklight.color.g, vklight.color.b})
+                : 0.0f;
+        requests.push_back({i, coverage, importance});
+    }
+    allocateShadowTiles(shadowAtlas, requests);
+
+    // origin and size, nothing without a tile
+    std::vector<std::pair<uint32_t, uint32_t>> rects(lightTable.size(),
+                                                     {0u, 0u});
+    for (const srShadowTile& tile : shadowAtlas.tiles) {
+        rects[tile.light] = {shadowTileOrigin(tile), tile.size};
+    }
+    // only the lights whose tile moved are uploaded again, and drawn again
+    // in the cache
+    for (uint32_t i = 0; i < lightTable.size(); i++) {
+        if (lightTable[i].shadowOrigin == rects[i].first and
+            lightTable[i].shadowSize == rects[i].second)
+            continue;
+        lightTable[i].shadowOrigin = rects[i].first;
+        lightTable[i].shadowSize = rects[i].second;
+        staleShadowTiles.push_back(i);
+        for (auto& range : lightDirtyRanges) {
+            markLightsDirty(range, i, i + 1);
+        }
+    }
+}
+
+void SceneRenderer::repackLight(uint32_t slot, const glm::mat4& transform) {
+    srLightSlot& lightSlot = lightSlots[slot];
+    lightSlot.transform = transform;
+    // assignShadowTiles decides whether the tile stays
+    vkLight vklight = packLight(lightSlot.light, transform);
+    vklight.shadowOrigin = lightTable[slot].shadowOrigin;
+    vklight.shadowSize = lightTable[slot].shadowSize;
+    // a new color shades the same shadow
+    if (vklight.proj != lightTable[slot].proj or
+        vklight.range != lightTable[slot].range)
+        staleShadowTiles.push_back(slot);
+    lightTable[slot] = vklight;
+    shadowTilesStale = true;
+
+    // nothing reads the frame's buffer before the submit, the others are
+    // written when their frame comes around
+    static_cast<vkLight*>(lightsBuffersMapped[currentFrame])[slot] = vklight;
+    for (uint32_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
+        if (i == currentFrame) continue;
+        markLightsDirty(lightDirtyRanges[i], slot, slot + 1);
+    }
+}
+
+uint32_t SceneRenderer::updateLightBuffer(uint32_t currentImage) {
+    ZoneScoped;
+    if (lightSlotsStale) {
+        rebuildLightTable();
+        lightSlotsStale = false;
+        shadowCacheStale = true;
+        shadowTilesStale = true;
+    }
+    // moved or edited lights are repacked by prepareModelDraws as its walk
+    // finds them. The tiles only change with them or the camera, still
+    // lights under a still camera cost nothing here
+    if (shadowTilesStale or cameraPosition != shadowTilesCamera or
+        pixelsAtUnitDistance != shadowTilesPixels) {
+        assignShadowTiles();
+        shadowTilesStale = false;
+        shadowTilesCamera = cameraPosition;
+        shadowTilesPixels = pixelsAtUnitDistance;
+    }
+
+    uint32_t count = static_cast<uint32_t>(lightTable.size());
+    auto& dirty = lightDirtyRanges[currentImage];
+    VkDeviceSize capacity = lightsBuffers[currentImage].size / sizeof(vkLight);
+    if (count > capacity) {
+        // its fence was waited, nothing reads the old one
+        destroyBuffer(device, lightsBuffers[currentImage]);
+        createLightBuffer(currentImage,
+                          std::max(count, static_cast<uint32_t>(capacity * 2)));
+        writeGlobalDescriptorSet(currentImage);
+        dirty = {0, count};
+    }
+    if (dirty.first < dirty.second) {
+        memcpy(static_cast<vkLight*>(lightsBuffersMapped[currentImage]) +
+                   dirty.first,
+               lightTable.data() + dirty.first,
+               (dirty.second - dirty.first) * sizeof(vkLight));
+    }
+    dirty = {0, 0};
+
+    if (debugDrawSettings.lightFrusta) {
+        for (const vkLight& vklight : lightTable) {
+            if (vklight.range <= 0.0f) continue;
+            debugFrustum(debugDraw, vklight.proj,
+                         glm::vec4(vklight.color, 1.0f));
+        }
+    }
+    return count;
 }
 
 void SceneRenderer::processScene() {
@@ -472,13 +1596,60 @@ void SceneRenderer::cleanup() {
         destroyBuffer(device, globalBuffers[i]);
         destroyBuffer(device, lightsBuffers[i]);
     }
+    destroyLightClusters(device, lightClusters);
+    destroyShadowCascades(device, shadowCascades);
 
-    vkDestroyDescriptorPool(device.ldevice, globalDescriptorPool, nullptr);
+    destroyDescriptorAllocator(device, globalDescAllocator);
+    for (auto& allocator : frameDescAllocators) {
+        destroyDescriptorAllocator(device, allocator);
+    }
 
+    destroyDescriptorTemplate(device, globalDescTemplate);
     vkDestroyDescriptorSetLayout(device.ldevice, globalDescriptorSetLayout,
                                  nullptr);
 
     vkDestroySampler(device.ldevice, textureSampler, nullptr);
+    vkDestroySampler(device.ldevice, shadowSampler, nullptr);
+    for (size_t i = 0; i < shadowImages.size(); i++) {
+        vkDestroyFramebuffer(device.ldevice, shadowFrameBuffer[i], nullptr);
+        destoryImage(shadowImages[i], device.ldevice);
+    }
+    vkDestroyRenderPass(device.ldevice, shadowRenderPass, nullptr);
+    vkDestroyFramebuffer(device.ldevice, shadowCacheFrameBuffer, nullptr);
+    destoryImage(shadowCache, device.ldevice);
+    vkDestroyRenderPass(device.ldevice, shadowCacheRenderPass, nullptr);
+    vkDestroyRenderPass(device.ldevice, shadowCacheUpdatePass, nullptr);
+
+    for (srUploadBatch& batch : uploadBatches) {
+        for (srTextureUpload& upload : batch.uploads) {
+            finishTextureUpload(*textureLoader, upload);
+        }
+        for (srDownsampleJob& job : batch.downsampleJobs) {
+            releaseDownsampleJob(device, downsampler, job);
+        }
+        for (srUploadedImage& uploaded : batch.images) {
+            destoryImage(uploaded.image, device.ldevice);
+        }
+        vkDestroyFence(device.ldevice, batch.fence, nullptr);
+    }
+    uploadBatches.clear();
+    for (uint32_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
+        releaseRetiredImages(i);
+    }
+    for (srTextureUpload& upload : stagedTextures) {
+        finishTextureUpload(*textureLoader, upload);
+    }
+    stagedTextures.clear();
+    stopTextureLoader(*textureLoader);
+    vkDestroyCommandPool(device.ldevice, uploadCmdPool, nullptr);
+    destroyDownsampler(device, downsampler);
+    destroyClusterCuller(device, clusterCuller);
+    destroyDebugDraw(device, debugDraw);
+    for (uint32_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
+        releaseMeshStaging(i);
+    }
+    destroyStagingRing(device, meshStaging);
+    destoryImage(placeholderTexture, device.ldevice);
 
     for (const auto& shader : active_scene_data.srsh_mg) {
         destroySrShader(device, active_scene_data.srsh_mg.get(shader));
@@ -496,7 +1667,7 @@ void SceneRenderer::cleanup() {
         destroyMesh(device, active_scene_data.srmsh_mg.get(mesh));
     }
 
-    vkDestroyDescriptorPool(device.ldevice, materialDescPool, nullptr);
+    destroyDescriptorAllocator(device, materialDescAllocator);
 
     for (int i = 0; i < MAX_FRAMES_IN_FLIGHT; ++i) {
         vkDestroySemaphore(device.ldevice, imageAvailableSemaphores[i],
@@ -577,6 +1748,8 @@ void SceneRenderer::recreateSwapChain() {
 }
 
 void SceneRenderer::cleanupSwapChain() {
+    untrackMemory(residency, MEMORY_ATTACHMENT,
+                  colorImage.size + depthImage.size);
     gbg::destoryImage(colorImage, device.ldevice);
     gbg::destoryImage(depthImage, device.ldevice);
     gbg::cleanupSwapChain(swapChain, device.ldevice);
@@ -605,6 +1778,7 @@ void SceneRenderer::createColorResources() {
         VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
     gbg::addImageView(colorImage, device.ldevice, colorFormat,
                       VK_IMAGE_ASPECT_COLOR_BIT, 1);
+    trackMemory(residency, MEMORY_ATTACHMENT, colorImage.size);
 }
 
 void SceneRenderer::createRenderPass() {
@@ -698,54 +1872,141 @@ void SceneRenderer::createRenderPass() {
     }
 }
 
-void SceneRenderer::createRendererObjects() {
-    CREATE_AND_GET(color_shader, internal_scene->sh_mg, "PlainColorShader");
-    setShaderCode(color_shader, "data/models/RendererScene/plain_color.vert", VERTEX);
-    setShaderCode(color_shader, "data/models/RendererScene/plain_color.frag", FRAGMENT);
-    reflectShader(color_shader);
-    
-    CREATE_AND_GET(white_material, internal_scene->mat_mg, "WhiteMaterial");
-    white_material.setShader(color_shader_h, color_shader, TextureHandle());
-    white_material.setParameterValue<VEC3_PARM>(0, glm::vec3(1.0f, 1.0f, 1.0f));
-    
-    objLoader("data/models/RendererScene/RendererObjects.obj", internal_scene.get() ,internal_scene->root, white_material_h);
+void SceneRenderer::createRendererObjects() {
+    CREATE_AND_GET(color_shader, internal_scene->sh_mg, "PlainColorShader");
+    setShaderCode(color_shader, "data/models/RendererScene/plain_color.vert", VERTEX);
+    setShaderCode(color_shader, "data/models/RendererScene/plain_color.frag", FRAGMENT);
+    reflectShader(color_shader);
+    
+    CREATE_AND_GET(white_material, internal_scene->mat_mg, "WhiteMaterial");
+    white_material.setShader(color_shader_h, color_shader, TextureHandle());
+    white_material.setParameterValue<VEC3_PARM>(0, glm::vec3(1.0f, 1.0f, 1.0f));
+    
+    objLoader("data/models/RendererScene/RendererObjects.obj", internal_scene.get() ,internal_scene->root, white_material_h);
+}
+
+
+void SceneRenderer::createShadowImages() {
+    VkFormat format = findDepthFormat();
+    shadowSize = {shadowAtlas.settings.size, shadowAtlas.settings.size};
+
+    for (auto& shadowImage : shadowImages) {
+        shadowImage =
+            createImage(device.pdevice, device.ldevice, shadowSize.width, shadowSize.height, 1,
+                        VK_SAMPLE_COUNT_1_BIT, format, VK_IMAGE_TILING_OPTIMAL,
+                        VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT |
+                            VK_IMAGE_USAGE_SAMPLED_BIT |
+                            VK_IMAGE_USAGE_TRANSFER_DST_BIT,
+                        VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+        addImageView(shadowImage, device.ldevice, format,
+                     VK_IMAGE_ASPECT_DEPTH_BIT, 1);
+        trackMemory(residency, MEMORY_ATTACHMENT, shadowImage.size);
+    }
+
+    shadowCache =
+        createImage(device.pdevice, device.ldevice, shadowSize.width,
+                    shadowSize.height, 1, VK_SAMPLE_COUNT_1_BIT, format,
+                    VK_IMAGE_TILING_OPTIMAL,
+                    VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT |
+                        VK_IMAGE_USAGE_TRANSFER_SRC_BIT,
+                    VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+    addImageView(shadowCache, device.ldevice, format,
+                 VK_IMAGE_ASPECT_DEPTH_BIT, 1);
+    trackMemory(residency, MEMORY_ATTACHMENT, shadowCache.size);
+
+    createShadowCascades(device, shadowCascades, format, MAX_FRAMES_IN_FLIGHT);
+    for (const srShadowCascadeFrame& frame : shadowCascades.frames) {
+        trackMemory(residency, MEMORY_ATTACHMENT, frame.maps.size);
+    }
+
+    VkSamplerCreateInfo createInfo{};
+    createInfo.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
+    createInfo.magFilter = VK_FILTER_LINEAR;
+    createInfo.minFilter = VK_FILTER_LINEAR;
+    createInfo.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+    createInfo.addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+    createInfo.addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+    createInfo.borderColor = VK_BORDER_COLOR_FLOAT_OPAQUE_WHITE;
+    createInfo.compareEnable = VK_TRUE;
+    createInfo.compareOp = VK_COMPARE_OP_LESS_OR_EQUAL;
+    createInfo.mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST;
+    createInfo.maxLod = 0.0f;
+
+    if (vkCreateSampler(device.ldevice, &createInfo, nullptr,
+                        &shadowSampler) != VK_SUCCESS) {
+        throw std::runtime_error("failed to create shadow sampler!");
+    }
+}
+
+// A pass with a single depth attachment, the dependencies order it with
+// what is recorded before and after it.
+static VkRenderPass createDepthRenderPass(
+    VkDevice device, const VkAttachmentDescription& depthDesc,
+    const std::array<VkSubpassDependency, 2>& subDep) {
+    VkAttachmentReference depthRef{};
+    depthRef.attachment = 0;
+    depthRef.layout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+
+    VkSubpassDescription subpassDesc{};
+    subpassDesc.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
+    subpassDesc.colorAttachmentCount = 0;
+    subpassDesc.pDepthStencilAttachment = &depthRef;
+
+    VkRenderPassCreateInfo rpc{};
+    rpc.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
+    rpc.subpassCount = 1;
+    rpc.pSubpasses = &subpassDesc;
+    rpc.dependencyCount = subDep.size();
+    rpc.pDependencies = subDep.data();
+    rpc.attachmentCount = 1;
+    rpc.pAttachments = &depthDesc;
+
+    VkRenderPass pass;
+    if (vkCreateRenderPass(device, &rpc, nullptr, &pass) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to create Shadow Render Pass!");
+    }
+    return pass;
+}
+
+static VkFramebuffer createDepthFramebuffer(VkDevice device,
+                                            VkRenderPass pass,
+                                            const vkImage& image,
+                                            VkExtent2D size) {
+    std::array<VkImageView, 1> attachments = {image.view.value()};
+
+    VkFramebufferCreateInfo framebufferInfo{};
+    framebufferInfo.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
+    framebufferInfo.renderPass = pass;
+    framebufferInfo.attachmentCount =
+        static_cast<uint32_t>(attachments.size());
+    framebufferInfo.pAttachments = attachments.data();
+    framebufferInfo.width = size.width;
+    framebufferInfo.height = size.height;
+    framebufferInfo.layers = 1;
+
+    VkFramebuffer framebuffer;
+    if (vkCreateFramebuffer(device, &framebufferInfo, nullptr, &framebuffer) !=
+        VK_SUCCESS) {
+        throw std::runtime_error("failed to create framebuffer!");
+    }
+    return framebuffer;
 }
 
-
 void SceneRenderer::createShadowResources() {
-    // create images
     VkFormat format = findDepthFormat();
 
-    for (auto& shadowImage : shadowImages) {
-        shadowImage =
-            createImage(device.pdevice, device.ldevice, shadowSize.width, shadowSize.height, 1,
-                        VK_SAMPLE_COUNT_1_BIT, format, VK_IMAGE_TILING_OPTIMAL,
-                        VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT |
-                            VK_IMAGE_USAGE_SAMPLED_BIT,
-                        VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
-        addImageView(shadowImage, device.ldevice, format,
-                     VK_IMAGE_ASPECT_DEPTH_BIT, 1);
-    }
-
     VkAttachmentDescription depthDesc{};
     depthDesc.format = format;
     depthDesc.samples = VK_SAMPLE_COUNT_1_BIT;
-    depthDesc.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-    depthDesc.finalLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
-    depthDesc.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
+    // the static casters were copied in
+    depthDesc.initialLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+    // the main pass samples it
+    depthDesc.finalLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL;
+    depthDesc.loadOp = VK_ATTACHMENT_LOAD_OP_LOAD;
     depthDesc.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
     depthDesc.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
     depthDesc.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
 
-    VkAttachmentReference depthRef{};
-    depthRef.attachment = 0;
-    depthRef.layout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
-
-    VkSubpassDescription subpassDesc{};
-    subpassDesc.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
-    subpassDesc.colorAttachmentCount = 0;
-    subpassDesc.pDepthStencilAttachment = &depthRef;
-
     // giving an external dependency is like putting a pipeline barrier
     // https://themaister.net/blog/2019/08/14/yet-another-blog-explaining-vulkan-synchronization/
 
@@ -753,60 +2014,70 @@ void SceneRenderer::createShadowResources() {
     subDep[0].srcSubpass = VK_SUBPASS_EXTERNAL;
     subDep[0].dstSubpass = 0;
     subDep[0].srcStageMask =
-        VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;  // all commands before need to
-                                                // have completed the fragemtn
-                                                // shader stage
+        VK_PIPELINE_STAGE_TRANSFER_BIT;  // the copy of the cache has to be
+                                         // done
     subDep[0].dstStageMask =
-        VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT;  // before entering this
-                                                     // stage (we will use in
-                                                     // fragemnt shader stage)
-    subDep[0].srcAccessMask =
-        VK_ACCESS_SHADER_READ_BIT;  // we wait until all reads to the depth
-                                    // buffer have completed
-    subDep[0].dstAccessMask =
-        VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;  // before writting to it
-    subDep[0].dependencyFlags = VK_DEPENDENCY_BY_REGION_BIT;  // welll
+        VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT |
+        VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;  // before the depth tests
+                                                    // read or write it
+    subDep[0].srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    subDep[0].dstAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT |
+                              VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+    // the copy isn't a framebuffer stage, it's done for the whole image
+    subDep[0].dependencyFlags = 0;
 
     subDep[1].srcSubpass = 0;
     subDep[1].dstSubpass = VK_SUBPASS_EXTERNAL;
-    subDep[1].srcStageMask = VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+    subDep[1].srcStageMask = VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT |
+                             VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
     subDep[1].dstStageMask = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
     subDep[1].srcAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
     subDep[1].dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
-    subDep[1].dependencyFlags = VK_DEPENDENCY_BY_REGION_BIT;
-
-    VkRenderPassCreateInfo rpc{};
-    rpc.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
-    rpc.subpassCount = 1;
-    rpc.pSubpasses = &subpassDesc;
-    rpc.dependencyCount = subDep.size();
-    rpc.pDependencies = subDep.data();
-    rpc.attachmentCount = 1;
-    rpc.pAttachments = &depthDesc;
+    // the main pass samples any texel of the atlas, not the same pixel
+    subDep[1].dependencyFlags = 0;
 
-    if (vkCreateRenderPass(device.ldevice, &rpc, nullptr, &shadowRenderPass) !=
-        VK_SUCCESS) {
-        throw std::runtime_error("Failed to create Shadow Render Pass!");
+    shadowRenderPass = createDepthRenderPass(device.ldevice, depthDesc, subDep);
+    for (size_t i = 0; i < shadowImages.size(); i++) {
+        shadowFrameBuffer[i] = createDepthFramebuffer(
+            device.ldevice, shadowRenderPass, shadowImages[i], shadowSize);
     }
 
-    for (size_t i = 0; i < shadowImages.size(); i++) {
-        std::array<VkImageView, 1> attachments = {shadowImages[i].view.value()};
+    // the cache starts over and is only copied from. Compatible with the
+    // pass above, the same pipeline draws in both
+    depthDesc.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+    depthDesc.finalLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+    depthDesc.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
 
-        VkFramebufferCreateInfo framebufferInfo{};
-        framebufferInfo.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
-        framebufferInfo.renderPass = shadowRenderPass;
-        framebufferInfo.attachmentCount =
-            static_cast<uint32_t>(attachments.size());
-        framebufferInfo.pAttachments = attachments.data();
-        framebufferInfo.width = shadowSize.width;
-        framebufferInfo.height = shadowSize.height;
-        framebufferInfo.layers = 1;
+    // the copies of the frames before read what gets cleared
+    subDep[0].srcStageMask = VK_PIPELINE_STAGE_TRANSFER_BIT;
+    subDep[0].srcAccessMask = 0;
+    subDep[0].dstStageMask = VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT |
+                             VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+    subDep[0].dstAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
 
-        if (vkCreateFramebuffer(device.ldevice, &framebufferInfo, nullptr,
-                                &shadowFrameBuffer[i]) != VK_SUCCESS) {
-            throw std::runtime_error("failed to create framebuffer!");
-        }
-    }
+    subDep[1].srcStageMask = VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+    subDep[1].dstStageMask = VK_PIPELINE_STAGE_TRANSFER_BIT;
+    subDep[1].srcAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+    subDep[1].dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+    subDep[1].dependencyFlags = 0;
+
+    shadowCacheRenderPass =
+        createDepthRenderPass(device.ldevice, depthDesc, subDep);
+    shadowCacheFrameBuffer = createDepthFramebuffer(
+        device.ldevice, shadowCacheRenderPass, shadowCache, shadowSize);
+
+    // the same from what a full update left, the tiles drawn again are
+    // cleared one by one
+    depthDesc.initialLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+    depthDesc.loadOp = VK_ATTACHMENT_LOAD_OP_LOAD;
+    // the tiles the last update drew are loaded
+    subDep[0].srcStageMask = VK_PIPELINE_STAGE_TRANSFER_BIT |
+                             VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+    subDep[0].srcAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+    subDep[0].dstAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT |
+                              VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+    shadowCacheUpdatePass =
+        createDepthRenderPass(device.ldevice, depthDesc, subDep);
 
     shadowShader_h = internal_resources.scene->sh_mg.create("Shadow Shader");
     auto& shadowShader = internal_resources.scene->sh_mg.get(shadowShader_h);
@@ -818,9 +2089,8 @@ void SceneRenderer::createShadowResources() {
     auto& shadowMaterial =
         internal_resources.scene->mat_mg.get(shadowMaterial_h);
 
+    // the light comes with the model matrix, it has no parameters
     shadowMaterial.setShader(shadowShader_h, shadowShader, TextureHandle());
-    
-    shadowMaterial.setParameterValue<ParameterTypes::INT_PARM>(0, 0);
 
     updateShader(shadowShader_h, internal_resources, shadowRenderPass, VK_SAMPLE_COUNT_1_BIT);
     updateMaterial(shadowMaterial_h, internal_resources);
@@ -851,8 +2121,34 @@ void SceneRenderer::createGlobalDescriptorSetLayouts() {
     lightsLayoutBinding.stageFlags =
         VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT;
 
-    std::array<VkDescriptorSetLayoutBinding, 3> globalBindings = {
-        uboLayoutBinding, samplerLayoutBinding, lightsLayoutBinding};
+    // the light clusters and their light indices
+    VkDescriptorSetLayoutBinding clustersLayoutBinding = lightsLayoutBinding;
+    clustersLayoutBinding.binding = 3;
+    clustersLayoutBinding.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
+    VkDescriptorSetLayoutBinding lightIndicesLayoutBinding =
+        clustersLayoutBinding;
+    lightIndicesLayoutBinding.binding = 4;
+
+    VkDescriptorSetLayoutBinding shadowAtlasLayoutBinding{};
+    shadowAtlasLayoutBinding.binding = 5;
+    shadowAtlasLayoutBinding.descriptorCount = 1;
+    shadowAtlasLayoutBinding.descriptorType =
+        VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+    shadowAtlasLayoutBinding.pImmutableSamplers = nullptr;
+    shadowAtlasLayoutBinding.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
+
+    // the directional light's cascades, the shadow pass reads the matrices
+    VkDescriptorSetLayoutBinding cascadesLayoutBinding = uboLayoutBinding;
+    cascadesLayoutBinding.binding = 6;
+    VkDescriptorSetLayoutBinding cascadeMapsLayoutBinding =
+        shadowAtlasLayoutBinding;
+    cascadeMapsLayoutBinding.binding = 7;
+
+    std::vector<VkDescriptorSetLayoutBinding> globalBindings = {
+        uboLayoutBinding,          samplerLayoutBinding,
+        lightsLayoutBinding,       clustersLayoutBinding,
+        lightIndicesLayoutBinding, shadowAtlasLayoutBinding,
+        cascadesLayoutBinding,     cascadeMapsLayoutBinding};
 
     VkDescriptorSetLayoutCreateInfo globalLayoutInfo{};
     globalLayoutInfo.sType =
@@ -865,6 +2161,9 @@ void SceneRenderer::createGlobalDescriptorSetLayouts() {
                                     &globalDescriptorSetLayout) != VK_SUCCESS) {
         throw std::runtime_error("failed to create descriptor set layout!");
     }
+
+    globalDescTemplate = createDescriptorTemplate(device, globalBindings,
+                                                  globalDescriptorSetLayout);
 }
 
 void SceneRenderer::createFrameBuffers() {
@@ -934,6 +2233,7 @@ void SceneRenderer::createDepthResources() {
 
     gbg::addImageView(depthImage, device.ldevice, depthFormat,
                       VK_IMAGE_ASPECT_DEPTH_BIT, 1);
+    trackMemory(residency, MEMORY_ATTACHMENT, depthImage.size);
 
     transitionImageLayout(depthImage.image, depthFormat,
                           VK_IMAGE_LAYOUT_UNDEFINED,
@@ -1050,7 +2350,8 @@ void SceneRenderer::createTextureSampler() {
 
     createInfo.mipmapMode = VK_SAMPLER_MIPMAP_MODE_LINEAR;
     createInfo.minLod = 0.0f;
-    createInfo.maxLod = static_cast<float>(3);  // TODO: define constant
+    // uploads generate the whole chain
+    createInfo.maxLod = VK_LOD_CLAMP_NONE;
     createInfo.mipLodBias = 0.0f;
 
     if (vkCreateSampler(device.ldevice, &createInfo, nullptr,
@@ -1059,6 +2360,64 @@ void SceneRenderer::createTextureSampler() {
     }
 }
 
+void SceneRenderer::createTextureUploader() {
+    // leave a core for the render thread
+    uint32_t workers =
+        std::clamp(std::thread::hardware_concurrency(), 2u, 9u) - 1;
+    textureLoader = std::make_unique<srTextureLoader>();
+    startTextureLoader(device, *textureLoader, workers, textureStagingSize);
+
+    VkCommandPoolCreateInfo poolInfo{};
+    poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+    poolInfo.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+    poolInfo.queueFamilyIndex =
+        getGraphicQueueFamilyIndex(device.pdevice).value();
+    if (vkCreateCommandPool(device.ldevice, &poolInfo, nullptr,
+                            &uploadCmdPool) != VK_SUCCESS) {
+        throw std::runtime_error("failed to create command pool!");
+    }
+
+    createDownsampler(device, downsampler, "data/shaders/downsample.comp");
+    createClusterCuller(device, clusterCuller, "data/shaders/cluster_cull.comp",
+                        MAX_FRAMES_IN_FLIGHT);
+    createStagingRing(device, meshStaging, meshStagingSize);
+    createDebugDraw(device, debugDraw, "data/shaders/debug.vert",
+                    "data/shaders/debug.frag", renderPass, msaaSamples,
+                    MAX_FRAMES_IN_FLIGHT);
+    createPlaceholderTexture();
+}
+
+void SceneRenderer::createPlaceholderTexture() {
+    VkFormat format = VK_FORMAT_R8G8B8A8_UNORM;
+    placeholderTexture = createImage(
+        device.pdevice, device.ldevice, 1, 1, 1, VK_SAMPLE_COUNT_1_BIT, format,
+        VK_IMAGE_TILING_OPTIMAL,
+        VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT,
+        VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+    addImageView(placeholderTexture, device.ldevice, format,
+                 VK_IMAGE_ASPECT_COLOR_BIT, 1);
+
+    const uint32_t white = 0xffffffff;
+    gbg::vkBuffer stagingBuffer = gbg::createBuffer(
+        device, sizeof(white), VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+        VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
+            VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+    void* data;
+    vkMapMemory(device.ldevice, stagingBuffer.memory, 0, sizeof(white), 0,
+                &data);
+    memcpy(data, &white, sizeof(white));
+    vkUnmapMemory(device.ldevice, stagingBuffer.memory);
+
+    transitionImageLayout(placeholderTexture.image, format,
+                          VK_IMAGE_LAYOUT_UNDEFINED,
+                          VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1);
+    copyBufferToImage(stagingBuffer.buffer, placeholderTexture.image, 1, 1);
+    transitionImageLayout(placeholderTexture.image, format,
+                          VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+                          VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, 1);
+    destroyBuffer(device, stagingBuffer);
+}
+
 void SceneRenderer::createGlobalShaderResources() {
     // camera
     VkDeviceSize bufferSize = sizeof(UniformBufferObjects);
@@ -1076,216 +2435,220 @@ void SceneRenderer::createGlobalShaderResources() {
     }
 
     // lights
-    bufferSize = sizeof(vkLight) * max_light;
-
-    for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; ++i) {
-        lightsBuffers[i] = gbg::createBuffer(
-            device, bufferSize, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
-            VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
-                VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
-        vkMapMemory(device.ldevice, lightsBuffers[i].memory, 0, bufferSize, 0,
-                    &lightsBuffersMapped[i]);
+    for (uint32_t i = 0; i < MAX_FRAMES_IN_FLIGHT; ++i) {
+        createLightBuffer(i, minLightCapacity);
     }
+    createLightClusters(device, lightClusters,
+                        "data/shaders/light_clusters.comp",
+                        MAX_FRAMES_IN_FLIGHT);
 }
 
-void SceneRenderer::createGlobalDescriptorPool() {
-    std::array<VkDescriptorPoolSize, 3> descriptorPoolSizes{};
-    descriptorPoolSizes[0].type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-    descriptorPoolSizes[0].descriptorCount =
-        static_cast<uint32_t>(MAX_FRAMES_IN_FLIGHT);
-    descriptorPoolSizes[1].type = VK_DESCRIPTOR_TYPE_SAMPLER;
-    descriptorPoolSizes[1].descriptorCount =
-        static_cast<uint32_t>(MAX_FRAMES_IN_FLIGHT);
-    descriptorPoolSizes[2].type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
-    descriptorPoolSizes[2].descriptorCount =
-        static_cast<uint32_t>(MAX_FRAMES_IN_FLIGHT);
-
-    VkDescriptorPoolCreateInfo poolInfo{};
-    poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
-    poolInfo.poolSizeCount = static_cast<uint32_t>(descriptorPoolSizes.size());
-    poolInfo.pPoolSizes = descriptorPoolSizes.data();
-    poolInfo.maxSets = static_cast<uint32_t>(MAX_FRAMES_IN_FLIGHT);
+void SceneRenderer::createLightBuffer(uint32_t frame, uint32_t capacity) {
+    VkDeviceSize bufferSize = sizeof(vkLight) * capacity;
+    lightsBuffers[frame] = gbg::createBuffer(
+        device, bufferSize, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+        VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
+            VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+    vkMapMemory(device.ldevice, lightsBuffers[frame].memory, 0, bufferSize, 0,
+                &lightsBuffersMapped[frame]);
+}
 
-    if (vkCreateDescriptorPool(device.ldevice, &poolInfo, nullptr,
-                               &globalDescriptorPool) != VK_SUCCESS) {
-        throw std::runtime_error("failed to create descriptor pool!");
-    }
+void SceneRenderer::createGlobalDescriptorPool() {
+    globalDescAllocator = createDescriptorAllocator(
+        device, MAX_FRAMES_IN_FLIGHT,
+        {{VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 2.0f},
+         {VK_DESCRIPTOR_TYPE_SAMPLER, 1.0f},
+         {VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 3.0f},
+         {VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 2.0f}});
 }
 
 void SceneRenderer::createMaterialDescriptorPool() {
-    std::array<VkDescriptorPoolSize, 2> descriptorPoolSizes{};
-    descriptorPoolSizes[0].type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-    descriptorPoolSizes[0].descriptorCount = max_mat;
-
-    descriptorPoolSizes[1].type = VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE;
-    descriptorPoolSizes[1].descriptorCount = static_cast<uint32_t>(max_tex);
+    // starts small, the allocator chains bigger pools when it runs out
+    materialDescAllocator = createDescriptorAllocator(
+        device, 64,
+        {{VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 1.0f},
+         {VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE, 4.0f}});
+}
 
-    VkDescriptorPoolCreateInfo poolInfo{};
-    poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
-    poolInfo.poolSizeCount = static_cast<uint32_t>(descriptorPoolSizes.size());
-    poolInfo.pPoolSizes = descriptorPoolSizes.data();
-    poolInfo.maxSets = max_mat + max_tex;
-    poolInfo.flags = VK_DESCRIPTOR_POOL_CREATE_FREE_DESCRIPTOR_SET_BIT;
-    if (vkCreateDescriptorPool(device.ldevice, &poolInfo, nullptr,
-                               &materialDescPool) != VK_SUCCESS) {
-        throw std::runtime_error("failed to create descriptor pool!");
+void SceneRenderer::createFrameDescriptorPools() {
+    for (auto& allocator : frameDescAllocators) {
+        allocator = createDescriptorAllocator(
+            device, 128,
+            {{VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 1.0f},
+             {VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 2.0f},
+             {VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE, 2.0f},
+             {VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 2.0f},
+             {VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1.0f}},
+            true);
     }
 }
 
 void SceneRenderer::createGlobalDescriptorSets() {
-    std::vector<VkDescriptorSetLayout> layouts(MAX_FRAMES_IN_FLIGHT,
-                                               globalDescriptorSetLayout);
-
-    VkDescriptorSetAllocateInfo setInfo{};
-    setInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
-    setInfo.descriptorPool = globalDescriptorPool;
-    setInfo.descriptorSetCount = static_cast<uint32_t>(layouts.size());
-    setInfo.pSetLayouts = layouts.data();
+    for (auto& set : globalDescriptorSets) {
+        set = allocateDescriptorSet(device, globalDescAllocator,
+                                    globalDescriptorSetLayout);
+    }
 
-    if (vkAllocateDescriptorSets(device.ldevice, &setInfo,
-                                 globalDescriptorSets.data()) != VK_SUCCESS) {
-        throw std::runtime_error("failed to create descriptor sets");
+    for (uint32_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
+        writeGlobalDescriptorSet(i);
     }
+}
 
+// Again when the frame's light buffer grows, once its fence was waited.
+void SceneRenderer::writeGlobalDescriptorSet(uint32_t i) {
     // Can it be because bouth frames sample sampler?
     VkDescriptorImageInfo imageInfo{};
     imageInfo.sampler = textureSampler;
     imageInfo.imageLayout = VK_IMAGE_LAYOUT_UNDEFINED;
     imageInfo.imageView = VK_NULL_HANDLE;
 
-    for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
-        VkDescriptorBufferInfo bufferInfo{};
-        bufferInfo.buffer = globalBuffers[i].buffer;
-        bufferInfo.range = sizeof(UniformBufferObjects);
-        bufferInfo.offset = 0;
+    std::vector<std::byte> data(globalDescTemplate.dataSize);
+    setTemplateImage(globalDescTemplate, data.data(), 1, 0, imageInfo);
 
-        VkDescriptorBufferInfo lightBufferInfo{};
-        lightBufferInfo.buffer = lightsBuffers[i].buffer;
-        lightBufferInfo.range = lightsBuffers[i].size;
-        lightBufferInfo.offset = 0;
-
-        std::array<VkWriteDescriptorSet, 3> descriptorWrites{};
-        descriptorWrites[0].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-        descriptorWrites[0].dstSet = globalDescriptorSets[i];
-        descriptorWrites[0].dstBinding = 0;
-        descriptorWrites[0].dstArrayElement = 0;
-        descriptorWrites[0].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-        descriptorWrites[0].descriptorCount = 1;
-        descriptorWrites[0].pBufferInfo = &bufferInfo;
-        // Only needed for other types of descriptors
-        descriptorWrites[0].pImageInfo = nullptr;
-        descriptorWrites[0].pTexelBufferView = nullptr;
-
-        descriptorWrites[1].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-        descriptorWrites[1].dstSet = globalDescriptorSets[i];
-        descriptorWrites[1].dstBinding = 1;
-        descriptorWrites[1].dstArrayElement = 0;
-        descriptorWrites[1].descriptorType = VK_DESCRIPTOR_TYPE_SAMPLER;
-        descriptorWrites[1].descriptorCount = 1;
-        descriptorWrites[1].pBufferInfo = nullptr;
-        // Only needed for other types of descriptors
-        descriptorWrites[1].pImageInfo = &imageInfo;
-        descriptorWrites[1].pTexelBufferView = nullptr;
-
-        descriptorWrites[2].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-        descriptorWrites[2].dstSet = globalDescriptorSets[i];
-        descriptorWrites[2].dstBinding = 2;
-        descriptorWrites[2].dstArrayElement = 0;
-        descriptorWrites[2].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
-        descriptorWrites[2].descriptorCount = 1;
-        descriptorWrites[2].pBufferInfo = &lightBufferInfo;
-        // Only needed for other types of descriptors
-        descriptorWrites[2].pImageInfo = nullptr;
-        descriptorWrites[2].pTexelBufferView = nullptr;
-
-        vkUpdateDescriptorSets(device.ldevice,
-                               static_cast<uint32_t>(descriptorWrites.size()),
-                               descriptorWrites.data(), 0, nullptr);
-    }
+    VkDescriptorBufferInfo bufferInfo{};
+    bufferInfo.buffer = globalBuffers[i].buffer;
+    bufferInfo.range = sizeof(UniformBufferObjects);
+    bufferInfo.offset = 0;
+    setTemplateBuffer(globalDescTemplate, data.data(), 0, 0, bufferInfo);
+
+    VkDescriptorBufferInfo lightBufferInfo{};
+    lightBufferInfo.buffer = lightsBuffers[i].buffer;
+    lightBufferInfo.range = lightsBuffers[i].size;
+    lightBufferInfo.offset = 0;
+    setTemplateBuffer(globalDescTemplate, data.data(), 2, 0,
+                      lightBufferInfo);
+
+    const srLightClusterFrame& clusterFrame = lightClusters.frames[i];
+    VkDescriptorBufferInfo clustersInfo{clusterFrame.clusters.buffer, 0,
+                                        VK_WHOLE_SIZE};
+    VkDescriptorBufferInfo lightIndicesInfo{clusterFrame.indices.buffer, 0,
+                                            VK_WHOLE_SIZE};
+    setTemplateBuffer(globalDescTemplate, data.data(), 3, 0, clustersInfo);
+    setTemplateBuffer(globalDescTemplate, data.data(), 4, 0,
+                      lightIndicesInfo);
+
+    VkDescriptorImageInfo shadowInfo{};
+    shadowInfo.sampler = shadowSampler;
+    shadowInfo.imageView = shadowImages[i].view.value();
+    shadowInfo.imageLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL;
+    setTemplateImage(globalDescTemplate, data.data(), 5, 0, shadowInfo);
+
+    const srShadowCascadeFrame& cascadeFrame = shadowCascades.frames[i];
+    VkDescriptorBufferInfo cascadesInfo{cascadeFrame.params.buffer, 0,
+                                        VK_WHOLE_SIZE};
+    setTemplateBuffer(globalDescTemplate, data.data(), 6, 0, cascadesInfo);
+    VkDescriptorImageInfo cascadeMapsInfo = shadowInfo;
+    cascadeMapsInfo.imageView = cascadeFrame.maps.view.value();
+    setTemplateImage(globalDescTemplate, data.data(), 7, 0, cascadeMapsInfo);
+
+    updateDescriptorSet(device, globalDescTemplate,
+                        globalDescriptorSets[i], data.data());
 }
 
 void SceneRenderer::updateMaterialDescriptorSet(MaterialHandle h,
                                                 InternalSceneData& scene_data) {
+    auto& srmat = scene_data.srmat_mg.getRelated(h);
+    if (srmat.descriptor_set == VK_NULL_HANDLE) return;
+
     // no volem cap frame dibuixant-se
     vkDeviceWaitIdle(device.ldevice);
 
+    writeMaterialDescriptorSet(h, scene_data);
+}
+
+void SceneRenderer::writeMaterialDescriptorSet(MaterialHandle h,
+                                               InternalSceneData& scene_data) {
     auto& srmat = scene_data.srmat_mg.getRelated(h);
     auto& mat = scene_data.scene->mat_mg.get(h);
 
-    std::vector<VkWriteDescriptorSet> descWrites = {};
-
-    VkDescriptorBufferInfo bufferInfo{};
-    bufferInfo.buffer = srmat.paramBuffer.buffer;
-    bufferInfo.offset = 0;
-    bufferInfo.range = VK_WHOLE_SIZE;
+    const vkDescriptorTemplate& tmpl =
+        scene_data.srsh_mg.getRelated(mat.getShaderHandle()).descTemplate;
+    std::byte* data = srmat.descriptorData.data();
 
-    if (not mat.getValues().empty()) {
-        VkWriteDescriptorSet writeDesc{};
+    if (hasTemplateBinding(tmpl, 0)) {
+        VkDescriptorBufferInfo bufferInfo{};
+        bufferInfo.buffer = srmat.paramBuffer.buffer;
+        bufferInfo.offset = 0;
+        bufferInfo.range = VK_WHOLE_SIZE;
+        setTemplateBuffer(tmpl, data, 0, 0, bufferInfo);
+    }
 
-        writeDesc.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-        writeDesc.dstSet = srmat.descriptor_set;
-        writeDesc.dstBinding = 0;
-        writeDesc.dstArrayElement = 0;
-        writeDesc.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-        writeDesc.descriptorCount = 1;
-        writeDesc.pImageInfo = nullptr;
-        writeDesc.pTexelBufferView = nullptr;
-        writeDesc.pBufferInfo = &bufferInfo;
-        descWrites.push_back(writeDesc);
+    srmat.textureGeneration = 0;
+    if (hasTemplateBinding(tmpl, 1)) {
+        uint32_t element = 0;
+        for (const parm_vt& val : mat.getValues()) {
+            if (auto th = std::get_if<TextureHandle>(&val)) {
+                const srTexture& tex = scene_data.srtx_mg.getRelated(*th);
+                VkDescriptorImageInfo imageInfo{};
+                imageInfo.sampler = textureSampler;
+                imageInfo.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+                if (tex.resident) {
+                    imageInfo.imageView = tex.textureImage.view.value();
+                } else {
+                    imageInfo.imageView = placeholderTexture.view.value();
+                }
+                srmat.textureGeneration += tex.generation;
+                setTemplateImage(tmpl, data, 1, element++, imageInfo);
+            }
+        }
     }
 
-    std::vector<VkDescriptorImageInfo> imageInfos;
+    updateDescriptorSet(device, tmpl, srmat.descriptor_set, data);
+}
 
-    // fun range stuff!
+void SceneRenderer::refreshMaterialDescriptorSet(
+    MaterialHandle h, InternalSceneData& scene_data) {
+    auto& srmat = scene_data.srmat_mg.getRelated(h);
+    auto& mat = scene_data.scene->mat_mg.get(h);
+    if (srmat.descriptor_set == VK_NULL_HANDLE) return;
+    // switched shader, updateMaterial recreates the set anyway
+    if (srmat.layout !=
+        scene_data.srsh_mg.getRelated(mat.getShaderHandle()).layout)
+        return;
+
+    // generations only grow, any new image changes the sum
+    uint32_t generation = 0;
     for (const parm_vt& val : mat.getValues()) {
         if (auto th = std::get_if<TextureHandle>(&val)) {
-            VkDescriptorImageInfo imageInfo{};
-            imageInfo.sampler = textureSampler;
-            imageInfo.imageView =
-                scene_data.srtx_mg.getRelated(*th).textureImage.view.value();
-            imageInfo.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
-            imageInfos.push_back(imageInfo);
+            generation += scene_data.srtx_mg.getRelated(*th).generation;
         }
     }
+    if (generation == srmat.textureGeneration) return;
+
+    // frames in flight still read the old set, write a new one instead of
+    // waiting for the device
+    retiredMaterialSets[currentFrame].push_back(
+        {srmat.layout, srmat.descriptor_set});
+    srmat.descriptor_set =
+        allocateDescriptorSet(device, materialDescAllocator, srmat.layout);
+    writeMaterialDescriptorSet(h, scene_data);
+}
 
-    if (imageInfos.size() > 0) {
-        VkWriteDescriptorSet writeDesc{};
-        writeDesc.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-        writeDesc.dstSet = srmat.descriptor_set;
-        writeDesc.dstBinding = 1;
-        writeDesc.dstArrayElement = 0;
-        writeDesc.descriptorType = VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE;
-        writeDesc.descriptorCount = static_cast<uint32_t>(imageInfos.size());
-        writeDesc.pImageInfo = imageInfos.data();
-        writeDesc.pTexelBufferView = nullptr;
-        writeDesc.pBufferInfo = nullptr;
-        descWrites.push_back(writeDesc);
+void SceneRenderer::releaseRetiredMaterialSets(uint32_t frame) {
+    for (auto [layout, set] : retiredMaterialSets[frame]) {
+        releaseDescriptorSet(materialDescAllocator, layout, set);
     }
-
-    if (descWrites.empty()) return;
-    vkUpdateDescriptorSets(device.ldevice, descWrites.size(), descWrites.data(),
-                           0, nullptr);
+    retiredMaterialSets[frame].clear();
 }
 
 void SceneRenderer::createMaterialDescriptorSet(MaterialHandle h,
                                                 InternalSceneData& scene_data) {
     auto& mat = scene_data.scene->mat_mg.get(h);
-    if (mat.getValues().empty()) return;  // has no parameters or textures
     ShaderHandle shh = mat.getShaderHandle();
 
     srShader& srsh = scene_data.srsh_mg.getRelated(shh);
     srMaterial& srmat = scene_data.srmat_mg.getRelated(h);
+    srmat.descriptor_set = VK_NULL_HANDLE;
+    srmat.layout = VK_NULL_HANDLE;
+    if (mat.getValues().empty()) return;  // has no parameters or textures
 
-    VkDescriptorSetAllocateInfo setInfo{};
-    setInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
-    setInfo.descriptorPool = materialDescPool;
-    setInfo.descriptorSetCount = 1;
-    setInfo.pSetLayouts = &srsh.layout;
+    if (srsh.layout == VK_NULL_HANDLE) return;  // shader without bindings
 
-    if (vkAllocateDescriptorSets(device.ldevice, &setInfo,
-                                 &srmat.descriptor_set) != VK_SUCCESS) {
-        throw std::runtime_error("failed to create descriptor sets");
-    }
+    srmat.descriptor_set =
+        allocateDescriptorSet(device, materialDescAllocator, srsh.layout);
+    srmat.layout = srsh.layout;
+    // sized once, later updates write in place
+    srmat.descriptorData.assign(srsh.descTemplate.dataSize, std::byte{0});
 }
 
 void SceneRenderer::createCommandBuffer() {
@@ -1323,7 +2686,9 @@ void SceneRenderer::recordDrawScene(
 
     std::queue<std::pair<SceneTreeHandle, glm::mat4>> Q;
     Q.push({root, glm::mat4(1.f)});
+    size_t modelsVisited = 0;
 
+    srShader* overrideShader = nullptr;
     if (override) {
         bindMaterial(commandBuffer, shadowMaterial_h, internal_resources);
         
@@ -1332,14 +2697,20 @@ void SceneRenderer::recordDrawScene(
         vkCmdSetScissor(commandBuffer, 0, 1, &scissor);
 
         Material& mt = internal_resources.scene->mat_mg.get(override);
-        srShader& srsh = internal_resources.srsh_mg.getRelated(
+        overrideShader = &internal_resources.srsh_mg.getRelated(
             mt.getShaderHandle());
+    }
+
+    // quantized positions are decoded by the model matrix
+    auto pushModel = [&](const srShader& srsh, const srMesh& mesh) {
         PerObjectPushConstant pc{};
-        pc.model = accumulated_transform;
+        pc.model = accumulated_transform * mesh.dequantize;
+        pc.lightIndex = shadowLight;
+        pc.cascade = shadowCascade;
         vkCmdPushConstants(commandBuffer, srsh.pipeline.layout,
                            VK_SHADER_STAGE_VERTEX_BIT, 0,
                            sizeof(PerObjectPushConstant), &pc);
-    }
+    };
 
     while (not Q.empty()) {
         SceneTreeHandle visited = Q.front().first;
@@ -1358,7 +2729,18 @@ void SceneRenderer::recordDrawScene(
                     TracyVkZone(tracyCtx[currentFrame], commandBuffer,
                                 "DrawModel");
                     Model& md = md_mg.get(mh);
+                    srModelDraw draw = modelDraws[modelsVisited++];
+                    if (override) {
+                        bool casts =
+                            shadowCascade == noShadowCascade
+                                ? draw.dynamicShadow == shadowCastersDynamic
+                                : ((draw.cascades >> shadowCascade) & 1u) != 0;
+                        if (not casts) return;
+                        draw.lod += lodSelection.shadowBias;
+                        draw.clusterSlot = noClusterDraw;
+                    }
 
+                    srShader* srsh = overrideShader;
                     if (not override) {
 
                         bindMaterial(commandBuffer, md.getMaterial(), active_scene_data);
@@ -1368,74 +2750,37 @@ void SceneRenderer::recordDrawScene(
                         vkCmdSetScissor(commandBuffer, 0, 1, &scissor);
                         
                         Material& mt = scene->mat_mg.get(md.getMaterial());
-                        srShader& srsh = active_scene_data.srsh_mg.getRelated(
+                        srsh = &active_scene_data.srsh_mg.getRelated(
                             mt.getShaderHandle());
-                        
-                        PerObjectPushConstant pc{};
-                        pc.model = accumulated_transform;
-                        vkCmdPushConstants(commandBuffer, srsh.pipeline.layout,
-                                           VK_SHADER_STAGE_VERTEX_BIT, 0,
-                                           sizeof(PerObjectPushConstant), &pc);
                     }
 
                     srMesh& mesh =
                         active_scene_data.srmsh_mg.getRelated(md.getMesh());
-
-                    std::vector<VkBuffer> vbuffers;
-                    std::vector<VkDeviceSize> voffsets;
-                    for (const auto& attrb : mesh.vertexAttributes) {
-                        vbuffers.push_back(attrb.buffer.buffer);
-                        voffsets.push_back(0);
+                    // a dropped mesh is uploaded again next frame
+                    mesh.lastUsed = residency.frame;
+                    if (not mesh.resident or mesh.lods.empty()) return;
+                    pushModel(*srsh, mesh);
+
+                    bindMeshVertexBuffers(commandBuffer, mesh);
+                    if (draw.clusterSlot != noClusterDraw) {
+                        drawClusters(clusterCuller, currentFrame,
+                                     commandBuffer, draw.clusterSlot);
+                        return;
+                    }
+                    bindMeshIndexBuffer(commandBuffer, mesh);
+
+                    const srMeshLod& lod = mesh.lods[std::min<size_t>(
+                        draw.lod, mesh.lods.size() - 1)];
+                    for (uint32_t i = lod.firstSubmesh;
+                         i < lod.firstSubmesh + lod.submeshCount; i++) {
+                        const srSubmesh& submesh = mesh.submeshes[i];
+                        vkCmdDrawIndexed(commandBuffer, submesh.indexCount, 1,
+                                         submesh.firstIndex,
+                                         submesh.vertexOffset, 0);
                     }
-
-                    vkCmdBindVertexBuffers(commandBuffer, 0, vbuffers.size(),
-                                           vbuffers.data(), voffsets.data());
-                    vkCmdBindIndexBuffer(commandBuffer, mesh.indexBuffer.buffer,
-                                         0, VK_INDEX_TYPE_UINT32);
-
-                    vkCmdDrawIndexed(commandBuffer, mesh.indexBuffer.size / 4,
-                                     1, 0, 0, 0);
                 },
                 [&](const CameraHandle& empty) {
-                    Model& md = internal_resources.scene->md_mg.getAll()[1];
-
-                    if (not override) {
-
-                        bindMaterial(commandBuffer, md.getMaterial(), internal_resources);
-
-                        vkCmdSetViewport(commandBuffer, 0, 1, &viewport);
-                    
-                        vkCmdSetScissor(commandBuffer, 0, 1, &scissor);
-                        
-                        Material& mt = internal_resources.scene->mat_mg.get(md.getMaterial());
-                        srShader& srsh = internal_resources.srsh_mg.getRelated(
-                            mt.getShaderHandle());
-                        
-                        PerObjectPushConstant pc{};
-                        pc.model = accumulated_transform;
-                        vkCmdPushConstants(commandBuffer, srsh.pipeline.layout,
-                                           VK_SHADER_STAGE_VERTEX_BIT, 0,
-                                           sizeof(PerObjectPushConstant), &pc);
-                    }
-
-                    srMesh& mesh =
-                        active_scene_data.srmsh_mg.getRelated(md.getMesh());
-
-                    std::vector<VkBuffer> vbuffers;
-                    std::vector<VkDeviceSize> voffsets;
-                    for (const auto& attrb : mesh.vertexAttributes) {
-                        vbuffers.push_back(attrb.buffer.buffer);
-                        voffsets.push_back(0);
-                    }
-
-                    vkCmdBindVertexBuffers(commandBuffer, 0, vbuffers.size(),
-                                           vbuffers.data(), voffsets.data());
-                    vkCmdBindIndexBuffer(commandBuffer, mesh.indexBuffer.buffer,
-                                         0, VK_INDEX_TYPE_UINT32);
-
-                    vkCmdDrawIndexed(commandBuffer, mesh.indexBuffer.size / 4,
-                                     1, 0, 0, 0);
-
+                    // prepareModelDraws shows it with the debug draw
                 },
                 [&](const std::monostate& empty) {
 
@@ -1463,13 +2808,14 @@ void SceneRenderer::bindMaterial(VkCommandBuffer commandBuffer, MaterialHandle m
     srMaterial& srmt =
         data.srmat_mg.getRelated(
             math);
+    srmt.lastUsed = residency.frame;
 
     vkCmdBindPipeline(commandBuffer,
                       VK_PIPELINE_BIND_POINT_GRAPHICS,
                       srsh.pipeline.pipeline);
 
 
-    if (not mt.getValues().empty())
+    if (srmt.descriptor_set != VK_NULL_HANDLE)
         vkCmdBindDescriptorSets(
             commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS,
             srsh.pipeline.layout, 1, 1,
@@ -1482,18 +2828,241 @@ void SceneRenderer::bindMaterial(VkCommandBuffer commandBuffer, MaterialHandle m
     
 }
 
-void SceneRenderer::recordCommandBuffer(VkCommandBuffer commandBuffer,
-                                        uint32_t imageIndex) {
-    ZoneScoped;
-    VkCommandBufferBeginInfo beginInfo{};
-    beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
-    beginInfo.flags = 0;
-    beginInfo.pInheritanceInfo = nullptr;
+void SceneRenderer::prepareModelDraws(VkCommandBuffer commandBuffer) {
+    Scene* scene = active_scene_data.scene;
+    auto& md_mg = scene->getModelManager();
+    auto& st_mg = scene->getSceneTreeManager();
 
-    if (vkBeginCommandBuffer(commandBuffer, &beginInfo) != VK_SUCCESS) {
-        throw std::runtime_error("failed to begin recording buffer");
+    beginClusterCulling(clusterCuller, currentFrame, viewProjection,
+                        cameraPosition);
+    lodHistogram.fill(0);
+
+    // the same walk as recordDrawScene, a draw per model it visits. The
+    // models under a dynamic caster node are dynamic casters too. The
+    // lights it finds in the order of the light table, those that moved or
+    // are DIRTY are repacked; the cascades got the old direction of the
+    // directional light, they follow the next frame
+    auto& lh_mg = scene->lh_mg;
+    size_t visits = 0;
+    uint32_t lightVisits = 0;
+    std::vector<LightHandle> dirtyLights;
+    std::queue<std::tuple<SceneTreeHandle, glm::mat4, bool>> Q;
+    Q.push({scene->root, glm::mat4(1.f), false});
+    while (not Q.empty()) {
+        auto [visited, transform, dynamicCaster] = Q.front();
+        Q.pop();
+
+        SceneTreeNode& stn = st_mg.get(visited);
+        transform = transform * stn.getLocalTransform();
+        dynamicCaster =
+            dynamicCaster or dynamicCasterNodes.contains(stn.getRID());
+
+        auto handle = stn.getResourceH();
+        if (const ModelHandle* mh = std::get_if<ModelHandle>(&handle)) {
+            srMesh& mesh =
+                active_scene_data.srmsh_mg.getRelated(md_mg.get(*mh).getMesh());
+            // a new model starts at the full mesh, the cache misses it
+            if (visits == modelDraws.size()) {
+                modelDraws.push_back({0, 0, false, 0, transform});
+                shadowCacheStale = true;
+            }
+            srModelDraw& draw = modelDraws[visits++];
+            draw.dynamicShadow = dynamicCaster or mesh.dynamic.has_value();
+            // the cache has the shadow of where it was
+            if (not draw.dynamicShadow and draw.transform != transform)
+                shadowCacheStale = true;
+            draw.transform = transform;
+
+            float scale = std::max({glm::length(glm::vec3(transform[0])),
+                                    glm::length(glm::vec3(transform[1])),
+                                    glm::length(glm::vec3(transform[2]))});
+            glm::vec3 center =
+                transform * glm::vec4(glm::vec3(mesh.bounds), 1.0f);
+            float distance = std::max(
+                glm::length(center - cameraPosition) - mesh.bounds.w * scale,
+                0.1f);
+            draw.lod = selectMeshLod(mesh, pixelsAtUnitDistance * scale / distance,
+                                     draw.lod, lodSelection);
+            lodHistogram[draw.lod]++;
+            if (debugDrawSettings.bounds)
+                debugSphere(debugDraw, center, mesh.bounds.w * scale,
+                            glm::vec4(0.0f, 1.0f, 0.0f, 1.0f), 16);
+
+            draw.cascades = 0;
+            for (uint32_t i = 0; i < shadowCascades.active; i++) {
+                if (not shadowCascadeSees(shadowCascades.cascades[i], center,
+                                          mesh.bounds.w * scale))
+                    continue;
+                draw.cascades |= 1u << i;
+                shadowCascades.stats.casters[i]++;
+            }
+
+            // meshlets are in object space, before the dequantization
+            draw.clusterSlot =
+                mesh.resident and mesh.meshletCount > 0 and draw.lod == 0
+                    ? addClusterDraw(clusterCuller, mesh, transform)
+                    : noClusterDraw;
+        } else if (const LightHandle* lh = std::get_if<LightHandle>(&handle)) {
+            // the tree changed without updateLights
+            if (lightVisits >= lightSlots.size() or
+                not (lightSlots[lightVisits].light == *lh)) {
+                lightSlotsStale = true;
+            } else if (transform != lightSlots[lightVisits].transform or
+                       (lh_mg.get(*lh).getFlags() & ResourceFlags::DIRTY)) {
+                repackLight(lightVisits, transform);
+                dirtyLights.push_back(*lh);
+            }
+            lightVisits++;
+        } else if (std::holds_alternative<CameraHandle>(handle) and
+                   not (visited == scene->active_camera) and
+                   debugDrawSettings.cameras) {
+            // a short frustum, the far plane would fill the screen
+            glm::mat4 gizmo = glm::perspective(
+                glm::radians(45.0f),
+                swapChain.swapChainImageExtent.width /
+                    (float)swapChain.swapChainImageExtent.height,
+                0.1f, 1.0f);
+            gizmo[1][1] *= -1;
+            debugFrustum(debugDraw, gizmo * glm::inverse(transform),
+                         glm::vec4(1.0f));
+            debugAxes(debugDraw, transform, 0.5f);
+        }
+
+        SceneTreeHandle child = stn.childH;
+        while (child) {
+            Q.push({child, transform, dynamicCaster});
+            child = st_mg.get(child).nextH;
+        }
+    }
+    // the cache still has the shadows of the removed ones
+    if (visits < modelDraws.size()) shadowCacheStale = true;
+    modelDraws.resize(visits);
+    if (lightVisits != lightSlots.size()) lightSlotsStale = true;
+    // after every slot of a light saw it
+    for (LightHandle lh : dirtyLights) {
+        lh_mg.get(lh).unsetFlag(ResourceFlags::DIRTY);
+    }
+
+    TracyVkZone(tracyCtx[currentFrame], commandBuffer, "Cull clusters");
+    recordClusterCulling(device, clusterCuller, currentFrame, commandBuffer,
+                         frameDescAllocators[currentFrame]);
+}
+
+void SceneRenderer::recordShadowTiles(VkCommandBuffer commandBuffer,
+                                      uint32_t imageIndex, bool onlyStale) {
+    // a view per light, each in its tile
+    for (const srShadowTile& tile : shadowAtlas.tiles) {
+        if (onlyStale and std::find(staleShadowTiles.begin(),
+                                    staleShadowTiles.end(),
+                                    tile.light) == staleShadowTiles.end())
+            continue;
+        VkViewport shadowViewport{};
+        shadowViewport.x = static_cast<float>(tile.x);
+        shadowViewport.y = static_cast<float>(tile.y);
+        shadowViewport.width = static_cast<float>(tile.size);
+        shadowViewport.height = static_cast<float>(tile.size);
+        shadowViewport.minDepth = 0.0f;
+        shadowViewport.maxDepth = 1.0f;
+
+        VkRect2D shadowScisors{};
+        shadowScisors.offset = {static_cast<int32_t>(tile.x),
+                                static_cast<int32_t>(tile.y)};
+        shadowScisors.extent = {tile.size, tile.size};
+
+        // what the tile held before, the rest of the cache stays
+        if (onlyStale) {
+            VkClearAttachment clear{};
+            clear.aspectMask = VK_IMAGE_ASPECT_DEPTH_BIT;
+            clear.clearValue.depthStencil = {1.0f, 0};
+            VkClearRect clearRect{};
+            clearRect.rect = shadowScisors;
+            clearRect.baseArrayLayer = 0;
+            clearRect.layerCount = 1;
+            vkCmdClearAttachments(commandBuffer, 1, &clear, 1, &clearRect);
+            shadowAtlas.stats.tileUpdates++;
+        }
+
+        shadowLight = tile.light;
+        recordDrawScene(commandBuffer, shadowViewport, shadowScisors,
+                        imageIndex, active_scene_data.scene->root,
+                        shadowMaterial_h);
+    }
+}
+
+void SceneRenderer::recordShadows(VkCommandBuffer commandBuffer,
+                                  uint32_t imageIndex) {
+    VkClearValue shadowClear = {.depthStencil = {1.0f, 0}};
+
+    // lights and static casters didn't change since it was drawn, or only
+    // some tiles did
+    if (shadowCacheStale or not staleShadowTiles.empty()) {
+        VkRenderPassBeginInfo cacheRenderPassInfo{};
+        cacheRenderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
+        cacheRenderPassInfo.renderPass =
+            shadowCacheStale ? shadowCacheRenderPass : shadowCacheUpdatePass;
+        cacheRenderPassInfo.framebuffer = shadowCacheFrameBuffer;
+        cacheRenderPassInfo.renderArea.offset = {0, 0};
+        cacheRenderPassInfo.renderArea.extent = shadowSize;
+        cacheRenderPassInfo.clearValueCount = 1;
+        cacheRenderPassInfo.pClearValues = &shadowClear;
+
+        vkCmdBeginRenderPass(commandBuffer, &cacheRenderPassInfo,
+                             VK_SUBPASS_CONTENTS_INLINE);
+        shadowCastersDynamic = false;
+        recordShadowTiles(commandBuffer, imageIndex, not shadowCacheStale);
+        vkCmdEndRenderPass(commandBuffer);
+
+        if (shadowCacheStale) {
+            shadowAtlas.stats.cacheUpdates++;
+            shadowAtlas.stats.tileUpdates = 0;
+        }
+        shadowCacheStale = false;
+        staleShadowTiles.clear();
+    }
+
+    // what the frame's atlas held is overwritten, the main pass of the
+    // frame that read it last is done since its fence was waited
+    VkImageMemoryBarrier barrier{};
+    barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+    barrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+    barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+    barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.image = shadowImages[currentFrame].image;
+    barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_DEPTH_BIT;
+    if (hasStencilComponent(findDepthFormat())) {
+        barrier.subresourceRange.aspectMask |= VK_IMAGE_ASPECT_STENCIL_BIT;
     }
+    barrier.subresourceRange.baseMipLevel = 0;
+    barrier.subresourceRange.levelCount = 1;
+    barrier.subresourceRange.baseArrayLayer = 0;
+    barrier.subresourceRange.layerCount = 1;
+    barrier.srcAccessMask = 0;
+    barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
+                         VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0,
+                         nullptr, 1, &barrier);
 
+    // only the tiles, the rest of the atlas is never sampled
+    std::vector<VkImageCopy> regions;
+    regions.reserve(shadowAtlas.tiles.size());
+    for (const srShadowTile& tile : shadowAtlas.tiles) {
+        VkImageCopy region{};
+        region.srcSubresource = {VK_IMAGE_ASPECT_DEPTH_BIT, 0, 0, 1};
+        region.dstSubresource = {VK_IMAGE_ASPECT_DEPTH_BIT, 0, 0, 1};
+        region.srcOffset = {static_cast<int32_t>(tile.x),
+                            static_cast<int32_t>(tile.y), 0};
+        region.dstOffset = region.srcOffset;
+        region.extent = {tile.size, tile.size, 1};
+        regions.push_back(region);
+    }
+    if (not regions.empty()) {
+        vkCmdCopyImage(commandBuffer, shadowCache.image,
+                       VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+                       shadowImages[currentFrame].image,
+                       VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+                       static_cast<uint32_t>(regions.size()), regions.data());
+    }
 
     VkRenderPassBeginInfo shadowRenderPassInfo{};
     shadowRenderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
@@ -1502,31 +3071,68 @@ void SceneRenderer::recordCommandBuffer(VkCommandBuffer commandBuffer,
     shadowRenderPassInfo.renderArea.offset = {0, 0};
     shadowRenderPassInfo.renderArea.extent = shadowSize;
 
-    VkClearValue shadowClear = {.depthStencil = {1.0f, 0}};
-
-    shadowRenderPassInfo.clearValueCount = 1;
-    shadowRenderPassInfo.pClearValues = &shadowClear;
-
     vkCmdBeginRenderPass(commandBuffer, &shadowRenderPassInfo,
                          VK_SUBPASS_CONTENTS_INLINE);
-    
-    VkViewport shadowViewport{};
-    shadowViewport.x = 0.0f;
-    shadowViewport.y = 0.0f;
-    shadowViewport.width = shadowSize.width;
-    shadowViewport.height = shadowSize.height; 
-    shadowViewport.minDepth = 0.0f;
-    shadowViewport.maxDepth = 1.0f;
-
-    VkRect2D shadowScisors{};
-    shadowScisors.offset = {0, 0};
-    shadowScisors.extent = shadowSize;
-    
+    shadowCastersDynamic = true;
+    recordShadowTiles(commandBuffer, imageIndex);
+    vkCmdEndRenderPass(commandBuffer);
 
-    recordDrawScene(commandBuffer, shadowViewport, shadowScisors, imageIndex,
-                    active_scene_data.scene->root, shadowMaterial_h);
+    recordShadowCascades(commandBuffer, imageIndex);
+}
 
-    vkCmdEndRenderPass(commandBuffer);
+void SceneRenderer::recordShadowCascades(VkCommandBuffer commandBuffer,
+                                         uint32_t imageIndex) {
+    float size = static_cast<float>(shadowCascades.settings.size);
+    VkViewport viewport{};
+    viewport.x = 0.0f;
+    viewport.y = 0.0f;
+    viewport.width = size;
+    viewport.height = size;
+    viewport.minDepth = 0.0f;
+    viewport.maxDepth = 1.0f;
+
+    VkRect2D scissor{};
+    scissor.offset = {0, 0};
+    scissor.extent = {shadowCascades.settings.size,
+                      shadowCascades.settings.size};
+
+    // without a light the shaders read no cascade, the layers stay as the
+    // last frame with one left them, in the layout the main pass reads
+    for (uint32_t i = 0; i < shadowCascades.active; i++) {
+        beginShadowCascade(shadowCascades, currentFrame, i, commandBuffer);
+        shadowCascade = i;
+        recordDrawScene(commandBuffer, viewport, scissor, imageIndex,
+                        active_scene_data.scene->root, shadowMaterial_h);
+        vkCmdEndRenderPass(commandBuffer);
+    }
+    shadowCascade = noShadowCascade;
+}
+
+void SceneRenderer::recordCommandBuffer(VkCommandBuffer commandBuffer,
+                                        uint32_t imageIndex) {
+    ZoneScoped;
+    VkCommandBufferBeginInfo beginInfo{};
+    beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+    beginInfo.flags = 0;
+    beginInfo.pInheritanceInfo = nullptr;
+
+    if (vkBeginCommandBuffer(commandBuffer, &beginInfo) != VK_SUCCESS) {
+        throw std::runtime_error("failed to begin recording buffer");
+    }
+
+    recordMeshUpdates(commandBuffer);
+    prepareModelDraws(commandBuffer);
+    {
+        TracyVkZone(tracyCtx[currentFrame], commandBuffer, "Cluster lights");
+        recordLightClustering(device, lightClusters, currentFrame,
+                              commandBuffer, lightsBuffers[currentFrame],
+                              frameDescAllocators[currentFrame]);
+    }
+
+    {
+        TracyVkZone(tracyCtx[currentFrame], commandBuffer, "Shadows");
+        recordShadows(commandBuffer, imageIndex);
+    }
 
     VkRenderPassBeginInfo renderPassInfo{};
     renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
@@ -1559,6 +3165,11 @@ void SceneRenderer::recordCommandBuffer(VkCommandBuffer commandBuffer,
 
     recordDrawScene(commandBuffer, viewport, scissor, imageIndex,
                     active_scene_data.scene->root);
+    {
+        TracyVkZone(tracyCtx[currentFrame], commandBuffer, "Debug draw");
+        recordDebugDraw(device, debugDraw, currentFrame, commandBuffer,
+                        viewProjection, viewport, scissor);
+    }
 
     // ImGui
     {
@@ -1568,6 +3179,8 @@ void SceneRenderer::recordCommandBuffer(VkCommandBuffer commandBuffer,
     }
 
     vkCmdEndRenderPass(commandBuffer);
+    // the counts beginClusterCulling reads the next time around
+    endClusterCulling(commandBuffer);
 
     TracyVkCollect(tracyCtx[currentFrame], commandBuffer);
 
@@ -1629,6 +3242,17 @@ VkSampleCountFlagBits SceneRenderer::getMaxUsableSampleCount(
     return VK_SAMPLE_COUNT_1_BIT;
 }
 
+void SceneRenderer::updateCameraProjection() {
+    cameraProjection =
+        glm::perspective(glm::radians(45.0f),
+                         swapChain.swapChainImageExtent.width /
+                             (float)swapChain.swapChainImageExtent.height,
+                         0.1f, 100.0f);
+    cameraProjection[1][1] *= -1;
+    pixelsAtUnitDistance = swapChain.swapChainImageExtent.height * 0.5f *
+                           glm::abs(cameraProjection[1][1]);
+}
+
 void SceneRenderer::updateGlobalDescriptorSets(uint32_t currentImage) {
     ZoneScoped;
     // cmaera
@@ -1643,20 +3267,69 @@ void SceneRenderer::updateGlobalDescriptorSets(uint32_t currentImage) {
     auto& st_mg = active_scene_data.scene->getSceneTreeManager();
     ubo.view = glm::inverse(
         st_mg.getGlobalTransform(active_scene_data.scene->active_camera));
-    ubo.proj =
-        glm::perspective(glm::radians(45.0f),
-                         swapChain.swapChainImageExtent.width /
-                             (float)swapChain.swapChainImageExtent.height,
-                         0.1f, 100.0f);
-    ubo.proj[1][1] *= -1;
+    ubo.proj = cameraProjection;
 
     ubo.time = time;
     ubo.obs = st_mg.getGlobalTransform(active_scene_data.scene->active_camera) *
               glm::vec4(0.0f, 0.0f, 0.0f, 1.0f);
+    // for the cluster culling and the levels of detail
+    viewProjection = ubo.proj * ubo.view;
+    cameraPosition = ubo.obs;
 
     memcpy(globalBuffersMapped[currentImage], &ubo, sizeof(ubo));
 
-    fillLightBuffer(currentImage);
+    uint32_t lightCount = updateLightBuffer(currentImage);
+    updateLightClusters(lightClusters, currentImage, ubo.view, ubo.proj,
+                        swapChain.swapChainImageExtent, lightCount);
+
+    // fitted before the models are culled into them
+    glm::vec3 sunDirection(0.0f);
+    glm::vec3 sunColor(0.0f);
+    for (uint32_t i = 0; directionalLight and i < lightSlots.size(); i++) {
+        if (lightSlots[i].light == directionalLight) {
+            sunDirection = lightTable[i].direction;
+            sunColor = lightTable[i].color;
+            break;
+        }
+    }
+    updateShadowCascades(shadowCascades, currentImage, ubo.view, ubo.proj,
+                         sunDirection, sunColor);
+    if (debugDrawSettings.lightFrusta) {
+        for (uint32_t i = 0; i < shadowCascades.active; i++) {
+            debugFrustum(debugDraw, shadowCascades.cascades[i].viewProjection,
+                         glm::vec4(sunColor, 1.0f));
+        }
+    }
+}
+
+RendererStats SceneRenderer::getStats() const {
+    RendererStats stats{};
+    stats.globalDescriptors = getDescriptorAllocatorStats(globalDescAllocator);
+    stats.materialDescriptors =
+        getDescriptorAllocatorStats(materialDescAllocator);
+    stats.frameDescriptors =
+        getDescriptorAllocatorStats(frameDescAllocators[currentFrame]);
+
+    stats.textureUploads.queued = getQueuedTextures(*textureLoader) +
+                                  static_cast<uint32_t>(stagedTextures.size());
+    for (const srUploadBatch& batch : uploadBatches) {
+        stats.textureUploads.uploading +=
+            static_cast<uint32_t>(batch.uploads.size());
+    }
+    stats.textureUploads.stagingUsed = getStagingUsage(textureLoader->ring);
+    stats.textureUploads.stagingSize = textureLoader->ring.buffer.size;
+    stats.memory = residency.stats;
+    stats.retention = retentionStats;
+    stats.meshOptimization = meshOptimizationStats;
+    stats.clusterCulling = clusterCuller.stats;
+    stats.lodHistogram = lodHistogram;
+    stats.meshCache = meshCacheStats;
+    stats.meshUpdates = meshUpdateStats;
+    stats.debugDraw = debugDraw.stats;
+    stats.lightClusters = lightClusters.stats;
+    stats.shadows = shadowAtlas.stats;
+    stats.shadowCascades = shadowCascades.stats;
+    return stats;
 }
 
 void SceneRenderer::drawFrame() {
@@ -1669,6 +3342,13 @@ void SceneRenderer::drawFrame() {
                         VK_TRUE, UINT64_MAX);
     }
 
+    // the gpu is done with this frame's transient sets
+    resetDescriptorAllocator(device, frameDescAllocators[currentFrame]);
+    residency.frame++;
+    releaseRetiredMaterialSets(currentFrame);
+    releaseRetiredImages(currentFrame);
+    releaseMeshStaging(currentFrame);
+
     uint32_t imageIndex;
     {
         ZoneScopedN("Update GPU Resources");
@@ -1694,6 +3374,13 @@ void SceneRenderer::drawFrame() {
             updateTexture(txh, active_scene_data);
         }
 
+        // the streaming and the shadows estimate sizes with it
+        updateCameraProjection();
+        processTextureUploads();
+        updateTextureStreaming();
+        updateMeshEdits();
+        updateResidency();
+
         for (MaterialHandle math : scene->mat_mg) {
             updateMaterial(math, active_scene_data);
         }
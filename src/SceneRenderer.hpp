@@ -7,6 +7,7 @@
 #include <cstring>
 #include <memory>
 #include <string>
+#include <unordered_set>
 #include <vector>
 
 #include "GlfwCreateRendererContext.hpp"
@@ -20,15 +21,27 @@
 #define GLM_FORCE_DEPTH_ZERO_TO_ONE
 #define GLM_ENABLE_EXPERIMENTAL
 #include "Scene.hpp"
+#include "srClusterCuller.hpp"
+#include "srDebugDraw.hpp"
+#include "srDownsampler.hpp"
 #include "srLight.hpp"
+#include "srLightClusters.hpp"
+#include "srMeshCache.hpp"
 #include "srMaterial.hpp"
+#include "srResidency.hpp"
+#include "srShadowAtlas.hpp"
+#include "srShadowCascades.hpp"
+#include "srRetention.hpp"
 #include "srShader.hpp"
 #include "srTexture.hpp"
+#include "srTextureLoader.hpp"
 #include "tracy/TracyVulkan.hpp"
 #include "vk_utils/vkBuffer.hh"
+#include "vk_utils/vkDescriptorAllocator.hh"
 #include "vk_utils/vkDevice.hh"
 #include "vk_utils/vkImage.hh"
 #include "vk_utils/vkInstance.hh"
+#include "vk_utils/vkStagingRing.hh"
 #include "vk_utils/vkSwapChain.h"
 
 namespace gbg {
@@ -42,8 +55,23 @@ const std::vector<const char*> validationLayers = {
 const std::vector<const char*> deviceExtensions = {
     VK_KHR_SWAPCHAIN_EXTENSION_NAME};
 
+// enabled when the device supports them
+const std::vector<const char*> optionalDeviceExtensions = {
+    VK_KHR_PUSH_DESCRIPTOR_EXTENSION_NAME, VK_EXT_MEMORY_BUDGET_EXTENSION_NAME};
+
+// shared by every texture upload in flight
+const VkDeviceSize textureStagingSize = 64 * 1024 * 1024;
+// mesh edits of the frames in flight, bigger ones get new buffers
+const VkDeviceSize meshStagingSize = 16 * 1024 * 1024;
+// lights a frame's buffer starts with room for, it grows on demand
+const uint32_t minLightCapacity = 64;
+
 struct PerObjectPushConstant {
     glm::mat4 model;
+    // the light whose tile the shadow pass draws, or the cascade of the
+    // directional light, noShadowCascade for a tile
+    uint32_t lightIndex;
+    uint32_t cascade;
 };
 
 struct UniformBufferObjects {
@@ -60,6 +88,70 @@ struct UniformBufferObjects {
     alignas(16) float time;
 };
 
+struct RendererStats {
+    vkDescriptorAllocatorStats globalDescriptors;
+    vkDescriptorAllocatorStats materialDescriptors;
+    vkDescriptorAllocatorStats frameDescriptors;
+    srTextureLoaderStats textureUploads;
+    srMemoryStats memory;
+    srRetentionStats retention;
+    srMeshOptimizationStats meshOptimization;
+    srMeshCacheStats meshCache;
+    srClusterCullStats clusterCulling;
+    srMeshUpdateStats meshUpdates;
+    // of the last frame
+    srDebugDrawStats debugDraw;
+    srLightClusterStats lightClusters;
+    srShadowAtlasStats shadows;
+    srShadowCascadeStats shadowCascades;
+    // models the main pass drew at each level of detail
+    std::array<uint32_t, maxMeshLods> lodHistogram{};
+};
+
+// What the passes draw a model with this frame.
+struct srModelDraw {
+    uint32_t lod;
+    // noClusterDraw unless its meshlets were culled
+    uint32_t clusterSlot;
+    // its shadow is drawn every frame instead of being cached
+    bool dynamicShadow;
+    // a bit per cascade it may shadow
+    uint32_t cascades;
+    // world, of the last frame. A static caster that moved redraws the cache
+    glm::mat4 transform;
+};
+
+// A light of the light table and the node the tree walk found it at.
+struct srLightSlot {
+    LightHandle light;
+    SceneTreeHandle node;
+    // global, the one its vkLight was packed with
+    glm::mat4 transform;
+};
+
+// A mesh edit recorded before the passes of the frame.
+struct srMeshPatchCopy {
+    VkBuffer src;
+    VkBuffer dst;
+    VkBufferCopy region;
+};
+
+// Swapped into its texture once the batch completes, the image it replaces
+// keeps being sampled until then.
+struct srUploadedImage {
+    gbg::vkImage image;
+    uint32_t mipLevels;
+};
+
+// Texture copies and mip generation recorded in a single command buffer.
+struct srUploadBatch {
+    VkCommandBuffer commandBuffer;
+    VkFence fence;
+    std::vector<srTextureUpload> uploads;
+    std::vector<srUploadedImage> images;  // one per upload
+    std::vector<srDownsampleJob> downsampleJobs;
+};
+
 struct InternalSceneData {
     srMaterialManager srmat_mg;
     srShaderManager srsh_mg;
@@ -78,6 +170,78 @@ class SceneRenderer {
     void resizeSwapchain(uint32_t width, uint32_t height);
     void cleanup();
     void drawFrame();
+    RendererStats getStats() const;
+
+    // Decodes the file in the background. The texture samples a placeholder
+    // until its upload completes. Only for textures that were never uploaded.
+    // Raw textures are linear and, when compressed, two channel (BC5).
+    void loadTextureAsync(TextureHandle h, const std::string& path,
+                          bool raw = false);
+    void setTextureCompression(const srTextureCompression& compression);
+    // Applies to textures loaded afterwards, the ones already streaming keep
+    // following the demand.
+    void setTextureStreaming(const srTextureStreaming& streaming);
+    void setMemoryBudget(const srMemoryBudget& budget);
+    // Applies to meshes uploaded afterwards, set it before setScene.
+    void setMeshOptimization(const srMeshOptimization& optimization);
+    // Meshes and pipelines have to agree on it, set it before setScene.
+    void setVertexFormat(srVertexFormat format);
+    void setLodSelection(const srLodSelection& selection);
+    // Lines and triangles added to it are drawn over the next frame.
+    srDebugDraw& getDebugDraw();
+    void setDebugDrawSettings(const srDebugDrawSettings& settings);
+    void setLightClusterSettings(const srLightClusterSettings& settings);
+    void setShadowAtlas(const srShadowAtlasSettings& settings);
+    // The light shines along its node's -z over the whole scene without
+    // falling off, shadowed by the cascades instead of a tile of the atlas.
+    // An empty handle goes back to none.
+    void setDirectionalLight(LightHandle h);
+    void setShadowCascades(const srShadowCascadeSettings& settings);
+    // Set it before setScene, the source is the file the scene was loaded
+    // from.
+    void setMeshCache(const srMeshCacheSettings& settings);
+    // What happens to the cpu copies once they are on the gpu. Applies to
+    // resources uploaded afterwards, meshes are uploaded by setScene.
+    void setRetention(const srRetention& retention);
+    // Overrides it for a resource the renderer has already seen, right away
+    // when it is uploaded. Freed data doesn't come back.
+    void setRetentionPolicy(MeshHandle h, srRetentionPolicy policy);
+    void setRetentionPolicy(TextureHandle h, srRetentionPolicy policy);
+    // The Mesh's vertices [first, first + count) changed, they are written
+    // into its buffers at the next frame while the frames in flight keep
+    // the old ones. Marking the Mesh DIRTY does all of them, and gets it new
+    // buffers if its vertex or face count changed. Needs the Mesh's data,
+    // RETAIN_KEEP keeps it.
+    void updateMeshVertices(MeshHandle h, uint32_t first, uint32_t count);
+    // Draws the mesh from a ring the application writes every frame, with
+    // room for maxVertices and maxIndices. The Mesh's data is left out,
+    // bounds has to hold every vertex it gets.
+    void setMeshDynamic(MeshHandle h, uint32_t maxVertices, uint32_t maxIndices,
+                        const glm::vec4& bounds);
+    // The region the next frame draws, written between drawFrames. Waits
+    // for the frame that last drew it. A frame it isn't written for draws
+    // what the last one got.
+    srDynamicMeshFrame beginDynamicMesh(MeshHandle h);
+    void endDynamicMesh(MeshHandle h, uint32_t vertexCount,
+                        uint32_t indexCount);
+    // Flags the Light DIRTY, its entry is rewritten at the next frame. A
+    // new global transform of its node is picked up without it.
+    void updateLight(LightHandle h);
+    // Lights were added to, removed from or moved in the tree. The light
+    // table is rebuilt from a walk of the tree, the next one if the frame's
+    // walk finds them elsewhere.
+    void updateLights();
+    // Where the light fades out to nothing, 0 goes back to the one of the
+    // light cluster settings.
+    void setLightRange(LightHandle h, float range);
+    // The models under the node move every frame, their shadows are drawn
+    // every frame over the cached ones of the rest. Dynamic meshes always
+    // are.
+    void setShadowCasterDynamic(SceneTreeHandle node, bool dynamic);
+    // The cached shadows are drawn again at the next frame. The frame's
+    // walk finds static casters that moved and models added or removed by
+    // itself, not a model that got another mesh.
+    void updateShadowCasters();
 
    private:
     vkInstance instance;
@@ -88,12 +252,14 @@ class SceneRenderer {
 
     VkRenderPass renderPass;
 
-    VkDescriptorPool globalDescriptorPool;
-    VkDescriptorPool materialDescPool;
-    VkDescriptorPool modelDescPool;
+    vkDescriptorAllocator globalDescAllocator;
+    vkDescriptorAllocator materialDescAllocator;
+    // transient sets, recycled when the frame comes around again
+    std::array<vkDescriptorAllocator, MAX_FRAMES_IN_FLIGHT> frameDescAllocators;
 
     // Descriptors that change in a frame basis but not per-material
     VkDescriptorSetLayout globalDescriptorSetLayout;
+    vkDescriptorTemplate globalDescTemplate;
     VkDescriptorSetLayout modelDescriptorSetLayout;
 
     std::array<VkDescriptorSet, MAX_FRAMES_IN_FLIGHT> globalDescriptorSets;
@@ -115,22 +281,109 @@ class SceneRenderer {
     std::unique_ptr<Scene> internal_scene;
     
 
-    const uint32_t max_obj = 1000;
-    const uint32_t max_mat = 1000;
-    const uint32_t max_tex = 1000;
-    const uint32_t max_light = 10;
-
     VkSampler textureSampler;
 
+    std::unique_ptr<srTextureLoader> textureLoader;
+    VkCommandPool uploadCmdPool;
+    // rgba8 mips in one dispatch, blits are the fallback
+    srDownsampler downsampler;
+    // waiting to be recorded in the next batch
+    std::vector<srTextureUpload> stagedTextures;
+    std::vector<srUploadBatch> uploadBatches;
+    gbg::vkImage placeholderTexture;
+    srTextureStreaming textureStreaming;
+    // images replaced by a streamed one that frames in flight may still read
+    std::array<std::vector<gbg::vkImage>, MAX_FRAMES_IN_FLIGHT> retiredImages;
+    srResidency residency;
+    srRetention retentionDefaults;
+    srRetentionStats retentionStats;
+    srMeshOptimization meshOptimization;
+    srMeshOptimizationStats meshOptimizationStats;
+    srVertexLayout vertexLayout;
+    srMeshCacheSettings meshCache;
+    // 0 leaves the cache out
+    uint64_t meshSourceKey = 0;
+    srMeshCacheStats meshCacheStats;
+    // meshes with meshlets are drawn from what survives it
+    srClusterCuller clusterCuller;
+    // per model the passes draw, in the order they visit them. Kept across
+    // frames for the level of detail hysteresis
+    std::vector<srModelDraw> modelDraws;
+    srLodSelection lodSelection;
+    std::array<uint32_t, maxMeshLods> lodHistogram{};
+    glm::mat4 cameraProjection{1.0f};
+    glm::mat4 viewProjection{1.0f};
+    glm::vec3 cameraPosition{0.0f};
+    // pixels a unit covers at a unit of distance
+    float pixelsAtUnitDistance = 1.0f;
+
+    // edits of the meshes, a frame's spans are released after its fence
+    vkStagingRing meshStaging;
+    std::array<std::vector<vkStagingSpan>, MAX_FRAMES_IN_FLIGHT>
+        meshStagingSpans;
+    std::vector<srMeshPatchCopy> meshPatchCopies;
+    // replaced mesh buffers that frames in flight may still read
+    std::array<std::vector<gbg::vkBuffer>, MAX_FRAMES_IN_FLIGHT>
+        retiredBuffers;
+    srMeshUpdateStats meshUpdateStats;
+    srDebugDraw debugDraw;
+    srDebugDrawSettings debugDrawSettings;
+    srLightClusters lightClusters;
+    // lights in the order the tree walk found them, lightTable holds their
+    // vkLight at the same index
+    std::vector<srLightSlot> lightSlots;
+    std::vector<vkLight> lightTable;
+    // set by setLightRange, the rest use lightClusters.settings.lightRange
+    std::vector<std::pair<LightHandle, float>> lightRanges;
+    bool lightSlotsStale = true;
+    // the tiles are assigned again once a light changed or the camera moved
+    bool shadowTilesStale = true;
+    glm::vec3 shadowTilesCamera{0.0f};
+    float shadowTilesPixels = 0.0f;
+    // entries [first, end) of lightTable a frame's buffer is missing
+    std::array<std::pair<uint32_t, uint32_t>, MAX_FRAMES_IN_FLIGHT>
+        lightDirtyRanges{};
+
+    // replaced material sets that frames in flight may still read
+    std::array<std::vector<std::pair<VkDescriptorSetLayout, VkDescriptorSet>>,
+               MAX_FRAMES_IN_FLIGHT>
+        retiredMaterialSets;
+
     // to be created
+    // the frame's copy of lightTable, grown on demand
     std::array<vkBuffer, MAX_FRAMES_IN_FLIGHT> lightsBuffers;
     std::array<void*, MAX_FRAMES_IN_FLIGHT> lightsBuffersMapped;
     std::array<VkFramebuffer, MAX_FRAMES_IN_FLIGHT> shadowFrameBuffer;
+    // the shadow atlas of each frame, its tiles are drawn in a single pass
     std::array<vkImage, MAX_FRAMES_IN_FLIGHT> shadowImages;
     VkRenderPass shadowRenderPass;
     ShaderHandle shadowShader_h;
     MaterialHandle shadowMaterial_h;
-    VkExtent2D shadowSize = {.width = 1080, .height = 1080};
+    VkExtent2D shadowSize = {.width = 4096, .height = 4096};
+    srShadowAtlas shadowAtlas;
+    // compares, filtering the results of the four texels
+    VkSampler shadowSampler;
+    // pushed with the model matrices
+    uint32_t shadowLight = 0;
+    // the tiles with the static casters only, copied into the frame's atlas
+    // before the dynamic ones are drawn. Drawn again once stale, keeps the
+    // levels of detail the casters had then
+    vkImage shadowCache;
+    VkRenderPass shadowCacheRenderPass;
+    // keeps the cache and draws over some of its tiles
+    VkRenderPass shadowCacheUpdatePass;
+    VkFramebuffer shadowCacheFrameBuffer;
+    bool shadowCacheStale = true;
+    // lights whose tile alone is drawn again, it moved or their view did
+    std::vector<uint32_t> staleShadowTiles;
+    // which of them the shadow pass draws
+    bool shadowCastersDynamic = false;
+    // the RIDs of the nodes setShadowCasterDynamic got
+    std::unordered_set<uint32_t> dynamicCasterNodes;
+    srShadowCascades shadowCascades;
+    LightHandle directionalLight;
+    // pushed with the model matrices
+    uint32_t shadowCascade = noShadowCascade;
 
     std::vector<gbg::vkBuffer> globalBuffers;
     std::vector<void*> globalBuffersMapped;
@@ -170,6 +423,7 @@ class SceneRenderer {
 
     void createGlobalDescriptorSetLayouts();
 
+    void createShadowImages();
     void createShadowResources();
 
     void createRendererObjects();
@@ -199,41 +453,106 @@ class SceneRenderer {
 
     void createTextureSampler();
 
+    void createTextureUploader();
+
+    void createPlaceholderTexture();
+
+    // Finishes completed batches and submits the textures decoded since the
+    // last frame.
+    void processTextureUploads();
+
+    void submitTextureUploads();
+
+    // Estimates the level every texture needs from the objects using it and
+    // requests new images for the ones that are off.
+    void updateTextureStreaming();
+    void requestTextureLevels(TextureHandle h, uint32_t baseMip);
+    void releaseRetiredImages(uint32_t frame);
+
+    // Uploads the meshes drawn again after being dropped and, over budget,
+    // drops idle meshes and streams the least recently drawn textures down.
+    void updateResidency();
+
     void createGlobalShaderResources();
 
     void createGlobalDescriptorPool();
 
     void createMaterialDescriptorPool();
 
-    void createModelDescriptorPool();
+    void createFrameDescriptorPools();
 
     void createGlobalDescriptorSets();
 
     void createMaterialDescriptorSet(MaterialHandle h, InternalSceneData& scene_data);
     void updateMaterialDescriptorSet(MaterialHandle h, InternalSceneData& scene_data);
-
-    void createModelDescriptorSets();
+    void writeMaterialDescriptorSet(MaterialHandle h, InternalSceneData& scene_data);
+    // rebinds textures that got a new image
+    void refreshMaterialDescriptorSet(MaterialHandle h, InternalSceneData& scene_data);
+    void releaseRetiredMaterialSets(uint32_t frame);
 
     void createCommandBuffer();
 
     void recordCommandBuffer(VkCommandBuffer commandBuffer,
                              uint32_t imageIndex);
 
+    // Before the render passes, picks the level of detail of every model
+    // and culls the meshlets of the ones the main pass draws in full.
+    void prepareModelDraws(VkCommandBuffer commandBuffer);
+
     void recordDrawScene(VkCommandBuffer commandBuffer, VkViewport viewport, VkRect2D scissor, uint32_t imageIndex, SceneTreeHandle root, MaterialHandle override);
+    // Every tile of the atlas, in the shadow pass that is begun.
+    // With onlyStale, clears and draws the tiles of staleShadowTiles only.
+    void recordShadowTiles(VkCommandBuffer commandBuffer, uint32_t imageIndex,
+                           bool onlyStale = false);
+    // Draws the static casters in the cache if stale, copies it into the
+    // frame's atlas and draws the dynamic ones over it.
+    void recordShadows(VkCommandBuffer commandBuffer, uint32_t imageIndex);
+    // A layer per cascade, each with the casters culled into it.
+    void recordShadowCascades(VkCommandBuffer commandBuffer,
+                              uint32_t imageIndex);
 
 
     void createSyncObjects();
 
     VkSampleCountFlagBits getMaxUsableSampleCount(VkPhysicalDevice pdevice);
 
+    // before anything of the frame estimates sizes on screen
+    void updateCameraProjection();
     void updateGlobalDescriptorSets(uint32_t currentImage);
 
     void updateMesh(MeshHandle mesh_h, InternalSceneData& scene_data);
+    void uploadMesh(MeshHandle mesh_h, srMesh& vkmesh,
+                    InternalSceneData& scene_data);
+    // Writes the edits of the Mesh resources in, before the frame is
+    // recorded, and carries the dynamic meshes the frame got nothing for.
+    void updateMeshEdits();
+    // false when the ring has no room left this frame
+    bool stageMeshPatches(srMesh& vkmesh,
+                          const std::vector<srVertexPatch>& patches);
+    // until the frame comes around again
+    void retireMeshBuffers(srMesh& vkmesh);
+    // new buffers from the Mesh, the old ones are retired
+    void rebuildMesh(MeshHandle mesh_h, srMesh& vkmesh);
+    void recordMeshUpdates(VkCommandBuffer commandBuffer);
+    void releaseMeshStaging(uint32_t frame);
+    // frees the cpu copy if the retention policy says so, once uploaded
+    void applyMeshRetention(MeshHandle mesh_h, InternalSceneData& scene_data);
+    void applyTextureRetention(TextureHandle h);
     void updateShader(ShaderHandle sh_h, InternalSceneData& scene_data, VkRenderPass renderPass, VkSampleCountFlagBits samples);
     void updateMaterial(MaterialHandle math, InternalSceneData& scene_data);
     void updateTexture(TextureHandle texture, InternalSceneData& scene_data);
-    void updateLight(LightHandle lh, InternalSceneData& scene_data);
 
-    void fillLightBuffer(uint32_t currentImage);
+    vkLight packLight(LightHandle h, const glm::mat4& transform) const;
+    void rebuildLightTable();
+    // Tiles of the atlas for this frame, their rects go in lightTable.
+    void assignShadowTiles();
+    // The walk of the frame found the slot's light moved or DIRTY, after
+    // the frame's buffer was brought up to date.
+    void repackLight(uint32_t slot, const glm::mat4& transform);
+    void createLightBuffer(uint32_t frame, uint32_t capacity);
+    void writeGlobalDescriptorSet(uint32_t frame);
+    // Brings the frame's buffer up to date with lightTable, returns how many
+    // lights it holds.
+    uint32_t updateLightBuffer(uint32_t currentImage);
 };
 }  // namespace gbg
@@ -0,0 +1,346 @@
+#include "bcEncoder.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstring>
+
+namespace gbg {
+
+using Block = std::array<std::array<uint8_t, 4>, 16>;
+
+size_t bcBlockSize(BCFormat format) {
+    return format == BCFormat::BC1 ? 8 : 16;
+}
+
+size_t bcImageSize(BCFormat format, uint32_t width, uint32_t height) {
+    size_t blocksX = (width + 3) / 4;
+    size_t blocksY = (height + 3) / 4;
+    return blocksX * blocksY * bcBlockSize(format);
+}
+
+static Block fetchBlock(const uint8_t* rgba, uint32_t width, uint32_t height,
+                        uint32_t bx, uint32_t by) {
+    Block block;
+    for (uint32_t y = 0; y < 4; y++) {
+        uint32_t py = std::min(by * 4 + y, height - 1);
+        for (uint32_t x = 0; x < 4; x++) {
+            uint32_t px = std::min(bx * 4 + x, width - 1);
+            std::memcpy(block[y * 4 + x].data(),
+                        rgba + (static_cast<size_t>(py) * width + px) * 4, 4);
+        }
+    }
+    return block;
+}
+
+// Extremes of the block along its principal axis, found with a few power
+// iterations on the covariance matrix.
+static void principalEndpoints(const Block& block, int channels,
+                               std::array<float, 4>& lo,
+                               std::array<float, 4>& hi) {
+    std::array<float, 4> mean{};
+    for (const auto& px : block)
+        for (int c = 0; c < channels; c++) mean[c] += px[c] / 16.0f;
+
+    float cov[4][4] = {};
+    for (const auto& px : block) {
+        for (int i = 0; i < channels; i++)
+            for (int j = 0; j < channels; j++)
+                cov[i][j] += (px[i] - mean[i]) * (px[j] - mean[j]);
+    }
+
+    std::array<float, 4> axis = {1.0f, 1.0f, 1.0f, 1.0f};
+    for (int it = 0; it < 8; it++) {
+        std::array<float, 4> next{};
+        for (int i = 0; i < channels; i++)
+            for (int j = 0; j < channels; j++) next[i] += cov[i][j] * axis[j];
+        float len = 0.0f;
+        for (int i = 0; i < channels; i++) len += next[i] * next[i];
+        if (len < 1e-8f) break;
+        len = std::sqrt(len);
+        for (int i = 0; i < channels; i++) axis[i] = next[i] / len;
+    }
+
+    float minT = 1e30f, maxT = -1e30f;
+    for (const auto& px : block) {
+        float t = 0.0f;
+        for (int c = 0; c < channels; c++) t += (px[c] - mean[c]) * axis[c];
+        minT = std::min(minT, t);
+        maxT = std::max(maxT, t);
+    }
+    for (int c = 0; c < channels; c++) {
+        lo[c] = std::clamp(mean[c] + axis[c] * minT, 0.0f, 255.0f);
+        hi[c] = std::clamp(mean[c] + axis[c] * maxT, 0.0f, 255.0f);
+    }
+}
+
+static int sqDistance(const uint8_t* a, const int* b, int channels) {
+    int d = 0;
+    for (int c = 0; c < channels; c++) d += (a[c] - b[c]) * (a[c] - b[c]);
+    return d;
+}
+
+static uint16_t pack565(const std::array<float, 4>& c) {
+    uint16_t r = static_cast<uint16_t>(std::lround(c[0] * 31.0f / 255.0f));
+    uint16_t g = static_cast<uint16_t>(std::lround(c[1] * 63.0f / 255.0f));
+    uint16_t b = static_cast<uint16_t>(std::lround(c[2] * 31.0f / 255.0f));
+    return (r << 11) | (g << 5) | b;
+}
+
+static void unpack565(uint16_t v, int* out) {
+    int r = (v >> 11) & 31, g = (v >> 5) & 63, b = v & 31;
+    out[0] = (r << 3) | (r >> 2);
+    out[1] = (g << 2) | (g >> 4);
+    out[2] = (b << 3) | (b >> 2);
+}
+
+static void encodeColorBlock(const Block& block, uint8_t* out) {
+    std::array<float, 4> lo, hi;
+    principalEndpoints(block, 3, lo, hi);
+
+    uint16_t c0 = pack565(hi);
+    uint16_t c1 = pack565(lo);
+    // four color mode needs c0 > c1
+    if (c0 < c1) std::swap(c0, c1);
+
+    uint32_t indices = 0;
+    if (c0 != c1) {
+        int palette[4][3];
+        unpack565(c0, palette[0]);
+        unpack565(c1, palette[1]);
+        for (int c = 0; c < 3; c++) {
+            palette[2][c] = (2 * palette[0][c] + palette[1][c]) / 3;
+            palette[3][c] = (palette[0][c] + 2 * palette[1][c]) / 3;
+        }
+        for (int i = 0; i < 16; i++) {
+            int best = 0, bestDist = sqDistance(block[i].data(), palette[0], 3);
+            for (int p = 1; p < 4; p++) {
+                int dist = sqDistance(block[i].data(), palette[p], 3);
+                if (dist < bestDist) best = p, bestDist = dist;
+            }
+            indices |= static_cast<uint32_t>(best) << (i * 2);
+        }
+    }
+
+    out[0] = c0 & 0xff;
+    out[1] = c0 >> 8;
+    out[2] = c1 & 0xff;
+    out[3] = c1 >> 8;
+    std::memcpy(out + 4, &indices, 4);
+}
+
+// BC4 style block for one channel, also the alpha of BC3
+static void encodeChannelBlock(const Block& block, int channel, uint8_t* out) {
+    int a0 = 0, a1 = 255;
+    for (const auto& px : block) {
+        a0 = std::max<int>(a0, px[channel]);
+        a1 = std::min<int>(a1, px[channel]);
+    }
+
+    int palette[8];
+    palette[0] = a0;
+    palette[1] = a1;
+    for (int i = 1; i < 7; i++) palette[i + 1] = ((7 - i) * a0 + i * a1) / 7;
+
+    uint64_t indices = 0;
+    for (int i = 0; i < 16; i++) {
+        int best = 0, bestDist = 256;
+        for (int p = 0; p < 8; p++) {
+            int dist = std::abs(block[i][channel] - palette[p]);
+            if (dist < bestDist) best = p, bestDist = dist;
+        }
+        indices |= static_cast<uint64_t>(best) << (i * 3);
+    }
+
+    out[0] = static_cast<uint8_t>(a0);
+    out[1] = static_cast<uint8_t>(a1);
+    for (int i = 0; i < 6; i++) out[2 + i] = (indices >> (i * 8)) & 0xff;
+}
+
+struct BitWriter {
+    uint8_t* out;
+    uint32_t pos = 0;
+
+    void write(uint32_t value, uint32_t bits) {
+        for (uint32_t i = 0; i < bits; i++, pos++) {
+            if ((value >> i) & 1) out[pos / 8] |= 1 << (pos % 8);
+        }
+    }
+};
+
+// 7 bit endpoint plus a shared p-bit, picks the p-bit with the least error
+static void quantizeBC7Endpoint(const std::array<float, 4>& e, int* q,
+                                int& pbit) {
+    float bestErr = 1e30f;
+    for (int p = 0; p < 2; p++) {
+        float err = 0.0f;
+        int cand[4];
+        for (int c = 0; c < 4; c++) {
+            cand[c] = std::clamp(static_cast<int>(std::lround((e[c] - p) / 2)),
+                                 0, 127);
+            float d = e[c] - ((cand[c] << 1) | p);
+            err += d * d;
+        }
+        if (err < bestErr) {
+            bestErr = err;
+            pbit = p;
+            std::copy(cand, cand + 4, q);
+        }
+    }
+}
+
+static void encodeBC7Block(const Block& block, uint8_t* out) {
+    static const int weights[16] = {0,  4,  9,  13, 17, 21, 26, 30,
+                                    34, 38, 43, 47, 51, 55, 60, 64};
+
+    std::array<float, 4> lo, hi;
+    principalEndpoints(block, 4, lo, hi);
+
+    int q[2][4], p[2];
+    quantizeBC7Endpoint(lo, q[0], p[0]);
+    quantizeBC7Endpoint(hi, q[1], p[1]);
+
+    int e[2][4];
+    for (int i = 0; i < 2; i++)
+        for (int c = 0; c < 4; c++) e[i][c] = (q[i][c] << 1) | p[i];
+
+    int palette[16][4];
+    for (int w = 0; w < 16; w++)
+        for (int c = 0; c < 4; c++)
+            palette[w][c] =
+                ((64 - weights[w]) * e[0][c] + weights[w] * e[1][c] + 32) >> 6;
+
+    int indices[16];
+    for (int i = 0; i < 16; i++) {
+        int best = 0, bestDist = sqDistance(block[i].data(), palette[0], 4);
+        for (int w = 1; w < 16; w++) {
+            int dist = sqDistance(block[i].data(), palette[w], 4);
+            if (dist < bestDist) best = w, bestDist = dist;
+        }
+        indices[i] = best;
+    }
+
+    // the msb of the first index is implicit 0, swap endpoints to keep it so
+    if (indices[0] >= 8) {
+        for (int c = 0; c < 4; c++) std::swap(q[0][c], q[1][c]);
+        std::swap(p[0], p[1]);
+        for (int& idx : indices) idx = 15 - idx;
+    }
+
+    std::memset(out, 0, 16);
+    BitWriter bits{out};
+    bits.write(1 << 6, 7);  // mode 6
+    for (int c = 0; c < 4; c++) {
+        bits.write(q[0][c], 7);
+        bits.write(q[1][c], 7);
+    }
+    bits.write(p[0], 1);
+    bits.write(p[1], 1);
+    bits.write(indices[0], 3);
+    for (int i = 1; i < 16; i++) bits.write(indices[i], 4);
+}
+
+void encodeBC(BCFormat format, const uint8_t* rgba, uint32_t width,
+              uint32_t height, uint8_t* out) {
+    uint32_t blocksX = (width + 3) / 4;
+    uint32_t blocksY = (height + 3) / 4;
+    size_t blockSize = bcBlockSize(format);
+
+    for (uint32_t by = 0; by < blocksY; by++) {
+        for (uint32_t bx = 0; bx < blocksX; bx++) {
+            Block block = fetchBlock(rgba, width, height, bx, by);
+            uint8_t* dst = out + (by * blocksX + bx) * blockSize;
+            switch (format) {
+                case BCFormat::BC1:
+                    encodeColorBlock(block, dst);
+                    break;
+                case BCFormat::BC3:
+                    encodeChannelBlock(block, 3, dst);
+                    encodeColorBlock(block, dst + 8);
+                    break;
+                case BCFormat::BC5:
+                    encodeChannelBlock(block, 0, dst);
+                    encodeChannelBlock(block, 1, dst + 8);
+                    break;
+                case BCFormat::BC7:
+                    encodeBC7Block(block, dst);
+                    break;
+            }
+        }
+    }
+}
+
+static const std::array<float, 256>& srgbToLinearTable() {
+    static const std::array<float, 256> table = [] {
+        std::array<float, 256> t;
+        for (int i = 0; i < 256; i++) {
+            float c = i / 255.0f;
+            t[i] = c <= 0.04045f ? c / 12.92f
+                                 : std::pow((c + 0.055f) / 1.055f, 2.4f);
+        }
+        return t;
+    }();
+    return table;
+}
+
+static uint8_t linearToSrgb(float c) {
+    c = c <= 0.0031308f ? c * 12.92f
+                        : 1.055f * std::pow(c, 1.0f / 2.4f) - 0.055f;
+    return static_cast<uint8_t>(std::clamp(std::lround(c * 255.0f), 0L, 255L));
+}
+
+std::vector<std::vector<uint8_t>> buildMipChain(const uint8_t* rgba,
+                                                uint32_t width,
+                                                uint32_t height, bool srgb) {
+    const auto& toLinear = srgbToLinearTable();
+
+    std::vector<std::vector<uint8_t>> levels;
+    levels.emplace_back(rgba, rgba + static_cast<size_t>(width) * height * 4);
+
+    while (width > 1 or height > 1) {
+        const std::vector<uint8_t>& src = levels.back();
+        uint32_t w = std::max(width / 2, 1u);
+        uint32_t h = std::max(height / 2, 1u);
+        std::vector<uint8_t> dst(static_cast<size_t>(w) * h * 4);
+
+        for (uint32_t y = 0; y < h; y++) {
+            for (uint32_t x = 0; x < w; x++) {
+                uint32_t x0 = std::min(x * 2, width - 1);
+                uint32_t x1 = std::min(x * 2 + 1, width - 1);
+                uint32_t y0 = std::min(y * 2, height - 1);
+                uint32_t y1 = std::min(y * 2 + 1, height - 1);
+                const uint8_t* s[4] = {&src[(y0 * width + x0) * 4],
+                                       &src[(y0 * width + x1) * 4],
+                                       &src[(y1 * width + x0) * 4],
+                                       &src[(y1 * width + x1) * 4]};
+                uint8_t* d = &dst[(y * w + x) * 4];
+                for (int c = 0; c < 4; c++) {
+                    if (srgb and c < 3) {
+                        float sum = 0.0f;
+                        for (const uint8_t* px : s) sum += toLinear[px[c]];
+                        d[c] = linearToSrgb(sum / 4.0f);
+                    } else {
+                        int sum = 0;
+                        for (const uint8_t* px : s) sum += px[c];
+                        d[c] = static_cast<uint8_t>((sum + 2) / 4);
+                    }
+                }
+            }
+        }
+
+        levels.push_back(std::move(dst));
+        width = w;
+        height = h;
+    }
+    return levels;
+}
+
+bool hasTransparency(const uint8_t* rgba, uint32_t width, uint32_t height) {
+    size_t count = static_cast<size_t>(width) * height;
+    for (size_t i = 0; i < count; i++) {
+        if (rgba[i * 4 + 3] != 255) return true;
+    }
+    return false;
+}
+
+}  // namespace gbg
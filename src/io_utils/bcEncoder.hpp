@@ -0,0 +1,32 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace gbg {
+
+enum class BCFormat {
+    BC1,  // rgb, 8 bytes per block
+    BC3,  // rgba, 16 bytes per block
+    BC5,  // two channels (normal maps), 16 bytes per block
+    BC7,  // rgba, 16 bytes per block (mode 6 only)
+};
+
+size_t bcBlockSize(BCFormat format);
+
+size_t bcImageSize(BCFormat format, uint32_t width, uint32_t height);
+
+// Compresses tightly packed RGBA8 pixels, out must hold bcImageSize bytes.
+// Blocks past the image edge repeat the last row/column.
+void encodeBC(BCFormat format, const uint8_t* rgba, uint32_t width,
+              uint32_t height, uint8_t* out);
+
+// RGBA8 mip chain down to 1x1 with a box filter, level 0 is a copy of the
+// input. sRGB levels are averaged in linear space.
+std::vector<std::vector<uint8_t>> buildMipChain(const uint8_t* rgba,
+                                                uint32_t width,
+                                                uint32_t height, bool srgb);
+
+bool hasTransparency(const uint8_t* rgba, uint32_t width, uint32_t height);
+
+}  // namespace gbg
@@ -0,0 +1,280 @@
+#include "ktx2.hpp"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+
+namespace gbg {
+
+static const uint8_t ktx2Identifier[12] = {0xAB, 'K',  'T',  'X',  ' ',  '2',
+                                           '0',  0xBB, '\r', '\n', 0x1A, '\n'};
+
+struct ktx2Header {
+    uint8_t identifier[12];
+    uint32_t vkFormat;
+    uint32_t typeSize;
+    uint32_t pixelWidth;
+    uint32_t pixelHeight;
+    uint32_t pixelDepth;
+    uint32_t layerCount;
+    uint32_t faceCount;
+    uint32_t levelCount;
+    uint32_t supercompressionScheme;
+    uint32_t dfdByteOffset;
+    uint32_t dfdByteLength;
+    uint32_t kvdByteOffset;
+    uint32_t kvdByteLength;
+    uint64_t sgdByteOffset;
+    uint64_t sgdByteLength;
+};
+
+struct ktx2LevelIndex {
+    uint64_t byteOffset;
+    uint64_t byteLength;
+    uint64_t uncompressedByteLength;
+};
+
+// khr_df color models and channel ids
+enum : uint8_t {
+    KHR_DF_MODEL_BC1A = 128,
+    KHR_DF_MODEL_BC3 = 130,
+    KHR_DF_MODEL_BC5 = 132,
+    KHR_DF_MODEL_BC7 = 134,
+};
+
+struct dfdSample {
+    uint16_t bitOffset;
+    uint8_t channel;
+};
+
+static bool describeFormat(VkFormat format, uint8_t& model, bool& srgb,
+                           uint32_t& blockBytes,
+                           std::vector<dfdSample>& samples) {
+    srgb = false;
+    switch (format) {
+        case VK_FORMAT_BC1_RGB_SRGB_BLOCK:
+            srgb = true;
+            [[fallthrough]];
+        case VK_FORMAT_BC1_RGB_UNORM_BLOCK:
+            model = KHR_DF_MODEL_BC1A;
+            blockBytes = 8;
+            samples = {{0, 0}};
+            return true;
+        case VK_FORMAT_BC3_SRGB_BLOCK:
+            srgb = true;
+            [[fallthrough]];
+        case VK_FORMAT_BC3_UNORM_BLOCK:
+            model = KHR_DF_MODEL_BC3;
+            blockBytes = 16;
+            samples = {{0, 15}, {64, 0}};  // alpha, color
+            return true;
+        case VK_FORMAT_BC5_UNORM_BLOCK:
+            model = KHR_DF_MODEL_BC5;
+            blockBytes = 16;
+            samples = {{0, 0}, {64, 1}};  // red, green
+            return true;
+        case VK_FORMAT_BC7_SRGB_BLOCK:
+            srgb = true;
+            [[fallthrough]];
+        case VK_FORMAT_BC7_UNORM_BLOCK:
+            model = KHR_DF_MODEL_BC7;
+            blockBytes = 16;
+            samples = {{0, 0}};
+            return true;
+        default:
+            return false;
+    }
+}
+
+template <typename T>
+static void append(std::vector<uint8_t>& out, T value) {
+    const uint8_t* bytes = reinterpret_cast<const uint8_t*>(&value);
+    out.insert(out.end(), bytes, bytes + sizeof(T));
+}
+
+static std::vector<uint8_t> buildDfd(VkFormat format) {
+    uint8_t model;
+    bool srgb;
+    uint32_t blockBytes;
+    std::vector<dfdSample> samples;
+    describeFormat(format, model, srgb, blockBytes, samples);
+
+    uint32_t blockSize = 24 + 16 * static_cast<uint32_t>(samples.size());
+    std::vector<uint8_t> dfd;
+    append<uint32_t>(dfd, 4 + blockSize);  // dfdTotalSize
+    append<uint32_t>(dfd, 0);              // vendor id and descriptor type
+    append<uint32_t>(dfd, 2 | (blockSize << 16));  // version 1.3
+    // model, primaries (bt709), transfer (linear or srgb), flags
+    append<uint32_t>(dfd, model | (1 << 8) | ((srgb ? 2 : 1) << 16));
+    append<uint32_t>(dfd, 3 | (3 << 8));  // 4x4 blocks
+    append<uint32_t>(dfd, blockBytes);    // bytes plane 0
+    append<uint32_t>(dfd, 0);
+    uint32_t sampleBits = blockBytes * 8 / static_cast<uint32_t>(samples.size());
+    for (const dfdSample& s : samples) {
+        append<uint32_t>(dfd, s.bitOffset | ((sampleBits - 1) << 16) |
+                                  (s.channel << 24));
+        append<uint32_t>(dfd, 0);           // sample position
+        append<uint32_t>(dfd, 0);           // lower
+        append<uint32_t>(dfd, UINT32_MAX);  // upper
+    }
+    return dfd;
+}
+
+static size_t alignTo(size_t value, size_t alignment) {
+    return (value + alignment - 1) / alignment * alignment;
+}
+
+bool writeKtx2(const std::string& path, VkFormat format, uint32_t width,
+               uint32_t height,
+               const std::vector<std::vector<uint8_t>>& levels) {
+    uint8_t model;
+    bool srgb;
+    uint32_t blockBytes;
+    std::vector<dfdSample> samples;
+    if (not describeFormat(format, model, srgb, blockBytes, samples))
+        return false;
+
+    std::vector<uint8_t> dfd = buildDfd(format);
+
+    ktx2Header header{};
+    std::memcpy(header.identifier, ktx2Identifier, sizeof(ktx2Identifier));
+    header.vkFormat = format;
+    header.typeSize = 1;
+    header.pixelWidth = width;
+    header.pixelHeight = height;
+    header.pixelDepth = 0;
+    header.layerCount = 0;
+    header.faceCount = 1;
+    header.levelCount = static_cast<uint32_t>(levels.size());
+    header.supercompressionScheme = 0;
+
+    size_t offset = sizeof(ktx2Header) + sizeof(ktx2LevelIndex) * levels.size();
+    header.dfdByteOffset = static_cast<uint32_t>(offset);
+    header.dfdByteLength = static_cast<uint32_t>(dfd.size());
+    offset += dfd.size();
+
+    // level data goes from the smallest mip to the base one
+    std::vector<ktx2LevelIndex> index(levels.size());
+    for (size_t i = levels.size(); i-- > 0;) {
+        offset = alignTo(offset, blockBytes);
+        index[i].byteOffset = offset;
+        index[i].byteLength = levels[i].size();
+        index[i].uncompressedByteLength = levels[i].size();
+        offset += levels[i].size();
+    }
+
+    // encoders of the same path don't write each other's file
+    static std::atomic<uint32_t> tmpCounter{0};
+    std::string tmpPath = path + ".tmp." + std::to_string(getpid()) + "." +
+                          std::to_string(tmpCounter++);
+    {
+        std::ofstream file(tmpPath, std::ios::binary | std::ios::trunc);
+        if (not file) return false;
+
+        auto writeAt = [&](size_t at, const void* data, size_t size) {
+            size_t pos = static_cast<size_t>(file.tellp());
+            static const char zeros[16] = {};
+            file.write(zeros, static_cast<std::streamsize>(at - pos));
+            file.write(static_cast<const char*>(data),
+                       static_cast<std::streamsize>(size));
+        };
+
+        writeAt(0, &header, sizeof(header));
+        writeAt(sizeof(header), index.data(),
+                index.size() * sizeof(ktx2LevelIndex));
+        writeAt(header.dfdByteOffset, dfd.data(), dfd.size());
+        for (size_t i = levels.size(); i-- > 0;) {
+            writeAt(index[i].byteOffset, levels[i].data(), levels[i].size());
+        }
+        if (not file) return false;
+    }
+
+    std::error_code ec;
+    std::filesystem::rename(tmpPath, path, ec);
+    if (ec) std::filesystem::remove(tmpPath, ec);
+    return not ec;
+}
+
+std::optional<ktx2Image> mapKtx2(const std::string& path) {
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd == -1) return std::nullopt;
+
+    struct stat st;
+    if (fstat(fd, &st) == -1 or
+        static_cast<size_t>(st.st_size) < sizeof(ktx2Header)) {
+        close(fd);
+        return std::nullopt;
+    }
+
+    ktx2Image image{};
+    image.mappingSize = static_cast<size_t>(st.st_size);
+    image.mapping =
+        mmap(nullptr, image.mappingSize, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (image.mapping == MAP_FAILED) return std::nullopt;
+
+    const auto* bytes = static_cast<const std::byte*>(image.mapping);
+    ktx2Header header;
+    std::memcpy(&header, bytes, sizeof(header));
+
+    uint8_t model;
+    bool srgb;
+    uint32_t blockBytes;
+    std::vector<dfdSample> samples;
+    // a full chain at most, 2D, a single layer and face
+    uint32_t maxLevels =
+        std::bit_width(std::max({header.pixelWidth, header.pixelHeight, 1u}));
+    size_t indexEnd =
+        sizeof(ktx2Header) + sizeof(ktx2LevelIndex) * header.levelCount;
+    if (std::memcmp(header.identifier, ktx2Identifier,
+                    sizeof(ktx2Identifier)) != 0 or
+        header.supercompressionScheme != 0 or header.levelCount == 0 or
+        header.levelCount > maxLevels or header.pixelWidth == 0 or
+        header.pixelHeight == 0 or header.pixelDepth > 1 or
+        header.layerCount > 1 or header.faceCount != 1 or
+        not describeFormat(static_cast<VkFormat>(header.vkFormat), model, srgb,
+                           blockBytes, samples) or
+        indexEnd > image.mappingSize) {
+        unmapKtx2(image);
+        return std::nullopt;
+    }
+
+    image.format = static_cast<VkFormat>(header.vkFormat);
+    image.width = header.pixelWidth;
+    image.height = header.pixelHeight;
+    for (uint32_t i = 0; i < header.levelCount; i++) {
+        ktx2LevelIndex level;
+        std::memcpy(&level, bytes + sizeof(ktx2Header) + i * sizeof(level),
+                    sizeof(level));
+        // the blocks the upload copies for the level's size
+        uint64_t blocksX = (std::max(header.pixelWidth >> i, 1u) + 3) / 4;
+        uint64_t blocksY = (std::max(header.pixelHeight >> i, 1u) + 3) / 4;
+        uint64_t expected = blocksX * blocksY * blockBytes;
+        if (level.byteOffset > image.mappingSize or
+            level.byteLength > image.mappingSize - level.byteOffset or
+            level.byteLength < expected) {
+            unmapKtx2(image);
+            return std::nullopt;
+        }
+        image.levels.emplace_back(bytes + level.byteOffset, expected);
+    }
+    return image;
+}
+
+void unmapKtx2(ktx2Image& image) {
+    if (image.mapping != nullptr and image.mapping != MAP_FAILED)
+        munmap(image.mapping, image.mappingSize);
+    image.mapping = nullptr;
+    image.levels.clear();
+}
+
+}  // namespace gbg
@@ -0,0 +1,34 @@
+#pragma once
+#include <vulkan/vulkan_core.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <span>
+#include <string>
+#include <vector>
+
+namespace gbg {
+
+// A KTX2 file mapped in memory, levels point into the mapping.
+struct ktx2Image {
+    VkFormat format;
+    uint32_t width;
+    uint32_t height;
+    std::vector<std::span<const std::byte>> levels;  // 0 is the base level
+
+    void* mapping = nullptr;
+    size_t mappingSize = 0;
+};
+
+// Writes a 2D block compressed texture with the basic data format descriptor
+// and no supercompression. Goes through a temporary file so a reader never
+// sees a half written cache.
+bool writeKtx2(const std::string& path, VkFormat format, uint32_t width,
+               uint32_t height, const std::vector<std::vector<uint8_t>>& levels);
+
+std::optional<ktx2Image> mapKtx2(const std::string& path);
+
+void unmapKtx2(ktx2Image& image);
+
+}  // namespace gbg
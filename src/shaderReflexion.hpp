@@ -148,4 +148,33 @@ inline std::pair<bool, std::string> setShaderCode(gbg::Shader& sh,
             res.GetErrorMessage()};
 }
 
+// For the renderer's own passes, they aren't reflected into a Shader.
+// Throws with the compiler output on errors.
+inline std::vector<uint32_t> compileRendererShader(
+    std::filesystem::path path, shaderc_shader_kind kind,
+    const std::vector<std::string>& defines = {}) {
+    auto data = readFile(path.string());
+
+    shaderc::CompileOptions options;
+    // subgroup operations need spirv 1.3
+    options.SetTargetEnvironment(shaderc_target_env_vulkan,
+                                 shaderc_env_version_vulkan_1_2);
+    for (const std::string& define : defines) {
+        options.AddMacroDefinition(define);
+    }
+
+    shaderc::Compiler cmp;
+    shaderc::CompilationResult res = cmp.CompileGlslToSpv(
+        data.data(), kind, path.filename().c_str(), options);
+    if (res.GetCompilationStatus() != shaderc_compilation_status_success) {
+        throw std::runtime_error(res.GetErrorMessage());
+    }
+    return {res.begin(), res.end()};
+}
+
+inline std::vector<uint32_t> compileComputeShader(
+    std::filesystem::path path, const std::vector<std::string>& defines = {}) {
+    return compileRendererShader(path, shaderc_compute_shader, defines);
+}
+
 }  // namespace gbg
@@ -0,0 +1,275 @@
+#include "srClusterCuller.hpp"
+
+#include <vulkan/vulkan_core.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+#include "shaderReflexion.hpp"
+
+namespace gbg {
+
+const uint32_t clusterCullGroupSize = 64;
+
+struct ClusterCullFrame {
+    glm::vec4 planes[6];
+    glm::vec4 camera;
+};
+
+struct ClusterCullDraw {
+    glm::mat4 model;
+    uint32_t meshletCount;
+    uint32_t coneCulling;
+    uint32_t padding[2];
+};
+
+static std::vector<VkDescriptorSetLayoutBinding> clusterCullBindings() {
+    // params, commands, culled indices, meshlets, mesh indices
+    std::vector<VkDescriptorSetLayoutBinding> bindings(5);
+    for (uint32_t i = 0; i < bindings.size(); i++) {
+        bindings[i].binding = i;
+        bindings[i].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+        bindings[i].descriptorCount = 1;
+        bindings[i].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+        bindings[i].pImmutableSamplers = nullptr;
+    }
+    return bindings;
+}
+
+void createClusterCuller(const vkDevice& device, srClusterCuller& culler,
+                         const std::string& shaderPath, uint32_t frameCount) {
+    std::vector<VkDescriptorSetLayoutBinding> bindings = clusterCullBindings();
+    VkDescriptorSetLayoutCreateInfo layoutInfo{};
+    layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+    layoutInfo.bindingCount = static_cast<uint32_t>(bindings.size());
+    layoutInfo.pBindings = bindings.data();
+    if (vkCreateDescriptorSetLayout(device.ldevice, &layoutInfo, nullptr,
+                                    &culler.layout) != VK_SUCCESS) {
+        throw std::runtime_error("failed to create descriptor set layout!");
+    }
+    culler.descTemplate =
+        createDescriptorTemplate(device, bindings, culler.layout);
+
+    // the draw the dispatch culls
+    VkPushConstantRange pushConstant{};
+    pushConstant.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+    pushConstant.offset = 0;
+    pushConstant.size = sizeof(uint32_t);
+
+    culler.pipeline = createComputePipeline(
+        device, compileComputeShader(shaderPath, {}), {culler.layout},
+        {pushConstant});
+    culler.frames.resize(frameCount);
+}
+
+// Gribb and Hartmann, rows of viewProjection with a 0 to 1 depth range.
+// Normalized so the sphere test reads distances.
+static void extractFrustumPlanes(const glm::mat4& m, glm::vec4 planes[6]) {
+    glm::vec4 row[4];
+    for (int i = 0; i < 4; i++) {
+        row[i] = glm::vec4(m[0][i], m[1][i], m[2][i], m[3][i]);
+    }
+    planes[0] = row[3] + row[0];
+    planes[1] = row[3] - row[0];
+    planes[2] = row[3] + row[1];
+    planes[3] = row[3] - row[1];
+    planes[4] = row[2];
+    planes[5] = row[3] - row[2];
+    for (int i = 0; i < 6; i++) {
+        planes[i] /= glm::length(glm::vec3(planes[i]));
+    }
+}
+
+void beginClusterCulling(srClusterCuller& culler, uint32_t frame,
+                         const glm::mat4& viewProjection,
+                         const glm::vec3& camera) {
+    srClusterCullFrame& cullFrame = culler.frames[frame];
+    // what the shader left from the last time the frame was recorded
+    srClusterCullStats& recorded = cullFrame.recorded;
+    recorded.visibleTriangles = 0;
+    const auto* commands =
+        static_cast<const VkDrawIndexedIndirectCommand*>(
+            cullFrame.commandsMapped);
+    for (uint32_t i = 0; i < recorded.draws; i++) {
+        recorded.visibleTriangles += commands[i].indexCount / 3;
+    }
+    culler.stats = recorded;
+    recorded = {};
+
+    extractFrustumPlanes(viewProjection, culler.planes);
+    culler.camera = camera;
+    culler.draws.clear();
+}
+
+uint32_t addClusterDraw(srClusterCuller& culler, const srMesh& mesh,
+                        const glm::mat4& model) {
+    // meshlets only cover the full mesh
+    culler.draws.push_back({mesh.meshletBuffer.buffer, mesh.indexBuffer.buffer,
+                            mesh.meshletCount, mesh.lods[0].indexCount, model});
+    return static_cast<uint32_t>(culler.draws.size() - 1);
+}
+
+// The cone test only holds when the normals turn with the model.
+static bool uniformScale(const glm::mat4& model) {
+    float x = glm::length(glm::vec3(model[0]));
+    float y = glm::length(glm::vec3(model[1]));
+    float z = glm::length(glm::vec3(model[2]));
+    float tolerance = 0.01f * std::max({x, y, z});
+    return std::abs(x - y) <= tolerance and std::abs(x - z) <= tolerance;
+}
+
+static void reserveClusterFrame(const vkDevice& device,
+                                srClusterCullFrame& frame, uint32_t draws,
+                                VkDeviceSize indices) {
+    if (draws > frame.drawCapacity) {
+        uint32_t capacity = std::max(draws, frame.drawCapacity * 2);
+        capacity = std::max(capacity, 64u);
+        destroyBuffer(device, frame.params);
+        destroyBuffer(device, frame.commands);
+
+        frame.params = createBuffer(
+            device, sizeof(ClusterCullFrame) + capacity * sizeof(ClusterCullDraw),
+            VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+            VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
+                VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+        vkMapMemory(device.ldevice, frame.params.memory, 0, frame.params.size,
+                    0, &frame.paramsMapped);
+        frame.commands = createBuffer(
+            device, capacity * sizeof(VkDrawIndexedIndirectCommand),
+            VK_BUFFER_USAGE_STORAGE_BUFFER_BIT |
+                VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT,
+            VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
+                VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+        vkMapMemory(device.ldevice, frame.commands.memory, 0,
+                    frame.commands.size, 0, &frame.commandsMapped);
+        frame.drawCapacity = capacity;
+    }
+    if (indices > frame.indexCapacity) {
+        VkDeviceSize capacity = std::max(indices, frame.indexCapacity * 2);
+        destroyBuffer(device, frame.indices);
+        frame.indices = createBuffer(
+            device, capacity * sizeof(uint32_t),
+            VK_BUFFER_USAGE_STORAGE_BUFFER_BIT |
+                VK_BUFFER_USAGE_INDEX_BUFFER_BIT,
+            VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+        frame.indexCapacity = capacity;
+    }
+}
+
+void recordClusterCulling(const vkDevice& device, srClusterCuller& culler,
+                          uint32_t frame, VkCommandBuffer commandBuffer,
+                          vkDescriptorAllocator& descriptors) {
+    if (culler.draws.empty()) return;
+    srClusterCullFrame& cullFrame = culler.frames[frame];
+
+    VkDeviceSize indexCount = 0;
+    for (const srClusterDraw& draw : culler.draws) {
+        indexCount += draw.indexCount;
+    }
+    uint32_t drawCount = static_cast<uint32_t>(culler.draws.size());
+    reserveClusterFrame(device, cullFrame, drawCount, indexCount);
+
+    auto* header = static_cast<ClusterCullFrame*>(cullFrame.paramsMapped);
+    std::memcpy(header->planes, culler.planes, sizeof(header->planes));
+    header->camera = glm::vec4(culler.camera, 1.0f);
+    auto* params = reinterpret_cast<ClusterCullDraw*>(header + 1);
+    auto* commands = static_cast<VkDrawIndexedIndirectCommand*>(
+        cullFrame.commandsMapped);
+
+    vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE,
+                      culler.pipeline.pipeline);
+
+    const vkDescriptorTemplate& tmpl = culler.descTemplate;
+    std::vector<std::byte> data(tmpl.dataSize);
+    uint32_t firstIndex = 0;
+    srClusterCullStats& recorded = cullFrame.recorded;
+    for (uint32_t i = 0; i < drawCount; i++) {
+        const srClusterDraw& draw = culler.draws[i];
+        params[i] = {draw.model, draw.meshletCount,
+                     uniformScale(draw.model) ? 1u : 0u, {0, 0}};
+        // the shader adds the indices that survive
+        commands[i] = {0, 1, firstIndex, 0, 0};
+
+        VkDescriptorBufferInfo paramsInfo{cullFrame.params.buffer, 0,
+                                          VK_WHOLE_SIZE};
+        VkDescriptorBufferInfo commandsInfo{cullFrame.commands.buffer, 0,
+                                            VK_WHOLE_SIZE};
+        VkDescriptorBufferInfo outputInfo{cullFrame.indices.buffer, 0,
+                                          VK_WHOLE_SIZE};
+        VkDescriptorBufferInfo meshletInfo{draw.meshlets, 0, VK_WHOLE_SIZE};
+        VkDescriptorBufferInfo indexInfo{draw.indices, 0, VK_WHOLE_SIZE};
+        setTemplateBuffer(tmpl, data.data(), 0, 0, paramsInfo);
+        setTemplateBuffer(tmpl, data.data(), 1, 0, commandsInfo);
+        setTemplateBuffer(tmpl, data.data(), 2, 0, outputInfo);
+        setTemplateBuffer(tmpl, data.data(), 3, 0, meshletInfo);
+        setTemplateBuffer(tmpl, data.data(), 4, 0, indexInfo);
+        VkDescriptorSet set =
+            allocateDescriptorSet(device, descriptors, culler.layout);
+        updateDescriptorSet(device, tmpl, set, data.data());
+
+        vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE,
+                                culler.pipeline.layout, 0, 1, &set, 0,
+                                nullptr);
+        vkCmdPushConstants(commandBuffer, culler.pipeline.layout,
+                           VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(uint32_t),
+                           &i);
+        vkCmdDispatch(commandBuffer,
+                      (draw.meshletCount + clusterCullGroupSize - 1) /
+                          clusterCullGroupSize,
+                      1, 1);
+
+        firstIndex += draw.indexCount;
+        recorded.draws++;
+        recorded.meshlets += draw.meshletCount;
+        recorded.triangles += draw.indexCount / 3;
+    }
+
+    VkMemoryBarrier barrier{};
+    barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+    barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+    barrier.dstAccessMask =
+        VK_ACCESS_INDIRECT_COMMAND_READ_BIT | VK_ACCESS_INDEX_READ_BIT;
+    vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                         VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT |
+                             VK_PIPELINE_STAGE_VERTEX_INPUT_BIT,
+                         0, 1, &barrier, 0, nullptr, 0, nullptr);
+}
+
+void drawClusters(const srClusterCuller& culler, uint32_t frame,
+                  VkCommandBuffer commandBuffer, uint32_t slot) {
+    const srClusterCullFrame& cullFrame = culler.frames[frame];
+    vkCmdBindIndexBuffer(commandBuffer, cullFrame.indices.buffer, 0,
+                         VK_INDEX_TYPE_UINT32);
+    vkCmdDrawIndexedIndirect(commandBuffer, cullFrame.commands.buffer,
+                             slot * sizeof(VkDrawIndexedIndirectCommand), 1,
+                             sizeof(VkDrawIndexedIndirectCommand));
+}
+
+void endClusterCulling(VkCommandBuffer commandBuffer) {
+    // the fence alone doesn't make the shader's writes visible to the host
+    VkMemoryBarrier barrier{};
+    barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+    barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+    barrier.dstAccessMask = VK_ACCESS_HOST_READ_BIT;
+    vkCmdPipelineBarrier(commandBuffer,
+                         VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT |
+                             VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT,
+                         VK_PIPELINE_STAGE_HOST_BIT, 0, 1, &barrier, 0,
+                         nullptr, 0, nullptr);
+}
+
+void destroyClusterCuller(const vkDevice& device, srClusterCuller& culler) {
+    for (srClusterCullFrame& frame : culler.frames) {
+        destroyBuffer(device, frame.params);
+        destroyBuffer(device, frame.commands);
+        destroyBuffer(device, frame.indices);
+    }
+    culler.frames.clear();
+    destroyDescriptorTemplate(device, culler.descTemplate);
+    vkDestroyDescriptorSetLayout(device.ldevice, culler.layout, nullptr);
+    vkDestroyPipeline(device.ldevice, culler.pipeline.pipeline, nullptr);
+    vkDestroyPipelineLayout(device.ldevice, culler.pipeline.layout, nullptr);
+}
+
+}  // namespace gbg
@@ -0,0 +1,100 @@
+#pragma once
+#include <vulkan/vulkan_core.h>
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "glm/glm.hpp"
+#include "srMesh.hh"
+#include "vk_utils/vkBuffer.hh"
+#include "vk_utils/vkDescriptorAllocator.hh"
+#include "vk_utils/vkDescriptorTemplate.hh"
+#include "vk_utils/vkDevice.hh"
+#include "vk_utils/vkPipeline.hh"
+
+namespace gbg {
+
+// returned for the draws that aren't culled
+const uint32_t noClusterDraw = ~0u;
+
+// A mesh with meshlets queued for culling this frame.
+struct srClusterDraw {
+    VkBuffer meshlets;
+    VkBuffer indices;
+    uint32_t meshletCount;
+    uint32_t indexCount;
+    glm::mat4 model;
+};
+
+struct srClusterCullStats {
+    uint32_t draws = 0;
+    uint32_t meshlets = 0;
+    uint64_t triangles = 0;
+    // that survived, read back when the frame comes around again
+    uint64_t visibleTriangles = 0;
+};
+
+// Buffers of one frame in flight, they grow with the draws and are only
+// touched once its fence was waited.
+struct srClusterCullFrame {
+    // the frustum and camera, then the model matrix of every draw
+    vkBuffer params{};
+    void* paramsMapped = nullptr;
+    // an indexed indirect command per draw, the shader adds the indices
+    vkBuffer commands{};
+    void* commandsMapped = nullptr;
+    // every draw gets room for all its indices
+    vkBuffer indices{};
+    uint32_t drawCapacity = 0;
+    VkDeviceSize indexCapacity = 0;
+    // what was recorded in it, for the stats
+    srClusterCullStats recorded;
+};
+
+// Culls the meshlets of a mesh against the frustum and by their normal
+// cone in a compute pass and packs the triangles left in an index buffer
+// the main pass draws indirectly, with the usual vertex buffers.
+struct srClusterCuller {
+    vkPipeline pipeline{};
+    VkDescriptorSetLayout layout = VK_NULL_HANDLE;
+    vkDescriptorTemplate descTemplate;
+    std::vector<srClusterCullFrame> frames;
+
+    std::vector<srClusterDraw> draws;
+    glm::vec4 planes[6];
+    glm::vec3 camera{0.0f};
+    srClusterCullStats stats;
+};
+
+void createClusterCuller(const vkDevice& device, srClusterCuller& culler,
+                         const std::string& shaderPath, uint32_t frameCount);
+
+// Once the frame's fence was waited. viewProjection is the one the main
+// pass draws with, camera in world space.
+void beginClusterCulling(srClusterCuller& culler, uint32_t frame,
+                         const glm::mat4& viewProjection,
+                         const glm::vec3& camera);
+
+// Returns the slot to draw it with, the mesh must have meshlets.
+uint32_t addClusterDraw(srClusterCuller& culler, const srMesh& mesh,
+                        const glm::mat4& model);
+
+// Dispatches the draws added since beginClusterCulling, outside of a render
+// pass. Sets come from the frame's transient allocator.
+void recordClusterCulling(const vkDevice& device, srClusterCuller& culler,
+                          uint32_t frame, VkCommandBuffer commandBuffer,
+                          vkDescriptorAllocator& descriptors);
+
+// Binds the culled indices over the mesh's, vertex buffers are left to the
+// caller.
+void drawClusters(const srClusterCuller& culler, uint32_t frame,
+                  VkCommandBuffer commandBuffer, uint32_t slot);
+
+// After the last pass that draws them, outside of a render pass. The host
+// reads what the shader counted once the frame's fence was waited.
+void endClusterCulling(VkCommandBuffer commandBuffer);
+
+void destroyClusterCuller(const vkDevice& device, srClusterCuller& culler);
+
+}  // namespace gbg
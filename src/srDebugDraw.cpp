@@ -0,0 +1,217 @@
+#include "srDebugDraw.hpp"
+
+#include <vulkan/vulkan_core.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstring>
+#include <stdexcept>
+
+#include "glm/gtc/packing.hpp"
+#include "shaderReflexion.hpp"
+
+namespace gbg {
+
+void createDebugDraw(const vkDevice& device, srDebugDraw& debug,
+                     const std::string& vertPath, const std::string& fragPath,
+                     VkRenderPass renderPass, VkSampleCountFlagBits samples,
+                     uint32_t frameCount) {
+    std::vector<uint32_t> vert =
+        compileRendererShader(vertPath, shaderc_vertex_shader);
+    std::vector<uint32_t> frag =
+        compileRendererShader(fragPath, shaderc_fragment_shader);
+
+    // interleaved, unlike the meshes' streams
+    VkVertexInputBindingDescription binding{};
+    binding.binding = 0;
+    binding.stride = sizeof(srDebugVertex);
+    binding.inputRate = VK_VERTEX_INPUT_RATE_VERTEX;
+    std::vector<VkVertexInputAttributeDescription> attributes(2);
+    attributes[0].location = 0;
+    attributes[0].binding = 0;
+    attributes[0].format = VK_FORMAT_R32G32B32_SFLOAT;
+    attributes[0].offset = offsetof(srDebugVertex, position);
+    attributes[1].location = 1;
+    attributes[1].binding = 0;
+    attributes[1].format = VK_FORMAT_R8G8B8A8_UNORM;
+    attributes[1].offset = offsetof(srDebugVertex, color);
+
+    // the view projection
+    VkPushConstantRange pushConstant{};
+    pushConstant.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
+    pushConstant.offset = 0;
+    pushConstant.size = sizeof(glm::mat4);
+
+    debug.lines = createGraphicsPipeline(
+        device, vert, frag, {}, {binding}, attributes, {pushConstant},
+        samples, renderPass, VK_PRIMITIVE_TOPOLOGY_LINE_LIST);
+    debug.triangles = createGraphicsPipeline(
+        device, vert, frag, {}, {binding}, attributes, {pushConstant},
+        samples, renderPass, VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST);
+    debug.frames.resize(frameCount);
+}
+
+static uint32_t packColor(const glm::vec4& color) {
+    return glm::packUnorm4x8(color);
+}
+
+void debugLine(srDebugDraw& debug, const glm::vec3& a, const glm::vec3& b,
+               const glm::vec4& color) {
+    uint32_t packed = packColor(color);
+    debug.lineVertices.push_back({a, packed});
+    debug.lineVertices.push_back({b, packed});
+}
+
+void debugTriangle(srDebugDraw& debug, const glm::vec3& a, const glm::vec3& b,
+                   const glm::vec3& c, const glm::vec4& color) {
+    uint32_t packed = packColor(color);
+    // the pipelines cull back faces
+    debug.triangleVertices.insert(debug.triangleVertices.end(),
+                                  {{a, packed},
+                                   {b, packed},
+                                   {c, packed},
+                                   {a, packed},
+                                   {c, packed},
+                                   {b, packed}});
+}
+
+// Corners indexed by their bits, x in the first.
+static void debugCorners(srDebugDraw& debug, const glm::vec3 corners[8],
+                         const glm::vec4& color) {
+    uint32_t packed = packColor(color);
+    for (uint32_t i = 0; i < 8; i++) {
+        for (uint32_t bit = 1; bit < 8; bit <<= 1) {
+            if (i & bit) continue;
+            debug.lineVertices.push_back({corners[i], packed});
+            debug.lineVertices.push_back({corners[i | bit], packed});
+        }
+    }
+}
+
+void debugBox(srDebugDraw& debug, const glm::vec3& lo, const glm::vec3& hi,
+              const glm::mat4& transform, const glm::vec4& color) {
+    glm::vec3 corners[8];
+    for (uint32_t i = 0; i < 8; i++) {
+        glm::vec3 corner((i & 1) ? hi.x : lo.x, (i & 2) ? hi.y : lo.y,
+                         (i & 4) ? hi.z : lo.z);
+        corners[i] = glm::vec3(transform * glm::vec4(corner, 1.0f));
+    }
+    debugCorners(debug, corners, color);
+}
+
+void debugFrustum(srDebugDraw& debug, const glm::mat4& viewProjection,
+                  const glm::vec4& color) {
+    glm::mat4 inverse = glm::inverse(viewProjection);
+    glm::vec3 corners[8];
+    for (uint32_t i = 0; i < 8; i++) {
+        glm::vec4 ndc((i & 1) ? 1.0f : -1.0f, (i & 2) ? 1.0f : -1.0f,
+                      (i & 4) ? 1.0f : 0.0f, 1.0f);
+        glm::vec4 world = inverse * ndc;
+        corners[i] = glm::vec3(world) / world.w;
+    }
+    debugCorners(debug, corners, color);
+}
+
+void debugAxes(srDebugDraw& debug, const glm::mat4& transform, float size) {
+    glm::vec3 origin(transform[3]);
+    for (int axis = 0; axis < 3; axis++) {
+        glm::vec4 color(0.0f, 0.0f, 0.0f, 1.0f);
+        color[axis] = 1.0f;
+        debugLine(debug, origin,
+                  origin + glm::vec3(transform[axis]) * size, color);
+    }
+}
+
+void debugSphere(srDebugDraw& debug, const glm::vec3& center, float radius,
+                 const glm::vec4& color, uint32_t segments) {
+    uint32_t packed = packColor(color);
+    segments = std::max(segments, 3u);
+    for (int axis = 0; axis < 3; axis++) {
+        glm::vec3 u(0.0f), v(0.0f);
+        u[(axis + 1) % 3] = radius;
+        v[(axis + 2) % 3] = radius;
+        glm::vec3 previous = center + u;
+        for (uint32_t i = 1; i <= segments; i++) {
+            float angle = 2.0f * static_cast<float>(M_PI) * i / segments;
+            glm::vec3 point =
+                center + u * std::cos(angle) + v * std::sin(angle);
+            debug.lineVertices.push_back({previous, packed});
+            debug.lineVertices.push_back({point, packed});
+            previous = point;
+        }
+    }
+}
+
+static void reserveDebugFrame(const vkDevice& device,
+                              srDebugDrawFrame& frame, VkDeviceSize size) {
+    if (size <= frame.capacity) return;
+    VkDeviceSize capacity = std::max(size, frame.capacity * 2);
+    // its fence was waited, nothing reads the old one
+    destroyBuffer(device, frame.vertices);
+    frame.vertices = createBuffer(device, capacity,
+                                  VK_BUFFER_USAGE_VERTEX_BUFFER_BIT,
+                                  VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
+                                      VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+    if (vkMapMemory(device.ldevice, frame.vertices.memory, 0, capacity, 0,
+                    &frame.mapped) != VK_SUCCESS) {
+        throw std::runtime_error("failed to map debug draw vertices!");
+    }
+    frame.capacity = capacity;
+}
+
+void recordDebugDraw(const vkDevice& device, srDebugDraw& debug,
+                     uint32_t frame, VkCommandBuffer commandBuffer,
+                     const glm::mat4& viewProjection,
+                     const VkViewport& viewport, const VkRect2D& scissor) {
+    debug.stats = {};
+    size_t lineCount = debug.lineVertices.size();
+    size_t triangleCount = debug.triangleVertices.size();
+    if (lineCount + triangleCount == 0) return;
+
+    srDebugDrawFrame& debugFrame = debug.frames[frame];
+    reserveDebugFrame(device, debugFrame,
+                      (lineCount + triangleCount) * sizeof(srDebugVertex));
+    auto* vertices = static_cast<srDebugVertex*>(debugFrame.mapped);
+    std::memcpy(vertices, debug.lineVertices.data(),
+                lineCount * sizeof(srDebugVertex));
+    std::memcpy(vertices + lineCount, debug.triangleVertices.data(),
+                triangleCount * sizeof(srDebugVertex));
+
+    VkDeviceSize offset = 0;
+    vkCmdBindVertexBuffers(commandBuffer, 0, 1, &debugFrame.vertices.buffer,
+                           &offset);
+    auto draw = [&](const vkPipeline& pipeline, size_t count, size_t first) {
+        if (count == 0) return;
+        vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS,
+                          pipeline.pipeline);
+        vkCmdSetViewport(commandBuffer, 0, 1, &viewport);
+        vkCmdSetScissor(commandBuffer, 0, 1, &scissor);
+        vkCmdPushConstants(commandBuffer, pipeline.layout,
+                           VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(glm::mat4),
+                           &viewProjection);
+        vkCmdDraw(commandBuffer, static_cast<uint32_t>(count), 1,
+                  static_cast<uint32_t>(first), 0);
+        debug.stats.drawCalls++;
+    };
+    draw(debug.lines, lineCount, 0);
+    draw(debug.triangles, triangleCount, lineCount);
+
+    debug.stats.lines = static_cast<uint32_t>(lineCount / 2);
+    debug.stats.triangles = static_cast<uint32_t>(triangleCount / 6);
+    debug.lineVertices.clear();
+    debug.triangleVertices.clear();
+}
+
+void destroyDebugDraw(const vkDevice& device, srDebugDraw& debug) {
+    for (srDebugDrawFrame& frame : debug.frames) {
+        destroyBuffer(device, frame.vertices);
+    }
+    debug.frames.clear();
+    for (vkPipeline* pipeline : {&debug.lines, &debug.triangles}) {
+        vkDestroyPipeline(device.ldevice, pipeline->pipeline, nullptr);
+        vkDestroyPipelineLayout(device.ldevice, pipeline->layout, nullptr);
+    }
+}
+
+}  // namespace gbg
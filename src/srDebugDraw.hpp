@@ -0,0 +1,88 @@
+#pragma once
+#include <vulkan/vulkan_core.h>
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "glm/glm.hpp"
+#include "vk_utils/vkBuffer.hh"
+#include "vk_utils/vkDevice.hh"
+#include "vk_utils/vkPipeline.hh"
+
+namespace gbg {
+
+struct srDebugVertex {
+    glm::vec3 position;
+    uint32_t color;  // rgba8
+};
+
+struct srDebugDrawStats {
+    uint32_t lines = 0;
+    uint32_t triangles = 0;
+    uint32_t drawCalls = 0;
+};
+
+// What the renderer adds by itself every frame.
+struct srDebugDrawSettings {
+    // bounding spheres of the models the main pass draws
+    bool bounds = false;
+    bool lightFrusta = false;
+    // every camera but the active one, as its axes and a short frustum
+    bool cameras = true;
+};
+
+// Host visible vertices of one frame in flight, grown on demand and only
+// written once its fence was waited.
+struct srDebugDrawFrame {
+    vkBuffer vertices{};
+    void* mapped = nullptr;
+    VkDeviceSize capacity = 0;
+};
+
+// Immediate mode lines and triangles in world space. Everything added in
+// a frame goes to a single vertex buffer, drawn with a call per topology
+// in the main pass.
+struct srDebugDraw {
+    vkPipeline lines{};
+    vkPipeline triangles{};
+    std::vector<srDebugDrawFrame> frames;
+
+    std::vector<srDebugVertex> lineVertices;
+    std::vector<srDebugVertex> triangleVertices;
+    srDebugDrawStats stats;
+};
+
+void createDebugDraw(const vkDevice& device, srDebugDraw& debug,
+                     const std::string& vertPath, const std::string& fragPath,
+                     VkRenderPass renderPass, VkSampleCountFlagBits samples,
+                     uint32_t frameCount);
+
+void debugLine(srDebugDraw& debug, const glm::vec3& a, const glm::vec3& b,
+               const glm::vec4& color);
+// Both sides.
+void debugTriangle(srDebugDraw& debug, const glm::vec3& a, const glm::vec3& b,
+                   const glm::vec3& c, const glm::vec4& color);
+// The box lo, hi in the space transform takes to world space.
+void debugBox(srDebugDraw& debug, const glm::vec3& lo, const glm::vec3& hi,
+              const glm::mat4& transform, const glm::vec4& color);
+// The edges of what viewProjection sees, with a 0 to 1 depth range.
+void debugFrustum(srDebugDraw& debug, const glm::mat4& viewProjection,
+                  const glm::vec4& color);
+// x, y and z of transform in red, green and blue.
+void debugAxes(srDebugDraw& debug, const glm::mat4& transform,
+               float size = 1.0f);
+// A circle around each axis.
+void debugSphere(srDebugDraw& debug, const glm::vec3& center, float radius,
+                 const glm::vec4& color, uint32_t segments = 24);
+
+// Inside the main pass, after the scene. Draws and then forgets what was
+// added since the last call.
+void recordDebugDraw(const vkDevice& device, srDebugDraw& debug,
+                     uint32_t frame, VkCommandBuffer commandBuffer,
+                     const glm::mat4& viewProjection,
+                     const VkViewport& viewport, const VkRect2D& scissor);
+
+void destroyDebugDraw(const vkDevice& device, srDebugDraw& debug);
+
+}  // namespace gbg
@@ -0,0 +1,253 @@
+#include "srDownsampler.hpp"
+
+#include <vulkan/vulkan_core.h>
+
+#include <algorithm>
+#include <cstring>
+
+#include "shaderReflexion.hpp"
+#include "vk_utils/vkImage.hh"
+
+namespace gbg {
+
+// a workgroup reduces a tile of this size down to one texel
+const uint32_t downsampleTile = 64;
+// the last workgroup has to fit level 6 in a tile
+const uint32_t maxDownsampleSize = downsampleTile << 6;
+
+struct DownsampleParams {
+    int32_t width;
+    int32_t height;
+    uint32_t levelCount;
+    uint32_t workGroups;
+    uint32_t srgb;
+};
+
+static std::vector<VkDescriptorSetLayoutBinding> downsampleBindings() {
+    std::vector<VkDescriptorSetLayoutBinding> bindings(4);
+    bindings[0].binding = 0;
+    bindings[0].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+    bindings[0].descriptorCount = 1;
+    bindings[1].binding = 1;
+    bindings[1].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+    bindings[1].descriptorCount = maxDownsampleLevels;
+    bindings[2].binding = 2;
+    bindings[2].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+    bindings[2].descriptorCount = 1;
+    bindings[3].binding = 3;
+    bindings[3].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    bindings[3].descriptorCount = 1;
+    for (VkDescriptorSetLayoutBinding& binding : bindings) {
+        binding.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+        binding.pImmutableSamplers = nullptr;
+    }
+    return bindings;
+}
+
+void createDownsampler(const vkDevice& device, srDownsampler& downsampler,
+                       const std::string& shaderPath) {
+    VkPhysicalDeviceFeatures features;
+    vkGetPhysicalDeviceFeatures(device.pdevice, &features);
+    VkFormatProperties formatProperties;
+    vkGetPhysicalDeviceFormatProperties(device.pdevice, VK_FORMAT_R8G8B8A8_UNORM,
+                                        &formatProperties);
+    // the level array is indexed with a uniform but not constant index
+    downsampler.supported =
+        features.shaderStorageImageArrayDynamicIndexing and
+        (formatProperties.optimalTilingFeatures &
+         VK_FORMAT_FEATURE_STORAGE_IMAGE_BIT);
+    if (not downsampler.supported) return;
+
+    VkPhysicalDeviceSubgroupProperties subgroup{};
+    subgroup.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_SUBGROUP_PROPERTIES;
+    VkPhysicalDeviceProperties2 properties{};
+    properties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2;
+    properties.pNext = &subgroup;
+    vkGetPhysicalDeviceProperties2(device.pdevice, &properties);
+    downsampler.subgroupQuad =
+        (subgroup.supportedOperations & VK_SUBGROUP_FEATURE_QUAD_BIT) and
+        (subgroup.supportedStages & VK_SHADER_STAGE_COMPUTE_BIT);
+
+    std::vector<VkDescriptorSetLayoutBinding> bindings = downsampleBindings();
+    VkDescriptorSetLayoutCreateInfo layoutInfo{};
+    layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+    layoutInfo.bindingCount = static_cast<uint32_t>(bindings.size());
+    layoutInfo.pBindings = bindings.data();
+    if (vkCreateDescriptorSetLayout(device.ldevice, &layoutInfo, nullptr,
+                                    &downsampler.layout) != VK_SUCCESS) {
+        throw std::runtime_error("failed to create descriptor set layout!");
+    }
+    downsampler.descTemplate =
+        createDescriptorTemplate(device, bindings, downsampler.layout);
+
+    VkPushConstantRange pushConstant{};
+    pushConstant.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+    pushConstant.offset = 0;
+    pushConstant.size = sizeof(DownsampleParams);
+
+    std::vector<std::string> defines;
+    if (downsampler.subgroupQuad) defines.push_back("USE_SUBGROUP_QUAD");
+    downsampler.pipeline = createComputePipeline(
+        device, compileComputeShader(shaderPath, defines),
+        {downsampler.layout}, {pushConstant});
+
+    downsampler.descriptors = createDescriptorAllocator(
+        device, 16,
+        {{VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1.0f},
+         {VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, maxDownsampleLevels + 1.0f},
+         {VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1.0f}});
+
+    // only texelFetch reads it
+    VkSamplerCreateInfo samplerInfo{};
+    samplerInfo.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
+    samplerInfo.magFilter = VK_FILTER_NEAREST;
+    samplerInfo.minFilter = VK_FILTER_NEAREST;
+    samplerInfo.mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST;
+    samplerInfo.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+    samplerInfo.addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+    samplerInfo.addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+    if (vkCreateSampler(device.ldevice, &samplerInfo, nullptr,
+                        &downsampler.sampler) != VK_SUCCESS) {
+        throw std::runtime_error("failed to create texture sampler!");
+    }
+
+    downsampler.counterStride = std::max<VkDeviceSize>(
+        properties.properties.limits.minStorageBufferOffsetAlignment,
+        sizeof(uint32_t));
+    downsampler.counters = createBuffer(
+        device, downsampler.counterStride * maxDownsampleJobs,
+        VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+        VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
+            VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+    void* data;
+    vkMapMemory(device.ldevice, downsampler.counters.memory, 0,
+                downsampler.counters.size, 0, &data);
+    std::memset(data, 0, downsampler.counters.size);
+    vkUnmapMemory(device.ldevice, downsampler.counters.memory);
+
+    for (uint32_t i = maxDownsampleJobs; i > 0; i--) {
+        downsampler.freeCounters.push_back(i - 1);
+    }
+}
+
+bool canDownsample(const srDownsampler& downsampler, VkFormat format,
+                   uint32_t width, uint32_t height, uint32_t mipLevels) {
+    return downsampler.supported and
+           (format == VK_FORMAT_R8G8B8A8_UNORM or
+            format == VK_FORMAT_R8G8B8A8_SRGB) and
+           mipLevels > 1 and mipLevels - 1 <= maxDownsampleLevels and
+           std::max(width, height) <= maxDownsampleSize and
+           not downsampler.freeCounters.empty();
+}
+
+srDownsampleJob prepareDownsample(const vkDevice& device,
+                                  srDownsampler& downsampler, VkImage image,
+                                  VkFormat format, uint32_t width,
+                                  uint32_t height, uint32_t mipLevels) {
+    srDownsampleJob job{};
+    job.image = image;
+    job.width = width;
+    job.height = height;
+    job.mipLevels = mipLevels;
+    job.srgb = format == VK_FORMAT_R8G8B8A8_SRGB;
+    job.counter = downsampler.freeCounters.back();
+    downsampler.freeCounters.pop_back();
+
+    // the sRGB view decodes level 0, storage views are always unorm
+    job.views.push_back(createImageView(image, device.ldevice, format,
+                                        VK_IMAGE_ASPECT_COLOR_BIT, 0, 1,
+                                        VK_IMAGE_USAGE_SAMPLED_BIT));
+    for (uint32_t level = 1; level < mipLevels; level++) {
+        job.views.push_back(createImageView(
+            image, device.ldevice, VK_FORMAT_R8G8B8A8_UNORM,
+            VK_IMAGE_ASPECT_COLOR_BIT, level, 1, VK_IMAGE_USAGE_STORAGE_BIT));
+    }
+
+    job.set = allocateDescriptorSet(device, downsampler.descriptors,
+                                    downsampler.layout);
+
+    std::vector<std::byte> data(downsampler.descTemplate.dataSize);
+    const vkDescriptorTemplate& tmpl = downsampler.descTemplate;
+
+    VkDescriptorImageInfo baseInfo{};
+    baseInfo.sampler = downsampler.sampler;
+    baseInfo.imageView = job.views[0];
+    baseInfo.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+    setTemplateImage(tmpl, data.data(), 0, 0, baseInfo);
+
+    // slots past the last level are never written but must be valid
+    for (uint32_t i = 0; i < maxDownsampleLevels; i++) {
+        VkDescriptorImageInfo levelInfo{};
+        levelInfo.imageView = job.views[std::min(i + 1, mipLevels - 1)];
+        levelInfo.imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+        setTemplateImage(tmpl, data.data(), 1, i, levelInfo);
+    }
+    VkDescriptorImageInfo level6Info{};
+    level6Info.imageView = job.views[std::min(6u, mipLevels - 1)];
+    level6Info.imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+    setTemplateImage(tmpl, data.data(), 2, 0, level6Info);
+
+    VkDescriptorBufferInfo counterInfo{};
+    counterInfo.buffer = downsampler.counters.buffer;
+    counterInfo.offset = job.counter * downsampler.counterStride;
+    counterInfo.range = sizeof(uint32_t);
+    setTemplateBuffer(tmpl, data.data(), 3, 0, counterInfo);
+
+    updateDescriptorSet(device, tmpl, job.set, data.data());
+    return job;
+}
+
+void recordDownsample(const srDownsampler& downsampler,
+                      VkCommandBuffer commandBuffer,
+                      const srDownsampleJob& job) {
+    uint32_t groupsX = (job.width + downsampleTile - 1) / downsampleTile;
+    uint32_t groupsY = (job.height + downsampleTile - 1) / downsampleTile;
+
+    DownsampleParams params{};
+    params.width = static_cast<int32_t>(job.width);
+    params.height = static_cast<int32_t>(job.height);
+    params.levelCount = job.mipLevels - 1;
+    params.workGroups = groupsX * groupsY;
+    params.srgb = job.srgb;
+
+    vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE,
+                      downsampler.pipeline.pipeline);
+    vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE,
+                            downsampler.pipeline.layout, 0, 1, &job.set, 0,
+                            nullptr);
+    vkCmdPushConstants(commandBuffer, downsampler.pipeline.layout,
+                       VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(params),
+                       &params);
+    vkCmdDispatch(commandBuffer, groupsX, groupsY, 1);
+}
+
+void releaseDownsampleJob(const vkDevice& device, srDownsampler& downsampler,
+                          srDownsampleJob& job) {
+    for (VkImageView view : job.views) {
+        vkDestroyImageView(device.ldevice, view, nullptr);
+    }
+    job.views.clear();
+    if (job.set != VK_NULL_HANDLE) {
+        releaseDescriptorSet(downsampler.descriptors, downsampler.layout,
+                             job.set);
+        job.set = VK_NULL_HANDLE;
+    }
+    downsampler.freeCounters.push_back(job.counter);
+}
+
+void destroyDownsampler(const vkDevice& device, srDownsampler& downsampler) {
+    if (not downsampler.supported) return;
+
+    destroyDescriptorAllocator(device, downsampler.descriptors);
+    destroyDescriptorTemplate(device, downsampler.descTemplate);
+    vkDestroyDescriptorSetLayout(device.ldevice, downsampler.layout, nullptr);
+    vkDestroyPipeline(device.ldevice, downsampler.pipeline.pipeline, nullptr);
+    vkDestroyPipelineLayout(device.ldevice, downsampler.pipeline.layout,
+                            nullptr);
+    vkDestroySampler(device.ldevice, downsampler.sampler, nullptr);
+    destroyBuffer(device, downsampler.counters);
+    downsampler.freeCounters.clear();
+    downsampler.supported = false;
+}
+
+}  // namespace gbg
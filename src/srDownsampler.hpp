@@ -0,0 +1,78 @@
+#pragma once
+#include <vulkan/vulkan_core.h>
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "vk_utils/vkBuffer.hh"
+#include "vk_utils/vkDescriptorAllocator.hh"
+#include "vk_utils/vkDescriptorTemplate.hh"
+#include "vk_utils/vkDevice.hh"
+#include "vk_utils/vkPipeline.hh"
+
+namespace gbg {
+
+const uint32_t maxDownsampleLevels = 12;
+// dispatches that can be recorded and not yet finished
+const uint32_t maxDownsampleJobs = 256;
+
+// Builds a whole mip chain in one compute dispatch instead of a blit and two
+// barriers per level. Works on any rgba8 image created with storage usage,
+// so texture uploads, bloom chains and the like can share it.
+struct srDownsampler {
+    vkPipeline pipeline{};
+    VkDescriptorSetLayout layout = VK_NULL_HANDLE;
+    vkDescriptorTemplate descTemplate;
+    vkDescriptorAllocator descriptors{};
+    VkSampler sampler = VK_NULL_HANDLE;
+
+    // an atomic counter per dispatch finds the last workgroup, the shader
+    // leaves it at zero for the next one
+    vkBuffer counters{};
+    VkDeviceSize counterStride = 0;
+    std::vector<uint32_t> freeCounters;
+
+    bool subgroupQuad = false;
+    bool supported = false;
+};
+
+// What a dispatch uses until the gpu is done with it.
+struct srDownsampleJob {
+    VkImage image = VK_NULL_HANDLE;
+    std::vector<VkImageView> views;
+    VkDescriptorSet set = VK_NULL_HANDLE;
+    uint32_t counter = 0;
+    uint32_t width = 0;
+    uint32_t height = 0;
+    uint32_t mipLevels = 0;
+    bool srgb = false;
+};
+
+void createDownsampler(const vkDevice& device, srDownsampler& downsampler,
+                       const std::string& shaderPath);
+
+// Images it can take must be created with storage usage and, for sRGB,
+// as VK_FORMAT_R8G8B8A8_UNORM with the mutable format flag.
+bool canDownsample(const srDownsampler& downsampler, VkFormat format,
+                   uint32_t width, uint32_t height, uint32_t mipLevels);
+
+// Only valid after canDownsample, reserves the views, set and counter.
+srDownsampleJob prepareDownsample(const vkDevice& device,
+                                  srDownsampler& downsampler, VkImage image,
+                                  VkFormat format, uint32_t width,
+                                  uint32_t height, uint32_t mipLevels);
+
+// Level 0 must be in SHADER_READ_ONLY_OPTIMAL and the rest in GENERAL,
+// barriers around the dispatch are left to the caller so they batch.
+void recordDownsample(const srDownsampler& downsampler,
+                      VkCommandBuffer commandBuffer,
+                      const srDownsampleJob& job);
+
+// Once the command buffer that recorded the job completed.
+void releaseDownsampleJob(const vkDevice& device, srDownsampler& downsampler,
+                          srDownsampleJob& job);
+
+void destroyDownsampler(const vkDevice& device, srDownsampler& downsampler);
+
+}  // namespace gbg
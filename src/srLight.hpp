@@ -1,19 +1,28 @@
 
 #include <glm/ext/vector_float3.hpp>
 
+#include <cstdint>
+
 #include "Light.hpp"
 #include "Resource.hpp"
 #include "glm/ext/matrix_float4x4.hpp"
 #include "macros.hpp"
 namespace gbg {
 
-// losing space
+// std430, the scalars fill the vec3s up to 16 bytes
 struct vkLight {
-    alignas(16) glm::vec3 color;
-    alignas(16) glm::vec3 direction;
-    alignas(16) glm::vec3 position;
-    alignas(16) glm::mat4 proj;
+    glm::vec3 position;
+    // it fades out to nothing there, the clusters bin it with it
+    float range;
+    glm::vec3 color;
+    // of its tile of the shadow atlas in texels, x in the low 16 bits
+    uint32_t shadowOrigin;
+    glm::vec3 direction;
+    // the side of the tile in texels, 0 without one
+    uint32_t shadowSize;
+    glm::mat4 proj;
 };
+static_assert(sizeof(vkLight) == 112);
 
 struct srLight : public Resource {
     srLight() : Resource() {}
@@ -0,0 +1,158 @@
+#include "srLightClusters.hpp"
+
+#include <vulkan/vulkan_core.h>
+
+#include <cmath>
+#include <cstring>
+
+#include "shaderReflexion.hpp"
+
+namespace gbg {
+
+const uint32_t lightClusterGroupSize = 64;
+
+struct LightClusterParams {
+    glm::mat4 view;
+    glm::mat4 inverseProjection;
+    glm::uvec4 grid;   // tiles x, y, depth slices, lights per cluster
+    glm::vec4 depth;   // near, far, slice scale, slice bias
+    glm::vec4 screen;  // size, tile size in pixels
+    uint32_t lightCount;
+    uint32_t padding[3];
+};
+
+// what the shader copies in front of the ranges
+const VkDeviceSize lightClusterHeaderSize = 48;
+
+static std::vector<VkDescriptorSetLayoutBinding> lightClusterBindings() {
+    // params, lights, clusters, light indices
+    std::vector<VkDescriptorSetLayoutBinding> bindings(4);
+    for (uint32_t i = 0; i < bindings.size(); i++) {
+        bindings[i].binding = i;
+        bindings[i].descriptorType = i == 0 ? VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER
+                                            : VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+        bindings[i].descriptorCount = 1;
+        bindings[i].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+        bindings[i].pImmutableSamplers = nullptr;
+    }
+    return bindings;
+}
+
+void createLightClusters(const vkDevice& device, srLightClusters& clusters,
+                         const std::string& shaderPath, uint32_t frameCount) {
+    std::vector<VkDescriptorSetLayoutBinding> bindings = lightClusterBindings();
+    VkDescriptorSetLayoutCreateInfo layoutInfo{};
+    layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+    layoutInfo.bindingCount = static_cast<uint32_t>(bindings.size());
+    layoutInfo.pBindings = bindings.data();
+    if (vkCreateDescriptorSetLayout(device.ldevice, &layoutInfo, nullptr,
+                                    &clusters.layout) != VK_SUCCESS) {
+        throw std::runtime_error("failed to create descriptor set layout!");
+    }
+    clusters.descTemplate =
+        createDescriptorTemplate(device, bindings, clusters.layout);
+    clusters.pipeline = createComputePipeline(
+        device, compileComputeShader(shaderPath, {}), {clusters.layout}, {});
+
+    clusters.frames.resize(frameCount);
+    for (srLightClusterFrame& frame : clusters.frames) {
+        frame.params = createBuffer(device, sizeof(LightClusterParams),
+                                    VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT,
+                                    VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
+                                        VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+        vkMapMemory(device.ldevice, frame.params.memory, 0, frame.params.size,
+                    0, &frame.paramsMapped);
+        frame.clusters = createBuffer(
+            device,
+            lightClusterHeaderSize + lightClusterCount * 2 * sizeof(uint32_t),
+            VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+            VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+        frame.indices = createBuffer(
+            device,
+            static_cast<VkDeviceSize>(lightClusterCount) *
+                maxLightsPerCluster * sizeof(uint32_t),
+            VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+            VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+    }
+}
+
+void updateLightClusters(srLightClusters& clusters, uint32_t frame,
+                         const glm::mat4& view, const glm::mat4& projection,
+                         VkExtent2D extent, uint32_t lightCount) {
+    // back from a perspective with a 0 to 1 depth range
+    float zNear = projection[3][2] / projection[2][2];
+    float zFar = projection[3][2] / (projection[2][2] + 1.0f);
+    float logRatio = std::log(zFar / zNear);
+
+    LightClusterParams params{};
+    params.view = view;
+    params.inverseProjection = glm::inverse(projection);
+    params.grid = {lightClusterTilesX, lightClusterTilesY, lightClusterSlices,
+                   maxLightsPerCluster};
+    // slice = log(depth) * scale - bias
+    params.depth = {zNear, zFar, lightClusterSlices / logRatio,
+                    lightClusterSlices * std::log(zNear) / logRatio};
+    params.screen = {static_cast<float>(extent.width),
+                     static_cast<float>(extent.height),
+                     std::ceil(extent.width / float(lightClusterTilesX)),
+                     std::ceil(extent.height / float(lightClusterTilesY))};
+    params.lightCount = lightCount;
+    std::memcpy(clusters.frames[frame].paramsMapped, &params, sizeof(params));
+
+    clusters.stats.lights = lightCount;
+}
+
+void recordLightClustering(const vkDevice& device, srLightClusters& clusters,
+                           uint32_t frame, VkCommandBuffer commandBuffer,
+                           const vkBuffer& lights,
+                           vkDescriptorAllocator& descriptors) {
+    const srLightClusterFrame& clusterFrame = clusters.frames[frame];
+    const vkDescriptorTemplate& tmpl = clusters.descTemplate;
+    std::vector<std::byte> data(tmpl.dataSize);
+    VkDescriptorBufferInfo paramsInfo{clusterFrame.params.buffer, 0,
+                                      VK_WHOLE_SIZE};
+    VkDescriptorBufferInfo lightsInfo{lights.buffer, 0, VK_WHOLE_SIZE};
+    VkDescriptorBufferInfo clustersInfo{clusterFrame.clusters.buffer, 0,
+                                        VK_WHOLE_SIZE};
+    VkDescriptorBufferInfo indicesInfo{clusterFrame.indices.buffer, 0,
+                                       VK_WHOLE_SIZE};
+    setTemplateBuffer(tmpl, data.data(), 0, 0, paramsInfo);
+    setTemplateBuffer(tmpl, data.data(), 1, 0, lightsInfo);
+    setTemplateBuffer(tmpl, data.data(), 2, 0, clustersInfo);
+    setTemplateBuffer(tmpl, data.data(), 3, 0, indicesInfo);
+    VkDescriptorSet set =
+        allocateDescriptorSet(device, descriptors, clusters.layout);
+    updateDescriptorSet(device, tmpl, set, data.data());
+
+    vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE,
+                      clusters.pipeline.pipeline);
+    vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE,
+                            clusters.pipeline.layout, 0, 1, &set, 0, nullptr);
+    vkCmdDispatch(commandBuffer,
+                  (lightClusterCount + lightClusterGroupSize - 1) /
+                      lightClusterGroupSize,
+                  1, 1);
+
+    VkMemoryBarrier barrier{};
+    barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+    barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+    barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+    vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                         VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0, 1, &barrier,
+                         0, nullptr, 0, nullptr);
+}
+
+void destroyLightClusters(const vkDevice& device, srLightClusters& clusters) {
+    for (srLightClusterFrame& frame : clusters.frames) {
+        destroyBuffer(device, frame.params);
+        destroyBuffer(device, frame.clusters);
+        destroyBuffer(device, frame.indices);
+    }
+    clusters.frames.clear();
+    destroyDescriptorTemplate(device, clusters.descTemplate);
+    vkDestroyDescriptorSetLayout(device.ldevice, clusters.layout, nullptr);
+    vkDestroyPipeline(device.ldevice, clusters.pipeline.pipeline, nullptr);
+    vkDestroyPipelineLayout(device.ldevice, clusters.pipeline.layout, nullptr);
+}
+
+}  // namespace gbg
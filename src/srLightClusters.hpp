@@ -0,0 +1,79 @@
+#pragma once
+#include <vulkan/vulkan_core.h>
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "glm/glm.hpp"
+#include "vk_utils/vkBuffer.hh"
+#include "vk_utils/vkDescriptorAllocator.hh"
+#include "vk_utils/vkDescriptorTemplate.hh"
+#include "vk_utils/vkDevice.hh"
+#include "vk_utils/vkPipeline.hh"
+
+namespace gbg {
+
+// froxels the view frustum is cut in, depth slices grow exponentially
+const uint32_t lightClusterTilesX = 16;
+const uint32_t lightClusterTilesY = 9;
+const uint32_t lightClusterSlices = 24;
+const uint32_t lightClusterCount =
+    lightClusterTilesX * lightClusterTilesY * lightClusterSlices;
+// the rest of the lights reaching a cluster are dropped
+const uint32_t maxLightsPerCluster = 128;
+
+struct srLightClusterSettings {
+    // lights fade out to nothing at this distance, the renderer writes it
+    // in their vkLight
+    float lightRange = 100.0f;
+};
+
+struct srLightClusterStats {
+    uint32_t lights = 0;
+    uint32_t clusters = lightClusterCount;
+};
+
+// Buffers of one frame in flight. The fragment shaders read clusters and
+// indices through the global set, so they are created once.
+struct srLightClusterFrame {
+    // camera and grid, written once its fence was waited
+    vkBuffer params{};
+    void* paramsMapped = nullptr;
+    // the grid the shader copies from params, then the first index and the
+    // count of every cluster
+    vkBuffer clusters{};
+    // maxLightsPerCluster slots per cluster
+    vkBuffer indices{};
+};
+
+// Bins the lights in the froxels of the camera in a compute pass, so the
+// main pass only shades a fragment with the lights reaching its cluster.
+struct srLightClusters {
+    vkPipeline pipeline{};
+    VkDescriptorSetLayout layout = VK_NULL_HANDLE;
+    vkDescriptorTemplate descTemplate;
+    std::vector<srLightClusterFrame> frames;
+
+    srLightClusterSettings settings;
+    srLightClusterStats stats;
+};
+
+void createLightClusters(const vkDevice& device, srLightClusters& clusters,
+                         const std::string& shaderPath, uint32_t frameCount);
+
+// Once the frame's fence was waited, with the matrices of the main pass.
+void updateLightClusters(srLightClusters& clusters, uint32_t frame,
+                         const glm::mat4& view, const glm::mat4& projection,
+                         VkExtent2D extent, uint32_t lightCount);
+
+// Outside of a render pass, lights holds lightCount vkLight. Sets come from
+// the frame's transient allocator.
+void recordLightClustering(const vkDevice& device, srLightClusters& clusters,
+                           uint32_t frame, VkCommandBuffer commandBuffer,
+                           const vkBuffer& lights,
+                           vkDescriptorAllocator& descriptors);
+
+void destroyLightClusters(const vkDevice& device, srLightClusters& clusters);
+
+}  // namespace gbg
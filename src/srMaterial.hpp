@@ -1,6 +1,10 @@
 #pragma once
 #include <vulkan/vulkan_core.h>
 
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
 #include "Material.hpp"
 #include "Resource.hpp"
 #include "macros.hpp"
@@ -16,9 +20,17 @@ struct srParameterValues {
 struct srMaterial : public Resource {
     srMaterial() : Resource(){};
     srMaterial(std::string name, uint32_t rid) : Resource(name, rid){};
-    VkDescriptorSet descriptor_set;
+    VkDescriptorSet descriptor_set = VK_NULL_HANDLE;
+    // layout the set was allocated with
+    VkDescriptorSetLayout layout = VK_NULL_HANDLE;
     std::vector<VkDescriptorSet> texture_descriptors;
     vkBuffer paramBuffer;
+    // packed descriptor infos laid out by the shader's update template
+    std::vector<std::byte> descriptorData;
+    // sum of the bound textures' generations, the placeholder counts as 0
+    uint32_t textureGeneration = 0;
+    // frame it was last bound in
+    uint64_t lastUsed = 0;
 };
 
 struct srMaterialHandle : public ResourceHandle {
@@ -3,72 +3,99 @@
 #include <string.h>
 #include <vulkan/vulkan_core.h>
 
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <iostream>
 #include <list>
+#include <span>
+#include <thread>
+#include <type_traits>
+#include <variant>
 #include <vector>
 
 #include "Mesh.hpp"
 #include "glm/ext/vector_float3.hpp"
 #include "glm/glm.hpp"
+#include "glm/gtc/packing.hpp"
 #include "vk_utils/Logger.hpp"
 #include "vk_utils/vkBuffer.hh"
 
 namespace gbg {
-srAttribute::srAttribute(vkDevice device, uint attrib_id, size_t size,
-                         AttributeTypes type, void* data)
-    : attrib_id(attrib_id), type(type) {
+srVertexLayout chooseVertexLayout(const vkDevice& device,
+                                  srVertexFormat format) {
+    srVertexLayout layout{};
+    layout.format = format;
+
+    VkFormatProperties properties;
+    vkGetPhysicalDeviceFormatProperties(device.pdevice, layout.unitVector,
+                                        &properties);
+    if (not(properties.bufferFeatures & VK_FORMAT_FEATURE_VERTEX_BUFFER_BIT))
+        layout.unitVector = VK_FORMAT_R8G8B8A8_SNORM;
+    return layout;
+}
+
+VkFormat vertexAttributeFormat(const srVertexLayout& layout, int attrib_id,
+                               AttributeTypes type) {
+    bool quantized = layout.format == VERTEX_QUANTIZED;
     switch (type) {
+        case gbg::AttributeTypes::FLOAT_ATTR:
+            return VK_FORMAT_R32_SFLOAT;
+        case gbg::AttributeTypes::VEC2_ATTR:
+            return quantized ? VK_FORMAT_R16G16_SFLOAT
+                             : VK_FORMAT_R32G32_SFLOAT;
         case gbg::AttributeTypes::VEC3_ATTR:
-            size *= sizeof(glm::vec3);
-            break;
-        case FLOAT_ATTR:
-            size *= sizeof(float);
-            break;
-        case VEC2_ATTR:
-            size *= sizeof(glm::vec2);
-            break;
+            if (not quantized) return VK_FORMAT_R32G32B32_SFLOAT;
+            // three 16 bit channels aren't required to be fetchable
+            return attrib_id == 0 ? VK_FORMAT_R16G16B16A16_UNORM
+                                  : layout.unitVector;
     }
+    return VK_FORMAT_UNDEFINED;
+}
 
-    this->size = size;
-
-    VkDeviceSize dsize = size;
-
-    gbg::vkBuffer stagingBuffer =
-        gbg::createBuffer(device, dsize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
-                          VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
-                              VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+uint32_t vertexFormatSize(VkFormat format) {
+    switch (format) {
+        case VK_FORMAT_R32_SFLOAT:
+        case VK_FORMAT_R16G16_SFLOAT:
+        case VK_FORMAT_A2B10G10R10_SNORM_PACK32:
+        case VK_FORMAT_R8G8B8A8_SNORM:
+            return 4;
+        case VK_FORMAT_R32G32_SFLOAT:
+        case VK_FORMAT_R16G16B16A16_UNORM:
+            return 8;
+        case VK_FORMAT_R32G32B32_SFLOAT:
+            return 12;
+        default:
+            return 0;
+    }
+}
 
-    void* sdata;
-    vkMapMemory(device.ldevice, stagingBuffer.memory, 0, dsize, 0, &sdata);
-    memcpy(sdata, data, size);
-    vkUnmapMemory(device.ldevice, stagingBuffer.memory);
+srAttribute::srAttribute(vkDevice device, uint attrib_id, size_t count,
+                         AttributeTypes type, VkFormat format, void* data)
+    : attrib_id(attrib_id), type(type), format(format) {
+    size = count * vertexFormatSize(format);
 
-    buffer = gbg::createBuffer(
-        device, dsize,
-        VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
-        VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
-    copyBuffer(device, stagingBuffer, buffer);
-    vkDestroyBuffer(device.ldevice, stagingBuffer.buffer, nullptr);
-    vkFreeMemory(device.ldevice, stagingBuffer.memory, nullptr);
+    vkBufferUpload upload =
+        beginBufferUpload(device, size, VK_BUFFER_USAGE_VERTEX_BUFFER_BIT);
+    memcpy(upload.data.data(), data, size);
+    finishBufferUploads(device, {&upload, 1});
+    buffer = upload.buffer;
 }
 
+srAttribute::srAttribute(uint attrib_id, size_t count, AttributeTypes type,
+                         VkFormat format, vkBuffer buffer)
+    : buffer(buffer),
+      attrib_id(attrib_id),
+      size(count * vertexFormatSize(format)),
+      type(type),
+      format(format) {}
+
 std::pair<VkVertexInputBindingDescription, VkVertexInputAttributeDescription>
 srAttribute::getAttributeDescriptions() const {
     VkVertexInputBindingDescription description{};
     VkVertexInputAttributeDescription attributeDescription{};
-    switch (type) {
-        case gbg::AttributeTypes::FLOAT_ATTR:
-            description.stride = sizeof(float);
-            attributeDescription.format = VK_FORMAT_R32_SFLOAT;
-            break;
-        case gbg::AttributeTypes::VEC2_ATTR:
-            description.stride = sizeof(glm::vec2);
-            attributeDescription.format = VK_FORMAT_R32G32_SFLOAT;
-            break;
-        case gbg::AttributeTypes::VEC3_ATTR:
-            description.stride = sizeof(glm::vec3);
-            attributeDescription.format = VK_FORMAT_R32G32B32_SFLOAT;
-            break;
-    }
+    description.stride = vertexFormatSize(format);
+    attributeDescription.format = format;
 
     description.binding = attrib_id;
     description.inputRate = VK_VERTEX_INPUT_RATE_VERTEX;
@@ -94,49 +121,1039 @@ std::vector<uint32_t> createIndexBuffer(
     return indices;
 }
 
-glm::vec3 computeTangent(glm::vec3 p1, glm::vec2 uv1, glm::vec3 p2,
-                         glm::vec2 uv2, glm::vec3 p3, glm::vec2 uv3) {
-    glm::vec3 edge1 = p2 - p1;
-    glm::vec3 edge2 = p3 - p1;
-    glm::vec2 duv1 = uv2 - uv1;
-    glm::vec2 duv2 = uv3 - uv1;
+// fewer triangles per thread than this aren't worth spawning it
+const size_t trianglesPerThread = 16384;
 
-    float f = 1.0f / (duv1.x * duv2.y - duv2.x * duv1.y);
+// Runs body(part, begin, end) over threads parts of [0, count), the first
+// one on the calling thread.
+template <typename F>
+static void splitAcrossThreads(size_t count, uint32_t threads, F&& body) {
+    std::vector<std::jthread> workers;
+    for (uint32_t i = 1; i < threads; i++) {
+        workers.emplace_back([&, i] {
+            body(i, count * i / threads, count * (i + 1) / threads);
+        });
+    }
+    body(0, 0, count / threads);
+}
+
+// Adds the uv tangent of triangles [begin, end) to the vertices they use.
+// The ones with degenerate uvs add nothing.
+static void accumulateTangents(const std::vector<glm::vec3>& pos,
+                               const std::vector<glm::vec2>& tex_coord,
+                               const std::vector<uint32_t>& indices,
+                               size_t begin, size_t end,
+                               std::vector<glm::vec3>& tangents) {
+    if (tex_coord.size() != pos.size()) return;
+    for (size_t t = begin; t < end; t++) {
+        const uint32_t* tri = &indices[t * 3];
+        glm::vec3 edge1 = pos[tri[1]] - pos[tri[0]];
+        glm::vec3 edge2 = pos[tri[2]] - pos[tri[0]];
+        glm::vec2 duv1 = tex_coord[tri[1]] - tex_coord[tri[0]];
+        glm::vec2 duv2 = tex_coord[tri[2]] - tex_coord[tri[0]];
 
-    glm::vec3 t;
-    t.x = f * (duv2.y * edge1.x - duv1.y * edge2.x);
-    t.y = f * (duv2.y * edge1.y - duv1.y * edge2.y);
-    t.z = f * (duv2.y * edge1.z - duv1.y * edge2.z);
+        float det = duv1.x * duv2.y - duv2.x * duv1.y;
+        // relative to the uv edges, tiny uv islands still count. Also
+        // false for nans
+        float scale = (std::abs(duv1.x) + std::abs(duv1.y)) *
+                      (std::abs(duv2.x) + std::abs(duv2.y));
+        if (not(std::abs(det) > 1e-6f * scale)) continue;
 
-    return t;
+        glm::vec3 tangent = (edge1 * duv2.y - edge2 * duv1.y) / det;
+        tangents[tri[0]] += tangent;
+        tangents[tri[1]] += tangent;
+        tangents[tri[2]] += tangent;
+    }
 }
 
 std::vector<glm::vec3> createTangentBuffer(
-    vkDevice device, const std::vector<glm::vec3>& pos,
-    const std::vector<glm::vec2> tex_coord,
-    const std::vector<uint32_t> indices) {
-    std::vector<glm::vec3> tangents(pos.size(), glm::vec3(0.0f));
-    for (int i = 0; i < indices.size(); i += 3) {
+    const std::vector<glm::vec3>& pos, const std::vector<glm::vec2>& tex_coord,
+    const std::vector<uint32_t>& indices, uint32_t threads) {
+    size_t vertexCount = pos.size();
+    size_t triangleCount = indices.size() / 3;
+    if (threads == 0)
+        threads = std::max(std::thread::hardware_concurrency(), 1u);
+    threads = static_cast<uint32_t>(std::clamp<size_t>(
+        triangleCount / trianglesPerThread, 1, threads));
+
+    // the first thread adds straight into the result, the others into their
+    // own copy so no vertex is written by two of them
+    std::vector<glm::vec3> tangents(vertexCount, glm::vec3(0.0f));
+    std::vector<std::vector<glm::vec3>> partial(threads - 1);
+    splitAcrossThreads(triangleCount, threads,
+                       [&](uint32_t part, size_t begin, size_t end) {
+                           std::vector<glm::vec3>& sums =
+                               part == 0 ? tangents : partial[part - 1];
+                           sums.resize(vertexCount, glm::vec3(0.0f));
+                           accumulateTangents(pos, tex_coord, indices, begin,
+                                              end, sums);
+                       });
+
+    splitAcrossThreads(
+        vertexCount, threads, [&](uint32_t part, size_t begin, size_t end) {
+            for (size_t v = begin; v < end; v++) {
+                glm::vec3 sum = tangents[v];
+                for (const std::vector<glm::vec3>& sums : partial)
+                    sum += sums[v];
+                float length2 = glm::dot(sum, sum);
+                tangents[v] = length2 > 1e-24f and std::isfinite(length2)
+                                  ? sum / std::sqrt(length2)
+                                  : glm::vec3(0.0f);
+            }
+        });
+
+    // No usable tangent: degenerate uvs only, or mirrored ones cancelling
+    // out. An edge of a triangle around the vertex lies on the surface, the
+    // shaders orthogonalize it against the normal.
+    const glm::vec3 missing(0.0f);
+    if (std::find(tangents.begin(), tangents.end(), missing) == tangents.end())
+        return tangents;
+    for (size_t i = 0; i + 2 < indices.size(); i += 3) {
+        for (size_t j = 0; j < 3; j++) {
+            uint32_t v = indices[i + j];
+            if (tangents[v] != missing) continue;
+            glm::vec3 edge = pos[indices[i + (j + 1) % 3]] - pos[v];
+            float length = glm::length(edge);
+            if (length > 0.0f and std::isfinite(length))
+                tangents[v] = edge / length;
+        }
+    }
+    // left with vertices no triangle with an area uses
+    std::replace(tangents.begin(), tangents.end(), missing,
+                 glm::vec3(1.0f, 0.0f, 0.0f));
+    return tangents;
+}
+
+// Written in place on devices with host visible vram.
+static vkBuffer uploadDeviceBuffer(vkDevice device, const void* data,
+                                   VkDeviceSize size,
+                                   VkBufferUsageFlags usage) {
+    vkBufferUpload upload = beginBufferUpload(device, size, usage);
+    memcpy(upload.data.data(), data, size);
+    finishBufferUploads(device, {&upload, 1});
+    return upload.buffer;
+}
+
+vkBuffer uploadIndexBuffer(vkDevice device, const void* indices,
+                           VkDeviceSize size) {
+    return uploadDeviceBuffer(device, indices, size,
+                              VK_BUFFER_USAGE_INDEX_BUFFER_BIT);
+}
+
+static std::vector<uint8_t> packIndices(const std::vector<uint32_t>& indices) {
+    std::vector<uint8_t> packed;
+    packed.reserve(indices.size());
+    uint32_t previous = 0;
+    for (uint32_t index : indices) {
+        int32_t delta = static_cast<int32_t>(index - previous);
+        uint32_t zigzag = (static_cast<uint32_t>(delta) << 1) ^
+                          static_cast<uint32_t>(delta >> 31);
+        while (zigzag >= 0x80) {
+            packed.push_back(static_cast<uint8_t>(zigzag | 0x80));
+            zigzag >>= 7;
+        }
+        packed.push_back(static_cast<uint8_t>(zigzag));
+        previous = index;
+    }
+    return packed;
+}
+
+static std::vector<uint32_t> unpackIndices(const std::vector<uint8_t>& packed,
+                                           uint32_t count) {
+    std::vector<uint32_t> indices;
+    indices.reserve(count);
+    uint32_t previous = 0;
+    size_t i = 0;
+    while (i < packed.size()) {
+        uint32_t zigzag = 0;
+        uint32_t shift = 0;
+        uint8_t byte;
+        do {
+            byte = packed[i++];
+            zigzag |= static_cast<uint32_t>(byte & 0x7f) << shift;
+            shift += 7;
+        } while (byte & 0x80);
+        uint32_t delta = (zigzag >> 1) ^ (0u - (zigzag & 1));
+        previous += delta;
+        indices.push_back(previous);
+    }
+    return indices;
+}
+
+// Packs the values in format to out. Positions are stored relative to the
+// bounding cube at origin with side extent.
+template <typename T>
+static void encodeVerticesTo(std::byte* out, std::span<const T> values,
+                             VkFormat format, glm::vec3 origin, float extent) {
+    if (vertexFormatSize(format) == sizeof(T)) {
+        memcpy(out, values.data(), values.size_bytes());
+        return;
+    }
+
+    for (const T& value : values) {
+        if constexpr (std::is_same_v<T, glm::vec2>) {
+            uint32_t packed = glm::packHalf2x16(value);
+            memcpy(out, &packed, sizeof(packed));
+        } else if constexpr (std::is_same_v<T, glm::vec3>) {
+            if (format == VK_FORMAT_R16G16B16A16_UNORM) {
+                uint64_t packed = glm::packUnorm4x16(
+                    glm::vec4((value - origin) / extent, 0.0f));
+                memcpy(out, &packed, sizeof(packed));
+            } else if (format == VK_FORMAT_A2B10G10R10_SNORM_PACK32) {
+                uint32_t packed =
+                    glm::packSnorm3x10_1x2(glm::vec4(value, 0.0f));
+                memcpy(out, &packed, sizeof(packed));
+            } else {
+                uint32_t packed = glm::packSnorm4x8(glm::vec4(value, 0.0f));
+                memcpy(out, &packed, sizeof(packed));
+            }
+        }
+        out += vertexFormatSize(format);
+    }
+}
+
+template <typename T>
+static std::vector<std::byte> encodeVertices(const std::vector<T>& values,
+                                             VkFormat format,
+                                             glm::vec3 origin, float extent) {
+    std::vector<std::byte> bytes(values.size() * vertexFormatSize(format));
+    encodeVerticesTo(bytes.data(), std::span<const T>(values), format, origin,
+                     extent);
+    return bytes;
+}
+
+srMeshCopy copyMesh(vkDevice device, Mesh& mesh,
+                    const srMeshOptimization& optimization,
+                    const srVertexLayout& layout,
+                    srMeshOptimizationStats* stats, bool uploadOnly) {
+    const auto& positions = mesh.getAttribute<AttributeTypes::VEC3_ATTR>(0);
+    std::vector<uint32_t> indices = createIndexBuffer(device, mesh.getFaces());
+    size_t vertexCount = positions.size();
+    const size_t meshVertices = vertexCount;
+
+    srMeshCopy copy{};
+    // over the Mesh's own vertices, before anything reorders them
+    copy.uvDensity = computeUVDensity(
+        positions, mesh.getAttribute<AttributeTypes::VEC2_ATTR>(2), indices);
+
+    // new vertex to old one, empty keeps the order
+    std::vector<uint32_t> remap;
+    if (optimization.weld and vertexCount > 0) {
+        std::vector<srVertexStream> streams;
+        for (auto& attr : mesh.getAttributes()) {
+            std::visit(
+                [&](auto&& values) {
+                    if (values.size() != vertexCount) return;
+                    streams.push_back(
+                        {reinterpret_cast<const std::byte*>(values.data()),
+                         sizeof(values[0])});
+                },
+                attr.second);
+        }
+        std::vector<uint32_t> original = indices;
+        remap = weldVertices(indices, streams, vertexCount);
+        // an edit of a merged vertex can't be written in place once it
+        // differs from the others
+        if (remap.size() < vertexCount) {
+            copy.weldedInto.assign(vertexCount, UINT32_MAX);
+            for (size_t i = 0; i < indices.size(); i++)
+                copy.weldedInto[original[i]] = remap[indices[i]];
+        }
+        LOG("Welded " << mesh.getName() << ": " << vertexCount << " -> "
+                      << remap.size() << " vertices");
+        vertexCount = remap.size();
+    }
+    auto welded = [&](const auto& values) {
+        return remap.empty() ? values : remapVertices(values, remap);
+    };
+
+    // over the welded vertices, so they are averaged across all the faces
+    // that share one
+    std::vector<glm::vec3> weldedPositions = welded(positions);
+    const auto& uvs = mesh.getAttribute<AttributeTypes::VEC2_ATTR>(2);
+    auto tangents = createTangentBuffer(
+        weldedPositions,
+        uvs.size() == meshVertices ? welded(uvs) : std::vector<glm::vec2>(),
+        indices);
+
+    if (optimization.enabled) {
+        srVertexCacheStats before =
+            analyzeVertexCache(indices, vertexCount, optimization.cacheSize);
+        auto clusters =
+            optimizeVertexCache(indices, vertexCount, optimization.cacheSize);
+        if (optimization.overdraw)
+            optimizeOverdraw(indices, clusters, weldedPositions);
+        if (optimization.vertexFetch) {
+            std::vector<uint32_t> fetch =
+                optimizeVertexFetch(indices, vertexCount);
+            tangents = remapVertices(tangents, fetch);
+            if (not remap.empty()) {
+                for (uint32_t& v : fetch) v = remap[v];
+            }
+            remap = std::move(fetch);
+            vertexCount = remap.size();
+        }
+        srVertexCacheStats after =
+            analyzeVertexCache(indices, vertexCount, optimization.cacheSize);
+        if (stats)
+            addOptimizationStats(*stats, indices.size() / 3, before, after);
+    }
+
+    // a cube keeps the scale uniform, normals go through the same matrix
+    glm::vec3 origin(0.0f);
+    float extent = 1.0f;
+    if (layout.format == VERTEX_QUANTIZED and not positions.empty()) {
+        glm::vec3 lo = positions[0], hi = positions[0];
+        for (const glm::vec3& p : positions) {
+            lo = glm::min(lo, p);
+            hi = glm::max(hi, p);
+        }
+        glm::vec3 size = hi - lo;
+        origin = lo;
+        extent = glm::max(size.x, glm::max(size.y, size.z));
+        if (extent <= 0.0f) extent = 1.0f;
+        copy.dequantize = glm::mat4(extent);
+        copy.dequantize[3] = glm::vec4(origin, 1.0f);
+    }
+
+    auto addStream = [&](int attrib_id, AttributeTypes type,
+                         const auto& values) {
+        VkFormat format = vertexAttributeFormat(layout, attrib_id, type);
+        copy.attributes.push_back(
+            {attrib_id, type, format, values.size(),
+             encodeVertices(values, format, origin, extent)});
+    };
+    for (auto& attr : mesh.getAttributes()) {
+        std::visit(
+            [&](auto&& values) {
+                int id = static_cast<int>(attr.first);
+                auto type = (AttributeTypes)attr.second.index();
+                if (remap.empty() or values.size() != meshVertices) {
+                    addStream(id, type, values);
+                } else {
+                    addStream(id, type, remapVertices(values, remap));
+                }
+            },
+            attr.second);
+    }
+    // already in the final order
+    int tangentId = static_cast<int>(mesh.getAttributes().size());
+    if (uploadOnly) {
+        // uploadMeshCopy encodes them into mapped memory
+        copy.attributes.push_back(
+            {tangentId, AttributeTypes::VEC3_ATTR,
+             vertexAttributeFormat(layout, tangentId, AttributeTypes::VEC3_ATTR),
+             tangents.size(), {}});
+        copy.tangents = std::move(tangents);
+    } else {
+        addStream(tangentId, AttributeTypes::VEC3_ATTR, tangents);
+    }
+
+    std::vector<glm::vec3> finalPositions =
+        remap.empty() ? positions : remapVertices(positions, remap);
+    // over the full mesh only
+    if (optimization.meshlets) {
+        copy.meshlets =
+            buildMeshlets(indices, finalPositions, optimization.meshletVertices,
+                          optimization.meshletTriangles);
+        LOG("Split " << mesh.getName() << " in " << copy.meshlets.size()
+                     << " meshlets");
+    }
+
+    // every level is simplified from the one before, appended to the
+    // indices and over the same vertices
+    copy.lods.push_back({0, static_cast<uint32_t>(indices.size()), 0, 0, 0.0f});
+    uint32_t levels = std::min(optimization.lods, maxMeshLods - 1);
+    std::vector<uint32_t> level = indices;
+    for (uint32_t l = 0; l < levels; l++) {
+        size_t target = static_cast<size_t>(level.size() / 3 *
+                                            optimization.lodRatio) * 3;
+        float error;
+        std::vector<uint32_t> simpler =
+            simplifyMesh(level, finalPositions, target, error);
+        // locked seams and borders can keep it from going much further
+        if (simpler.empty() or simpler.size() > level.size() * 9 / 10) break;
+        if (optimization.enabled)
+            optimizeVertexCache(simpler, vertexCount, optimization.cacheSize);
+
+        copy.lods.push_back({static_cast<uint32_t>(indices.size()),
+                             static_cast<uint32_t>(simpler.size()), 0, 0,
+                             copy.lods.back().error + error});
+        indices.insert(indices.end(), simpler.begin(), simpler.end());
+        level = std::move(simpler);
+    }
+    if (copy.lods.size() > 1) {
+        LOG("Simplified " << mesh.getName() << ": "
+                          << copy.lods.front().indexCount / 3 << " -> "
+                          << copy.lods.back().indexCount / 3 << " triangles in "
+                          << copy.lods.size() - 1 << " levels");
+    }
+
+    copy.indices = packIndices(indices);
+    copy.indexCount = static_cast<uint32_t>(indices.size());
+    copy.sourceVertices = std::move(remap);
+    return copy;
+}
+
+// 0xffff is left out, it restarts primitives when that is enabled
+const uint32_t shortIndexRange = 0xffff;
+
+// Greedy in triangle order, a submesh ends when its vertices would span
+// more than a 16 bit index reaches. First use order keeps the spans short.
+static std::vector<srSubmesh> splitShortIndices(
+    const std::vector<uint32_t>& indices) {
+    std::vector<srSubmesh> submeshes;
+    uint32_t begin = 0;
+    uint32_t lo = UINT32_MAX, hi = 0;
+    for (uint32_t t = 0; t + 2 < indices.size(); t += 3) {
+        uint32_t tlo = std::min({indices[t], indices[t + 1], indices[t + 2]});
+        uint32_t thi = std::max({indices[t], indices[t + 1], indices[t + 2]});
+        if (t > begin and std::max(hi, thi) - std::min(lo, tlo) >=
+                              shortIndexRange) {
+            submeshes.push_back({begin, t - begin, static_cast<int32_t>(lo)});
+            begin = t;
+            lo = UINT32_MAX;
+            hi = 0;
+        }
+        lo = std::min(lo, tlo);
+        hi = std::max(hi, thi);
+    }
+    uint32_t count = static_cast<uint32_t>(indices.size());
+    if (count > begin)
+        submeshes.push_back({begin, count - begin, static_cast<int32_t>(lo)});
+    return submeshes;
+}
+
+// the type, submeshes and levels, the bytes are left to writeIndexData
+static srIndexData planIndexData(const srMeshCopy& copy,
+                                 const std::vector<uint32_t>& indices,
+                                 bool splitIndices) {
+    uint32_t count = static_cast<uint32_t>(indices.size());
+    uint32_t maxIndex =
+        indices.empty() ? 0 : *std::max_element(indices.begin(), indices.end());
+
+    srIndexData data{};
+    data.lods = copy.lods;
+    if (data.lods.empty()) data.lods.push_back({0, count, 0, 0, 0.0f});
+
+    // a submesh per level, unless they get split
+    auto wholeLevels = [&]() {
+        data.submeshes.clear();
+        for (srMeshLod& lod : data.lods) {
+            lod.firstSubmesh = static_cast<uint32_t>(data.submeshes.size());
+            lod.submeshCount = 1;
+            data.submeshes.push_back({lod.firstIndex, lod.indexCount, 0});
+        }
+    };
+
+    // the culling shader reads them as they are
+    bool shortIndices = maxIndex < shortIndexRange and copy.meshlets.empty();
+    if (shortIndices) {
+        wholeLevels();
+    } else if (splitIndices and copy.meshlets.empty()) {
+        // scattered vertices would take a draw every few triangles
+        size_t fewest = maxIndex / shortIndexRange + 1;
+        shortIndices = true;
+        for (srMeshLod& lod : data.lods) {
+            std::vector<srSubmesh> submeshes = splitShortIndices(
+                std::vector<uint32_t>(
+                    indices.begin() + lod.firstIndex,
+                    indices.begin() + lod.firstIndex + lod.indexCount));
+            if (submeshes.size() > 4 * fewest) {
+                shortIndices = false;
+                break;
+            }
+            lod.firstSubmesh = static_cast<uint32_t>(data.submeshes.size());
+            lod.submeshCount = static_cast<uint32_t>(submeshes.size());
+            for (srSubmesh& submesh : submeshes) {
+                submesh.firstIndex += lod.firstIndex;
+                data.submeshes.push_back(submesh);
+            }
+        }
+    }
+
+    if (not shortIndices) {
+        data.type = VK_INDEX_TYPE_UINT32;
+        wholeLevels();
+        return data;
+    }
+    data.type = VK_INDEX_TYPE_UINT16;
+    return data;
+}
+
+static size_t indexDataSize(const srIndexData& data, size_t count) {
+    return count * (data.type == VK_INDEX_TYPE_UINT16 ? sizeof(uint16_t)
+                                                      : sizeof(uint32_t));
+}
+
+// 16 bit ones relative to their submesh, out holds indexDataSize bytes
+static void writeIndexData(const srIndexData& data,
+                           const std::vector<uint32_t>& indices,
+                           std::byte* out) {
+    if (data.type == VK_INDEX_TYPE_UINT32) {
+        memcpy(out, indices.data(), indices.size() * sizeof(uint32_t));
+        return;
+    }
+    auto* packed = reinterpret_cast<uint16_t*>(out);
+    for (const srSubmesh& submesh : data.submeshes) {
+        for (uint32_t i = submesh.firstIndex;
+             i < submesh.firstIndex + submesh.indexCount; i++) {
+            packed[i] = static_cast<uint16_t>(
+                indices[i] - static_cast<uint32_t>(submesh.vertexOffset));
+        }
+    }
+}
+
+srIndexData buildIndexData(const srMeshCopy& copy, bool splitIndices) {
+    std::vector<uint32_t> indices =
+        unpackIndices(copy.indices, copy.indexCount);
+    srIndexData data = planIndexData(copy, indices, splitIndices);
+    data.bytes.resize(indexDataSize(data, indices.size()));
+    writeIndexData(data, indices, data.bytes.data());
+    return data;
+}
+
+srMeshData viewMeshCopy(const srMeshCopy& copy, const srIndexData& indices) {
+    srMeshData data{};
+    for (const srAttributeCopy& attr : copy.attributes) {
+        data.attributes.push_back({attr.attrib_id, attr.type, attr.format,
+                                   attr.count, attr.data.data()});
+    }
+    data.indexType = indices.type;
+    data.indices = indices.bytes;
+    data.submeshes = indices.submeshes;
+    data.lods = indices.lods;
+    data.meshlets = copy.meshlets;
+    data.dequantize = copy.dequantize;
+    return data;
+}
+
+// The buffers of a mesh begun in mapped memory, an upload per attribute,
+// then the indices and the meshlets.
+struct srMeshUpload {
+    std::vector<vkBufferUpload> uploads;
+    std::optional<vkStagingSpan> span;
+};
+
+// Sized from data, whose streams may still be unwritten, with indexSize
+// bytes of indices.
+static srMeshUpload beginMeshUpload(vkDevice device, const srMeshData& data,
+                                    VkDeviceSize indexSize,
+                                    vkStagingRing* ring) {
+    // the streams packed one after the other in the ring
+    const VkDeviceSize streamAlignment = 16;
+    auto aligned = [&](VkDeviceSize size) {
+        return (size + streamAlignment - 1) & ~(streamAlignment - 1);
+    };
+    srMeshUpload upload{};
+    if (ring and ring->mapped and not device.hostVisibleDeviceLocal) {
+        VkDeviceSize total =
+            aligned(indexSize) + aligned(data.meshlets.size_bytes());
+        for (const srAttributeView& attr : data.attributes) {
+            total += aligned(attr.count * vertexFormatSize(attr.format));
+        }
+        upload.span = acquireStaging(*ring, total, false);
+    }
+
+    VkDeviceSize spanOffset = 0;
+    auto begin = [&](VkDeviceSize size, VkBufferUsageFlags usage) {
+        if (upload.span) {
+            upload.uploads.push_back(beginBufferUpload(
+                device, size, usage, upload.span->buffer,
+                upload.span->offset + spanOffset,
+                upload.span->data + spanOffset));
+            spanOffset += aligned(size);
+        } else {
+            upload.uploads.push_back(beginBufferUpload(device, size, usage));
+        }
+    };
+    for (const srAttributeView& attr : data.attributes) {
+        begin(attr.count * vertexFormatSize(attr.format),
+              VK_BUFFER_USAGE_VERTEX_BUFFER_BIT);
+    }
+    VkBufferUsageFlags indexUsage = VK_BUFFER_USAGE_INDEX_BUFFER_BIT;
+    if (not data.meshlets.empty()) {
+        indexUsage |= VK_BUFFER_USAGE_STORAGE_BUFFER_BIT;
+    }
+    begin(indexSize, indexUsage);
+    if (not data.meshlets.empty()) {
+        begin(data.meshlets.size_bytes(), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT);
+    }
+    return upload;
+}
+
+// Once every stream was written, the staged ones go in one submit for the
+// whole mesh.
+static void finishMeshUpload(vkDevice device, srMesh& mesh,
+                             const srMeshData& data, srMeshUpload& upload,
+                             vkStagingRing* ring) {
+    std::vector<vkBufferUpload>& uploads = upload.uploads;
+    finishBufferUploads(device, uploads);
+    // the copies are done when it returns
+    if (upload.span) releaseStaging(*ring, *upload.span);
+
+    mesh.vertexAttributes.clear();
+    for (size_t i = 0; i < data.attributes.size(); i++) {
+        const srAttributeView& attr = data.attributes[i];
+        mesh.vertexAttributes.push_back(srAttribute(
+            attr.attrib_id, attr.count, attr.type, attr.format,
+            uploads[i].buffer));
+    }
+    mesh.dequantize = data.dequantize;
+    mesh.indexType = data.indexType;
+    mesh.indexCount = static_cast<uint32_t>(
+        data.indices.size() /
+        (data.indexType == VK_INDEX_TYPE_UINT16 ? sizeof(uint16_t)
+                                                : sizeof(uint32_t)));
+    mesh.submeshes.assign(data.submeshes.begin(), data.submeshes.end());
+    mesh.lods.assign(data.lods.begin(), data.lods.end());
+
+    size_t next = data.attributes.size();
+    mesh.indexBuffer = uploads[next++].buffer;
+    mesh.meshletCount = static_cast<uint32_t>(data.meshlets.size());
+    if (not data.meshlets.empty()) {
+        mesh.meshletBuffer = uploads[next].buffer;
+    }
+}
+
+void uploadMeshData(vkDevice device, srMesh& mesh, const srMeshData& data,
+                    vkStagingRing* ring) {
+    // every stream goes from the copy or the cache mapping to mapped memory
+    srMeshUpload upload =
+        beginMeshUpload(device, data, data.indices.size(), ring);
+    for (size_t i = 0; i < data.attributes.size(); i++) {
+        std::span<std::byte> out = upload.uploads[i].data;
+        memcpy(out.data(), data.attributes[i].data, out.size());
+    }
+    size_t next = data.attributes.size();
+    memcpy(upload.uploads[next++].data.data(), data.indices.data(),
+           data.indices.size());
+    if (not data.meshlets.empty()) {
+        memcpy(upload.uploads[next].data.data(), data.meshlets.data(),
+               data.meshlets.size_bytes());
+    }
+    finishMeshUpload(device, mesh, data, upload, ring);
+}
+
+void uploadMeshCopy(vkDevice device, srMesh& mesh, const srMeshCopy& copy,
+                    bool splitIndices, vkStagingRing* ring) {
+    std::vector<uint32_t> indices =
+        unpackIndices(copy.indices, copy.indexCount);
+    srIndexData layout = planIndexData(copy, indices, splitIndices);
+    srMeshData data = viewMeshCopy(copy, layout);
+    srMeshUpload upload = beginMeshUpload(
+        device, data, indexDataSize(layout, indices.size()), ring);
+
+    for (size_t i = 0; i < data.attributes.size(); i++) {
+        std::span<std::byte> out = upload.uploads[i].data;
+        bool tangents = i + 1 == data.attributes.size() and
+                        not copy.tangents.empty();
+        if (tangents) {
+            // only unit vectors, the position's cube doesn't matter
+            encodeVerticesTo(out.data(),
+                             std::span<const glm::vec3>(copy.tangents),
+                             data.attributes[i].format, glm::vec3(0.0f),
+                             1.0f);
+        } else {
+            memcpy(out.data(), data.attributes[i].data, out.size());
+        }
+    }
+    // the indices are packed straight into mapped memory
+    size_t next = data.attributes.size();
+    std::span<std::byte> out = upload.uploads[next++].data;
+    writeIndexData(layout, indices, out.data());
+    data.indices = out;
+    if (not data.meshlets.empty()) {
+        memcpy(upload.uploads[next].data.data(), data.meshlets.data(),
+               data.meshlets.size_bytes());
+    }
+    finishMeshUpload(device, mesh, data, upload, ring);
+}
+
+size_t meshCopySize(const srMeshCopy& copy) {
+    size_t size = copy.indices.size() +
+                  copy.meshlets.size() * sizeof(srMeshlet) +
+                  copy.lods.size() * sizeof(srMeshLod);
+    for (const srAttributeCopy& attr : copy.attributes) {
+        size += attr.data.size();
+    }
+    return size;
+}
+
+std::optional<std::vector<srVertexPatch>> patchMeshVertices(
+    const srMesh& vkmesh, Mesh& mesh, uint32_t first, uint32_t count) {
+    const auto& positions = mesh.getAttribute<AttributeTypes::VEC3_ATTR>(0);
+    if (not vkmesh.patchable or positions.size() != vkmesh.sourceVertexCount or
+        mesh.getFaces().size() != vkmesh.sourceFaceCount or
+        hashMeshFaces(mesh) != vkmesh.sourceFaceHash)
+        return std::nullopt;
+    size_t end = std::min(static_cast<size_t>(first) + count, positions.size());
+    if (first >= end) return std::vector<srVertexPatch>{};
+
+    // a welded vertex is written once for all of its group, which have to
+    // stay bit identical in every stream
+    const std::vector<uint32_t>& welded = vkmesh.weldedInto;
+    auto edited = [&](uint32_t v) { return v >= first and v < end; };
+    for (uint32_t v = 0; v < welded.size(); v++) {
+        uint32_t kept = welded[v];
+        if (kept == v or kept == UINT32_MAX) continue;
+        if (not edited(v) and not edited(kept)) continue;
+        bool same = true;
+        for (auto& attr : mesh.getAttributes()) {
+            std::visit(
+                [&](auto&& values) {
+                    if (values.size() != vkmesh.sourceVertexCount) return;
+                    same = same and memcmp(&values[v], &values[kept],
+                                           sizeof(values[v])) == 0;
+                },
+                attr.second);
+        }
+        if (not same) return std::nullopt;
+    }
+
+    // the span of the buffers holding the range, welding and the fetch
+    // order may have spread it
+    uint32_t lo = first, hi = static_cast<uint32_t>(end - 1);
+    const std::vector<uint32_t>& order = vkmesh.sourceVertices;
+    if (not order.empty()) {
+        lo = UINT32_MAX;
+        hi = 0;
+        for (uint32_t v = 0; v < order.size(); v++) {
+            if (order[v] < first or order[v] >= end) continue;
+            lo = std::min(lo, v);
+            hi = std::max(hi, v);
+        }
+        // every one was welded into a vertex outside of it, and still
+        // matches it
+        if (lo > hi) return std::vector<srVertexPatch>{};
+    }
+    // what's in between is encoded again too, from wherever it comes from
+    std::vector<uint32_t> sources(hi - lo + 1);
+    for (uint32_t v = lo; v <= hi; v++)
+        sources[v - lo] = order.empty() ? v : order[v];
+
+    glm::vec3 origin(vkmesh.dequantize[3]);
+    float extent = vkmesh.dequantize[0][0];
+    std::vector<srVertexPatch> patches;
+    bool fits = true;
+    for (auto& attr : mesh.getAttributes()) {
+        std::visit(
+            [&](auto&& values) {
+                using T = typename std::decay_t<decltype(values)>::value_type;
+                // uploaded as they were, not per vertex
+                if (values.size() != vkmesh.sourceVertexCount) return;
+                int id = static_cast<int>(attr.first);
+                for (uint32_t a = 0; a < vkmesh.vertexAttributes.size(); a++) {
+                    const srAttribute& stream = vkmesh.vertexAttributes[a];
+                    if (stream.attrib_id != id) continue;
+
+                    std::vector<T> picked = remapVertices(values, sources);
+                    if constexpr (std::is_same_v<T, glm::vec3>) {
+                        if (stream.format == VK_FORMAT_R16G16B16A16_UNORM) {
+                            for (const glm::vec3& p : picked) {
+                                glm::vec3 q = (p - origin) / extent;
+                                fits = fits and
+                                       std::min({q.x, q.y, q.z}) >= 0.0f and
+                                       std::max({q.x, q.y, q.z}) <= 1.0f;
+                            }
+                        }
+                    }
+                    patches.push_back(
+                        {a, static_cast<VkDeviceSize>(lo) *
+                                vertexFormatSize(stream.format),
+                         encodeVertices(picked, stream.format, origin,
+                                        extent)});
+                }
+            },
+            attr.second);
+    }
+    if (not fits) return std::nullopt;
+    return patches;
+}
+
+uint64_t hashMeshFaces(Mesh& mesh) {
+    // FNV-1a over the indices, a face ends with its size
+    uint64_t hash = 14695981039346656037ull;
+    auto add = [&](uint32_t value) {
+        for (int i = 0; i < 4; i++) {
+            hash ^= (value >> (8 * i)) & 0xff;
+            hash *= 1099511628211ull;
+        }
+    };
+    for (const auto& face : mesh.getFaces()) {
+        for (uint index : face) add(index);
+        add(static_cast<uint32_t>(face.size()));
+    }
+    return hash;
+}
+
+size_t releaseMeshData(Mesh& mesh) {
+    size_t freed = 0;
+    for (auto& attr : mesh.getAttributes()) {
+        std::visit(
+            [&](auto& values) {
+                using Values = std::decay_t<decltype(values)>;
+                freed += values.capacity() * sizeof(typename Values::value_type);
+                Values().swap(values);
+            },
+            attr.second);
+    }
+
+    // a node per index plus the list itself per face
+    auto& faces = mesh.getFaces();
+    using Faces = std::decay_t<decltype(faces)>;
+    for (const auto& face : faces) {
+        freed += face.size() * (sizeof(uint) + 2 * sizeof(void*));
+    }
+    freed += faces.capacity() * sizeof(typename Faces::value_type);
+    Faces().swap(faces);
+    return freed;
+}
+
+// streams and regions start on cache lines
+static VkDeviceSize alignDynamic(VkDeviceSize size) {
+    return (size + 63) / 64 * 64;
+}
+
+void createDynamicMesh(vkDevice device, srMesh& mesh, Mesh& source,
+                       const srVertexLayout& layout, uint32_t maxVertices,
+                       uint32_t maxIndices, uint32_t regions,
+                       const glm::vec4& bounds) {
+    srDynamicMesh dynamic{};
+    dynamic.vertexCapacity = maxVertices;
+    dynamic.indexCapacity = maxIndices;
+
+    // the streams copyMesh would build, without data
+    mesh.vertexAttributes.clear();
+    VkDeviceSize offset = 0;
+    auto addStream = [&](int attrib_id, AttributeTypes type) {
+        VkFormat format = vertexAttributeFormat(layout, attrib_id, type);
+        mesh.vertexAttributes.push_back(
+            srAttribute(attrib_id, maxVertices, type, format, vkBuffer{}));
+        dynamic.streamOffsets.push_back(offset);
+        offset += alignDynamic(static_cast<VkDeviceSize>(maxVertices) *
+                               vertexFormatSize(format));
+    };
+    for (auto& attr : source.getAttributes()) {
+        addStream(static_cast<int>(attr.first),
+                  (AttributeTypes)attr.second.index());
+    }
+    addStream(static_cast<int>(source.getAttributes().size()),
+              AttributeTypes::VEC3_ATTR);
+    dynamic.indexOffset = offset;
+    dynamic.regionSize =
+        alignDynamic(offset + static_cast<VkDeviceSize>(maxIndices) *
+                                  sizeof(uint32_t));
+
+    VkMemoryPropertyFlags properties = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
+                                       VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+    if (device.hostVisibleDeviceLocal)
+        properties |= VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT;
+    dynamic.buffer = createBuffer(
+        device, dynamic.regionSize * regions,
+        VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT,
+        properties);
+    void* mapped;
+    if (vkMapMemory(device.ldevice, dynamic.buffer.memory, 0,
+                    dynamic.buffer.size, 0, &mapped) != VK_SUCCESS) {
+        throw std::runtime_error("failed to map dynamic mesh buffer!");
+    }
+    dynamic.mapped = static_cast<std::byte*>(mapped);
+
+    // a cube around the bounds for quantized positions
+    if (layout.format == VERTEX_QUANTIZED) {
+        float extent = glm::max(2.0f * bounds.w, 1e-6f);
+        mesh.dequantize = glm::mat4(extent);
+        mesh.dequantize[3] =
+            glm::vec4(glm::vec3(bounds) - glm::vec3(bounds.w), 1.0f);
+    } else {
+        mesh.dequantize = glm::mat4(1.0f);
+    }
+    mesh.indexBuffer = vkBuffer{};
+    mesh.indexType = VK_INDEX_TYPE_UINT32;
+    mesh.indexCount = 0;
+    mesh.submeshes = {{0, 0, 0}};
+    mesh.lods = {{0, 0, 0, 1, 0.0f}};
+    mesh.meshletBuffer = vkBuffer{};
+    mesh.meshletCount = 0;
+    mesh.bounds = bounds;
+    mesh.uvDensity = 0.0f;
+    mesh.patchable = false;
+    mesh.resident = true;
+    mesh.dynamic = std::move(dynamic);
+}
+
+srDynamicMeshFrame mapDynamicMesh(srMesh& mesh, uint32_t region) {
+    srDynamicMesh& dynamic = *mesh.dynamic;
+    std::byte* base = dynamic.mapped + region * dynamic.regionSize;
+    srDynamicMeshFrame frame{};
+    for (size_t i = 0; i < mesh.vertexAttributes.size(); i++) {
+        const srAttribute& attr = mesh.vertexAttributes[i];
+        frame.streams.push_back(
+            {attr.format, {base + dynamic.streamOffsets[i], attr.size}});
+    }
+    frame.indices = {reinterpret_cast<uint32_t*>(base + dynamic.indexOffset),
+                     dynamic.indexCapacity};
+    glm::vec3 origin(mesh.dequantize[3]);
+    frame.origin = origin;
+    frame.extent = mesh.dequantize[0][0];
+    frame.region = region;
+    return frame;
+}
+
+void setDynamicMeshCounts(srMesh& mesh, uint32_t region, uint32_t vertexCount,
+                          uint32_t indexCount) {
+    srDynamicMesh& dynamic = *mesh.dynamic;
+    dynamic.region = region;
+    dynamic.vertexCount = std::min(vertexCount, dynamic.vertexCapacity);
+    dynamic.indexCount = std::min(indexCount, dynamic.indexCapacity);
+    mesh.indexCount = dynamic.indexCount;
+    mesh.submeshes[0].indexCount = dynamic.indexCount;
+    mesh.lods[0].indexCount = dynamic.indexCount;
+}
+
+void copyDynamicMeshRegion(srMesh& mesh, uint32_t region) {
+    srDynamicMesh& dynamic = *mesh.dynamic;
+    if (dynamic.region == region) return;
+    const std::byte* src = dynamic.mapped + dynamic.region * dynamic.regionSize;
+    std::byte* dst = dynamic.mapped + region * dynamic.regionSize;
+    for (size_t i = 0; i < mesh.vertexAttributes.size(); i++) {
+        memcpy(dst + dynamic.streamOffsets[i], src + dynamic.streamOffsets[i],
+               static_cast<size_t>(dynamic.vertexCount) *
+                   vertexFormatSize(mesh.vertexAttributes[i].format));
+    }
+    memcpy(dst + dynamic.indexOffset, src + dynamic.indexOffset,
+           dynamic.indexCount * sizeof(uint32_t));
+    dynamic.region = region;
+}
+
+void bindMeshVertexBuffers(VkCommandBuffer commandBuffer, const srMesh& mesh) {
+    std::vector<VkBuffer> vbuffers;
+    std::vector<VkDeviceSize> voffsets;
+    for (size_t i = 0; i < mesh.vertexAttributes.size(); i++) {
+        if (mesh.dynamic) {
+            vbuffers.push_back(mesh.dynamic->buffer.buffer);
+            voffsets.push_back(mesh.dynamic->region * mesh.dynamic->regionSize +
+                               mesh.dynamic->streamOffsets[i]);
+        } else {
+            vbuffers.push_back(mesh.vertexAttributes[i].buffer.buffer);
+            voffsets.push_back(0);
+        }
+    }
+    vkCmdBindVertexBuffers(commandBuffer, 0,
+                           static_cast<uint32_t>(vbuffers.size()),
+                           vbuffers.data(), voffsets.data());
+}
+
+void bindMeshIndexBuffer(VkCommandBuffer commandBuffer, const srMesh& mesh) {
+    if (mesh.dynamic) {
+        vkCmdBindIndexBuffer(commandBuffer, mesh.dynamic->buffer.buffer,
+                             mesh.dynamic->region * mesh.dynamic->regionSize +
+                                 mesh.dynamic->indexOffset,
+                             mesh.indexType);
+    } else {
+        vkCmdBindIndexBuffer(commandBuffer, mesh.indexBuffer.buffer, 0,
+                             mesh.indexType);
+    }
+}
+
+template <typename T>
+static void writeStream(const srDynamicMeshFrame& frame, uint32_t stream,
+                        std::span<const T> values, uint32_t first) {
+    const srDynamicStream& out = frame.streams[stream];
+    size_t stride = vertexFormatSize(out.format);
+    size_t capacity = out.data.size() / stride;
+    if (first >= capacity) return;
+    size_t count = std::min(values.size(), capacity - first);
+    encodeVerticesTo(out.data.data() + first * stride, values.first(count),
+                     out.format, frame.origin, frame.extent);
+}
+
+void writeDynamicStream(const srDynamicMeshFrame& frame, uint32_t stream,
+                        std::span<const float> values, uint32_t first) {
+    writeStream(frame, stream, values, first);
+}
+
+void writeDynamicStream(const srDynamicMeshFrame& frame, uint32_t stream,
+                        std::span<const glm::vec2> values, uint32_t first) {
+    writeStream(frame, stream, values, first);
+}
+
+void writeDynamicStream(const srDynamicMeshFrame& frame, uint32_t stream,
+                        std::span<const glm::vec3> values, uint32_t first) {
+    writeStream(frame, stream, values, first);
+}
+
+glm::vec4 computeBoundingSphere(const std::vector<glm::vec3>& pos) {
+    if (pos.empty()) return glm::vec4(0.0f);
+
+    glm::vec3 lo = pos[0], hi = pos[0];
+    for (const glm::vec3& p : pos) {
+        lo = glm::min(lo, p);
+        hi = glm::max(hi, p);
+    }
+    glm::vec3 center = (lo + hi) * 0.5f;
+
+    float radius = 0.0f;
+    for (const glm::vec3& p : pos) {
+        radius = glm::max(radius, glm::length(p - center));
+    }
+    return glm::vec4(center, radius);
+}
+
+float computeUVDensity(const std::vector<glm::vec3>& pos,
+                       const std::vector<glm::vec2>& tex_coord,
+                       const std::vector<uint32_t>& indices) {
+    if (tex_coord.size() != pos.size()) return 0.0f;
+
+    double area = 0.0, uvArea = 0.0;
+    for (size_t i = 0; i + 2 < indices.size(); i += 3) {
         uint32_t i1 = indices[i];
         uint32_t i2 = indices[i + 1];
         uint32_t i3 = indices[i + 2];
 
-        glm::vec3 tangent = computeTangent(pos[i1], tex_coord[i1], pos[i2],
-                                              tex_coord[i2], pos[i3], tex_coord[i3]); 
-        tangents[i1] += tangent;
-        tangents[i2] += tangent;
-        tangents[i3] += tangent;
+        area += glm::length(glm::cross(pos[i2] - pos[i1], pos[i3] - pos[i1]));
+        glm::vec2 duv1 = tex_coord[i2] - tex_coord[i1];
+        glm::vec2 duv2 = tex_coord[i3] - tex_coord[i1];
+        uvArea += glm::abs(duv1.x * duv2.y - duv2.x * duv1.y);
     }
+    if (area <= 0.0) return 0.0f;
+    return static_cast<float>(glm::sqrt(uvArea / area));
+}
 
-    for(auto& tan : tangents) {
-        tan = normalize(tan);
+uint32_t selectMeshLod(const srMesh& mesh, float pixelsPerUnit,
+                       uint32_t current, const srLodSelection& selection) {
+    if (mesh.lods.empty()) return 0;
+    uint32_t last = static_cast<uint32_t>(mesh.lods.size() - 1);
+    current = std::min(current, last);
+    auto within = [&](uint32_t lod, float pixels) {
+        return mesh.lods[lod].error * pixelsPerUnit <= pixels;
+    };
+
+    // errors only grow with the level
+    uint32_t lod = 0;
+    while (lod < last and within(lod + 1, selection.pixelError)) lod++;
+    if (lod <= current) return lod;
+
+    lod = current;
+    while (lod < last and
+           within(lod + 1, selection.pixelError * selection.hysteresis))
+        lod++;
+    return lod;
+}
+
+VkDeviceSize meshMemorySize(const srMesh& mesh) {
+    VkDeviceSize size = mesh.indexBuffer.size + mesh.meshletBuffer.size;
+    for (const auto& attrb : mesh.vertexAttributes) {
+        size += attrb.buffer.size;
     }
-    
-    return tangents;
+    return size;
 }
 
 void destroyMesh(const vkDevice& device, const srMesh& mesh) {
+    if (mesh.dynamic) destroyBuffer(device, mesh.dynamic->buffer);
     destroyBuffer(device, mesh.indexBuffer);
+    destroyBuffer(device, mesh.meshletBuffer);
     for (const auto& attrb : mesh.vertexAttributes) {
         destroyBuffer(device, attrb.buffer);
     }
@@ -1,20 +1,57 @@
 #pragma once
 #include <vulkan/vulkan_core.h>
 
+#include <cstdint>
 #include <list>
+#include <optional>
+#include <span>
+#include <string>
 #include <vector>
 
 #include "Mesh.hpp"
 #include "Resource.hpp"
 #include "macros.hpp"
+#include "srMeshOptimizer.hpp"
+#include "srRetention.hpp"
 #include "vk_utils/vkBuffer.hh"
 #include "vk_utils/vkDevice.hh"
+#include "vk_utils/vkStagingRing.hh"
 namespace gbg {
 
+// How the vertex attributes are stored on the gpu. Shaders read floats
+// either way, the vertex fetch unpacks the quantized formats.
+enum srVertexFormat : uint32_t {
+    VERTEX_FLOAT,
+    // positions as 16 bit unorm in the mesh's bounding cube, the other vec3
+    // attributes (normals, tangents) as 10 bit snorm unit vectors and the
+    // uvs as half floats
+    VERTEX_QUANTIZED,
+};
+
+struct srVertexLayout {
+    srVertexFormat format = VERTEX_FLOAT;
+    // of the unit vectors when quantized, 8 bit snorm on devices that can't
+    // fetch the 10 bit one
+    VkFormat unitVector = VK_FORMAT_A2B10G10R10_SNORM_PACK32;
+};
+
+srVertexLayout chooseVertexLayout(const vkDevice& device,
+                                  srVertexFormat format);
+
+// What an attribute is stored as, the pipelines are built from the same.
+// Attribute 0 is the position.
+VkFormat vertexAttributeFormat(const srVertexLayout& layout, int attrib_id,
+                               AttributeTypes type);
+
+uint32_t vertexFormatSize(VkFormat format);
+
 struct srAttribute {
    public:
-    srAttribute(vkDevice device, uint attrib_id, size_t size,
-                AttributeTypes type, void* data);
+    srAttribute(vkDevice device, uint attrib_id, size_t count,
+                AttributeTypes type, VkFormat format, void* data);
+    // takes a buffer already filled with count vertices
+    srAttribute(uint attrib_id, size_t count, AttributeTypes type,
+                VkFormat format, vkBuffer buffer);
 
     std::pair<VkVertexInputBindingDescription,
               VkVertexInputAttributeDescription>
@@ -25,6 +62,81 @@ struct srAttribute {
     int attrib_id;
     size_t size;
     AttributeTypes type;
+    VkFormat format;
+};
+
+struct srAttributeCopy {
+    int attrib_id;
+    AttributeTypes type;
+    VkFormat format;
+    size_t count;
+    std::vector<std::byte> data;
+};
+
+// A level of detail, a range of the index buffer over the same vertices as
+// the others. Level 0 is the full mesh.
+struct srMeshLod {
+    uint32_t firstIndex;
+    uint32_t indexCount;
+    // the submeshes it is drawn with, once uploaded
+    uint32_t firstSubmesh;
+    uint32_t submeshCount;
+    // object space, how far the surface may be from the full mesh
+    float error;
+};
+
+// The streams sent to the gpu, tangents included and in the optimized
+// order, enough to upload the mesh again once the Mesh resource let go of
+// its data.
+struct srMeshCopy {
+    std::vector<srAttributeCopy> attributes;
+    // zigzag deltas as varints, a fan triangulated face mostly takes a
+    // byte per index
+    std::vector<uint8_t> indices;
+    uint32_t indexCount = 0;
+    // maps quantized positions back to object space
+    glm::mat4 dequantize{1.0f};
+    // over the full mesh's indices, empty unless the optimization builds
+    // them
+    std::vector<srMeshlet> meshlets;
+    // the simplified levels follow the full mesh in indices
+    std::vector<srMeshLod> lods;
+    // gpu vertex to the Mesh's vertex, empty when they match. Lets edits of
+    // the Mesh be written in place, the cache doesn't keep it
+    std::vector<uint32_t> sourceVertices;
+    // Mesh vertex to the one it was welded into, itself when it was kept and
+    // UINT32_MAX when no face uses it. Empty when nothing was merged
+    std::vector<uint32_t> weldedInto;
+    // what computeUVDensity gives for the Mesh
+    float uvDensity = 0.0f;
+    // of a copy that is only uploaded, not encoded yet. Their stream is the
+    // last one and has no data
+    std::vector<glm::vec3> tangents;
+};
+
+// A draw of part of the index buffer. Indices are relative to vertexOffset.
+struct srSubmesh {
+    uint32_t firstIndex;
+    uint32_t indexCount;
+    int32_t vertexOffset;
+};
+
+// Written by the host every frame instead of uploaded once. Lives in a
+// persistently mapped, host visible buffer cut in a region per frame in
+// flight, each holding every stream and then the indices.
+struct srDynamicMesh {
+    vkBuffer buffer{};
+    std::byte* mapped = nullptr;
+    uint32_t vertexCapacity = 0;
+    uint32_t indexCapacity = 0;
+    // in a region, one per vertex attribute
+    std::vector<VkDeviceSize> streamOffsets;
+    VkDeviceSize indexOffset = 0;
+    VkDeviceSize regionSize = 0;
+    // the region the draws read and what was written to it
+    uint32_t region = 0;
+    uint32_t vertexCount = 0;
+    uint32_t indexCount = 0;
 };
 
 struct srMesh : public Resource {
@@ -32,6 +144,49 @@ struct srMesh : public Resource {
     srMesh(std::string name, uint32_t rid) : Resource(name, rid){};
     std::vector<srAttribute> vertexAttributes;
     gbg::vkBuffer indexBuffer;
+    // 16 bit whenever the vertices, or every submesh's, fit
+    VkIndexType indexType = VK_INDEX_TYPE_UINT32;
+    uint32_t indexCount = 0;
+    // a single one per level unless the mesh got split
+    std::vector<srSubmesh> submeshes;
+    std::vector<srMeshLod> lods;
+    // goes before the model matrix, identity unless quantized
+    glm::mat4 dequantize{1.0f};
+    // the clusters the main pass culls, read with the index buffer as
+    // storage buffers
+    vkBuffer meshletBuffer{};
+    uint32_t meshletCount = 0;
+    // object space, center in xyz and radius in w
+    glm::vec4 bounds{0.0f};
+    // uv units per object space unit, 0 without texture coordinates
+    float uvDensity = 0.0f;
+    // false once the buffers got dropped to stay under the memory budget
+    bool resident = true;
+    // frame it was last drawn in
+    uint64_t lastUsed = 0;
+
+    srRetentionPolicy retention = RETAIN_DEFAULT;
+    // the Mesh resource's data was freed
+    bool released = false;
+    std::optional<srMeshCopy> cpuCopy;
+    // the mesh cache file it can be uploaded again from, empty without one
+    std::string cachePath;
+
+    // How the Mesh's vertices map to the buffers, to write its edits in
+    // place. Only known when it was built from the Mesh and keeps its data.
+    bool patchable = false;
+    std::vector<uint32_t> sourceVertices;
+    std::vector<uint32_t> weldedInto;
+    size_t sourceVertexCount = 0;
+    size_t sourceFaceCount = 0;
+    uint64_t sourceFaceHash = 0;
+    // Mesh vertices changed since the last frame, [dirtyFirst, dirtyEnd)
+    uint32_t dirtyFirst = 0;
+    uint32_t dirtyEnd = 0;
+    // the geometry changed after the load, the cache file holds the old one
+    bool edited = false;
+    // drawn from its region instead of the buffers above
+    std::optional<srDynamicMesh> dynamic;
 };
 
 struct srMeshHandle : public ResourceHandle {
@@ -44,8 +199,180 @@ RESOURCE_MANAGER(srMesh);
 std::vector<uint32_t> createIndexBuffer(vkDevice device,
                            const std::vector<std::list<uint>>& faces);
 
-std::vector<glm::vec3> createTangentBuffer(vkDevice device, const std::vector<glm::vec3>& pos,
-                             const std::vector<glm::vec2> tex_coord, const std::vector<uint32_t> indices);
+// Per vertex, the uv tangents of the triangles around it summed and
+// normalized. Large meshes are split across threads, 0 takes one per core.
+// Never returns nans, vertices without uvs to follow get an edge along the
+// surface.
+std::vector<glm::vec3> createTangentBuffer(
+    const std::vector<glm::vec3>& pos, const std::vector<glm::vec2>& tex_coord,
+    const std::vector<uint32_t>& indices, uint32_t threads = 0);
+// Staged copy into a device local index buffer.
+vkBuffer uploadIndexBuffer(vkDevice device, const void* indices,
+                           VkDeviceSize size);
+
+// Builds the streams to upload in the layout's formats, reordered when
+// optimization is enabled, in which case the cache stats before and after
+// are added to stats. A copy made uploadOnly is only good for
+// uploadMeshCopy, which writes its tangents straight into mapped memory.
+srMeshCopy copyMesh(vkDevice device, Mesh& mesh,
+                    const srMeshOptimization& optimization,
+                    const srVertexLayout& layout,
+                    srMeshOptimizationStats* stats = nullptr,
+                    bool uploadOnly = false);
+
+// The index buffer as the gpu gets it. Indices are 16 bit when they fit,
+// or when splitIndices lets large meshes be split in submeshes that fit,
+// unless the copy has meshlets.
+struct srIndexData {
+    VkIndexType type;
+    std::vector<std::byte> bytes;
+    std::vector<srSubmesh> submeshes;
+    std::vector<srMeshLod> lods;
+};
+
+srIndexData buildIndexData(const srMeshCopy& copy, bool splitIndices);
+
+struct srAttributeView {
+    int attrib_id;
+    AttributeTypes type;
+    VkFormat format;
+    size_t count;
+    const std::byte* data;
+};
+
+// Everything the buffers of a mesh are created from, pointing into a copy
+// or a mapped cache file.
+struct srMeshData {
+    std::vector<srAttributeView> attributes;
+    VkIndexType indexType;
+    std::span<const std::byte> indices;
+    std::span<const srSubmesh> submeshes;
+    std::span<const srMeshLod> lods;
+    std::span<const srMeshlet> meshlets;
+    glm::mat4 dequantize;
+};
+
+// Only valid while both live.
+srMeshData viewMeshCopy(const srMeshCopy& copy, const srIndexData& indices);
+
+// The staged streams go through a single span of ring when it has room for
+// them, a staging buffer each otherwise.
+void uploadMeshData(vkDevice device, srMesh& mesh, const srMeshData& data,
+                    vkStagingRing* ring = nullptr);
+
+// Creates the vertex and index buffers of mesh from the copy. The indices
+// are packed straight into mapped memory, without a copy of their own.
+void uploadMeshCopy(vkDevice device, srMesh& mesh, const srMeshCopy& copy,
+                    bool splitIndices, vkStagingRing* ring = nullptr);
+
+size_t meshCopySize(const srMeshCopy& copy);
+
+struct srMeshUpdateStats {
+    // written in place through the staging ring
+    uint32_t patches = 0;
+    uint64_t patchedBytes = 0;
+    // got new buffers, its size changed or it couldn't be patched
+    uint32_t rebuilds = 0;
+    // waited a frame for room in the ring
+    uint32_t deferred = 0;
+};
+
+// Part of a vertex buffer to write again.
+struct srVertexPatch {
+    uint32_t attribute;  // in vertexAttributes
+    VkDeviceSize offset;
+    std::vector<std::byte> data;
+};
+
+// Encodes again the buffers' vertices that come from the Mesh's
+// [first, first + count), every stream but the tangents, which keep the
+// ones of the upload. Nothing when it can't be done in place: the mesh
+// isn't patchable, its vertex count or faces changed, a vertex no longer
+// matches the ones it was welded with or a quantized position left the box.
+std::optional<std::vector<srVertexPatch>> patchMeshVertices(
+    const srMesh& vkmesh, Mesh& mesh, uint32_t first, uint32_t count);
+
+// Tells whether the faces changed since the upload.
+uint64_t hashMeshFaces(Mesh& mesh);
+
+// Frees the attributes and faces of the Mesh resource and returns about how
+// many bytes they took.
+size_t releaseMeshData(Mesh& mesh);
+
+// The streams a Mesh would get, empty, in a ring of regions. Indices are
+// 32 bit and relative to the region. Quantized positions are relative to
+// the cube around bounds.
+void createDynamicMesh(vkDevice device, srMesh& mesh, Mesh& source,
+                       const srVertexLayout& layout, uint32_t maxVertices,
+                       uint32_t maxIndices, uint32_t regions,
+                       const glm::vec4& bounds);
+
+struct srDynamicStream {
+    VkFormat format;
+    std::span<std::byte> data;
+};
+
+// Where the host writes a dynamic mesh for a frame.
+struct srDynamicMeshFrame {
+    // one per vertex attribute, room for the mesh's capacity
+    std::vector<srDynamicStream> streams;
+    std::span<uint32_t> indices;
+    // the cube quantized positions are relative to
+    glm::vec3 origin;
+    float extent;
+    uint32_t region;
+};
+
+srDynamicMeshFrame mapDynamicMesh(srMesh& mesh, uint32_t region);
+
+// What the draws take from the region from now on.
+void setDynamicMeshCounts(srMesh& mesh, uint32_t region, uint32_t vertexCount,
+                          uint32_t indexCount);
+
+// For a frame the host wrote nothing in, carries the last region over.
+void copyDynamicMeshRegion(srMesh& mesh, uint32_t region);
+
+// The buffers a draw reads, the current region of a dynamic mesh.
+void bindMeshVertexBuffers(VkCommandBuffer commandBuffer, const srMesh& mesh);
+void bindMeshIndexBuffer(VkCommandBuffer commandBuffer, const srMesh& mesh);
+
+// Encodes values in the stream's format from vertex first on, a memcpy
+// when they match.
+void writeDynamicStream(const srDynamicMeshFrame& frame, uint32_t stream,
+                        std::span<const float> values, uint32_t first = 0);
+void writeDynamicStream(const srDynamicMeshFrame& frame, uint32_t stream,
+                        std::span<const glm::vec2> values, uint32_t first = 0);
+void writeDynamicStream(const srDynamicMeshFrame& frame, uint32_t stream,
+                        std::span<const glm::vec3> values, uint32_t first = 0);
+
+glm::vec4 computeBoundingSphere(const std::vector<glm::vec3>& pos);
+
+// From the summed triangle areas, how many uv units an object space unit
+// covers. Texture streaming turns it into texels per pixel.
+float computeUVDensity(const std::vector<glm::vec3>& pos,
+                       const std::vector<glm::vec2>& tex_coord,
+                       const std::vector<uint32_t>& indices);
+
+// How the draws pick a level of detail.
+struct srLodSelection {
+    // projected error, in pixels, a level may show
+    float pixelError = 1.0f;
+    // a coarser level is only taken once its error is below this fraction
+    // of pixelError, so levels don't flip back and forth at the threshold
+    float hysteresis = 0.75f;
+    // levels coarser the shadow pass draws
+    uint32_t shadowBias = 1;
+};
+
+// The coarsest level within the error, pixelsPerUnit is how many pixels an
+// object space unit covers at the mesh's closest point and current the level
+// drawn last frame.
+uint32_t selectMeshLod(const srMesh& mesh, float pixelsPerUnit,
+                       uint32_t current, const srLodSelection& selection);
+
+// bytes in the vertex and index buffers
+VkDeviceSize meshMemorySize(const srMesh& mesh);
+
 void destroyMesh(const vkDevice& device, const srMesh& mesh);
 
 }  // namespace gbg
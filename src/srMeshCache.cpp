@@ -0,0 +1,307 @@
+#include "srMeshCache.hpp"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <bit>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <vector>
+
+namespace gbg {
+
+static const char meshCacheMagic[8] = {'G', 'B', 'G', 'M', 'E', 'S', 'H', 0};
+// bumped whenever the layout or what copyMesh produces changes
+const uint32_t meshCacheVersion = 1;
+// sections start at multiples of it, meshlets hold vec4s
+const size_t meshCacheAlignment = 16;
+
+struct MeshCacheHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t attributeCount;
+    uint32_t indexType;
+    uint32_t submeshCount;
+    uint32_t lodCount;
+    uint32_t meshletCount;
+    uint64_t indexOffset;
+    uint64_t indexSize;
+    uint64_t submeshOffset;
+    uint64_t lodOffset;
+    uint64_t meshletOffset;
+    glm::mat4 dequantize;
+    glm::vec4 bounds;
+    float uvDensity;
+    uint32_t padding[3];
+};
+
+struct MeshCacheAttribute {
+    int32_t attribId;
+    uint32_t type;
+    uint32_t format;
+    uint32_t padding;
+    uint64_t count;
+    uint64_t offset;
+    uint64_t size;
+};
+
+static uint64_t hashBytes(const void* data, size_t size,
+                          uint64_t hash = 14695981039346656037ull) {
+    // FNV-1a
+    const auto* bytes = static_cast<const unsigned char*>(data);
+    for (size_t i = 0; i < size; i++) {
+        hash ^= bytes[i];
+        hash *= 1099511628211ull;
+    }
+    return hash;
+}
+
+uint64_t hashMeshSource(const std::string& path) {
+    std::error_code ec;
+    auto modified = std::filesystem::last_write_time(path, ec);
+    if (ec) return 0;
+    std::ifstream in(path, std::ios::binary);
+    if (not in) return 0;
+
+    uint64_t hash = hashBytes(path.data(), path.size());
+    auto ticks = modified.time_since_epoch().count();
+    hash = hashBytes(&ticks, sizeof(ticks), hash);
+    std::vector<char> chunk(1 << 20);
+    while (in) {
+        in.read(chunk.data(), static_cast<std::streamsize>(chunk.size()));
+        hash = hashBytes(chunk.data(), static_cast<size_t>(in.gcount()), hash);
+    }
+    return hash;
+}
+
+uint64_t hashMeshSettings(const srMeshOptimization& optimization,
+                          const srVertexLayout& layout) {
+    // field by field, the structs have padding
+    uint32_t values[] = {
+        meshCacheVersion,
+        optimization.weld,
+        optimization.enabled,
+        optimization.cacheSize,
+        optimization.overdraw,
+        optimization.vertexFetch,
+        optimization.splitIndices,
+        optimization.meshlets,
+        optimization.meshletVertices,
+        optimization.meshletTriangles,
+        optimization.lods,
+        std::bit_cast<uint32_t>(optimization.lodRatio),
+        layout.format,
+        static_cast<uint32_t>(layout.unitVector),
+    };
+    return hashBytes(values, sizeof(values));
+}
+
+std::string meshCachePath(const std::string& dir, uint64_t sourceKey,
+                          uint64_t settingsKey, const std::string& meshName,
+                          uint32_t occurrence) {
+    // the source key already covers its path
+    uint64_t key = hashBytes(meshName.data(), meshName.size(),
+                             hashBytes(&settingsKey, sizeof(settingsKey),
+                                       sourceKey));
+    key = hashBytes(&occurrence, sizeof(occurrence), key);
+    char name[64];
+    snprintf(name, sizeof(name), "%016llx.mesh",
+             static_cast<unsigned long long>(key));
+    return (std::filesystem::path(dir) / name).string();
+}
+
+static size_t alignTo(size_t offset, size_t alignment) {
+    return (offset + alignment - 1) / alignment * alignment;
+}
+
+bool writeMeshCache(const std::string& path, const srMeshData& data,
+                    const glm::vec4& bounds, float uvDensity) {
+    MeshCacheHeader header{};
+    std::memcpy(header.magic, meshCacheMagic, sizeof(meshCacheMagic));
+    header.version = meshCacheVersion;
+    header.attributeCount = static_cast<uint32_t>(data.attributes.size());
+    header.indexType = data.indexType;
+    header.submeshCount = static_cast<uint32_t>(data.submeshes.size());
+    header.lodCount = static_cast<uint32_t>(data.lods.size());
+    header.meshletCount = static_cast<uint32_t>(data.meshlets.size());
+    header.dequantize = data.dequantize;
+    header.bounds = bounds;
+    header.uvDensity = uvDensity;
+
+    size_t offset = sizeof(MeshCacheHeader) +
+                    data.attributes.size() * sizeof(MeshCacheAttribute);
+    std::vector<MeshCacheAttribute> attributes;
+    for (const srAttributeView& attr : data.attributes) {
+        offset = alignTo(offset, meshCacheAlignment);
+        size_t size = attr.count * vertexFormatSize(attr.format);
+        attributes.push_back({attr.attrib_id, static_cast<uint32_t>(attr.type),
+                              static_cast<uint32_t>(attr.format), 0,
+                              attr.count, offset, size});
+        offset += size;
+    }
+    auto section = [&](uint64_t& at, size_t size) {
+        offset = alignTo(offset, meshCacheAlignment);
+        at = offset;
+        offset += size;
+    };
+    section(header.indexOffset, data.indices.size());
+    header.indexSize = data.indices.size();
+    section(header.submeshOffset, data.submeshes.size_bytes());
+    section(header.lodOffset, data.lods.size_bytes());
+    section(header.meshletOffset, data.meshlets.size_bytes());
+
+    std::string tmpPath = path + ".tmp";
+    {
+        std::ofstream file(tmpPath, std::ios::binary | std::ios::trunc);
+        if (not file) return false;
+
+        auto writeAt = [&](size_t at, const void* bytes, size_t size) {
+            size_t pos = static_cast<size_t>(file.tellp());
+            static const char zeros[meshCacheAlignment] = {};
+            file.write(zeros, static_cast<std::streamsize>(at - pos));
+            file.write(static_cast<const char*>(bytes),
+                       static_cast<std::streamsize>(size));
+        };
+
+        writeAt(0, &header, sizeof(header));
+        writeAt(sizeof(header), attributes.data(),
+                attributes.size() * sizeof(MeshCacheAttribute));
+        for (size_t i = 0; i < attributes.size(); i++) {
+            writeAt(attributes[i].offset, data.attributes[i].data,
+                    attributes[i].size);
+        }
+        writeAt(header.indexOffset, data.indices.data(), data.indices.size());
+        writeAt(header.submeshOffset, data.submeshes.data(),
+                data.submeshes.size_bytes());
+        writeAt(header.lodOffset, data.lods.data(), data.lods.size_bytes());
+        writeAt(header.meshletOffset, data.meshlets.data(),
+                data.meshlets.size_bytes());
+        if (not file) return false;
+    }
+
+    std::error_code ec;
+    std::filesystem::rename(tmpPath, path, ec);
+    return not ec;
+}
+
+std::optional<srMappedMesh> mapMeshCache(const std::string& path) {
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd == -1) return std::nullopt;
+
+    struct stat st;
+    if (fstat(fd, &st) == -1 or
+        static_cast<size_t>(st.st_size) < sizeof(MeshCacheHeader)) {
+        close(fd);
+        return std::nullopt;
+    }
+
+    srMappedMesh mesh{};
+    mesh.mappingSize = static_cast<size_t>(st.st_size);
+    mesh.mapping =
+        mmap(nullptr, mesh.mappingSize, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (mesh.mapping == MAP_FAILED) return std::nullopt;
+
+    const auto* bytes = static_cast<const std::byte*>(mesh.mapping);
+    MeshCacheHeader header;
+    std::memcpy(&header, bytes, sizeof(header));
+
+    // everything has to be inside the file
+    auto fits = [&](uint64_t offset, uint64_t size) {
+        return offset <= mesh.mappingSize and
+               size <= mesh.mappingSize - offset;
+    };
+    size_t attributesEnd = sizeof(MeshCacheHeader) +
+                           header.attributeCount * sizeof(MeshCacheAttribute);
+    bool valid =
+        std::memcmp(header.magic, meshCacheMagic, sizeof(meshCacheMagic)) ==
+            0 and
+        header.version == meshCacheVersion and
+        fits(sizeof(MeshCacheHeader),
+             header.attributeCount * sizeof(MeshCacheAttribute)) and
+        fits(header.indexOffset, header.indexSize) and
+        fits(header.submeshOffset, header.submeshCount * sizeof(srSubmesh)) and
+        fits(header.lodOffset, header.lodCount * sizeof(srMeshLod)) and
+        fits(header.meshletOffset, header.meshletCount * sizeof(srMeshlet));
+
+    std::vector<MeshCacheAttribute> attributes(valid ? header.attributeCount
+                                                     : 0);
+    if (valid) {
+        std::memcpy(attributes.data(), bytes + sizeof(MeshCacheHeader),
+                    attributesEnd - sizeof(MeshCacheHeader));
+    }
+    for (const MeshCacheAttribute& attr : attributes) {
+        uint32_t stride = vertexFormatSize(static_cast<VkFormat>(attr.format));
+        valid = valid and fits(attr.offset, attr.size) and stride != 0 and
+                attr.count <= attr.size / stride and
+                attr.size == attr.count * stride;
+    }
+    // whole indices, and the draws inside them
+    uint64_t indexBytes = header.indexType == VK_INDEX_TYPE_UINT16   ? 2
+                          : header.indexType == VK_INDEX_TYPE_UINT32 ? 4
+                                                                     : 0;
+    valid = valid and indexBytes != 0 and header.indexSize % indexBytes == 0;
+    if (valid) {
+        uint64_t indexCount = header.indexSize / indexBytes;
+        for (uint32_t i = 0; i < header.submeshCount; i++) {
+            srSubmesh submesh;
+            std::memcpy(&submesh,
+                        bytes + header.submeshOffset + i * sizeof(srSubmesh),
+                        sizeof(submesh));
+            valid = valid and static_cast<uint64_t>(submesh.firstIndex) +
+                                      submesh.indexCount <=
+                                  indexCount;
+        }
+        for (uint32_t i = 0; i < header.lodCount; i++) {
+            srMeshLod lod;
+            std::memcpy(&lod, bytes + header.lodOffset + i * sizeof(srMeshLod),
+                        sizeof(lod));
+            valid = valid and
+                    static_cast<uint64_t>(lod.firstIndex) + lod.indexCount <=
+                        indexCount and
+                    static_cast<uint64_t>(lod.firstSubmesh) +
+                            lod.submeshCount <=
+                        header.submeshCount;
+        }
+    }
+    if (not valid) {
+        munmap(mesh.mapping, mesh.mappingSize);
+        return std::nullopt;
+    }
+
+    for (const MeshCacheAttribute& attr : attributes) {
+        mesh.data.attributes.push_back(
+            {attr.attribId, static_cast<AttributeTypes>(attr.type),
+             static_cast<VkFormat>(attr.format), attr.count,
+             bytes + attr.offset});
+    }
+    // sections are aligned for their types
+    mesh.data.indexType = static_cast<VkIndexType>(header.indexType);
+    mesh.data.indices = {bytes + header.indexOffset, header.indexSize};
+    mesh.data.submeshes = {
+        reinterpret_cast<const srSubmesh*>(bytes + header.submeshOffset),
+        header.submeshCount};
+    mesh.data.lods = {
+        reinterpret_cast<const srMeshLod*>(bytes + header.lodOffset),
+        header.lodCount};
+    mesh.data.meshlets = {
+        reinterpret_cast<const srMeshlet*>(bytes + header.meshletOffset),
+        header.meshletCount};
+    mesh.data.dequantize = header.dequantize;
+    mesh.bounds = header.bounds;
+    mesh.uvDensity = header.uvDensity;
+    return mesh;
+}
+
+void unmapMeshCache(srMappedMesh& mesh) {
+    if (mesh.mapping != nullptr and mesh.mapping != MAP_FAILED)
+        munmap(mesh.mapping, mesh.mappingSize);
+    mesh.mapping = nullptr;
+    mesh.data = {};
+}
+
+}  // namespace gbg
@@ -0,0 +1,64 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <string>
+
+#include "glm/glm.hpp"
+#include "srMesh.hh"
+#include "srMeshOptimizer.hpp"
+
+namespace gbg {
+
+// Meshes are written to dir after their first upload, in the layout the
+// gpu gets them, and mapped back on later loads instead of being welded,
+// optimized and simplified again. Files are keyed by the source file's
+// path, modification time and content, the mesh name and the settings the
+// streams were built with. Meshes sharing a name are told apart by their
+// order in the source.
+struct srMeshCacheSettings {
+    bool enabled = false;
+    std::string dir = "mesh_cache";
+    // the file the scene's meshes were loaded from
+    std::string source;
+};
+
+struct srMeshCacheStats {
+    uint32_t hits = 0;
+    uint32_t misses = 0;
+    // building and uploading the meshes, cold from the Mesh resources and
+    // warm from the cache
+    double coldMs = 0.0;
+    double warmMs = 0.0;
+};
+
+// A cache file mapped in memory, data points into the mapping.
+struct srMappedMesh {
+    srMeshData data;
+    glm::vec4 bounds;
+    float uvDensity;
+
+    void* mapping = nullptr;
+    size_t mappingSize = 0;
+};
+
+// 0 when the file can't be read.
+uint64_t hashMeshSource(const std::string& path);
+
+uint64_t hashMeshSettings(const srMeshOptimization& optimization,
+                          const srVertexLayout& layout);
+
+// occurrence counts the source's earlier meshes with the same name.
+std::string meshCachePath(const std::string& dir, uint64_t sourceKey,
+                          uint64_t settingsKey, const std::string& meshName,
+                          uint32_t occurrence);
+
+// Goes through a temporary file so a reader never sees a half written one.
+bool writeMeshCache(const std::string& path, const srMeshData& data,
+                    const glm::vec4& bounds, float uvDensity);
+
+std::optional<srMappedMesh> mapMeshCache(const std::string& path);
+
+void unmapMeshCache(srMappedMesh& mesh);
+
+}  // namespace gbg
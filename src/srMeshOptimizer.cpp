@@ -0,0 +1,581 @@
+#include "srMeshOptimizer.hpp"
+
+#include <algorithm>
+#include <bit>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <numeric>
+#include <unordered_map>
+#include <vector>
+
+namespace gbg {
+
+// A vertex is in a FIFO cache of cacheSize entries when fewer than that many
+// vertices were transformed after it. time counts transformations and every
+// vertex keeps the time it was transformed at.
+static bool inCache(uint32_t time, uint32_t timestamp, uint32_t cacheSize) {
+    return time - timestamp <= cacheSize;
+}
+
+static uint64_t hashVertex(const std::vector<srVertexStream>& streams,
+                           uint32_t vertex) {
+    uint64_t hash = 14695981039346656037ull;
+    for (const srVertexStream& stream : streams) {
+        const std::byte* bytes = stream.data + vertex * stream.stride;
+        for (size_t i = 0; i < stream.stride; i++) {
+            hash ^= static_cast<uint8_t>(bytes[i]);
+            hash *= 1099511628211ull;
+        }
+    }
+    return hash;
+}
+
+static bool sameVertex(const std::vector<srVertexStream>& streams,
+                       uint32_t a, uint32_t b) {
+    for (const srVertexStream& stream : streams) {
+        if (std::memcmp(stream.data + a * stream.stride,
+                        stream.data + b * stream.stride, stream.stride) != 0)
+            return false;
+    }
+    return true;
+}
+
+std::vector<uint32_t> weldVertices(std::vector<uint32_t>& indices,
+                                   const std::vector<srVertexStream>& streams,
+                                   size_t vertexCount) {
+    const uint32_t empty = std::numeric_limits<uint32_t>::max();
+    // open addressing, holds new vertices
+    std::vector<uint32_t> table(std::bit_ceil(vertexCount * 2 + 1), empty);
+    size_t mask = table.size() - 1;
+
+    std::vector<uint32_t> newIndex(vertexCount, empty);
+    std::vector<uint32_t> remap;
+    for (uint32_t& index : indices) {
+        if (newIndex[index] == empty) {
+            size_t slot = hashVertex(streams, index) & mask;
+            while (table[slot] != empty and
+                   not sameVertex(streams, remap[table[slot]], index)) {
+                slot = (slot + 1) & mask;
+            }
+            if (table[slot] == empty) {
+                table[slot] = static_cast<uint32_t>(remap.size());
+                remap.push_back(index);
+            }
+            newIndex[index] = table[slot];
+        }
+        index = newIndex[index];
+    }
+    return remap;
+}
+
+void addOptimizationStats(srMeshOptimizationStats& stats, size_t triangles,
+                          const srVertexCacheStats& before,
+                          const srVertexCacheStats& after) {
+    size_t total = stats.triangles + triangles;
+    if (total == 0) return;
+    auto blend = [&](float average, float value) {
+        return (average * stats.triangles + value * triangles) / total;
+    };
+    stats.before.acmr = blend(stats.before.acmr, before.acmr);
+    stats.before.atvr = blend(stats.before.atvr, before.atvr);
+    stats.after.acmr = blend(stats.after.acmr, after.acmr);
+    stats.after.atvr = blend(stats.after.atvr, after.atvr);
+    stats.triangles = total;
+    stats.meshes++;
+}
+
+srVertexCacheStats analyzeVertexCache(const std::vector<uint32_t>& indices,
+                                      size_t vertexCount, uint32_t cacheSize) {
+    srVertexCacheStats stats{};
+    if (indices.empty()) return stats;
+
+    std::vector<uint32_t> timestamps(vertexCount, 0);
+    std::vector<bool> referenced(vertexCount, false);
+    uint32_t time = cacheSize + 1;
+    size_t transformed = 0, unique = 0;
+    for (uint32_t index : indices) {
+        if (not referenced[index]) {
+            referenced[index] = true;
+            unique++;
+        }
+        if (not inCache(time, timestamps[index], cacheSize)) {
+            timestamps[index] = time++;
+            transformed++;
+        }
+    }
+
+    stats.acmr = static_cast<float>(transformed) / (indices.size() / 3);
+    stats.atvr = static_cast<float>(transformed) / unique;
+    return stats;
+}
+
+std::vector<uint32_t> optimizeVertexCache(std::vector<uint32_t>& indices,
+                                          size_t vertexCount,
+                                          uint32_t cacheSize) {
+    std::vector<uint32_t> clusters;
+    size_t triangleCount = indices.size() / 3;
+    if (triangleCount == 0) return clusters;
+
+    // triangles not emitted yet around every vertex
+    std::vector<uint32_t> live(vertexCount, 0);
+    for (size_t i = 0; i < triangleCount * 3; i++) live[indices[i]]++;
+
+    std::vector<uint32_t> offsets(vertexCount + 1, 0);
+    for (size_t v = 0; v < vertexCount; v++) {
+        offsets[v + 1] = offsets[v] + live[v];
+    }
+    std::vector<uint32_t> adjacency(offsets[vertexCount]);
+    std::vector<uint32_t> fill(offsets.begin(), offsets.end() - 1);
+    for (size_t i = 0; i < triangleCount * 3; i++) {
+        adjacency[fill[indices[i]]++] = static_cast<uint32_t>(i / 3);
+    }
+
+    std::vector<uint32_t> timestamps(vertexCount, 0);
+    std::vector<bool> emitted(triangleCount, false);
+    // recently used vertices to go back to at a dead end
+    std::vector<uint32_t> deadEnd;
+    std::vector<uint32_t> candidates;
+    std::vector<uint32_t> output;
+    output.reserve(triangleCount * 3);
+
+    uint32_t time = cacheSize + 1;
+    // vertices before it have no live triangles left
+    size_t cursor = 0;
+    auto nextUnused = [&]() -> int64_t {
+        while (cursor < vertexCount and live[cursor] == 0) cursor++;
+        return cursor < vertexCount ? static_cast<int64_t>(cursor) : -1;
+    };
+
+    int64_t fanning = nextUnused();
+    while (fanning >= 0) {
+        uint32_t f = static_cast<uint32_t>(fanning);
+        if (not inCache(time, timestamps[f], cacheSize)) {
+            clusters.push_back(static_cast<uint32_t>(output.size() / 3));
+        }
+
+        candidates.clear();
+        for (uint32_t a = offsets[f]; a < offsets[f + 1]; a++) {
+            uint32_t t = adjacency[a];
+            if (emitted[t]) continue;
+            emitted[t] = true;
+            for (uint32_t j = 0; j < 3; j++) {
+                uint32_t v = indices[t * 3 + j];
+                output.push_back(v);
+                deadEnd.push_back(v);
+                candidates.push_back(v);
+                live[v]--;
+                if (not inCache(time, timestamps[v], cacheSize))
+                    timestamps[v] = time++;
+            }
+        }
+
+        // the candidate that stays longest in cache while its remaining
+        // triangles are emitted, the ones that would fall out rank last
+        fanning = -1;
+        int64_t best = -1;
+        for (uint32_t v : candidates) {
+            if (live[v] == 0) continue;
+            int64_t priority = 0;
+            if (time - timestamps[v] + 2 * live[v] <= cacheSize)
+                priority = time - timestamps[v];
+            if (priority > best) {
+                best = priority;
+                fanning = v;
+            }
+        }
+
+        if (fanning < 0) {
+            while (not deadEnd.empty()) {
+                uint32_t d = deadEnd.back();
+                deadEnd.pop_back();
+                if (live[d] > 0) {
+                    fanning = d;
+                    break;
+                }
+            }
+        }
+        if (fanning < 0) fanning = nextUnused();
+    }
+
+    indices = std::move(output);
+    return clusters;
+}
+
+void optimizeOverdraw(std::vector<uint32_t>& indices,
+                      const std::vector<uint32_t>& clusters,
+                      const std::vector<glm::vec3>& positions) {
+    size_t triangleCount = indices.size() / 3;
+    if (clusters.size() < 2) return;
+
+    struct Cluster {
+        uint32_t begin;
+        uint32_t end;
+        glm::vec3 centroid;
+        glm::vec3 normal;
+        float key;
+    };
+    std::vector<Cluster> sorted;
+    sorted.reserve(clusters.size());
+
+    glm::vec3 center(0.0f);
+    float totalArea = 0.0f;
+    for (size_t c = 0; c < clusters.size(); c++) {
+        Cluster cluster{};
+        cluster.begin = clusters[c];
+        cluster.end = c + 1 < clusters.size()
+                          ? clusters[c + 1]
+                          : static_cast<uint32_t>(triangleCount);
+
+        float area = 0.0f;
+        for (uint32_t t = cluster.begin; t < cluster.end; t++) {
+            const glm::vec3& p0 = positions[indices[t * 3]];
+            const glm::vec3& p1 = positions[indices[t * 3 + 1]];
+            const glm::vec3& p2 = positions[indices[t * 3 + 2]];
+            glm::vec3 n = glm::cross(p1 - p0, p2 - p0);
+            float a = glm::length(n);
+            cluster.centroid += (p0 + p1 + p2) * (a / 3.0f);
+            cluster.normal += n;
+            area += a;
+        }
+        center += cluster.centroid;
+        totalArea += area;
+        if (area > 0.0f) cluster.centroid /= area;
+        sorted.push_back(cluster);
+    }
+    if (totalArea > 0.0f) center /= totalArea;
+
+    for (Cluster& cluster : sorted) {
+        float length = glm::length(cluster.normal);
+        cluster.key =
+            length > 0.0f
+                ? glm::dot(cluster.centroid - center, cluster.normal / length)
+                : -std::numeric_limits<float>::max();
+    }
+    std::stable_sort(sorted.begin(), sorted.end(),
+                     [](const Cluster& a, const Cluster& b) {
+                         return a.key > b.key;
+                     });
+
+    std::vector<uint32_t> output;
+    output.reserve(indices.size());
+    for (const Cluster& cluster : sorted) {
+        output.insert(output.end(), indices.begin() + cluster.begin * 3,
+                      indices.begin() + cluster.end * 3);
+    }
+    indices = std::move(output);
+}
+
+static void computeMeshletBounds(srMeshlet& meshlet,
+                                 const std::vector<uint32_t>& indices,
+                                 const std::vector<glm::vec3>& positions) {
+    size_t first = meshlet.firstIndex;
+    size_t end = first + meshlet.triangleCount * 3;
+
+    glm::vec3 lo = positions[indices[first]], hi = lo;
+    for (size_t i = first; i < end; i++) {
+        lo = glm::min(lo, positions[indices[i]]);
+        hi = glm::max(hi, positions[indices[i]]);
+    }
+    glm::vec3 center = (lo + hi) * 0.5f;
+    float radius = 0.0f;
+    for (size_t i = first; i < end; i++) {
+        radius = glm::max(radius, glm::length(positions[indices[i]] - center));
+    }
+    meshlet.sphere = glm::vec4(center, radius);
+
+    auto triangleNormal = [&](size_t i) {
+        const glm::vec3& p0 = positions[indices[i]];
+        return glm::cross(positions[indices[i + 1]] - p0,
+                          positions[indices[i + 2]] - p0);
+    };
+    glm::vec3 axis(0.0f);
+    for (size_t i = first; i < end; i += 3) {
+        glm::vec3 n = triangleNormal(i);
+        float area = glm::length(n);
+        if (area > 0.0f) axis += n / area;
+    }
+
+    // no cone, it never passes the test
+    meshlet.cone = glm::vec4(0.0f, 0.0f, 1.0f, 1.0f);
+    float length = glm::length(axis);
+    if (length <= 0.0f) return;
+    axis /= length;
+    float minDot = 1.0f;
+    for (size_t i = first; i < end; i += 3) {
+        glm::vec3 n = triangleNormal(i);
+        float area = glm::length(n);
+        if (area > 0.0f) minDot = glm::min(minDot, glm::dot(n / area, axis));
+    }
+    // past a half space culling would need the camera inside the cone
+    if (minDot <= 0.0f) return;
+    meshlet.cone = glm::vec4(axis, glm::sqrt(1.0f - minDot * minDot));
+}
+
+std::vector<srMeshlet> buildMeshlets(const std::vector<uint32_t>& indices,
+                                     const std::vector<glm::vec3>& positions,
+                                     uint32_t maxVertices,
+                                     uint32_t maxTriangles) {
+    std::vector<srMeshlet> meshlets;
+    size_t triangleCount = indices.size() / 3;
+    // meshlet a vertex was last counted in, plus one
+    std::vector<uint32_t> seen(positions.size(), 0);
+
+    srMeshlet meshlet{};
+    uint32_t vertices = 0;
+    for (size_t t = 0; t < triangleCount; t++) {
+        const uint32_t* tri = &indices[t * 3];
+        uint32_t id = static_cast<uint32_t>(meshlets.size()) + 1;
+        uint32_t added = 0;
+        for (uint32_t j = 0; j < 3; j++) {
+            bool repeated = (j > 0 and tri[j] == tri[0]) or
+                            (j > 1 and tri[j] == tri[1]);
+            if (seen[tri[j]] != id and not repeated) added++;
+        }
+        if (meshlet.triangleCount > 0 and
+            (meshlet.triangleCount == maxTriangles or
+             vertices + added > maxVertices)) {
+            computeMeshletBounds(meshlet, indices, positions);
+            meshlets.push_back(meshlet);
+            meshlet = srMeshlet{};
+            meshlet.firstIndex = static_cast<uint32_t>(t * 3);
+            vertices = 0;
+            id++;
+        }
+        for (uint32_t j = 0; j < 3; j++) {
+            if (seen[tri[j]] != id) {
+                seen[tri[j]] = id;
+                vertices++;
+            }
+        }
+        meshlet.triangleCount++;
+    }
+    if (meshlet.triangleCount > 0) {
+        computeMeshletBounds(meshlet, indices, positions);
+        meshlets.push_back(meshlet);
+    }
+    return meshlets;
+}
+
+std::vector<uint32_t> optimizeVertexFetch(std::vector<uint32_t>& indices,
+                                          size_t vertexCount) {
+    const uint32_t unused = std::numeric_limits<uint32_t>::max();
+    std::vector<uint32_t> newIndex(vertexCount, unused);
+    std::vector<uint32_t> remap;
+    for (uint32_t& index : indices) {
+        if (newIndex[index] == unused) {
+            newIndex[index] = static_cast<uint32_t>(remap.size());
+            remap.push_back(index);
+        }
+        index = newIndex[index];
+    }
+    return remap;
+}
+
+// Symmetric 4x4, the sum of the squared distances to a set of planes.
+struct Quadric {
+    double a00, a01, a02, a03, a11, a12, a13, a22, a23, a33;
+};
+
+static Quadric planeQuadric(const glm::vec3& n, float d) {
+    return {n.x * n.x, n.x * n.y, n.x * n.z, n.x * d, n.y * n.y,
+            n.y * n.z, n.y * d,   n.z * n.z, n.z * d, double(d) * d};
+}
+
+static void addQuadric(Quadric& q, const Quadric& other) {
+    q.a00 += other.a00;
+    q.a01 += other.a01;
+    q.a02 += other.a02;
+    q.a03 += other.a03;
+    q.a11 += other.a11;
+    q.a12 += other.a12;
+    q.a13 += other.a13;
+    q.a22 += other.a22;
+    q.a23 += other.a23;
+    q.a33 += other.a33;
+}
+
+static double quadricError(const Quadric& q, const glm::vec3& p) {
+    double x = p.x, y = p.y, z = p.z;
+    double error = q.a00 * x * x + q.a11 * y * y + q.a22 * z * z +
+                   2 * (q.a01 * x * y + q.a02 * x * z + q.a12 * y * z) +
+                   2 * (q.a03 * x + q.a13 * y + q.a23 * z) + q.a33;
+    return std::max(error, 0.0);
+}
+
+// Vertices that can't move: the ones sharing their position with another
+// one, where attributes split, and the ones on open edges.
+static std::vector<bool> lockedVertices(const std::vector<uint32_t>& indices,
+                                        const std::vector<glm::vec3>& positions) {
+    std::vector<uint32_t> byPosition = indices;
+    std::vector<uint32_t> firstVertex = weldVertices(
+        byPosition,
+        {{reinterpret_cast<const std::byte*>(positions.data()),
+          sizeof(glm::vec3)}},
+        positions.size());
+
+    std::vector<bool> locked(positions.size(), false);
+    std::vector<uint32_t> position(positions.size(), 0);
+    std::vector<uint32_t> sharing(firstVertex.size(), 0);
+    std::vector<bool> counted(positions.size(), false);
+    for (size_t i = 0; i < indices.size(); i++) {
+        position[indices[i]] = byPosition[i];
+        if (not counted[indices[i]]) {
+            counted[indices[i]] = true;
+            sharing[byPosition[i]]++;
+        }
+    }
+
+    // edges between positions and the triangles on them, an open edge has
+    // a single one
+    std::unordered_map<uint64_t, uint32_t> edges;
+    edges.reserve(indices.size());
+    for (size_t t = 0; t + 2 < indices.size(); t += 3) {
+        for (uint32_t j = 0; j < 3; j++) {
+            uint64_t a = byPosition[t + j];
+            uint64_t b = byPosition[t + (j + 1) % 3];
+            edges[std::min(a, b) << 32 | std::max(a, b)]++;
+        }
+    }
+    std::vector<bool> open(firstVertex.size(), false);
+    for (const auto& [edge, count] : edges) {
+        if (count != 2) {
+            open[edge >> 32] = true;
+            open[edge & 0xffffffff] = true;
+        }
+    }
+
+    for (uint32_t v : indices) {
+        locked[v] = sharing[position[v]] > 1 or open[position[v]];
+    }
+    return locked;
+}
+
+struct Collapse {
+    uint32_t from;
+    uint32_t to;
+    double error;
+};
+
+std::vector<uint32_t> simplifyMesh(const std::vector<uint32_t>& indices,
+                                   const std::vector<glm::vec3>& positions,
+                                   size_t targetIndexCount, float& error) {
+    std::vector<uint32_t> result = indices;
+    double maxError = 0.0;
+    error = 0.0f;
+    if (result.size() <= targetIndexCount) return result;
+
+    std::vector<bool> locked = lockedVertices(indices, positions);
+    std::vector<Quadric> quadrics(positions.size(), Quadric{});
+    for (size_t t = 0; t + 2 < indices.size(); t += 3) {
+        const glm::vec3& p0 = positions[indices[t]];
+        glm::vec3 n = glm::cross(positions[indices[t + 1]] - p0,
+                                 positions[indices[t + 2]] - p0);
+        float area = glm::length(n);
+        if (area <= 0.0f) continue;
+        n /= area;
+        Quadric q = planeQuadric(n, -glm::dot(n, p0));
+        for (uint32_t j = 0; j < 3; j++) addQuadric(quadrics[indices[t + j]], q);
+    }
+
+    std::vector<uint32_t> target(positions.size());
+    std::vector<bool> touched(positions.size());
+    std::vector<uint32_t> firstTriangle(positions.size() + 1);
+    std::vector<uint32_t> triangles;
+    std::vector<Collapse> collapses;
+    while (result.size() > targetIndexCount) {
+        size_t triangleCount = result.size() / 3;
+
+        // triangles around every vertex
+        std::fill(firstTriangle.begin(), firstTriangle.end(), 0);
+        for (uint32_t v : result) firstTriangle[v + 1]++;
+        for (size_t v = 0; v < positions.size(); v++)
+            firstTriangle[v + 1] += firstTriangle[v];
+        triangles.resize(result.size());
+        std::vector<uint32_t> filled(firstTriangle.begin(),
+                                     firstTriangle.end() - 1);
+        for (size_t i = 0; i < result.size(); i++)
+            triangles[filled[result[i]]++] = static_cast<uint32_t>(i / 3);
+
+        collapses.clear();
+        for (size_t t = 0; t < triangleCount; t++) {
+            for (uint32_t j = 0; j < 3; j++) {
+                uint32_t a = result[t * 3 + j];
+                uint32_t b = result[t * 3 + (j + 1) % 3];
+                // both ways, onto the vertex it keeps
+                for (auto [from, to] : {std::pair{a, b}, std::pair{b, a}}) {
+                    if (locked[from]) continue;
+                    Quadric q = quadrics[from];
+                    addQuadric(q, quadrics[to]);
+                    collapses.push_back({from, to, quadricError(q, positions[to])});
+                }
+            }
+        }
+        std::sort(collapses.begin(), collapses.end(),
+                  [](const Collapse& a, const Collapse& b) {
+                      return a.error < b.error;
+                  });
+
+        // a collapse takes about two triangles, the ones around a collapsed
+        // vertex wait for the next pass so the flip test holds
+        size_t wanted = (triangleCount - targetIndexCount / 3) / 2 + 1;
+        size_t applied = 0;
+        std::iota(target.begin(), target.end(), 0u);
+        std::fill(touched.begin(), touched.end(), false);
+        for (const Collapse& collapse : collapses) {
+            if (applied == wanted) break;
+            if (touched[collapse.from] or touched[collapse.to]) continue;
+
+            // the triangles that stay must not turn over, or close to it
+            bool flips = false;
+            for (uint32_t i = firstTriangle[collapse.from];
+                 i < firstTriangle[collapse.from + 1] and not flips; i++) {
+                const uint32_t* tri = &result[triangles[i] * 3];
+                if (tri[0] == collapse.to or tri[1] == collapse.to or
+                    tri[2] == collapse.to)
+                    continue;
+                glm::vec3 p[3], moved[3];
+                for (uint32_t j = 0; j < 3; j++) {
+                    p[j] = positions[tri[j]];
+                    moved[j] = tri[j] == collapse.from ? positions[collapse.to]
+                                                       : p[j];
+                }
+                glm::vec3 before = glm::cross(p[1] - p[0], p[2] - p[0]);
+                glm::vec3 after =
+                    glm::cross(moved[1] - moved[0], moved[2] - moved[0]);
+                flips = glm::dot(before, after) <=
+                        0.25f * glm::length(before) * glm::length(after);
+            }
+            if (flips) continue;
+
+            target[collapse.from] = collapse.to;
+            addQuadric(quadrics[collapse.to], quadrics[collapse.from]);
+            for (uint32_t i = firstTriangle[collapse.from];
+                 i < firstTriangle[collapse.from + 1]; i++) {
+                const uint32_t* tri = &result[triangles[i] * 3];
+                touched[tri[0]] = touched[tri[1]] = touched[tri[2]] = true;
+            }
+            touched[collapse.to] = true;
+            maxError = std::max(maxError, collapse.error);
+            applied++;
+        }
+        if (applied == 0) break;
+
+        size_t kept = 0;
+        for (size_t t = 0; t < triangleCount; t++) {
+            uint32_t a = target[result[t * 3]];
+            uint32_t b = target[result[t * 3 + 1]];
+            uint32_t c = target[result[t * 3 + 2]];
+            if (a == b or b == c or a == c) continue;
+            result[kept++] = a;
+            result[kept++] = b;
+            result[kept++] = c;
+        }
+        result.resize(kept);
+    }
+    error = static_cast<float>(std::sqrt(maxError));
+    return result;
+}
+
+}  // namespace gbg
@@ -0,0 +1,138 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "glm/glm.hpp"
+
+namespace gbg {
+
+// Applied to meshes when they are uploaded. Welding is on by default, the
+// reordering is off, OBJ files come in whatever order the exporter wrote.
+struct srMeshOptimization {
+    // merges identical vertices before the tangents are generated
+    bool weld = true;
+    // reorders the index buffer
+    bool enabled = false;
+    // post transform cache entries the order is tuned for
+    uint32_t cacheSize = 16;
+    // draws the clusters the cache order leaves outer facing first
+    bool overdraw = true;
+    // lays the vertices out in the order they are first used
+    bool vertexFetch = true;
+    // draws meshes with too many vertices for 16 bit indices in chunks that
+    // fit, each with its vertex offset
+    bool splitIndices = true;
+    // splits meshes in clusters the main pass culls on the gpu, their
+    // indices stay 32 bit for the compute pass to read
+    bool meshlets = false;
+    uint32_t meshletVertices = 64;
+    uint32_t meshletTriangles = 124;
+    // simplified levels added after the full mesh, each with about
+    // lodRatio of the previous one's triangles, up to maxMeshLods in all
+    uint32_t lods = 3;
+    float lodRatio = 0.5f;
+};
+
+// the full mesh included
+const uint32_t maxMeshLods = 5;
+
+// Of a FIFO post transform cache. ACMR is vertices transformed per
+// triangle (0.5 at best, 3 at worst), ATVR vertices transformed per vertex
+// referenced (1 at best).
+struct srVertexCacheStats {
+    float acmr = 0.0f;
+    float atvr = 0.0f;
+};
+
+// Averages over the meshes optimized, weighted by their triangles.
+struct srMeshOptimizationStats {
+    uint32_t meshes = 0;
+    size_t triangles = 0;
+    srVertexCacheStats before;
+    srVertexCacheStats after;
+};
+
+void addOptimizationStats(srMeshOptimizationStats& stats, size_t triangles,
+                          const srVertexCacheStats& before,
+                          const srVertexCacheStats& after);
+
+// One attribute of every vertex, stride bytes apart.
+struct srVertexStream {
+    const std::byte* data;
+    size_t stride;
+};
+
+// Merges the vertices that are bit identical in every stream and leaves out
+// the ones no triangle uses. Rewrites the indices and returns, for every
+// new vertex, the old one.
+std::vector<uint32_t> weldVertices(std::vector<uint32_t>& indices,
+                                   const std::vector<srVertexStream>& streams,
+                                   size_t vertexCount);
+
+srVertexCacheStats analyzeVertexCache(const std::vector<uint32_t>& indices,
+                                      size_t vertexCount, uint32_t cacheSize);
+
+// Tipsify (Sander et al. 2007), fans around the vertices in cache. Returns
+// where, in triangles, each cluster of the new order starts: the points
+// where it had to jump away and the cache starts over.
+std::vector<uint32_t> optimizeVertexCache(std::vector<uint32_t>& indices,
+                                          size_t vertexCount,
+                                          uint32_t cacheSize);
+
+// Sorts the clusters so the ones facing away from the mesh center come
+// first, they tend to occlude the rest. Triangles keep their order within
+// a cluster so the cache hits stay.
+void optimizeOverdraw(std::vector<uint32_t>& indices,
+                      const std::vector<uint32_t>& clusters,
+                      const std::vector<glm::vec3>& positions);
+
+// Renumbers the vertices in first use order and returns, for every new
+// vertex, the old one. Vertices no triangle uses are left out.
+std::vector<uint32_t> optimizeVertexFetch(std::vector<uint32_t>& indices,
+                                          size_t vertexCount);
+
+// A run of triangles in the index buffer, laid out as the cluster culling
+// shader reads it (std430).
+struct srMeshlet {
+    // object space, center in xyz and radius in w
+    glm::vec4 sphere;
+    // axis in xyz, w the sine of the cone's half angle. Facing away from
+    // cameras where dot(center - camera, axis) >= w * distance + radius, w is
+    // 1 when the triangles spread over a half space
+    glm::vec4 cone;
+    uint32_t firstIndex;
+    uint32_t triangleCount;
+    uint32_t padding[2];
+};
+
+// Cuts the triangles, in their current order, in runs of at most
+// maxTriangles using at most maxVertices. Cache optimized orders give
+// compact clusters.
+std::vector<srMeshlet> buildMeshlets(const std::vector<uint32_t>& indices,
+                                     const std::vector<glm::vec3>& positions,
+                                     uint32_t maxVertices,
+                                     uint32_t maxTriangles);
+
+// Collapses edges onto one of their vertices, cheapest first by the quadric
+// error of the planes around them (Garland and Heckbert 1997), until at
+// most targetIndexCount indices are left or nothing else can go. Vertices
+// on open edges or attribute seams, the ones sharing their position with
+// another, stay. Returns indices over the same vertices and, in error, how
+// far in object space the surface may have moved.
+std::vector<uint32_t> simplifyMesh(const std::vector<uint32_t>& indices,
+                                   const std::vector<glm::vec3>& positions,
+                                   size_t targetIndexCount, float& error);
+
+template <typename T>
+std::vector<T> remapVertices(const std::vector<T>& values,
+                             const std::vector<uint32_t>& remap) {
+    std::vector<T> remapped;
+    remapped.reserve(remap.size());
+    for (uint32_t old : remap) {
+        remapped.push_back(values[old]);
+    }
+    return remapped;
+}
+
+}  // namespace gbg
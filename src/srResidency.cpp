@@ -0,0 +1,70 @@
+#include "srResidency.hpp"
+
+#include <vulkan/vulkan_core.h>
+
+#include <algorithm>
+
+namespace gbg {
+
+void trackMemory(srResidency& residency, srMemoryClass memoryClass,
+                 VkDeviceSize size) {
+    residency.stats.used[memoryClass] += size;
+}
+
+void untrackMemory(srResidency& residency, srMemoryClass memoryClass,
+                   VkDeviceSize size) {
+    VkDeviceSize& used = residency.stats.used[memoryClass];
+    used -= std::min(used, size);
+}
+
+VkDeviceSize trackedMemory(const srResidency& residency) {
+    VkDeviceSize total = 0;
+    for (VkDeviceSize used : residency.stats.used) total += used;
+    return total;
+}
+
+VkDeviceSize updateMemoryBudget(const vkDevice& device,
+                                srResidency& residency) {
+    VkPhysicalDeviceMemoryBudgetPropertiesEXT budgetProperties{};
+    budgetProperties.sType =
+        VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_BUDGET_PROPERTIES_EXT;
+
+    VkPhysicalDeviceMemoryProperties2 properties{};
+    properties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_PROPERTIES_2;
+    if (device.memoryBudget) properties.pNext = &budgetProperties;
+    vkGetPhysicalDeviceMemoryProperties2(device.pdevice, &properties);
+
+    const srMemoryBudget& settings = residency.settings;
+    srMemoryStats& stats = residency.stats;
+    stats.budget = 0;
+    stats.usage = 0;
+    const VkPhysicalDeviceMemoryProperties& memory =
+        properties.memoryProperties;
+    for (uint32_t i = 0; i < memory.memoryHeapCount; i++) {
+        if (not(memory.memoryHeaps[i].flags & VK_MEMORY_HEAP_DEVICE_LOCAL_BIT))
+            continue;
+        if (device.memoryBudget) {
+            stats.budget += budgetProperties.heapBudget[i];
+            stats.usage += budgetProperties.heapUsage[i];
+        } else {
+            stats.budget += static_cast<VkDeviceSize>(
+                memory.memoryHeaps[i].size * settings.heapFraction);
+        }
+    }
+    // without the extension only our own allocations are known
+    if (not device.memoryBudget) stats.usage = trackedMemory(residency);
+    if (settings.limit > 0) stats.budget = std::min(stats.budget, settings.limit);
+
+    VkDeviceSize target =
+        static_cast<VkDeviceSize>(stats.budget * settings.target);
+    if (stats.usage > stats.budget) {
+        residency.overBudget = true;
+    } else if (stats.usage <= target) {
+        residency.overBudget = false;
+    }
+
+    if (not residency.overBudget) return 0;
+    return stats.usage - std::min(stats.usage, target);
+}
+
+}  // namespace gbg
@@ -0,0 +1,69 @@
+#pragma once
+#include <vulkan/vulkan_core.h>
+
+#include <array>
+#include <cstdint>
+
+#include "vk_utils/vkDevice.hh"
+
+namespace gbg {
+
+// What the device memory the renderer allocates holds.
+enum srMemoryClass : uint32_t {
+    MEMORY_MESH,
+    MEMORY_TEXTURE,
+    MEMORY_MATERIAL,
+    MEMORY_ATTACHMENT,
+    MEMORY_CLASS_COUNT
+};
+
+// When the device local heaps fill up, the least recently drawn textures
+// are streamed down to coarser levels and meshes nobody drew are dropped.
+struct srMemoryBudget {
+    bool enabled = true;
+    // caps the budget below what the driver gives, 0 to leave it
+    VkDeviceSize limit = 0;
+    // share of the heaps used as budget without VK_EXT_memory_budget
+    float heapFraction = 0.8f;
+    // evicting stops, and streaming finer levels resumes, below this share
+    // of the budget
+    float target = 0.9f;
+    // frames a mesh has to go undrawn before its buffers can be dropped
+    uint32_t meshIdleFrames = 600;
+};
+
+struct srMemoryStats {
+    // allocated by the renderer, by class
+    std::array<VkDeviceSize, MEMORY_CLASS_COUNT> used{};
+    // of the device local heaps
+    VkDeviceSize budget = 0;
+    // the whole process in those heaps when the driver reports it, the
+    // tracked total otherwise
+    VkDeviceSize usage = 0;
+    uint32_t evictedTextures = 0;
+    uint32_t droppedMeshes = 0;
+};
+
+struct srResidency {
+    srMemoryBudget settings;
+    srMemoryStats stats;
+    // set past the budget, cleared once back under the target
+    bool overBudget = false;
+    // stamped on what gets drawn
+    uint64_t frame = 0;
+};
+
+void trackMemory(srResidency& residency, srMemoryClass memoryClass,
+                 VkDeviceSize size);
+
+void untrackMemory(srResidency& residency, srMemoryClass memoryClass,
+                   VkDeviceSize size);
+
+VkDeviceSize trackedMemory(const srResidency& residency);
+
+// Refreshes the budget and usage and returns the bytes to free to get back
+// under the target, 0 when there is nothing to do.
+VkDeviceSize updateMemoryBudget(const vkDevice& device,
+                                srResidency& residency);
+
+}  // namespace gbg
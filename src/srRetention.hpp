@@ -0,0 +1,39 @@
+#pragma once
+#include <vulkan/vulkan_core.h>
+
+#include <cstdint>
+
+namespace gbg {
+
+// What happens to the cpu copy of a mesh or texture once it is on the gpu.
+enum srRetentionPolicy : uint32_t {
+    RETAIN_DEFAULT,  // whatever srRetention says for its kind
+    RETAIN_KEEP,
+    // freed, what can't be read again from a file stays as uploaded
+    RETAIN_RELEASE,
+    // freed, a compact copy is kept to upload it again. Meshes keep the
+    // streams sent to the gpu with the indices delta coded, textures
+    // without a source file keep their block compressed cache.
+    RETAIN_COMPRESS,
+};
+
+struct srRetention {
+    srRetentionPolicy meshes = RETAIN_KEEP;
+    srRetentionPolicy textures = RETAIN_KEEP;
+};
+
+struct srRetentionStats {
+    VkDeviceSize meshBytesFreed = 0;
+    VkDeviceSize textureBytesFreed = 0;
+    // held by the compact copies instead
+    VkDeviceSize compactBytes = 0;
+    uint32_t releasedMeshes = 0;
+    uint32_t releasedTextures = 0;
+};
+
+inline srRetentionPolicy resolveRetention(srRetentionPolicy policy,
+                                          srRetentionPolicy fallback) {
+    return policy == RETAIN_DEFAULT ? fallback : policy;
+}
+
+}  // namespace gbg
@@ -2,7 +2,8 @@
 
 namespace gbg {
 
-void destroySrShader(const vkDevice& device, const srShader& shader) {
+void destroySrShader(const vkDevice& device, srShader& shader) {
+    destroyDescriptorTemplate(device, shader.descTemplate);
     vkDestroyPipeline(device.ldevice, shader.pipeline.pipeline, nullptr);
     vkDestroyPipelineLayout(device.ldevice, shader.pipeline.layout, nullptr);
     vkDestroyDescriptorSetLayout(device.ldevice, shader.layout, nullptr);
@@ -4,6 +4,7 @@
 
 #include "Resource.hpp"
 #include "macros.hpp"
+#include "vk_utils/vkDescriptorTemplate.hh"
 #include "vk_utils/vkPipeline.hh"
 
 namespace gbg {
@@ -11,7 +12,9 @@ struct srShader : public Resource {
     srShader() : Resource() {}
     srShader(std::string name, uint32_t rid) : Resource(name, rid) {}
     vkPipeline pipeline;
-    VkDescriptorSetLayout layout;
+    VkDescriptorSetLayout layout = VK_NULL_HANDLE;
+    // writes a material set from srMaterial::descriptorData
+    vkDescriptorTemplate descTemplate;
     VkPrimitiveTopology topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
 };
 
@@ -20,7 +23,7 @@ struct srShaderHandle : public ResourceHandle {
     srShaderHandle(uint32_t rid, size_t index) : ResourceHandle(rid, index) {};
 };
 
-void destroySrShader(const vkDevice& device, const srShader& shader);
+void destroySrShader(const vkDevice& device, srShader& shader);
 
 RESOURCE_MANAGER(srShader);
 
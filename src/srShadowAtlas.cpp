@@ -0,0 +1,184 @@
+#include "srShadowAtlas.hpp"
+
+#include <algorithm>
+#include <bit>
+
+namespace gbg {
+
+static float shadowPriority(const srShadowRequest& request) {
+    return std::min(request.coverage, 1.0f) * request.importance;
+}
+
+// the even bits of a Morton code
+static uint32_t compactBits(uint32_t v) {
+    v &= 0x55555555;
+    v = (v | (v >> 1)) & 0x33333333;
+    v = (v | (v >> 2)) & 0x0f0f0f0f;
+    v = (v | (v >> 4)) & 0x00ff00ff;
+    v = (v | (v >> 8)) & 0x0000ffff;
+    return v;
+}
+
+// the inverse of compactBits
+static uint32_t spreadBits(uint32_t v) {
+    v &= 0x0000ffff;
+    v = (v | (v << 8)) & 0x00ff00ff;
+    v = (v | (v << 4)) & 0x0f0f0f0f;
+    v = (v | (v << 2)) & 0x33333333;
+    v = (v | (v << 1)) & 0x55555555;
+    return v;
+}
+
+void allocateShadowTiles(srShadowAtlas& atlas,
+                         std::vector<srShadowRequest>& requests) {
+    const srShadowAtlasSettings& settings = atlas.settings;
+    std::vector<srShadowTile> previous = std::move(atlas.tiles);
+    atlas.tiles.clear();
+    atlas.stats.requests = static_cast<uint32_t>(requests.size());
+    auto previousTile = [&](uint32_t light) -> const srShadowTile* {
+        for (const srShadowTile& tile : previous) {
+            if (tile.light == light) return &tile;
+        }
+        return nullptr;
+    };
+    float keep = 1.0f + std::max(settings.hysteresis, 0.0f);
+
+    // lights that light nothing cast no shadow
+    std::erase_if(requests, [](const srShadowRequest& request) {
+        return shadowPriority(request) <= 0.0f;
+    });
+    // a light holding a tile keeps it until another one is clearly ahead,
+    // ties keep their order
+    std::vector<float> priorities(requests.size());
+    std::vector<uint32_t> ranked(requests.size());
+    for (uint32_t i = 0; i < requests.size(); i++) {
+        priorities[i] = shadowPriority(requests[i]) *
+                        (previousTile(requests[i].light) ? keep : 1.0f);
+        ranked[i] = i;
+    }
+    std::stable_sort(ranked.begin(), ranked.end(), [&](uint32_t a, uint32_t b) {
+        return priorities[a] > priorities[b];
+    });
+    std::vector<srShadowRequest> sorted;
+    sorted.reserve(requests.size());
+    for (uint32_t i : ranked) sorted.push_back(requests[i]);
+    requests = std::move(sorted);
+    size_t count = std::min<size_t>(requests.size(), settings.maxLights);
+
+    // the tiles are placed in the largest power of two square that fits
+    uint32_t side = std::bit_floor(settings.size);
+    uint32_t maxTile = std::bit_floor(std::min(settings.maxTile, side));
+    uint32_t minTile =
+        std::min(std::bit_floor(std::max(settings.minTile, 1u)), maxTile);
+    uint64_t capacity = static_cast<uint64_t>(side) * side;
+
+    std::vector<uint32_t> sizes(count);
+    uint64_t area = 0;
+    for (size_t i = 0; i < count; i++) {
+        float wanted = maxTile * std::min(requests[i].coverage, 1.0f);
+        sizes[i] = std::clamp(
+            std::bit_floor(std::max(static_cast<uint32_t>(wanted), 1u)),
+            minTile, maxTile);
+        // grows once well past the next size, shrinks once well below its
+        // own
+        if (const srShadowTile* tile = previousTile(requests[i].light)) {
+            float held = static_cast<float>(tile->size);
+            bool grows = sizes[i] > tile->size and
+                         (wanted >= maxTile or wanted >= 2.0f * held * keep);
+            bool shrinks = sizes[i] < tile->size and wanted < held / keep;
+            if (not grows and not shrinks)
+                sizes[i] = std::clamp(tile->size, minTile, maxTile);
+        }
+        area += static_cast<uint64_t>(sizes[i]) * sizes[i];
+    }
+    // halving a tile frees three quarters of it
+    while (area > capacity) {
+        bool halved = false;
+        for (size_t i = count; i-- > 0 and area > capacity;) {
+            if (sizes[i] <= minTile) continue;
+            area -= static_cast<uint64_t>(sizes[i]) * sizes[i] / 4 * 3;
+            sizes[i] /= 2;
+            halved = true;
+        }
+        if (not halved) break;
+    }
+    // still too many at the smallest tile
+    while (area > capacity) {
+        count--;
+        area -= static_cast<uint64_t>(sizes[count]) * sizes[count];
+    }
+
+    // every tile starts at a multiple of its own cell count, an aligned
+    // square of the image
+    uint32_t grid = side / minTile;
+    std::vector<bool> used(static_cast<size_t>(grid) * grid, false);
+    auto cellCount = [&](uint32_t i) {
+        return (sizes[i] / minTile) * (sizes[i] / minTile);
+    };
+    auto isFree = [&](uint32_t cell, uint32_t cells) {
+        return std::none_of(used.begin() + cell, used.begin() + cell + cells,
+                            [](bool u) { return u; });
+    };
+    std::vector<int64_t> cellOf(count, -1);
+    for (uint32_t i = 0; i < count; i++) {
+        const srShadowTile* tile = previousTile(requests[i].light);
+        if (not tile or tile->size != sizes[i] or tile->x % sizes[i] != 0 or
+            tile->y % sizes[i] != 0 or tile->x + sizes[i] > side or
+            tile->y + sizes[i] > side)
+            continue;
+        uint32_t cell = spreadBits(tile->x / minTile) |
+                        (spreadBits(tile->y / minTile) << 1);
+        if (not isFree(cell, cellCount(i))) continue;
+        std::fill_n(used.begin() + cell, cellCount(i), true);
+        cellOf[i] = cell;
+    }
+
+    // the rest largest first, in the first free run
+    std::vector<uint32_t> order(count);
+    for (uint32_t i = 0; i < count; i++) order[i] = i;
+    std::stable_sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b) {
+        return sizes[a] > sizes[b];
+    });
+    bool placed = true;
+    for (uint32_t i : order) {
+        if (cellOf[i] >= 0) continue;
+        uint32_t cells = cellCount(i);
+        for (uint32_t cell = 0; cell + cells <= used.size(); cell += cells) {
+            if (not isFree(cell, cells)) continue;
+            std::fill_n(used.begin() + cell, cells, true);
+            cellOf[i] = cell;
+            break;
+        }
+        if (cellOf[i] < 0) {
+            placed = false;
+            break;
+        }
+    }
+    // the kept tiles split the free space, packed from the start nothing is
+    // left between them
+    if (not placed) {
+        uint32_t cell = 0;
+        for (uint32_t i : order) {
+            cellOf[i] = cell;
+            cell += cellCount(i);
+        }
+    }
+
+    for (uint32_t i : order) {
+        uint32_t cell = static_cast<uint32_t>(cellOf[i]);
+        atlas.tiles.push_back({requests[i].light,
+                               compactBits(cell) * minTile,
+                               compactBits(cell >> 1) * minTile, sizes[i]});
+    }
+
+    atlas.stats.tiles = static_cast<uint32_t>(count);
+    atlas.stats.usage =
+        static_cast<float>(area) /
+        (static_cast<float>(settings.size) * static_cast<float>(settings.size));
+}
+
+uint32_t shadowTileOrigin(const srShadowTile& tile) {
+    return tile.x | tile.y << 16;
+}
+
+}  // namespace gbg
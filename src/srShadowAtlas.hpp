@@ -0,0 +1,69 @@
+#pragma once
+#include <cstdint>
+#include <vector>
+
+namespace gbg {
+
+// The shadow maps of every light share one depth image, cut in square
+// tiles with power of two sides.
+struct srShadowAtlasSettings {
+    // side of the image, set it before setScene. Below 65536, the tiles go
+    // in 16 bits
+    uint32_t size = 4096;
+    uint32_t maxTile = 2048;
+    uint32_t minTile = 256;
+    // the most important ones cast shadows, the rest don't
+    uint32_t maxLights = 16;
+    // how far past the next size, or the priority of a light holding a
+    // tile, a light has to get before its tile changes. Keeps the tiles,
+    // and the cache of their static casters, still as the camera moves
+    float hysteresis = 0.25f;
+};
+
+// What a light asks the atlas for this frame.
+struct srShadowRequest {
+    uint32_t light;
+    // share of the screen height its range covers, 1 with the camera in it
+    float coverage;
+    // how much it lights, its brightest channel
+    float importance;
+};
+
+// In pixels of the image.
+struct srShadowTile {
+    uint32_t light;
+    uint32_t x;
+    uint32_t y;
+    uint32_t size;
+};
+
+struct srShadowAtlasStats {
+    uint32_t requests = 0;
+    uint32_t tiles = 0;
+    // share of the image the tiles cover
+    float usage = 0.0f;
+    // times the static casters were drawn again
+    uint32_t cacheUpdates = 0;
+    // tiles drawn again on their own since the last full update
+    uint32_t tileUpdates = 0;
+};
+
+struct srShadowAtlas {
+    srShadowAtlasSettings settings;
+    std::vector<srShadowTile> tiles;
+    srShadowAtlasStats stats;
+};
+
+// Sizes a tile for the lights that cover the most of the screen times
+// their importance, halving the least important ones first until they fit.
+// The tiles of the last call are kept, with the hysteresis, and stay where
+// they were when their size does. The others are placed largest first in
+// the first free aligned run of a Morton curve, so they never overlap; when
+// the holes left don't fit them everything is packed again from the start.
+void allocateShadowTiles(srShadowAtlas& atlas,
+                         std::vector<srShadowRequest>& requests);
+
+// x and y in texels, a 16 bit half each, what the shaders get with the size.
+uint32_t shadowTileOrigin(const srShadowTile& tile);
+
+}  // namespace gbg
@@ -0,0 +1,263 @@
+#include "srShadowCascades.hpp"
+
+#include <vulkan/vulkan_core.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <stdexcept>
+
+#include "glm/gtc/matrix_transform.hpp"
+
+namespace gbg {
+
+// std140, what the shaders read at the global set's binding 6
+struct ShadowCascadeParams {
+    glm::mat4 viewProjection[maxShadowCascades];
+    glm::vec4 splits;     // view depth each one reaches
+    glm::vec4 bias;       // depth bias of each, about a texel
+    glm::vec4 direction;  // towards the light, the cascade count
+    glm::vec4 color;
+};
+
+static VkRenderPass createCascadeRenderPass(VkDevice device,
+                                            VkFormat depthFormat) {
+    VkAttachmentDescription depthDesc{};
+    depthDesc.format = depthFormat;
+    depthDesc.samples = VK_SAMPLE_COUNT_1_BIT;
+    depthDesc.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+    depthDesc.finalLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL;
+    depthDesc.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
+    depthDesc.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+    depthDesc.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+    depthDesc.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+
+    VkAttachmentReference depthRef{};
+    depthRef.attachment = 0;
+    depthRef.layout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+
+    VkSubpassDescription subpassDesc{};
+    subpassDesc.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
+    subpassDesc.colorAttachmentCount = 0;
+    subpassDesc.pDepthStencilAttachment = &depthRef;
+
+    // the main pass of the frame before sampled it, this frame's samples it.
+    // Anywhere in the layer, not at the same pixel, so not by region
+    std::array<VkSubpassDependency, 2> subDep{};
+    subDep[0].srcSubpass = VK_SUBPASS_EXTERNAL;
+    subDep[0].dstSubpass = 0;
+    subDep[0].srcStageMask = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
+    subDep[0].dstStageMask = VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT |
+                             VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+    subDep[0].srcAccessMask = VK_ACCESS_SHADER_READ_BIT;
+    subDep[0].dstAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+    subDep[0].dependencyFlags = 0;
+
+    subDep[1].srcSubpass = 0;
+    subDep[1].dstSubpass = VK_SUBPASS_EXTERNAL;
+    subDep[1].srcStageMask = VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT |
+                             VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+    subDep[1].dstStageMask = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
+    subDep[1].srcAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+    subDep[1].dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+    subDep[1].dependencyFlags = 0;
+
+    VkRenderPassCreateInfo rpc{};
+    rpc.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
+    rpc.subpassCount = 1;
+    rpc.pSubpasses = &subpassDesc;
+    rpc.dependencyCount = subDep.size();
+    rpc.pDependencies = subDep.data();
+    rpc.attachmentCount = 1;
+    rpc.pAttachments = &depthDesc;
+
+    VkRenderPass pass;
+    if (vkCreateRenderPass(device, &rpc, nullptr, &pass) != VK_SUCCESS) {
+        throw std::runtime_error("failed to create shadow cascade render pass!");
+    }
+    return pass;
+}
+
+void createShadowCascades(const vkDevice& device, srShadowCascades& cascades,
+                          VkFormat depthFormat, uint32_t frameCount) {
+    srShadowCascadeSettings& settings = cascades.settings;
+    settings.count = std::clamp(settings.count, 1u, maxShadowCascades);
+    cascades.renderPass = createCascadeRenderPass(device.ldevice, depthFormat);
+
+    VkImageAspectFlags aspect = VK_IMAGE_ASPECT_DEPTH_BIT;
+    cascades.frames.resize(frameCount);
+    for (srShadowCascadeFrame& frame : cascades.frames) {
+        frame.params = createBuffer(device, sizeof(ShadowCascadeParams),
+                                    VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT,
+                                    VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
+                                        VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+        if (vkMapMemory(device.ldevice, frame.params.memory, 0,
+                        frame.params.size, 0,
+                        &frame.paramsMapped) != VK_SUCCESS) {
+            throw std::runtime_error("failed to map shadow cascade params!");
+        }
+        // nothing to shadow until the first update
+        std::memset(frame.paramsMapped, 0, sizeof(ShadowCascadeParams));
+
+        frame.maps = createImage(
+            device.pdevice, device.ldevice, settings.size, settings.size, 1,
+            VK_SAMPLE_COUNT_1_BIT, depthFormat, VK_IMAGE_TILING_OPTIMAL,
+            VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT |
+                VK_IMAGE_USAGE_SAMPLED_BIT,
+            VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, 0, settings.count);
+        frame.maps.view = createImageLayerView(
+            frame.maps.image, device.ldevice, depthFormat, aspect, 0,
+            settings.count, VK_IMAGE_VIEW_TYPE_2D_ARRAY);
+
+        for (uint32_t i = 0; i < settings.count; i++) {
+            VkImageView layer =
+                createImageLayerView(frame.maps.image, device.ldevice,
+                                     depthFormat, aspect, i, 1,
+                                     VK_IMAGE_VIEW_TYPE_2D);
+            frame.layers.push_back(layer);
+
+            VkFramebufferCreateInfo framebufferInfo{};
+            framebufferInfo.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
+            framebufferInfo.renderPass = cascades.renderPass;
+            framebufferInfo.attachmentCount = 1;
+            framebufferInfo.pAttachments = &layer;
+            framebufferInfo.width = settings.size;
+            framebufferInfo.height = settings.size;
+            framebufferInfo.layers = 1;
+
+            VkFramebuffer framebuffer;
+            if (vkCreateFramebuffer(device.ldevice, &framebufferInfo, nullptr,
+                                    &framebuffer) != VK_SUCCESS) {
+                throw std::runtime_error("failed to create framebuffer!");
+            }
+            frame.framebuffers.push_back(framebuffer);
+        }
+    }
+
+    // cleared once and left to be sampled, frames without a light bind
+    // them as they are
+    VkCommandBuffer commandBuffer =
+        beginSingleTimeCommands(device, device.graphicsCmdPool);
+    for (uint32_t frame = 0; frame < frameCount; frame++) {
+        for (uint32_t i = 0; i < settings.count; i++) {
+            beginShadowCascade(cascades, frame, i, commandBuffer);
+            vkCmdEndRenderPass(commandBuffer);
+        }
+    }
+    endSingleTimeCommands(device, commandBuffer, device.graphicsCmdPool,
+                          device.gqueue);
+}
+
+void updateShadowCascades(srShadowCascades& cascades, uint32_t frame,
+                          const glm::mat4& view, const glm::mat4& projection,
+                          const glm::vec3& direction, const glm::vec3& color) {
+    const srShadowCascadeSettings& settings = cascades.settings;
+    ShadowCascadeParams params{};
+    cascades.active = 0;
+    cascades.stats = {};
+
+    bool lit = std::max({color.r, color.g, color.b}) > 0.0f and
+               glm::length(direction) > 0.0f;
+    if (lit) {
+        uint32_t count = settings.count;
+        // back from a perspective with a 0 to 1 depth range
+        float zNear = projection[3][2] / projection[2][2];
+        float zFar = projection[3][2] / (projection[2][2] + 1.0f);
+        float end = std::clamp(settings.distance, zNear, zFar);
+        // squared distance from the axis of a slice's corner at depth 1
+        float tanX = 1.0f / std::abs(projection[0][0]);
+        float tanY = 1.0f / std::abs(projection[1][1]);
+        float k2 = tanX * tanX + tanY * tanY;
+
+        // the rotation alone, the cascades snap in it
+        glm::vec3 dir = glm::normalize(direction);
+        glm::vec3 up = std::abs(dir.y) > 0.99f ? glm::vec3(0.0f, 0.0f, 1.0f)
+                                                : glm::vec3(0.0f, 1.0f, 0.0f);
+        glm::mat4 lightView = glm::lookAtRH(glm::vec3(0.0f), dir, up);
+        glm::mat4 cameraWorld = glm::inverse(view);
+
+        float begin = zNear;
+        for (uint32_t i = 0; i < count; i++) {
+            float t = float(i + 1) / float(count);
+            float uniform = zNear + (end - zNear) * t;
+            float logarithmic = zNear * std::pow(end / zNear, t);
+            float split = uniform + (logarithmic - uniform) * settings.splitLambda;
+
+            // the smallest sphere through the corners of both ends, on the
+            // axis of the camera. Rounded up so it keeps its size
+            float c = std::min((split + begin) * (1.0f + k2) * 0.5f, split);
+            float radius =
+                std::sqrt(split * split * k2 + (split - c) * (split - c));
+            radius = std::ceil(radius * 16.0f) / 16.0f;
+
+            glm::vec3 center = cameraWorld * glm::vec4(0.0f, 0.0f, -c, 1.0f);
+            glm::vec3 origin = lightView * glm::vec4(center, 1.0f);
+            float texel = 2.0f * radius / settings.size;
+            origin.x = std::floor(origin.x / texel) * texel;
+            origin.y = std::floor(origin.y / texel) * texel;
+
+            srShadowCascade& cascade = cascades.cascades[i];
+            cascade.radius = radius;
+            cascade.zNear = -(origin.z + radius + settings.casterReach);
+            cascade.zFar = -(origin.z - radius);
+            cascade.split = split;
+            glm::mat4 ortho = glm::orthoRH_ZO(
+                origin.x - radius, origin.x + radius, origin.y - radius,
+                origin.y + radius, cascade.zNear, cascade.zFar);
+            // the same winding as the other passes
+            ortho[1][1] *= -1;
+            cascade.viewProjection = ortho * lightView;
+
+            params.viewProjection[i] = cascade.viewProjection;
+            params.splits[i] = split;
+            params.bias[i] = 2.0f * texel / (cascade.zFar - cascade.zNear);
+            begin = split;
+        }
+        params.direction = glm::vec4(-dir, static_cast<float>(count));
+        params.color = glm::vec4(color, 1.0f);
+        cascades.active = count;
+        cascades.stats.cascades = count;
+    }
+    std::memcpy(cascades.frames[frame].paramsMapped, &params, sizeof(params));
+}
+
+bool shadowCascadeSees(const srShadowCascade& cascade,
+                       const glm::vec3& center, float radius) {
+    glm::vec4 p = cascade.viewProjection * glm::vec4(center, 1.0f);
+    float side = 1.0f + radius / cascade.radius;
+    float depth = radius / (cascade.zFar - cascade.zNear);
+    return std::abs(p.x) <= side and std::abs(p.y) <= side and
+           p.z >= -depth and p.z <= 1.0f + depth;
+}
+
+void beginShadowCascade(const srShadowCascades& cascades, uint32_t frame,
+                        uint32_t cascade, VkCommandBuffer commandBuffer) {
+    VkClearValue clear = {.depthStencil = {1.0f, 0}};
+
+    VkRenderPassBeginInfo renderPassInfo{};
+    renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
+    renderPassInfo.renderPass = cascades.renderPass;
+    renderPassInfo.framebuffer = cascades.frames[frame].framebuffers[cascade];
+    renderPassInfo.renderArea.offset = {0, 0};
+    renderPassInfo.renderArea.extent = {cascades.settings.size,
+                                        cascades.settings.size};
+    renderPassInfo.clearValueCount = 1;
+    renderPassInfo.pClearValues = &clear;
+    vkCmdBeginRenderPass(commandBuffer, &renderPassInfo,
+                         VK_SUBPASS_CONTENTS_INLINE);
+}
+
+void destroyShadowCascades(const vkDevice& device, srShadowCascades& cascades) {
+    for (srShadowCascadeFrame& frame : cascades.frames) {
+        for (VkFramebuffer framebuffer : frame.framebuffers)
+            vkDestroyFramebuffer(device.ldevice, framebuffer, nullptr);
+        for (VkImageView layer : frame.layers)
+            vkDestroyImageView(device.ldevice, layer, nullptr);
+        destoryImage(frame.maps, device.ldevice);
+        destroyBuffer(device, frame.params);
+    }
+    cascades.frames.clear();
+    vkDestroyRenderPass(device.ldevice, cascades.renderPass, nullptr);
+}
+
+}  // namespace gbg
@@ -0,0 +1,97 @@
+#pragma once
+#include <vulkan/vulkan_core.h>
+
+#include <array>
+#include <cstdint>
+#include <vector>
+
+#include "glm/glm.hpp"
+#include "vk_utils/vkBuffer.hh"
+#include "vk_utils/vkDevice.hh"
+#include "vk_utils/vkImage.hh"
+
+namespace gbg {
+
+const uint32_t maxShadowCascades = 4;
+// what the shadow pass draws when it isn't a cascade
+const uint32_t noShadowCascade = UINT32_MAX;
+
+struct srShadowCascadeSettings {
+    // layers of the image and their side, set them before setScene
+    uint32_t count = 3;
+    uint32_t size = 2048;
+    // from the camera, fragments past it aren't shadowed
+    float distance = 60.0f;
+    // 0 splits the distance evenly, 1 logarithmically
+    float splitLambda = 0.75f;
+    // casters this far towards the light from a cascade still cast in it
+    float casterReach = 100.0f;
+};
+
+// An orthographic view of the light around a slice of the camera frustum.
+struct srShadowCascade {
+    glm::mat4 viewProjection;
+    // of the sphere around the slice, half the side of the view
+    float radius;
+    // along the view's -z
+    float zNear;
+    float zFar;
+    // view depth of the camera where the slice ends
+    float split;
+};
+
+struct srShadowCascadeStats {
+    uint32_t cascades = 0;
+    // models culled into each
+    std::array<uint32_t, maxShadowCascades> casters{};
+};
+
+// Buffers and images of one frame in flight.
+struct srShadowCascadeFrame {
+    // the matrices and splits the shaders read, written once its fence was
+    // waited
+    vkBuffer params{};
+    void* paramsMapped = nullptr;
+    // a layer per cascade, view holds them all
+    vkImage maps{};
+    std::vector<VkImageView> layers;
+    std::vector<VkFramebuffer> framebuffers;
+};
+
+// Shadows of the directional light, fitted every frame to slices of the
+// camera frustum. Each cascade is a sphere around its slice, so its size
+// doesn't change as the camera turns, and its origin moves by whole texels,
+// so the edges don't crawl as the camera moves.
+struct srShadowCascades {
+    srShadowCascadeSettings settings;
+    std::array<srShadowCascade, maxShadowCascades> cascades{};
+    // fitted this frame, none without a light
+    uint32_t active = 0;
+    // clears a layer and leaves it to be sampled. The layers start
+    // cleared, the passes are only recorded for the active ones
+    VkRenderPass renderPass = VK_NULL_HANDLE;
+    std::vector<srShadowCascadeFrame> frames;
+    srShadowCascadeStats stats;
+};
+
+// Compatible with any single sample depth pass of the same format.
+void createShadowCascades(const vkDevice& device, srShadowCascades& cascades,
+                          VkFormat depthFormat, uint32_t frameCount);
+
+// Once the frame's fence was waited. direction is the one the light shines
+// towards, a black color leaves them out.
+void updateShadowCascades(srShadowCascades& cascades, uint32_t frame,
+                          const glm::mat4& view, const glm::mat4& projection,
+                          const glm::vec3& direction, const glm::vec3& color);
+
+// Whether a caster with this bounding sphere can shadow the cascade.
+bool shadowCascadeSees(const srShadowCascade& cascade,
+                       const glm::vec3& center, float radius);
+
+// Clears the layer, the caller draws the casters and ends the pass.
+void beginShadowCascade(const srShadowCascades& cascades, uint32_t frame,
+                        uint32_t cascade, VkCommandBuffer commandBuffer);
+
+void destroyShadowCascades(const vkDevice& device, srShadowCascades& cascades);
+
+}  // namespace gbg
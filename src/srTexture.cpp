@@ -1,17 +1,23 @@
 #include "srTexture.hpp"
 #include <vulkan/vulkan_core.h>
 
+#include <algorithm>
+#include <cmath>
 #include <stdexcept>
 
 #include "vk_utils/vkCommandBuffer.hh"
 namespace gbg {
-void generateMipmaps(vkDevice device, VkImage image, VkFormat format,
-                     int32_t texWidth, int32_t texHeight, uint32_t mipLevels) {
+bool supportsLinearBlit(const vkDevice& device, VkFormat format) {
     VkFormatProperties formatProperties;
     vkGetPhysicalDeviceFormatProperties(device.pdevice, format,
                                         &formatProperties);
-    if (!(formatProperties.optimalTilingFeatures &
-          VK_FORMAT_FEATURE_SAMPLED_IMAGE_FILTER_LINEAR_BIT)) {
+    return formatProperties.optimalTilingFeatures &
+           VK_FORMAT_FEATURE_SAMPLED_IMAGE_FILTER_LINEAR_BIT;
+}
+
+void generateMipmaps(vkDevice device, VkImage image, VkFormat format,
+                     int32_t texWidth, int32_t texHeight, uint32_t mipLevels) {
+    if (not supportsLinearBlit(device, format)) {
         throw std::runtime_error(
             "texture image format does not support linear blitting!");
     }
@@ -19,6 +25,14 @@ void generateMipmaps(vkDevice device, VkImage image, VkFormat format,
     VkCommandBuffer commandBuffer =
         beginSingleTimeCommands(device, device.graphicsCmdPool);
 
+    recordMipmaps(commandBuffer, image, texWidth, texHeight, mipLevels);
+
+    endSingleTimeCommands(device, commandBuffer, device.graphicsCmdPool,
+                          device.gqueue);
+}
+
+void recordMipmaps(VkCommandBuffer commandBuffer, VkImage image,
+                   int32_t texWidth, int32_t texHeight, uint32_t mipLevels) {
     VkImageMemoryBarrier barrier{};
     barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
     barrier.image = image;
@@ -88,13 +102,18 @@ void generateMipmaps(vkDevice device, VkImage image, VkFormat format,
     vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT,
                          VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0, 0, nullptr,
                          0, nullptr, 1, &barrier);
-
-    endSingleTimeCommands(device, commandBuffer, device.graphicsCmdPool,
-                          device.gqueue);
 }
 
+float estimateMipLevel(uint32_t textureSize, float uvPerUnit,
+                       float pixelsPerUnit) {
+    // without uvs nothing can be said, ask for the base level
+    if (uvPerUnit <= 0.0f or pixelsPerUnit <= 0.0f) return 0.0f;
+    float texelsPerPixel = textureSize * uvPerUnit / pixelsPerUnit;
+    return std::log2(std::max(texelsPerPixel, 1e-6f));
+}
 
 void destroySrTexture(const vkDevice& device, const srTexture& texture) {
+    if (texture.textureImage.image == VK_NULL_HANDLE) return;
     vkFreeMemory(device.ldevice, texture.textureImage.memory, nullptr);
     if(texture.textureImage.view) {
         vkDestroyImageView(device.ldevice, texture.textureImage.view.value(), nullptr);
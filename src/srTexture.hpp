@@ -1,21 +1,78 @@
 
 
 #pragma once
+#include <cstdint>
+#include <string>
+
 #include "Resource.hpp"
 #include "macros.hpp"
+#include "srRetention.hpp"
 #include "vk_utils/vkDevice.hh"
 #include "vk_utils/vkImage.hh"
 
 namespace gbg {
 
+const uint32_t noStreamRequest = UINT32_MAX;
+
 struct srTexture : public Resource {
     RESOURCE_CONSTR(srTexture)
 
-    uint32_t mipLevels;
-    gbg::vkImage textureImage;
+    uint32_t mipLevels;  // in the image
+    gbg::vkImage textureImage{};
     VkSampler sampler;
+    // false until the upload finishes, a placeholder is bound meanwhile
+    bool resident = false;
+    // bumped every time a new image replaces the bound one
+    uint32_t generation = 0;
+
+    // streaming, the image holds levels baseMip.. of a fullMips chain
+    uint32_t baseMip = 0;
+    uint32_t fullMips = 0;
+    // base level requested and not landed yet
+    uint32_t pendingMip = noStreamRequest;
+    // finest level the objects on screen asked for in the last estimate
+    uint32_t wantedMip = noStreamRequest;
+    // frame an estimate last asked for a level
+    uint64_t lastWanted = 0;
+    // file the texels are read again from, empty for Texture::data
+    std::string sourcePath;
+    bool raw = false;
+    // frame a material using it was last drawn in
+    uint64_t lastUsed = 0;
+
+    srRetentionPolicy retention = RETAIN_DEFAULT;
+    // its KTX2 in the compression cache, empty when not compressed
+    std::string cachePath;
 };
 
+// Only the tail of every chain is loaded at first, finer levels follow the
+// texel density objects show on screen.
+struct srTextureStreaming {
+    bool enabled = true;
+    // largest level loaded before the texture has been seen
+    uint32_t tailSize = 64;
+    // added to the estimated level, > 0 trades sharpness for memory
+    float bias = 0.0f;
+    // new images being read or uploaded at once
+    uint32_t maxRequests = 8;
+    // frames without being seen before a texture goes back down to its
+    // tail, 0 keeps the levels it got
+    uint32_t idleFrames = 600;
+};
+
+// Level whose texels map about one to one to pixels. uvPerUnit is the uv
+// density of the mesh over its world scale and pixelsPerUnit the pixels a
+// world unit covers at the object's distance.
+float estimateMipLevel(uint32_t textureSize, float uvPerUnit,
+                       float pixelsPerUnit);
+
+// Expects every level in TRANSFER_DST_OPTIMAL with level 0 filled, leaves
+// them all in SHADER_READ_ONLY_OPTIMAL.
+void recordMipmaps(VkCommandBuffer commandBuffer, VkImage image,
+                   int32_t texWidth, int32_t texHeight, uint32_t mipLevels);
+
+bool supportsLinearBlit(const vkDevice& device, VkFormat format);
+
 void generateMipmaps(vkDevice device, VkImage image, VkFormat format,
                      int32_t texWidth, int32_t texHeight, uint32_t mipLevels);
 
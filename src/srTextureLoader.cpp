@@ -0,0 +1,416 @@
+#include "srTextureLoader.hpp"
+
+#include <vulkan/vulkan_core.h>
+
+#include <algorithm>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <span>
+#include <stop_token>
+
+#include "io_utils/bcEncoder.hpp"
+#include "io_utils/ktx2.hpp"
+#include "stb_image.h"
+#include "tracy/Tracy.hpp"
+
+namespace gbg {
+
+// copy offsets of compressed levels must be a multiple of the block size
+const VkDeviceSize levelAlignment = 16;
+
+using LevelSpans = std::vector<std::span<const std::byte>>;
+
+static uint64_t hashBytes(const void* data, size_t size,
+                          uint64_t hash = 14695981039346656037ull) {
+    // FNV-1a
+    const auto* bytes = static_cast<const unsigned char*>(data);
+    for (size_t i = 0; i < size; i++) {
+        hash ^= bytes[i];
+        hash *= 1099511628211ull;
+    }
+    return hash;
+}
+
+static std::string cachePath(const srTextureCompression& compression,
+                             uint64_t hash, bool raw) {
+    char name[64];
+    const char* kind = raw ? "normal" : compression.highQuality ? "color-hq"
+                                                                : "color";
+    snprintf(name, sizeof(name), "%016llx-%s.ktx2",
+             static_cast<unsigned long long>(hash), kind);
+    return (std::filesystem::path(compression.cacheDir) / name).string();
+}
+
+static void writeStaging(srTextureLoader& loader, srTextureUpload& upload,
+                         const LevelSpans& levels, bool wait) {
+    VkDeviceSize size = 0;
+    upload.levelOffsets.clear();
+    for (const auto& level : levels) {
+        size = (size + levelAlignment - 1) & ~(levelAlignment - 1);
+        upload.levelOffsets.push_back(size);
+        size += level.size();
+    }
+
+    std::byte* data = nullptr;
+    upload.staging = acquireStaging(loader.ring, size, wait);
+    if (upload.staging) {
+        data = upload.staging->data;
+    } else if (wait and stagingFits(loader.ring, size)) {
+        return;  // it fits but the ring was closed while waiting
+    } else {
+        // too big for the ring (or it is full and we can't wait)
+        vkBuffer buffer = createBuffer(loader.device, size,
+                                       VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+                                       VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
+                                           VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+        void* mapped;
+        vkMapMemory(loader.device.ldevice, buffer.memory, 0, size, 0, &mapped);
+        data = static_cast<std::byte*>(mapped);
+        upload.ownStaging = buffer;
+    }
+
+    for (size_t i = 0; i < levels.size(); i++) {
+        std::memcpy(data + upload.levelOffsets[i], levels[i].data(),
+                    levels[i].size());
+    }
+    if (upload.ownStaging)
+        vkUnmapMemory(loader.device.ldevice, upload.ownStaging->memory);
+}
+
+uint32_t fullMipLevels(uint32_t width, uint32_t height) {
+    uint32_t levels = 1;
+    while (std::max(width, height) >> levels) levels++;
+    return levels;
+}
+
+static uint32_t firstStagedLevel(const srTextureRequest& request,
+                                 uint32_t width, uint32_t height,
+                                 uint32_t levels) {
+    uint32_t tail = 0;
+    if (request.tailSize) {
+        while (tail + 1 < levels and
+               std::max(width >> tail, height >> tail) > request.tailSize)
+            tail++;
+    }
+    return std::min(std::max(request.baseMip, tail), levels - 1);
+}
+
+// levels from the first staged one to the end of the chain
+static void stageLevels(srTextureLoader& loader, srTextureUpload& upload,
+                        const srTextureRequest& request,
+                        const LevelSpans& levels) {
+    upload.baseMip = firstStagedLevel(request, upload.width, upload.height,
+                                      static_cast<uint32_t>(levels.size()));
+    upload.mipLevels =
+        static_cast<uint32_t>(levels.size()) - upload.baseMip;
+    upload.generateMips = false;
+    writeStaging(loader, upload,
+                 LevelSpans(levels.begin() + upload.baseMip, levels.end()),
+                 true);
+}
+
+static void stageCompressed(srTextureLoader& loader, srTextureUpload& upload,
+                            const srTextureRequest& request,
+                            const srTextureCompression& compression,
+                            const unsigned char* rgba,
+                            const std::string& path) {
+    ZoneScopedN("Compress Texture");
+    bool srgb = not request.raw;
+    BCFormat bc;
+    if (request.raw) {
+        bc = BCFormat::BC5;
+        upload.format = VK_FORMAT_BC5_UNORM_BLOCK;
+    } else if (compression.highQuality) {
+        bc = BCFormat::BC7;
+        upload.format = VK_FORMAT_BC7_SRGB_BLOCK;
+    } else if (hasTransparency(rgba, upload.width, upload.height)) {
+        bc = BCFormat::BC3;
+        upload.format = VK_FORMAT_BC3_SRGB_BLOCK;
+    } else {
+        bc = BCFormat::BC1;
+        upload.format = VK_FORMAT_BC1_RGB_SRGB_BLOCK;
+    }
+
+    auto mips = buildMipChain(rgba, upload.width, upload.height, srgb);
+    std::vector<std::vector<uint8_t>> levels;
+    uint32_t width = upload.width, height = upload.height;
+    for (const auto& mip : mips) {
+        std::vector<uint8_t> level(bcImageSize(bc, width, height));
+        encodeBC(bc, mip.data(), width, height, level.data());
+        levels.push_back(std::move(level));
+        width = std::max(width / 2, 1u);
+        height = std::max(height / 2, 1u);
+    }
+
+    std::error_code ec;
+    std::filesystem::create_directories(compression.cacheDir, ec);
+    if (writeKtx2(path, upload.format, upload.width, upload.height, levels)) {
+        upload.cachePath = path;
+    } else {
+        std::cerr << "failed to write texture cache " << path << std::endl;
+    }
+
+    LevelSpans spans;
+    for (const auto& level : levels) {
+        spans.push_back(std::as_bytes(std::span(level)));
+    }
+    stageLevels(loader, upload, request, spans);
+}
+
+static srTextureUpload processRequest(srTextureLoader& loader,
+                                      const srTextureRequest& request,
+                                      const srTextureCompression& compression) {
+    ZoneScoped;
+    srTextureUpload upload{};
+    upload.handle = request.handle;
+    upload.raw = request.raw;
+    upload.path = request.path;
+
+    // a cache file kept for re-upload, already compressed
+    if (std::filesystem::path(request.path).extension() == ".ktx2") {
+        auto image = mapKtx2(request.path);
+        if (not image) {
+            upload.error = "failed to read texture " + request.path;
+            return upload;
+        }
+        upload.width = image->width;
+        upload.height = image->height;
+        upload.format = image->format;
+        upload.cachePath = request.path;
+        stageLevels(loader, upload, request, image->levels);
+        unmapKtx2(*image);
+        return upload;
+    }
+
+    std::vector<char> file;
+    uint64_t hash;
+    if (not request.path.empty()) {
+        std::ifstream in(request.path, std::ios::binary | std::ios::ate);
+        if (not in) {
+            upload.error = "failed to open texture " + request.path;
+            return upload;
+        }
+        file.resize(static_cast<size_t>(in.tellg()));
+        in.seekg(0);
+        in.read(file.data(), static_cast<std::streamsize>(file.size()));
+        hash = hashBytes(file.data(), file.size());
+    } else {
+        hash = hashBytes(&request.width, sizeof(request.width));
+        hash = hashBytes(&request.height, sizeof(request.height), hash);
+        hash = hashBytes(request.pixels.data(), request.pixels.size(), hash);
+    }
+
+    bool compress =
+        compression.enabled and loader.device.textureCompressionBC;
+    std::string path;
+    if (compress) {
+        path = cachePath(compression, hash, request.raw);
+        if (auto cached = mapKtx2(path)) {
+            upload.width = cached->width;
+            upload.height = cached->height;
+            upload.format = cached->format;
+            upload.cachePath = path;
+            stageLevels(loader, upload, request, cached->levels);
+            unmapKtx2(*cached);
+            return upload;
+        }
+    }
+
+    const unsigned char* rgba;
+    if (not request.path.empty()) {
+        int width, height, channels;
+        unsigned char* pixels = stbi_load_from_memory(
+            reinterpret_cast<const stbi_uc*>(file.data()),
+            static_cast<int>(file.size()), &width, &height, &channels,
+            STBI_rgb_alpha);
+        if (pixels == nullptr) {
+            upload.error = "failed to load texture " + request.path + ": " +
+                           stbi_failure_reason();
+            return upload;
+        }
+        file = {};
+
+        upload.width = static_cast<uint32_t>(width);
+        upload.height = static_cast<uint32_t>(height);
+        upload.pixels = {pixels, stbi_image_free};
+        rgba = pixels;
+    } else {
+        upload.width = request.width;
+        upload.height = request.height;
+        rgba = request.pixels.data();
+    }
+
+    if (compress) {
+        stageCompressed(loader, upload, request, compression, rgba, path);
+        return upload;
+    }
+
+    upload.format =
+        request.raw ? VK_FORMAT_R8G8B8A8_UNORM : VK_FORMAT_R8G8B8A8_SRGB;
+    upload.baseMip =
+        firstStagedLevel(request, upload.width, upload.height,
+                         fullMipLevels(upload.width, upload.height));
+    upload.mipLevels = 1;
+    upload.generateMips = true;
+
+    // only the first staged level, the gpu builds the ones below
+    std::vector<std::vector<uint8_t>> mips;
+    if (upload.baseMip > 0) {
+        ZoneScopedN("Downscale Texture");
+        mips = buildMipChain(rgba, upload.width, upload.height,
+                             not request.raw);
+        rgba = mips[upload.baseMip].data();
+    }
+    size_t size =
+        static_cast<size_t>(std::max(upload.width >> upload.baseMip, 1u)) *
+        std::max(upload.height >> upload.baseMip, 1u) * 4;
+    writeStaging(loader, upload,
+                 {std::as_bytes(std::span(rgba, size))}, true);
+    return upload;
+}
+
+static void textureWorker(std::stop_token stop, srTextureLoader& loader) {
+    while (true) {
+        srTextureRequest request;
+        srTextureCompression compression;
+        {
+            std::unique_lock lock(loader.mutex);
+            if (not loader.wake.wait(lock, stop, [&] {
+                    return not loader.requests.empty();
+                })) {
+                return;
+            }
+            request = std::move(loader.requests.front());
+            loader.requests.pop_front();
+            compression = loader.compression;
+            loader.decoding++;
+        }
+
+        srTextureUpload upload = processRequest(loader, request, compression);
+
+        std::lock_guard lock(loader.mutex);
+        loader.decoding--;
+        if (upload.error.empty() and not upload.staging and
+            not upload.ownStaging) {
+            return;  // stopped while waiting for staging space
+        }
+        loader.decoded.push_back(std::move(upload));
+    }
+}
+
+void startTextureLoader(const vkDevice& device, srTextureLoader& loader,
+                        uint32_t workerCount, VkDeviceSize stagingSize) {
+    loader.device = device;
+    createStagingRing(device, loader.ring, stagingSize);
+    for (uint32_t i = 0; i < workerCount; i++) {
+        loader.workers.emplace_back(
+            [&loader](std::stop_token stop) { textureWorker(stop, loader); });
+    }
+}
+
+void setTextureCompression(srTextureLoader& loader,
+                           const srTextureCompression& compression) {
+    std::lock_guard lock(loader.mutex);
+    loader.compression = compression;
+}
+
+bool compressesTextures(srTextureLoader& loader) {
+    std::lock_guard lock(loader.mutex);
+    return loader.compression.enabled and loader.device.textureCompressionBC;
+}
+
+void requestTexture(srTextureLoader& loader, TextureHandle handle,
+                    std::string path, bool raw, uint32_t baseMip,
+                    uint32_t tailSize) {
+    srTextureRequest request{};
+    request.handle = handle;
+    request.raw = raw;
+    request.path = std::move(path);
+    request.baseMip = baseMip;
+    request.tailSize = tailSize;
+    {
+        std::lock_guard lock(loader.mutex);
+        loader.requests.push_back(std::move(request));
+    }
+    loader.wake.notify_one();
+}
+
+void requestTexturePixels(srTextureLoader& loader, TextureHandle handle,
+                          std::vector<unsigned char> pixels, uint32_t width,
+                          uint32_t height, bool raw, uint32_t baseMip,
+                          uint32_t tailSize) {
+    srTextureRequest request{};
+    request.handle = handle;
+    request.raw = raw;
+    request.pixels = std::move(pixels);
+    request.width = width;
+    request.height = height;
+    request.baseMip = baseMip;
+    request.tailSize = tailSize;
+    {
+        std::lock_guard lock(loader.mutex);
+        loader.requests.push_back(std::move(request));
+    }
+    loader.wake.notify_one();
+}
+
+srTextureUpload stageTexture(srTextureLoader& loader, TextureHandle handle,
+                             uint32_t width, uint32_t height,
+                             const void* pixels, size_t size, bool raw) {
+    srTextureUpload upload{};
+    upload.handle = handle;
+    upload.width = width;
+    upload.height = height;
+    upload.format = raw ? VK_FORMAT_R8G8B8A8_UNORM : VK_FORMAT_R8G8B8A8_SRGB;
+    upload.mipLevels = 1;
+    upload.generateMips = true;
+    // the main thread frees the ring, it can't wait for it
+    writeStaging(loader, upload,
+                 {std::span(static_cast<const std::byte*>(pixels), size)},
+                 false);
+    return upload;
+}
+
+std::vector<srTextureUpload> takeDecodedTextures(srTextureLoader& loader) {
+    std::vector<srTextureUpload> decoded;
+    std::lock_guard lock(loader.mutex);
+    decoded.swap(loader.decoded);
+    return decoded;
+}
+
+void finishTextureUpload(srTextureLoader& loader, srTextureUpload& upload) {
+    if (upload.staging) {
+        releaseStaging(loader.ring, upload.staging.value());
+        upload.staging.reset();
+    }
+    if (upload.ownStaging) {
+        destroyBuffer(loader.device, upload.ownStaging.value());
+        upload.ownStaging.reset();
+    }
+    upload.pixels.reset();
+}
+
+uint32_t getQueuedTextures(srTextureLoader& loader) {
+    std::lock_guard lock(loader.mutex);
+    return static_cast<uint32_t>(loader.requests.size() + loader.decoding +
+                                 loader.decoded.size());
+}
+
+void stopTextureLoader(srTextureLoader& loader) {
+    for (std::jthread& worker : loader.workers) {
+        worker.request_stop();
+    }
+    closeStagingRing(loader.ring);
+    loader.workers.clear();  // joins
+
+    for (srTextureUpload& upload : loader.decoded) {
+        finishTextureUpload(loader, upload);
+    }
+    loader.decoded.clear();
+    loader.requests.clear();
+    destroyStagingRing(loader.device, loader.ring);
+}
+
+}  // namespace gbg
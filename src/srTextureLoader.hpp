@@ -0,0 +1,131 @@
+#pragma once
+#include <vulkan/vulkan_core.h>
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "Texture.hpp"
+#include "vk_utils/vkBuffer.hh"
+#include "vk_utils/vkDevice.hh"
+#include "vk_utils/vkStagingRing.hh"
+
+namespace gbg {
+
+// Block compression done by the workers the first time a texture is seen.
+// The result is cached as KTX2 in cacheDir, named after the source hash.
+struct srTextureCompression {
+    bool enabled = true;
+    // BC7 for color textures instead of BC1 (opaque) or BC3 (alpha)
+    bool highQuality = false;
+    std::string cacheDir = "texture_cache";
+};
+
+// Texels waiting in staging memory to be copied to their image.
+struct srTextureUpload {
+    TextureHandle handle;
+    // size of level 0, the image starts at baseMip
+    uint32_t width;
+    uint32_t height;
+    uint32_t baseMip = 0;
+    VkFormat format;
+    uint32_t mipLevels;  // levels in staging, from baseMip
+    // only the base level is staged, blit the rest on the gpu
+    bool generateMips;
+    bool raw = false;
+    // file it was read from, empty for pixels
+    std::string path;
+    // KTX2 holding the compressed chain, empty when not compressed
+    std::string cachePath;
+    // from the start of the staging memory, one per level
+    std::vector<VkDeviceSize> levelOffsets;
+
+    // decoded pixels, moved to the Texture resource on the main thread.
+    // Empty when the texture was already decoded or came from the cache.
+    std::unique_ptr<unsigned char, void (*)(void*)> pixels{nullptr, nullptr};
+
+    std::optional<vkStagingSpan> staging;
+    // used when the texture doesn't fit in the ring
+    std::optional<vkBuffer> ownStaging;
+
+    std::string error;
+};
+
+// Either a file to decode or pixels that only need compressing.
+struct srTextureRequest {
+    TextureHandle handle;
+    bool raw;
+    std::string path;
+    std::vector<unsigned char> pixels;
+    uint32_t width;
+    uint32_t height;
+    // first level to stage, or the first one no bigger than tailSize when
+    // that is smaller (0 to ignore it)
+    uint32_t baseMip = 0;
+    uint32_t tailSize = 0;
+};
+
+// Decodes image files on a pool of workers and writes the texels straight
+// into the shared staging ring. Nothing here touches the Scene.
+struct srTextureLoader {
+    vkDevice device;
+    vkStagingRing ring;
+    std::vector<std::jthread> workers;
+
+    std::mutex mutex;
+    std::condition_variable_any wake;
+    std::deque<srTextureRequest> requests;
+    std::vector<srTextureUpload> decoded;
+    uint32_t decoding = 0;
+    srTextureCompression compression;
+};
+
+struct srTextureLoaderStats {
+    uint32_t queued = 0;     // waiting for or being decoded
+    uint32_t uploading = 0;  // recorded in a batch the gpu hasn't finished
+    VkDeviceSize stagingUsed = 0;
+    VkDeviceSize stagingSize = 0;
+};
+
+void startTextureLoader(const vkDevice& device, srTextureLoader& loader,
+                        uint32_t workerCount, VkDeviceSize stagingSize);
+
+void setTextureCompression(srTextureLoader& loader,
+                           const srTextureCompression& compression);
+
+// True when textures go through the workers to be block compressed.
+bool compressesTextures(srTextureLoader& loader);
+
+void requestTexture(srTextureLoader& loader, TextureHandle handle,
+                    std::string path, bool raw, uint32_t baseMip = 0,
+                    uint32_t tailSize = 0);
+
+void requestTexturePixels(srTextureLoader& loader, TextureHandle handle,
+                          std::vector<unsigned char> pixels, uint32_t width,
+                          uint32_t height, bool raw, uint32_t baseMip = 0,
+                          uint32_t tailSize = 0);
+
+// Levels of a full chain for a width x height base.
+uint32_t fullMipLevels(uint32_t width, uint32_t height);
+
+// Copies already decoded pixels into staging memory from the calling thread.
+srTextureUpload stageTexture(srTextureLoader& loader, TextureHandle handle,
+                             uint32_t width, uint32_t height,
+                             const void* pixels, size_t size, bool raw);
+
+std::vector<srTextureUpload> takeDecodedTextures(srTextureLoader& loader);
+
+// Gives back the staging memory once the copy has completed.
+void finishTextureUpload(srTextureLoader& loader, srTextureUpload& upload);
+
+uint32_t getQueuedTextures(srTextureLoader& loader);
+
+void stopTextureLoader(srTextureLoader& loader);
+
+}  // namespace gbg
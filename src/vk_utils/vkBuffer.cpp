@@ -63,4 +63,91 @@ void destroyBuffer(vkDevice device, vkBuffer buffer) {
     vkDestroyBuffer(device.ldevice, buffer.buffer, nullptr);
     vkFreeMemory(device.ldevice, buffer.memory, nullptr);
 }
+
+vkBufferUpload beginBufferUpload(vkDevice device, VkDeviceSize size,
+                                 VkBufferUsageFlags usage) {
+    vkBufferUpload upload{};
+    upload.staged = not device.hostVisibleDeviceLocal;
+
+    VkDeviceMemory mapped;
+    if (upload.staged) {
+        upload.buffer = createBuffer(device, size,
+                                     usage | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+                                     VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+        upload.staging = createBuffer(device, size,
+                                      VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+                                      VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
+                                          VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+        mapped = upload.staging.memory;
+    } else {
+        upload.buffer = createBuffer(device, size, usage,
+                                     VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT |
+                                         VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
+                                         VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+        mapped = upload.buffer.memory;
+    }
+
+    void* data;
+    if (vkMapMemory(device.ldevice, mapped, 0, size, 0, &data) != VK_SUCCESS) {
+        throw std::runtime_error("failed to map upload buffer!");
+    }
+    upload.data = {static_cast<std::byte*>(data), static_cast<size_t>(size)};
+    return upload;
+}
+
+vkBufferUpload beginBufferUpload(vkDevice device, VkDeviceSize size,
+                                 VkBufferUsageFlags usage, VkBuffer staging,
+                                 VkDeviceSize stagingOffset,
+                                 std::byte* stagingData) {
+    // nothing to stage, it is written in place
+    if (device.hostVisibleDeviceLocal)
+        return beginBufferUpload(device, size, usage);
+
+    vkBufferUpload upload{};
+    upload.staged = true;
+    upload.sharedStaging = true;
+    upload.buffer = createBuffer(device, size,
+                                 usage | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+                                 VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+    upload.staging.buffer = staging;
+    upload.staging.size = size;
+    upload.stagingOffset = stagingOffset;
+    upload.data = {stagingData, static_cast<size_t>(size)};
+    return upload;
+}
+
+void finishBufferUploads(vkDevice device, std::span<vkBufferUpload> uploads) {
+    bool anyStaged = false;
+    for (vkBufferUpload& upload : uploads) {
+        if (not upload.sharedStaging) {
+            vkUnmapMemory(device.ldevice, upload.staged
+                                              ? upload.staging.memory
+                                              : upload.buffer.memory);
+        }
+        upload.data = {};
+        anyStaged = anyStaged or upload.staged;
+    }
+    if (not anyStaged) return;
+
+    VkCommandBuffer cpyCmdBuffer =
+        beginSingleTimeCommands(device, device.transferCmdPool);
+    for (const vkBufferUpload& upload : uploads) {
+        if (not upload.staged) continue;
+        VkBufferCopy cpyRegion{};
+        cpyRegion.srcOffset = upload.stagingOffset;
+        cpyRegion.size = upload.buffer.size;
+        vkCmdCopyBuffer(cpyCmdBuffer, upload.staging.buffer,
+                        upload.buffer.buffer, 1, &cpyRegion);
+    }
+    endSingleTimeCommands(device, cpyCmdBuffer, device.transferCmdPool,
+                          device.tqueue);
+
+    for (vkBufferUpload& upload : uploads) {
+        if (not upload.staged) continue;
+        if (not upload.sharedStaging) destroyBuffer(device, upload.staging);
+        upload.staging = {};
+        upload.staged = false;
+        upload.sharedStaging = false;
+    }
+}
 }  // namespace gbg
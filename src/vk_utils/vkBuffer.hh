@@ -1,7 +1,9 @@
 #pragma once
 #include <vulkan/vulkan_core.h>
 
+#include <cstddef>
 #include <optional>
+#include <span>
 
 #include "vkCommandBuffer.hh"
 #include "vkDevice.hh"
@@ -22,4 +24,33 @@ vkBuffer createBuffer(vkDevice device, VkDeviceSize size,
 void copyBuffer(vkDevice device, vkBuffer srcBuffer, vkBuffer dstBuffer);
 
 void destroyBuffer(vkDevice device, vkBuffer buffer);
+
+// A device local buffer the host is filling. data maps the buffer itself
+// when the device has host visible vram, nothing is copied on the gpu then,
+// otherwise a staging buffer.
+struct vkBufferUpload {
+    vkBuffer buffer{};
+    vkBuffer staging{};
+    bool staged = false;
+    // staging belongs to the caller, data is a piece of it at stagingOffset
+    bool sharedStaging = false;
+    VkDeviceSize stagingOffset = 0;
+    std::span<std::byte> data;
+};
+
+// The producer writes its size bytes to data before finishing it.
+vkBufferUpload beginBufferUpload(vkDevice device, VkDeviceSize size,
+                                 VkBufferUsageFlags usage);
+
+// Stages through size bytes of the caller's mapped buffer, at stagingOffset
+// and mapped at stagingData, instead of a buffer of its own. The caller
+// keeps them until finishBufferUploads returns.
+vkBufferUpload beginBufferUpload(vkDevice device, VkDeviceSize size,
+                                 VkBufferUsageFlags usage, VkBuffer staging,
+                                 VkDeviceSize stagingOffset,
+                                 std::byte* stagingData);
+
+// Records the staged ones in a single submit, then unmaps and releases the
+// staging memory. The buffers are ready to use when it returns.
+void finishBufferUploads(vkDevice device, std::span<vkBufferUpload> uploads);
 }  // namespace gbg
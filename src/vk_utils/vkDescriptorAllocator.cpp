@@ -0,0 +1,194 @@
+#include "vkDescriptorAllocator.hh"
+
+#include <vulkan/vulkan_core.h>
+
+#include <algorithm>
+#include <stdexcept>
+
+namespace gbg {
+
+const uint32_t maxSetsPerPool = 4096;
+
+static vkDescriptorPoolSlot createPoolSlot(const vkDevice& device,
+                                           const vkDescriptorAllocator& alloc,
+                                           uint32_t maxSets) {
+    std::vector<VkDescriptorPoolSize> sizes;
+    for (const vkPoolSizeRatio& ratio : alloc.ratios) {
+        VkDescriptorPoolSize size{};
+        size.type = ratio.type;
+        size.descriptorCount =
+            std::max(1u, static_cast<uint32_t>(ratio.ratio * maxSets));
+        sizes.push_back(size);
+    }
+
+    VkDescriptorPoolCreateInfo poolInfo{};
+    poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+    poolInfo.poolSizeCount = static_cast<uint32_t>(sizes.size());
+    poolInfo.pPoolSizes = sizes.data();
+    poolInfo.maxSets = maxSets;
+    // sets are never freed one by one, they are recycled or the whole pool
+    // is reset
+    poolInfo.flags = 0;
+
+    vkDescriptorPoolSlot slot{};
+    slot.maxSets = maxSets;
+    slot.fresh = true;
+    if (vkCreateDescriptorPool(device.ldevice, &poolInfo, nullptr,
+                               &slot.pool) != VK_SUCCESS) {
+        throw std::runtime_error("failed to create descriptor pool!");
+    }
+    return slot;
+}
+
+vkDescriptorAllocator createDescriptorAllocator(
+    const vkDevice& device, uint32_t setsPerPool,
+    const std::vector<vkPoolSizeRatio>& ratios, bool transient) {
+    vkDescriptorAllocator alloc{};
+    alloc.ratios = ratios;
+    alloc.setsPerPool = setsPerPool;
+    alloc.transient = transient;
+    alloc.pools.push_back(createPoolSlot(device, alloc, setsPerPool));
+    return alloc;
+}
+
+static size_t getReadyPool(const vkDevice& device,
+                           vkDescriptorAllocator& alloc) {
+    for (size_t i = 0; i < alloc.pools.size(); i++) {
+        if (not alloc.pools[i].full) return i;
+    }
+
+    // every pool is exhausted, chain a bigger one
+    uint32_t maxSets =
+        std::min(alloc.pools.back().maxSets * 2, maxSetsPerPool);
+    alloc.pools.push_back(createPoolSlot(device, alloc, maxSets));
+    return alloc.pools.size() - 1;
+}
+
+VkDescriptorSet allocateDescriptorSet(const vkDevice& device,
+                                      vkDescriptorAllocator& alloc,
+                                      VkDescriptorSetLayout layout) {
+    auto freeList = alloc.freeSets.find(layout);
+    if (freeList != alloc.freeSets.end() and not freeList->second.empty()) {
+        VkDescriptorSet set = freeList->second.back();
+        freeList->second.pop_back();
+        alloc.reuses++;
+        return set;
+    }
+
+    VkDescriptorSetAllocateInfo setInfo{};
+    setInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+    setInfo.descriptorSetCount = 1;
+    setInfo.pSetLayouts = &layout;
+
+    VkDescriptorSet set;
+    while (true) {
+        size_t index = getReadyPool(device, alloc);
+        vkDescriptorPoolSlot& slot = alloc.pools[index];
+        setInfo.descriptorPool = slot.pool;
+
+        VkResult res = vkAllocateDescriptorSets(device.ldevice, &setInfo, &set);
+        if (res == VK_SUCCESS) {
+            slot.fresh = false;
+            slot.liveSets++;
+            if (slot.liveSets == slot.maxSets) slot.full = true;
+            if (not alloc.transient) alloc.owners[set] = index;
+            alloc.allocations++;
+            return set;
+        }
+
+        if (res != VK_ERROR_OUT_OF_POOL_MEMORY and
+            res != VK_ERROR_FRAGMENTED_POOL) {
+            throw std::runtime_error("failed to allocate descriptor set!");
+        }
+
+        if (slot.fresh) {
+            // a fresh pool can't hold the set, the ratios are wrong
+            throw std::runtime_error(
+                "descriptor set does not fit in an empty pool!");
+        }
+        if (slot.liveSets == 0) {
+            // emptied but still holding the memory of its dropped sets
+            vkResetDescriptorPool(device.ldevice, slot.pool, 0);
+            slot.fresh = true;
+            slot.full = false;
+            continue;
+        }
+        slot.full = true;
+    }
+}
+
+void releaseDescriptorSet(vkDescriptorAllocator& alloc,
+                          VkDescriptorSetLayout layout, VkDescriptorSet set) {
+    alloc.freeSets[layout].push_back(set);
+}
+
+void dropDescriptorSet(const vkDevice& device, vkDescriptorAllocator& alloc,
+                       VkDescriptorSet set) {
+    auto owner = alloc.owners.find(set);
+    if (owner == alloc.owners.end()) return;
+
+    vkDescriptorPoolSlot& slot = alloc.pools[owner->second];
+    alloc.owners.erase(owner);
+    slot.liveSets--;
+
+    // sets aren't freed one by one, only a reset gives their memory back
+    if (slot.liveSets == 0) {
+        vkResetDescriptorPool(device.ldevice, slot.pool, 0);
+        slot.full = false;
+        slot.fresh = true;
+    }
+}
+
+void forgetDescriptorLayout(const vkDevice& device,
+                            vkDescriptorAllocator& alloc,
+                            VkDescriptorSetLayout layout) {
+    auto freeList = alloc.freeSets.find(layout);
+    if (freeList == alloc.freeSets.end()) return;
+
+    std::vector<VkDescriptorSet> sets = std::move(freeList->second);
+    alloc.freeSets.erase(freeList);
+    for (VkDescriptorSet set : sets) {
+        dropDescriptorSet(device, alloc, set);
+    }
+}
+
+void resetDescriptorAllocator(const vkDevice& device,
+                              vkDescriptorAllocator& alloc) {
+    for (vkDescriptorPoolSlot& slot : alloc.pools) {
+        if (slot.fresh) continue;
+        vkResetDescriptorPool(device.ldevice, slot.pool, 0);
+        slot.liveSets = 0;
+        slot.full = false;
+        slot.fresh = true;
+    }
+    alloc.freeSets.clear();
+    alloc.owners.clear();
+}
+
+void destroyDescriptorAllocator(const vkDevice& device,
+                                vkDescriptorAllocator& alloc) {
+    for (const vkDescriptorPoolSlot& slot : alloc.pools) {
+        vkDestroyDescriptorPool(device.ldevice, slot.pool, nullptr);
+    }
+    alloc.pools.clear();
+    alloc.freeSets.clear();
+    alloc.owners.clear();
+}
+
+vkDescriptorAllocatorStats getDescriptorAllocatorStats(
+    const vkDescriptorAllocator& alloc) {
+    vkDescriptorAllocatorStats stats{};
+    stats.pools = static_cast<uint32_t>(alloc.pools.size());
+    for (const vkDescriptorPoolSlot& slot : alloc.pools) {
+        stats.capacity += slot.maxSets;
+        stats.liveSets += slot.liveSets;
+    }
+    for (const auto& [layout, sets] : alloc.freeSets) {
+        stats.freeListSets += static_cast<uint32_t>(sets.size());
+    }
+    stats.allocations = alloc.allocations;
+    stats.reuses = alloc.reuses;
+    return stats;
+}
+
+}  // namespace gbg
@@ -0,0 +1,85 @@
+#pragma once
+#include <vulkan/vulkan_core.h>
+
+#include <cstdint>
+#include <map>
+#include <vector>
+
+#include "vkDevice.hh"
+
+namespace gbg {
+
+// Descriptors of a type a pool reserves for every set it can hold.
+struct vkPoolSizeRatio {
+    VkDescriptorType type;
+    float ratio;
+};
+
+struct vkDescriptorPoolSlot {
+    VkDescriptorPool pool;
+    uint32_t maxSets;
+    uint32_t liveSets;
+    bool full;
+    // nothing was allocated from it since it was created or reset
+    bool fresh;
+};
+
+struct vkDescriptorAllocatorStats {
+    uint32_t pools = 0;
+    uint32_t capacity = 0;      // sets all the pools can hold
+    uint32_t liveSets = 0;      // sets handed out (free lists included)
+    uint32_t freeListSets = 0;  // released sets waiting to be reused
+    uint64_t allocations = 0;   // sets allocated from a pool
+    uint64_t reuses = 0;        // sets served from a free list
+
+    float utilization() const {
+        return capacity ? static_cast<float>(liveSets) / capacity : 0.0f;
+    }
+};
+
+// Chains pools as they run out. Long lived sets can be released to a per
+// layout free list and are handed out again before touching the pools.
+// Transient sets are recycled all at once with resetDescriptorAllocator.
+struct vkDescriptorAllocator {
+    std::vector<vkPoolSizeRatio> ratios;
+    uint32_t setsPerPool;
+    std::vector<vkDescriptorPoolSlot> pools;
+    std::map<VkDescriptorSetLayout, std::vector<VkDescriptorSet>> freeSets;
+    std::map<VkDescriptorSet, size_t> owners;
+    bool transient;
+    uint64_t allocations;
+    uint64_t reuses;
+};
+
+vkDescriptorAllocator createDescriptorAllocator(
+    const vkDevice& device, uint32_t setsPerPool,
+    const std::vector<vkPoolSizeRatio>& ratios, bool transient = false);
+
+VkDescriptorSet allocateDescriptorSet(const vkDevice& device,
+                                      vkDescriptorAllocator& allocator,
+                                      VkDescriptorSetLayout layout);
+
+// The set goes to the free list of its layout, the layout must stay alive.
+void releaseDescriptorSet(vkDescriptorAllocator& allocator,
+                          VkDescriptorSetLayout layout, VkDescriptorSet set);
+
+// For sets whose layout was destroyed, they can't be reused. A pool is reset
+// once all its sets are dropped.
+void dropDescriptorSet(const vkDevice& device, vkDescriptorAllocator& allocator,
+                       VkDescriptorSet set);
+
+// Call before destroying a layout, drops the sets of its free list.
+void forgetDescriptorLayout(const vkDevice& device,
+                            vkDescriptorAllocator& allocator,
+                            VkDescriptorSetLayout layout);
+
+void resetDescriptorAllocator(const vkDevice& device,
+                              vkDescriptorAllocator& allocator);
+
+void destroyDescriptorAllocator(const vkDevice& device,
+                                vkDescriptorAllocator& allocator);
+
+vkDescriptorAllocatorStats getDescriptorAllocatorStats(
+    const vkDescriptorAllocator& allocator);
+
+}  // namespace gbg
@@ -0,0 +1,128 @@
+#include "vkDescriptorTemplate.hh"
+
+#include <vulkan/vulkan_core.h>
+
+#include <cstring>
+#include <stdexcept>
+
+namespace gbg {
+
+static size_t descriptorInfoSize(VkDescriptorType type) {
+    switch (type) {
+        case VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER:
+        case VK_DESCRIPTOR_TYPE_STORAGE_BUFFER:
+        case VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC:
+        case VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC:
+            return sizeof(VkDescriptorBufferInfo);
+        case VK_DESCRIPTOR_TYPE_UNIFORM_TEXEL_BUFFER:
+        case VK_DESCRIPTOR_TYPE_STORAGE_TEXEL_BUFFER:
+            return sizeof(VkBufferView);
+        default:
+            return sizeof(VkDescriptorImageInfo);
+    }
+}
+
+static vkDescriptorTemplate createTemplate(
+    const vkDevice& device,
+    const std::vector<VkDescriptorSetLayoutBinding>& bindings,
+    VkDescriptorUpdateTemplateCreateInfo& createInfo) {
+    vkDescriptorTemplate tmpl{};
+
+    std::vector<VkDescriptorUpdateTemplateEntry> entries;
+    for (const VkDescriptorSetLayoutBinding& binding : bindings) {
+        size_t stride = descriptorInfoSize(binding.descriptorType);
+
+        VkDescriptorUpdateTemplateEntry entry{};
+        entry.dstBinding = binding.binding;
+        entry.dstArrayElement = 0;
+        entry.descriptorCount = binding.descriptorCount;
+        entry.descriptorType = binding.descriptorType;
+        entry.offset = tmpl.dataSize;
+        entry.stride = stride;
+        entries.push_back(entry);
+
+        tmpl.offsets[binding.binding] = tmpl.dataSize;
+        tmpl.strides[binding.binding] = stride;
+        tmpl.dataSize += stride * binding.descriptorCount;
+    }
+
+    createInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_UPDATE_TEMPLATE_CREATE_INFO;
+    createInfo.descriptorUpdateEntryCount =
+        static_cast<uint32_t>(entries.size());
+    createInfo.pDescriptorUpdateEntries = entries.data();
+
+    if (vkCreateDescriptorUpdateTemplate(device.ldevice, &createInfo, nullptr,
+                                         &tmpl.handle) != VK_SUCCESS) {
+        throw std::runtime_error("failed to create descriptor update template!");
+    }
+    return tmpl;
+}
+
+vkDescriptorTemplate createDescriptorTemplate(
+    const vkDevice& device,
+    const std::vector<VkDescriptorSetLayoutBinding>& bindings,
+    VkDescriptorSetLayout layout) {
+    VkDescriptorUpdateTemplateCreateInfo createInfo{};
+    createInfo.templateType = VK_DESCRIPTOR_UPDATE_TEMPLATE_TYPE_DESCRIPTOR_SET;
+    createInfo.descriptorSetLayout = layout;
+    return createTemplate(device, bindings, createInfo);
+}
+
+vkDescriptorTemplate createPushDescriptorTemplate(
+    const vkDevice& device,
+    const std::vector<VkDescriptorSetLayoutBinding>& bindings,
+    VkDescriptorSetLayout layout, VkPipelineBindPoint bindPoint,
+    VkPipelineLayout pipelineLayout, uint32_t set) {
+    if (not device.pushDescriptor) {
+        throw std::runtime_error("push descriptors are not supported!");
+    }
+
+    VkDescriptorUpdateTemplateCreateInfo createInfo{};
+    createInfo.templateType =
+        VK_DESCRIPTOR_UPDATE_TEMPLATE_TYPE_PUSH_DESCRIPTORS_KHR;
+    createInfo.descriptorSetLayout = layout;
+    createInfo.pipelineBindPoint = bindPoint;
+    createInfo.pipelineLayout = pipelineLayout;
+    createInfo.set = set;
+    return createTemplate(device, bindings, createInfo);
+}
+
+void destroyDescriptorTemplate(const vkDevice& device,
+                               vkDescriptorTemplate& tmpl) {
+    if (tmpl.handle != VK_NULL_HANDLE)
+        vkDestroyDescriptorUpdateTemplate(device.ldevice, tmpl.handle, nullptr);
+    tmpl = vkDescriptorTemplate{};
+}
+
+void setTemplateBuffer(const vkDescriptorTemplate& tmpl, std::byte* data,
+                       uint32_t binding, uint32_t element,
+                       const VkDescriptorBufferInfo& info) {
+    size_t offset = tmpl.offsets.at(binding) + tmpl.strides.at(binding) * element;
+    std::memcpy(data + offset, &info, sizeof(info));
+}
+
+void setTemplateImage(const vkDescriptorTemplate& tmpl, std::byte* data,
+                      uint32_t binding, uint32_t element,
+                      const VkDescriptorImageInfo& info) {
+    size_t offset = tmpl.offsets.at(binding) + tmpl.strides.at(binding) * element;
+    std::memcpy(data + offset, &info, sizeof(info));
+}
+
+void updateDescriptorSet(const vkDevice& device,
+                         const vkDescriptorTemplate& tmpl, VkDescriptorSet set,
+                         const std::byte* data) {
+    vkUpdateDescriptorSetWithTemplate(device.ldevice, set, tmpl.handle, data);
+}
+
+void pushDescriptorSet(const vkDevice& device, const vkDescriptorTemplate& tmpl,
+                       VkCommandBuffer commandBuffer,
+                       VkPipelineLayout pipelineLayout, uint32_t set,
+                       const std::byte* data) {
+    if (device.cmdPushDescriptorSetWithTemplate == nullptr) {
+        throw std::runtime_error("push descriptors are not supported!");
+    }
+    device.cmdPushDescriptorSetWithTemplate(commandBuffer, tmpl.handle,
+                                            pipelineLayout, set, data);
+}
+
+}  // namespace gbg
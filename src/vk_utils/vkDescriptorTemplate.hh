@@ -0,0 +1,63 @@
+#pragma once
+#include <vulkan/vulkan_core.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <vector>
+
+#include "vkDevice.hh"
+
+namespace gbg {
+
+// An update template and the layout of the packed data it reads. Every
+// binding gets its descriptors one after the other, so a set is written
+// from a single blob without building VkWriteDescriptorSet arrays.
+struct vkDescriptorTemplate {
+    VkDescriptorUpdateTemplate handle = VK_NULL_HANDLE;
+    // binding -> offset of its first descriptor in the blob
+    std::map<uint32_t, size_t> offsets;
+    std::map<uint32_t, size_t> strides;
+    size_t dataSize = 0;
+};
+
+vkDescriptorTemplate createDescriptorTemplate(
+    const vkDevice& device,
+    const std::vector<VkDescriptorSetLayoutBinding>& bindings,
+    VkDescriptorSetLayout layout);
+
+// Template for a layout created with the push descriptor flag, it needs the
+// pipeline layout and the set number it is pushed to.
+vkDescriptorTemplate createPushDescriptorTemplate(
+    const vkDevice& device,
+    const std::vector<VkDescriptorSetLayoutBinding>& bindings,
+    VkDescriptorSetLayout layout, VkPipelineBindPoint bindPoint,
+    VkPipelineLayout pipelineLayout, uint32_t set);
+
+void destroyDescriptorTemplate(const vkDevice& device,
+                               vkDescriptorTemplate& tmpl);
+
+inline bool hasTemplateBinding(const vkDescriptorTemplate& tmpl,
+                               uint32_t binding) {
+    return tmpl.offsets.contains(binding);
+}
+
+void setTemplateBuffer(const vkDescriptorTemplate& tmpl, std::byte* data,
+                       uint32_t binding, uint32_t element,
+                       const VkDescriptorBufferInfo& info);
+
+void setTemplateImage(const vkDescriptorTemplate& tmpl, std::byte* data,
+                      uint32_t binding, uint32_t element,
+                      const VkDescriptorImageInfo& info);
+
+void updateDescriptorSet(const vkDevice& device,
+                         const vkDescriptorTemplate& tmpl, VkDescriptorSet set,
+                         const std::byte* data);
+
+// Needs VK_KHR_push_descriptor (device.pushDescriptor)
+void pushDescriptorSet(const vkDevice& device, const vkDescriptorTemplate& tmpl,
+                       VkCommandBuffer commandBuffer,
+                       VkPipelineLayout pipelineLayout, uint32_t set,
+                       const std::byte* data);
+
+}  // namespace gbg
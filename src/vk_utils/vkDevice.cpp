@@ -2,11 +2,42 @@
 
 #include <vulkan/vulkan_core.h>
 
+#include <cstring>
+#include <optional>
 #include <set>
 
 #include "Logger.hpp"
 #include "vkInstance.hh"
 namespace gbg {
+// Only when the mappable type is on the biggest device local heap, without
+// resizable bar it sits on a 256MB window that's better kept for others.
+static bool hasHostVisibleDeviceLocal(VkPhysicalDevice pdevice) {
+    VkPhysicalDeviceMemoryProperties properties;
+    vkGetPhysicalDeviceMemoryProperties(pdevice, &properties);
+
+    std::optional<uint32_t> largest;
+    for (uint32_t i = 0; i < properties.memoryHeapCount; i++) {
+        if (not(properties.memoryHeaps[i].flags &
+                VK_MEMORY_HEAP_DEVICE_LOCAL_BIT))
+            continue;
+        if (not largest or properties.memoryHeaps[i].size >
+                               properties.memoryHeaps[*largest].size)
+            largest = i;
+    }
+    if (not largest) return false;
+
+    const VkMemoryPropertyFlags flags = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT |
+                                        VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
+                                        VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+    for (uint32_t i = 0; i < properties.memoryTypeCount; i++) {
+        const VkMemoryType& type = properties.memoryTypes[i];
+        // findMemoryType takes the first match, it has to be this one
+        if ((type.propertyFlags & flags) == flags)
+            return type.heapIndex == *largest;
+    }
+    return false;
+}
+
 vkDevice createDevice(VkPhysicalDevice pdevice,
                       const std::vector<const char*>& deviceExtensions,
                       VkSurfaceKHR surface) {
@@ -46,10 +77,25 @@ vkDevice createDevice(VkPhysicalDevice pdevice,
 
     vkDevice device;
     device.pdevice = pdevice;
+    device.textureCompressionBC = deviceFeatures.textureCompressionBC;
+    for (const char* extension : deviceExtensions) {
+        if (strcmp(extension, VK_KHR_PUSH_DESCRIPTOR_EXTENSION_NAME) == 0)
+            device.pushDescriptor = true;
+        if (strcmp(extension, VK_EXT_MEMORY_BUDGET_EXTENSION_NAME) == 0)
+            device.memoryBudget = true;
+    }
+    device.hostVisibleDeviceLocal = hasHostVisibleDeviceLocal(pdevice);
     if (vkCreateDevice(device.pdevice, &deviceCreateInfo, nullptr,
                        &device.ldevice) != VK_SUCCESS) {
         throw std::runtime_error("failed to create logical device!");
     }
+    if (device.pushDescriptor) {
+        device.cmdPushDescriptorSetWithTemplate =
+            (PFN_vkCmdPushDescriptorSetWithTemplateKHR)vkGetDeviceProcAddr(
+                device.ldevice, "vkCmdPushDescriptorSetWithTemplateKHR");
+        device.pushDescriptor =
+            device.cmdPushDescriptorSetWithTemplate != nullptr;
+    }
 
     vkGetDeviceQueue(device.ldevice, gfamily.value(), 0, &device.gqueue);
     vkGetDeviceQueue(device.ldevice, pfamily.value(), 0, &device.pqueue);
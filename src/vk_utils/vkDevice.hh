@@ -11,6 +11,18 @@ struct vkDevice {
     VkQueue tqueue;
     VkCommandPool graphicsCmdPool;
     VkCommandPool transferCmdPool;
+
+    // optional extensions that got enabled
+    bool pushDescriptor = false;
+    // the loader doesn't export the extension's entry point, it's this
+    // device's
+    PFN_vkCmdPushDescriptorSetWithTemplateKHR cmdPushDescriptorSetWithTemplate =
+        nullptr;
+    bool memoryBudget = false;
+    bool textureCompressionBC = false;
+    // the host can map most of the vram, resizable bar or a gpu sharing
+    // memory with the cpu, buffers can be written in place
+    bool hostVisibleDeviceLocal = false;
 };
 vkDevice createDevice(VkPhysicalDevice pdevice,
                       const std::vector<const char*>& deviceExtensions,
@@ -10,11 +10,13 @@ vkImage createImage(VkPhysicalDevice physicalDevice, VkDevice device,
                     uint32_t width, uint32_t height, uint32_t mipLevels,
                     VkSampleCountFlagBits numSamples, VkFormat format,
                     VkImageTiling tiling, VkImageUsageFlags usage,
-                    VkMemoryPropertyFlags properties) {
+                    VkMemoryPropertyFlags properties,
+                    VkImageCreateFlags flags, uint32_t arrayLayers) {
     vkImage image;
 
     VkImageCreateInfo imageInfo{};
     imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+    imageInfo.flags = flags;
     imageInfo.imageType = VK_IMAGE_TYPE_2D;
     imageInfo.format = format;
     imageInfo.usage = usage;
@@ -25,7 +27,7 @@ vkImage createImage(VkPhysicalDevice physicalDevice, VkDevice device,
     imageInfo.extent.height = height;
     imageInfo.extent.depth = 1;
     imageInfo.mipLevels = mipLevels;
-    imageInfo.arrayLayers = 1;
+    imageInfo.arrayLayers = arrayLayers;
     imageInfo.tiling = tiling;
 
     if (vkCreateImage(device, &imageInfo, nullptr, &image.image) !=
@@ -48,6 +50,7 @@ vkImage createImage(VkPhysicalDevice physicalDevice, VkDevice device,
     }
 
     vkBindImageMemory(device, image.image, image.memory, 0);
+    image.size = imageRequirements.size;
 
     return image;
 }
@@ -55,15 +58,27 @@ vkImage createImage(VkPhysicalDevice physicalDevice, VkDevice device,
 VkImageView createImageView(VkImage image, VkDevice device, VkFormat format,
                             VkImageAspectFlags aspectFlags,
                             uint32_t mipLevels) {
+    return createImageView(image, device, format, aspectFlags, 0, mipLevels);
+}
+
+VkImageView createImageView(VkImage image, VkDevice device, VkFormat format,
+                            VkImageAspectFlags aspectFlags,
+                            uint32_t baseMipLevel, uint32_t levelCount,
+                            VkImageUsageFlags usage) {
+    VkImageViewUsageCreateInfo usageInfo{};
+    usageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_USAGE_CREATE_INFO;
+    usageInfo.usage = usage;
+
     VkImageViewCreateInfo createInfo{};
+    if (usage != 0) createInfo.pNext = &usageInfo;
     createInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
     createInfo.image = image;
     createInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
     createInfo.format = format;
     // image porpouse
     createInfo.subresourceRange.aspectMask = aspectFlags;
-    createInfo.subresourceRange.baseMipLevel = 0;
-    createInfo.subresourceRange.levelCount = mipLevels;
+    createInfo.subresourceRange.baseMipLevel = baseMipLevel;
+    createInfo.subresourceRange.levelCount = levelCount;
     // the layers are for example to create stereographic images with
     // an image for each eye
     createInfo.subresourceRange.baseArrayLayer = 0;
@@ -76,6 +91,29 @@ VkImageView createImageView(VkImage image, VkDevice device, VkFormat format,
     return view;
 }
 
+VkImageView createImageLayerView(VkImage image, VkDevice device,
+                                 VkFormat format,
+                                 VkImageAspectFlags aspectFlags,
+                                 uint32_t baseArrayLayer, uint32_t layerCount,
+                                 VkImageViewType viewType) {
+    VkImageViewCreateInfo createInfo{};
+    createInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+    createInfo.image = image;
+    createInfo.viewType = viewType;
+    createInfo.format = format;
+    createInfo.subresourceRange.aspectMask = aspectFlags;
+    createInfo.subresourceRange.baseMipLevel = 0;
+    createInfo.subresourceRange.levelCount = 1;
+    createInfo.subresourceRange.baseArrayLayer = baseArrayLayer;
+    createInfo.subresourceRange.layerCount = layerCount;
+
+    VkImageView view;
+    if (vkCreateImageView(device, &createInfo, nullptr, &view) != VK_SUCCESS) {
+        throw std::runtime_error("failed to create image views!");
+    }
+    return view;
+}
+
 void addImageView(vkImage& image, VkDevice device, VkFormat format,
                   VkImageAspectFlags aspectFlags, uint32_t mipLevels) {
     image.view =
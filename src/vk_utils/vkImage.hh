@@ -11,13 +11,16 @@ struct vkImage {
     VkImage image;
     VkDeviceMemory memory;
     std::optional<VkImageView> view;
+    // bytes allocated for it
+    VkDeviceSize size = 0;
 };
 
 vkImage createImage(VkPhysicalDevice physicalDevice, VkDevice device,
                     uint32_t width, uint32_t height, uint32_t mipLevels,
                     VkSampleCountFlagBits numSamples, VkFormat format,
                     VkImageTiling tiling, VkImageUsageFlags usage,
-                    VkMemoryPropertyFlags properties);
+                    VkMemoryPropertyFlags properties,
+                    VkImageCreateFlags flags = 0, uint32_t arrayLayers = 1);
 
 void addImageView(vkImage& image, VkDevice device, VkFormat format,
                   VkImageAspectFlags aspectFlags, uint32_t mipLevels);
@@ -25,6 +28,22 @@ void addImageView(vkImage& image, VkDevice device, VkFormat format,
 VkImageView createImageView(VkImage image, VkDevice device, VkFormat format,
                             VkImageAspectFlags aspectFlags, uint32_t mipLevels);
 
+// View of levelCount levels starting at baseMipLevel. A non zero usage
+// restricts the view to it, needed to view a mutable image with a format
+// that lacks some of the image usages (an sRGB view of a storage image).
+VkImageView createImageView(VkImage image, VkDevice device, VkFormat format,
+                            VkImageAspectFlags aspectFlags,
+                            uint32_t baseMipLevel, uint32_t levelCount,
+                            VkImageUsageFlags usage = 0);
+
+// View of layerCount layers starting at baseArrayLayer, of the first level.
+// viewType is an array type to sample them as one.
+VkImageView createImageLayerView(VkImage image, VkDevice device,
+                                 VkFormat format,
+                                 VkImageAspectFlags aspectFlags,
+                                 uint32_t baseArrayLayer, uint32_t layerCount,
+                                 VkImageViewType viewType);
+
 void destoryImage(vkImage image, VkDevice device);
 
 }  // namespace gbg
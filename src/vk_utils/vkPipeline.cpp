@@ -44,6 +44,20 @@ vkVertexInputDescription getVertexFloatInputDescription(uint32_t attrib_id) {
     return desc;
 }
 
+vkVertexInputDescription getVertexInputDescription(uint32_t attrib_id,
+                                                   VkFormat format,
+                                                   uint32_t stride) {
+    vkVertexInputDescription desc;
+    desc.binding_desc.binding = attrib_id;
+    desc.binding_desc.stride = stride;
+    desc.binding_desc.inputRate = VK_VERTEX_INPUT_RATE_VERTEX;
+    desc.attrib_desc.location = attrib_id;
+    desc.attrib_desc.binding = attrib_id;
+    desc.attrib_desc.format = format;
+    desc.attrib_desc.offset = 0;
+    return desc;
+}
+
 VkShaderModule createShaderModule(const vkDevice& device,
                                   std::vector<uint32_t> code) {
     VkShaderModuleCreateInfo createInfo{};
@@ -245,4 +259,46 @@ vkPipeline createGraphicsPipeline(
 
     return pipeline;
 }
+
+vkPipeline createComputePipeline(
+    const vkDevice& device, const std::vector<uint32_t>& shaderCode,
+    const std::vector<VkDescriptorSetLayout>& desc_sets_layouts,
+    const std::vector<VkPushConstantRange>& push_constants) {
+    vkPipeline pipeline{};
+
+    VkPipelineLayoutCreateInfo layoutCreateInfo{};
+    layoutCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+    layoutCreateInfo.setLayoutCount =
+        static_cast<uint32_t>(desc_sets_layouts.size());
+    layoutCreateInfo.pSetLayouts = desc_sets_layouts.data();
+    layoutCreateInfo.pushConstantRangeCount =
+        static_cast<uint32_t>(push_constants.size());
+    layoutCreateInfo.pPushConstantRanges = push_constants.data();
+
+    if (vkCreatePipelineLayout(device.ldevice, &layoutCreateInfo, nullptr,
+                               &pipeline.layout) != VK_SUCCESS) {
+        throw std::runtime_error("failed to create pipeline layout!");
+    }
+
+    VkShaderModule shaderModule = createShaderModule(device, shaderCode);
+
+    VkComputePipelineCreateInfo pipelineInfo{};
+    pipelineInfo.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+    pipelineInfo.stage.sType =
+        VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+    pipelineInfo.stage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+    pipelineInfo.stage.module = shaderModule;
+    pipelineInfo.stage.pName = "main";
+    pipelineInfo.layout = pipeline.layout;
+
+    if (vkCreateComputePipelines(device.ldevice, VK_NULL_HANDLE, 1,
+                                 &pipelineInfo, nullptr,
+                                 &pipeline.pipeline) != VK_SUCCESS) {
+        throw std::runtime_error("failed to create compute pipeline!");
+    }
+
+    vkDestroyShaderModule(device.ldevice, shaderModule, nullptr);
+
+    return pipeline;
+}
 }  // namespace gbg
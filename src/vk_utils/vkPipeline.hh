@@ -22,6 +22,10 @@ struct vkPipeline {
 vkVertexInputDescription getVertexVector3InputDescription(uint32_t attrib_id);
 vkVertexInputDescription getVertexVector2InputDescription(uint32_t attrib_id);
 vkVertexInputDescription getVertexFloatInputDescription(uint32_t attrib_id);
+// For packed formats, the shader reads them as floats.
+vkVertexInputDescription getVertexInputDescription(uint32_t attrib_id,
+                                                   VkFormat format,
+                                                   uint32_t stride);
 
 vkPipeline createGraphicsPipeline(
     const vkDevice& device,const std::vector<uint32_t>& vertShaderCode,
@@ -32,6 +36,11 @@ vkPipeline createGraphicsPipeline(
     const std::vector<VkPushConstantRange>& push_constants,
     VkSampleCountFlagBits msaaSamples, VkRenderPass renderPass, VkPrimitiveTopology topology);
 
+vkPipeline createComputePipeline(
+    const vkDevice& device, const std::vector<uint32_t>& shaderCode,
+    const std::vector<VkDescriptorSetLayout>& desc_sets_layouts,
+    const std::vector<VkPushConstantRange>& push_constants);
+
 VkShaderModule createShaderModule(const std::vector<uint32_t>& code);
 
 }  // namespace gbg
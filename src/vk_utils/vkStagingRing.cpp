@@ -0,0 +1,128 @@
+#include "vkStagingRing.hh"
+
+#include <vulkan/vulkan_core.h>
+
+#include <stdexcept>
+
+namespace gbg {
+
+// keeps every span valid as a buffer to image copy offset
+const VkDeviceSize stagingAlignment = 16;
+
+void createStagingRing(const vkDevice& device, vkStagingRing& ring,
+                       VkDeviceSize size) {
+    ring.buffer = createBuffer(device, size, VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+                               VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
+                                   VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+
+    void* data;
+    if (vkMapMemory(device.ldevice, ring.buffer.memory, 0, size, 0, &data) !=
+        VK_SUCCESS) {
+        throw std::runtime_error("failed to map staging ring!");
+    }
+    ring.mapped = static_cast<std::byte*>(data);
+    ring.head = ring.tail = ring.used = 0;
+    ring.blocks.clear();
+    ring.firstBlock = 0;
+    ring.closed = false;
+}
+
+static std::optional<VkDeviceSize> tryReserve(vkStagingRing& ring,
+                                              VkDeviceSize size) {
+    VkDeviceSize capacity = ring.buffer.size;
+    if (ring.used == 0) ring.head = ring.tail = 0;
+
+    VkDeviceSize offset;
+    VkDeviceSize blockSize;
+    if (ring.used == 0 or ring.head > ring.tail) {
+        if (ring.head + size <= capacity) {
+            offset = ring.head;
+            blockSize = size;
+        } else if (size <= ring.tail) {
+            // skip the end of the buffer and start again from the beginning
+            offset = 0;
+            blockSize = capacity - ring.head + size;
+        } else {
+            return std::nullopt;
+        }
+    } else if (ring.head + size <= ring.tail) {
+        offset = ring.head;
+        blockSize = size;
+    } else {
+        return std::nullopt;
+    }
+
+    ring.head = (offset + size) % capacity;
+    ring.used += blockSize;
+    ring.blocks.push_back({blockSize, false});
+    return offset;
+}
+
+static VkDeviceSize alignStaging(VkDeviceSize size) {
+    return (size + stagingAlignment - 1) & ~(stagingAlignment - 1);
+}
+
+bool stagingFits(const vkStagingRing& ring, VkDeviceSize size) {
+    return alignStaging(size) <= ring.buffer.size;
+}
+
+std::optional<vkStagingSpan> acquireStaging(vkStagingRing& ring,
+                                            VkDeviceSize size, bool wait) {
+    if (not stagingFits(ring, size)) return std::nullopt;
+    VkDeviceSize aligned = alignStaging(size);
+
+    std::unique_lock lock(ring.mutex);
+    while (not ring.closed) {
+        if (auto offset = tryReserve(ring, aligned)) {
+            vkStagingSpan span{};
+            span.buffer = ring.buffer.buffer;
+            span.offset = offset.value();
+            span.size = size;
+            span.data = ring.mapped + span.offset;
+            span.id = ring.firstBlock + ring.blocks.size() - 1;
+            return span;
+        }
+        if (not wait) break;
+        ring.released.wait(lock);
+    }
+    return std::nullopt;
+}
+
+void releaseStaging(vkStagingRing& ring, const vkStagingSpan& span) {
+    {
+        std::lock_guard lock(ring.mutex);
+        ring.blocks[span.id - ring.firstBlock].released = true;
+
+        while (not ring.blocks.empty() and ring.blocks.front().released) {
+            VkDeviceSize size = ring.blocks.front().size;
+            ring.tail = (ring.tail + size) % ring.buffer.size;
+            ring.used -= size;
+            ring.blocks.pop_front();
+            ring.firstBlock++;
+        }
+    }
+    ring.released.notify_all();
+}
+
+void closeStagingRing(vkStagingRing& ring) {
+    {
+        std::lock_guard lock(ring.mutex);
+        ring.closed = true;
+    }
+    ring.released.notify_all();
+}
+
+VkDeviceSize getStagingUsage(vkStagingRing& ring) {
+    std::lock_guard lock(ring.mutex);
+    return ring.used;
+}
+
+void destroyStagingRing(const vkDevice& device, vkStagingRing& ring) {
+    if (ring.mapped == nullptr) return;
+    vkUnmapMemory(device.ldevice, ring.buffer.memory);
+    destroyBuffer(device, ring.buffer);
+    ring.mapped = nullptr;
+    ring.blocks.clear();
+}
+
+}  // namespace gbg
@@ -0,0 +1,68 @@
+#pragma once
+#include <vulkan/vulkan_core.h>
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <optional>
+
+#include "vkBuffer.hh"
+#include "vkDevice.hh"
+
+namespace gbg {
+
+// A piece of the ring, writable through data until it is released.
+struct vkStagingSpan {
+    VkBuffer buffer;
+    VkDeviceSize offset;
+    VkDeviceSize size;
+    std::byte* data;
+    uint64_t id;
+};
+
+struct vkStagingBlock {
+    VkDeviceSize size;  // includes the padding skipped when wrapping
+    bool released;
+};
+
+// Persistently mapped upload buffer shared by several threads. Spans are
+// handed out in order and the space is given back in that same order, so a
+// span released early waits for the older ones.
+struct vkStagingRing {
+    vkBuffer buffer;
+    std::byte* mapped = nullptr;
+    VkDeviceSize head = 0;
+    VkDeviceSize tail = 0;
+    VkDeviceSize used = 0;
+
+    std::deque<vkStagingBlock> blocks;
+    uint64_t firstBlock = 0;  // id of blocks.front()
+
+    std::mutex mutex;
+    std::condition_variable released;
+    bool closed = false;
+};
+
+void createStagingRing(const vkDevice& device, vkStagingRing& ring,
+                       VkDeviceSize size);
+
+// Whether a span of size fits once the ring is empty, with its alignment.
+bool stagingFits(const vkStagingRing& ring, VkDeviceSize size);
+
+// With wait the caller sleeps until enough space is released. Returns
+// nothing if the span can never fit or the ring was closed.
+std::optional<vkStagingSpan> acquireStaging(vkStagingRing& ring,
+                                            VkDeviceSize size, bool wait);
+
+void releaseStaging(vkStagingRing& ring, const vkStagingSpan& span);
+
+// Wakes up every thread waiting for space.
+void closeStagingRing(vkStagingRing& ring);
+
+VkDeviceSize getStagingUsage(vkStagingRing& ring);
+
+void destroyStagingRing(const vkDevice& device, vkStagingRing& ring);
+
+}  // namespace gbg
@@ -1,11 +1,14 @@
 #include <nfd.h>
 #include <vulkan/vulkan_core.h>
 
+#include <chrono>
+#include <cinttypes>
 #include <iostream>
 #include <memory>
 #include <ostream>
 #include <ranges>
 #include <span>
+#include <string_view>
 #include <variant>
 
 #include "GlfwCreateRendererContext.hpp"
@@ -30,7 +33,6 @@
 #include "imgui.h"
 #include "io_utils/watcher.hpp"
 #include "loaders/objLoader.hpp"
-#include "loaders/texLoader.hpp"
 #include "shaderReflexion.hpp"
 
 #define TRACY_ENABLE 1
@@ -104,7 +106,10 @@ int main(int argc, char* argv[]) {
     std::span arguments(argv, argc);
 
     if (arguments.size() < 2) {
-        std::cout << "Usage: app obj-file-name" << std::endl;
+        std::cout << "Usage: app obj-file-name [--optimize-meshes] "
+                     "[--quantize-vertices] [--meshlets] [--no-lods] "
+                     "[--mesh-cache] [--debug-draw]"
+                  << std::endl;
         exit(1);
     }
 
@@ -113,7 +118,7 @@ int main(int argc, char* argv[]) {
 
     gbg::RendererContext context = gbg::glfwCreateRendererContext(
         window, gbg::validationLayers, enableValidationLayers,
-        gbg::deviceExtensions);
+        gbg::deviceExtensions, gbg::optionalDeviceExtensions);
 
     gbg::SceneRenderer renderer(context);
 
@@ -151,10 +156,12 @@ int main(int argc, char* argv[]) {
     auto tx_h = tx_mg.create("DiffuseTexture");
     auto tx1_h = tx_mg.create("StoneTexture");
 
-    loadTexture("data/textures/plank_texture/raw_plank_wall_diff_1k.png", &sc,
-                tx_h);  // loads texture
-    loadTexture("data/textures/plank_texture/raw_plank_wall_nor_gl_1k.png", &sc,
-                tx1_h);           // loads texture
+    // decoded in the background, a placeholder is sampled meanwhile
+    renderer.loadTextureAsync(
+        tx_h, "data/textures/plank_texture/raw_plank_wall_diff_1k.png");
+    renderer.loadTextureAsync(
+        tx1_h, "data/textures/plank_texture/raw_plank_wall_nor_gl_1k.png",
+        true);
     tx_mg.get(tx1_h).raw = true;  // not srgb
 
     mt.setShader(shh, sh, tx_h);
@@ -211,11 +218,45 @@ int main(int argc, char* argv[]) {
 
     std::cout << "Loading::" << arguments[1] << std::endl;
 
+    auto loadStart = std::chrono::steady_clock::now();
     gbg::objLoader(arguments[1], &sc, sc.root, mth);
-    std::cout << "Obj loaded" << std::endl;
-
+    std::cout << "Obj loaded in "
+              << std::chrono::duration<double, std::milli>(
+                     std::chrono::steady_clock::now() - loadStart)
+                     .count()
+              << " ms" << std::endl;
+
+    gbg::srMeshOptimization optimization{};
+    bool debugDraw = false;
+    for (std::string_view argument : arguments.subspan(2)) {
+        if (argument == "--optimize-meshes") {
+            optimization.enabled = true;
+        } else if (argument == "--meshlets") {
+            optimization.meshlets = true;
+        } else if (argument == "--no-lods") {
+            optimization.lods = 0;
+        } else if (argument == "--quantize-vertices") {
+            renderer.setVertexFormat(gbg::VERTEX_QUANTIZED);
+        } else if (argument == "--mesh-cache") {
+            gbg::srMeshCacheSettings cache{};
+            cache.enabled = true;
+            cache.source = arguments[1];
+            renderer.setMeshCache(cache);
+        } else if (argument == "--debug-draw") {
+            debugDraw = true;
+            renderer.setDebugDrawSettings({.bounds = true, .lightFrusta = true});
+        }
+    }
+    renderer.setMeshOptimization(optimization);
     renderer.setScene(&sc);
 
+    auto cache = renderer.getStats().meshCache;
+    if (cache.hits + cache.misses > 0) {
+        std::cout << "Meshes: " << cache.misses << " cold in " << cache.coldMs
+                  << " ms, " << cache.hits << " from the cache in "
+                  << cache.warmMs << " ms" << std::endl;
+    }
+
     for (auto shh : sh_mg) {
         sh_mg.get(shh).unsetFlag(gbg::ResourceFlags::NEW);
         sh_mg.get(shh).unsetFlag(gbg::ResourceFlags::DIRTY);
@@ -258,6 +299,75 @@ int main(int argc, char* argv[]) {
                 ImGuiWindowFlags_NoBackground | ImGuiWindowFlags_NoTitleBar)) {
             int fps = 1. / delta;
             ImGui::Text("FPS: %d", fps);
+
+            gbg::RendererStats stats = renderer.getStats();
+            auto& matDesc = stats.materialDescriptors;
+            ImGui::Text("Material sets: %u live, %u free, %u pools (%.0f%%)",
+                        matDesc.liveSets, matDesc.freeListSets, matDesc.pools,
+                        matDesc.utilization() * 100.0f);
+            ImGui::Text("Material set allocations: %lu (%lu reused)",
+                        (unsigned long)matDesc.allocations,
+                        (unsigned long)matDesc.reuses);
+            ImGui::Text("Frame sets: %u live, %u pools",
+                        stats.frameDescriptors.liveSets,
+                        stats.frameDescriptors.pools);
+            auto& uploads = stats.textureUploads;
+            ImGui::Text("Textures: %u decoding, %u uploading, staging %lu/%lu MB",
+                        uploads.queued, uploads.uploading,
+                        uploads.stagingUsed >> 20, uploads.stagingSize >> 20);
+            auto& memory = stats.memory;
+            ImGui::Text("VRAM: %lu/%lu MB (%lu tex, %lu mesh, %lu att)",
+                        memory.usage >> 20, memory.budget >> 20,
+                        memory.used[gbg::MEMORY_TEXTURE] >> 20,
+                        memory.used[gbg::MEMORY_MESH] >> 20,
+                        memory.used[gbg::MEMORY_ATTACHMENT] >> 20);
+            auto& retention = stats.retention;
+            ImGui::Text("CPU copies freed: %lu MB (%lu MB kept compact)",
+                        (retention.meshBytesFreed +
+                         retention.textureBytesFreed) >> 20,
+                        retention.compactBytes >> 20);
+            auto& meshes = stats.meshOptimization;
+            if (meshes.meshes > 0) {
+                ImGui::Text("ACMR %.2f -> %.2f, ATVR %.2f -> %.2f",
+                            meshes.before.acmr, meshes.after.acmr,
+                            meshes.before.atvr, meshes.after.atvr);
+            }
+            auto& lods = stats.lodHistogram;
+            ImGui::Text("LODs drawn: %u %u %u %u %u", lods[0], lods[1],
+                        lods[2], lods[3], lods[4]);
+            auto& clusters = stats.clusterCulling;
+            if (clusters.draws > 0) {
+                ImGui::Text("Meshlets: %u in %u draws, %lu/%lu triangles",
+                            clusters.meshlets, clusters.draws,
+                            clusters.visibleTriangles, clusters.triangles);
+            }
+            ImGui::Text("Lights: %u binned in %u clusters",
+                        stats.lightClusters.lights,
+                        stats.lightClusters.clusters);
+            ImGui::Text("Shadows: %u of %u lights, %.0f%% of the atlas, "
+                        "static ones drawn %u times, then %u tiles",
+                        stats.shadows.tiles, stats.shadows.requests,
+                        stats.shadows.usage * 100.0f,
+                        stats.shadows.cacheUpdates,
+                        stats.shadows.tileUpdates);
+            if (stats.shadowCascades.cascades > 0) {
+                const auto& cascades = stats.shadowCascades;
+                ImGui::Text("Cascades: %u, casters %u %u %u %u",
+                            cascades.cascades, cascades.casters[0],
+                            cascades.casters[1], cascades.casters[2],
+                            cascades.casters[3]);
+            }
+            if (stats.debugDraw.drawCalls > 0) {
+                ImGui::Text("Debug: %u lines, %u triangles in %u draws",
+                            stats.debugDraw.lines, stats.debugDraw.triangles,
+                            stats.debugDraw.drawCalls);
+            }
+            auto& edits = stats.meshUpdates;
+            if (edits.patches + edits.rebuilds > 0) {
+                ImGui::Text("Mesh edits: %u patched (%" PRIu64 " KB), %u rebuilt",
+                            edits.patches, edits.patchedBytes / 1024,
+                            edits.rebuilds);
+            }
             ImGui::End();
         }
 
@@ -289,6 +399,8 @@ int main(int argc, char* argv[]) {
                         auto& sn = st_mg.get(snh);
                         ImGui::PushID(sn.getRID());
                         if (ImGui::CollapsingHeader(sn.getName().c_str())) {
+                            // the renderer sees the casters and lights
+                            // under it move by itself
                             ImGui::InputFloat3("Translation",
                                                (float*)&sn.translation);
                             ImGui::InputFloat3("Rotation",
@@ -322,9 +434,14 @@ int main(int argc, char* argv[]) {
                                     [&](gbg::LightHandle handle) {
                                         gbg::Light& light =
                                             sc.lh_mg.get(handle);
-                                        ImGui::ColorPicker3(
-                                            "Light Color",
-                                            (float*)&light.color);
+                                        if (ImGui::ColorPicker3(
+                                                "Light Color",
+                                                (float*)&light.color))
+                                            light.setFlags(
+                                                gbg::ResourceFlags::DIRTY);
+                                        // along the node's -z, with cascades
+                                        if (ImGui::Button("Make directional"))
+                                            renderer.setDirectionalLight(handle);
                                     },
                                     [&](auto&& def) {
 
@@ -440,7 +557,8 @@ int main(int argc, char* argv[]) {
 
                                 if (ImGui::Button("Confirm")) {
                                     auto hand = tx_mg.create(name);
-                                    loadTexture(buff, &sc, hand);
+                                    renderer.loadTextureAsync(hand, buff,
+                                                              raw);
                                     tx_mg.get(hand).raw = raw;
                                     ImGui::CloseCurrentPopup();
                                 }
@@ -470,6 +588,7 @@ int main(int argc, char* argv[]) {
         xpos = xnew;
         ypos = ynew;
 
+        if (debugDraw) gbg::debugAxes(renderer.getDebugDraw(), glm::mat4(1.0f));
         renderer.drawFrame();
 
         for (auto shh : sh_mg) {
@@ -0,0 +1,17 @@
+#version 450
+
+// Debug lines and triangles, already in world space.
+
+layout(push_constant) uniform Push {
+    mat4 viewProjection;
+};
+
+layout(location = 0) in vec3 inPosition;
+layout(location = 1) in vec4 inColor;
+
+layout(location = 0) out vec4 fragColor;
+
+void main() {
+    fragColor = inColor;
+    gl_Position = viewProjection * vec4(inPosition, 1.0);
+}
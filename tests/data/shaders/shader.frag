@@ -22,16 +22,44 @@ layout(set = 0, binding = 1) uniform sampler _sampler;
 layout(set = 1, binding = 1) uniform texture2D _texture[2];
 
 struct Light {
+    vec3 position;
+    float range;
     vec3 color;
+    uint shadowOrigin;  // of its tile in the atlas, in texels
     vec3 direction;
-    vec3 position;
+    uint shadowSize;    // 0 without one
     mat4 proj;
 };
 
-layout(std140, set = 0, binding = 2) readonly buffer LightBlock {
+layout(std430, set = 0, binding = 2) readonly buffer LightBlock {
     Light lights[];
 } lightData;
 
+// the lights reaching each cluster of the view frustum, binned every frame
+layout(std430, set = 0, binding = 3) readonly buffer ClusterBlock {
+    uvec4 grid;      // tiles x, y, depth slices, lights per cluster
+    vec4 depth;      // near, far, slice scale, slice bias
+    vec4 screen;     // size, tile size in pixels
+    uvec2 ranges[];  // first index, count
+} clusters;
+
+layout(std430, set = 0, binding = 4) readonly buffer LightIndexBlock {
+    uint indices[];
+} lightIndices;
+
+// every light's shadow map is a tile of it
+layout(set = 0, binding = 5) uniform sampler2DShadow shadowAtlas;
+
+// the directional light's, fitted to slices of the view frustum
+layout(set = 0, binding = 6) uniform CascadeBlock {
+    mat4 viewProjection[4];
+    vec4 splits;     // view depth each one reaches
+    vec4 bias;
+    vec4 direction;  // towards the light, the cascade count
+    vec4 color;
+} cascades;
+layout(set = 0, binding = 7) uniform sampler2DArrayShadow cascadeMaps;
+
 layout(set = 1, binding = 0) uniform MatParms {
     vec3 color;
     float ambientI;
@@ -50,20 +78,78 @@ float spec(vec3 L, vec3 N, vec3 V, int exp) {
     return pow(VdotR, exp);
 }
 
+// fades to nothing at the range, lights past it are left out of a cluster
+float rangeFalloff(float d, float range) {
+    float x = clamp(1. - pow(d / range, 4.), 0., 1.);
+    return x * x;
+}
+
+// 1 when lit, fragments its shadow view doesn't see are
+float shadowFactor(Light light) {
+    if (light.shadowSize == 0u) return 1.;
+    vec4 p = light.proj * vec4(fs_in.fpos, 1.);
+    if (p.w <= 0.) return 1.;
+    p.xyz /= p.w;
+    if (any(greaterThan(abs(p.xy), vec2(1.))) || p.z > 1.) return 1.;
+
+    // half a texel in, filtering doesn't read the neighbour tiles
+    vec2 texel = 1. / vec2(textureSize(shadowAtlas, 0));
+    vec2 origin = vec2(light.shadowOrigin & 0xffffu, light.shadowOrigin >> 16) *
+                  texel;
+    vec2 extent = float(light.shadowSize) * texel;
+    vec2 uv = origin + (p.xy * .5 + .5) * extent;
+    uv = clamp(uv, origin + .5 * texel, origin + extent - .5 * texel);
+    return texture(shadowAtlas, vec3(uv, p.z - 0.0005));
+}
+
+// the first cascade reaching the fragment, lit past the last one
+float cascadeShadow(float viewDepth) {
+    uint count = uint(cascades.direction.w);
+    for (uint i = 0; i < count; i++) {
+        if (viewDepth > cascades.splits[i]) continue;
+        vec4 p = cascades.viewProjection[i] * vec4(fs_in.fpos, 1.);
+        vec2 uv = p.xy * .5 + .5;
+        return texture(cascadeMaps, vec4(uv, float(i), p.z - cascades.bias[i]));
+    }
+    return 1.;
+}
+
+uint clusterIndex(float viewDepth) {
+    uvec2 tile = min(uvec2(gl_FragCoord.xy / clusters.screen.zw),
+                     clusters.grid.xy - 1u);
+    float slice = log(viewDepth) * clusters.depth.z - clusters.depth.w;
+    uint z = uint(clamp(slice, 0., float(clusters.grid.z - 1u)));
+    return tile.x + clusters.grid.x * (tile.y + clusters.grid.y * z);
+}
+
 void main() {
     vec3 albedo = texture(sampler2D(_texture[0], _sampler), fs_in.fragTexCoord).rgb * color;
     vec3 lcolor = ambientI * albedo;
     vec3 V = normalize(ubo.obs - fs_in.fpos);
 
-    vec3 n = texture(sampler2D(_texture[1], _sampler), fs_in.fragTexCoord).rgb;
-    n = (n * 2.) - 1.;
+    // z is rebuilt so two channel (BC5) normal maps work too
+    vec3 n;
+    n.xy = texture(sampler2D(_texture[1], _sampler), fs_in.fragTexCoord).rg;
+    n.xy = (n.xy * 2.) - 1.;
+    n.z = sqrt(max(1. - dot(n.xy, n.xy), 0.));
     n.y *= -1;
     n = normalize(fs_in.fTBN * n);
 
-    for (int i = 0; i < lightData.lights.length(); i++) {
-        vec3 L = normalize(lightData.lights[i].position - fs_in.fpos);
+    float viewDepth = -(ubo.view * vec4(fs_in.fpos, 1.)).z;
+    if (cascades.direction.w > 0.) {
+        vec3 L = cascades.direction.xyz;
+        vec3 sun = cascades.color.rgb * cascadeShadow(viewDepth);
+        lcolor += albedo * diffuse(L, n) * sun + sun * spec(L, n, V, 127);
+    }
+
+    uvec2 range = clusters.ranges[clusterIndex(viewDepth)];
+    for (uint i = 0; i < range.y; i++) {
+        Light light = lightData.lights[lightIndices.indices[range.x + i]];
+        vec3 toLight = light.position - fs_in.fpos;
+        vec3 L = normalize(toLight);
+        float falloff = rangeFalloff(length(toLight), light.range) * shadowFactor(light);
 
-        lcolor += albedo * diffuse(L, n) * lightData.lights[i].color + (lightData.lights[i].color * spec(L, n, V, 127));
+        lcolor += falloff * (albedo * diffuse(L, n) * light.color + (light.color * spec(L, n, V, 127)));
     }
     outColor = vec4(lcolor, 1.0f);
 }
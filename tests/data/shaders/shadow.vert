@@ -2,6 +2,8 @@
 
 layout(push_constant) uniform pc {
     mat4 model;
+    uint lightIndex;  // whose tile of the atlas is drawn
+    uint cascade;     // or which cascade, past them for a tile
 };
 
 layout(set = 0, binding = 0) uniform UniformBufferObject {
@@ -16,21 +18,31 @@ layout(location = 1) in vec3 inNormal;
 layout(location = 2) in vec2 inTexCoord;
 layout(location = 3) in vec3 inTangent;
 
-layout(set = 1, binding = 0) uniform MatParms {
-    int lightIndex;
-};
-
 struct Light {
+    vec3 position;
+    float range;
     vec3 color;
+    uint shadowOrigin;  // of its tile in the atlas, in texels
     vec3 direction;
-    vec3 position;
+    uint shadowSize;    // 0 without one
     mat4 proj;
 };
 
-layout(std140, set = 0, binding = 2) readonly buffer LightBlock {
+layout(std430, set = 0, binding = 2) readonly buffer LightBlock {
     Light lights[];
 } lightData;
 
+// the directional light's, fitted to slices of the view frustum
+layout(set = 0, binding = 6) uniform CascadeBlock {
+    mat4 viewProjection[4];
+    vec4 splits;     // view depth each one reaches
+    vec4 bias;
+    vec4 direction;  // towards the light, the cascade count
+    vec4 color;
+} cascades;
+
 void main() {
-    gl_Position = lightData.lights[lightIndex].proj * model * vec4(inPosition, 1.0f);
+    mat4 proj = cascade < 4u ? cascades.viewProjection[cascade]
+                             : lightData.lights[lightIndex].proj;
+    gl_Position = proj * model * vec4(inPosition, 1.0f);
 }
@@ -0,0 +1,123 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <iostream>
+#include <span>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "Mesh.hpp"
+#include "Scene.hpp"
+#include "glm/glm.hpp"
+#include "loaders/objLoader.hpp"
+#include "srMesh.hh"
+
+// Times createTangentBuffer over every mesh of an obj, sponza by default,
+// against the single threaded loop it replaced.
+
+struct MeshData {
+    std::vector<glm::vec3> positions;
+    std::vector<glm::vec2> uvs;
+    std::vector<uint32_t> indices;
+};
+
+// the previous implementation, nans on degenerate uvs included
+static std::vector<glm::vec3> scalarTangents(
+    const std::vector<glm::vec3>& pos, const std::vector<glm::vec2> tex_coord,
+    const std::vector<uint32_t> indices) {
+    std::vector<glm::vec3> tangents(pos.size(), glm::vec3(0.0f));
+    for (size_t i = 0; i < indices.size(); i += 3) {
+        uint32_t i1 = indices[i];
+        uint32_t i2 = indices[i + 1];
+        uint32_t i3 = indices[i + 2];
+
+        glm::vec3 edge1 = pos[i2] - pos[i1];
+        glm::vec3 edge2 = pos[i3] - pos[i1];
+        glm::vec2 duv1 = tex_coord[i2] - tex_coord[i1];
+        glm::vec2 duv2 = tex_coord[i3] - tex_coord[i1];
+        float f = 1.0f / (duv1.x * duv2.y - duv2.x * duv1.y);
+        glm::vec3 tangent = f * (duv2.y * edge1 - duv1.y * edge2);
+        tangents[i1] += tangent;
+        tangents[i2] += tangent;
+        tangents[i3] += tangent;
+    }
+    for (auto& tan : tangents) {
+        tan = glm::normalize(tan);
+    }
+    return tangents;
+}
+
+// best of runs, in milliseconds
+template <typename F>
+static double timeRuns(int runs, F&& body) {
+    double best = 1e30;
+    for (int i = 0; i < runs; i++) {
+        auto start = std::chrono::steady_clock::now();
+        body();
+        auto end = std::chrono::steady_clock::now();
+        best = std::min(
+            best,
+            std::chrono::duration<double, std::milli>(end - start).count());
+    }
+    return best;
+}
+
+int main(int argc, char** argv) {
+    std::span arguments(argv, argc);
+    std::string path = arguments.size() > 1
+                           ? arguments[1]
+                           : "data/models/sponza/sponza.obj";
+    int runs = arguments.size() > 2 ? std::stoi(arguments[2]) : 10;
+
+    gbg::Scene sc;
+    gbg::MaterialHandle mth =
+        sc.getMaterialManager().create("BenchMaterial");
+    std::cout << "Loading::" << path << std::endl;
+    gbg::objLoader(path, &sc, sc.root, mth);
+
+    std::vector<MeshData> meshes;
+    size_t triangles = 0, degenerate = 0;
+    for (gbg::MeshHandle mh : sc.ms_mg) {
+        gbg::Mesh& mesh = sc.ms_mg.get(mh);
+        MeshData data;
+        data.positions = mesh.getAttribute<gbg::AttributeTypes::VEC3_ATTR>(0);
+        data.uvs = mesh.getAttribute<gbg::AttributeTypes::VEC2_ATTR>(2);
+        data.indices = gbg::createIndexBuffer(gbg::vkDevice{}, mesh.getFaces());
+        if (data.uvs.size() != data.positions.size()) continue;
+        triangles += data.indices.size() / 3;
+        meshes.push_back(std::move(data));
+    }
+    if (meshes.empty()) {
+        std::cout << "No meshes with uvs in " << path << std::endl;
+        return 1;
+    }
+
+    for (const MeshData& data : meshes) {
+        for (const glm::vec3& t :
+             scalarTangents(data.positions, data.uvs, data.indices)) {
+            if (not(glm::dot(t, t) > 0.5f)) degenerate++;
+        }
+    }
+    std::cout << meshes.size() << " meshes, " << triangles << " triangles, "
+              << degenerate << " nan or zero tangents before" << std::endl;
+
+    double scalar = timeRuns(runs, [&]() {
+        for (const MeshData& data : meshes)
+            scalarTangents(data.positions, data.uvs, data.indices);
+    });
+    std::cout << "scalar:          " << scalar << " ms" << std::endl;
+
+    uint32_t cores = std::max(std::thread::hardware_concurrency(), 1u);
+    for (uint32_t threads = 1; threads <= cores; threads *= 2) {
+        double parallel = timeRuns(runs, [&]() {
+            for (const MeshData& data : meshes)
+                gbg::createTangentBuffer(data.positions, data.uvs,
+                                         data.indices, threads);
+        });
+        std::cout << "createTangentBuffer, " << threads
+                  << " threads: " << parallel << " ms (x"
+                  << scalar / parallel << ")" << std::endl;
+    }
+    return 0;
+}